@@ -21,24 +21,29 @@ echo "Source directory: $SOURCE_DIR"
 BUILD_DIR="${PROJECT_ROOT}/build"
 echo "Build directory: $BUILD_DIR"
 
+# Define the build directory for the host (Linux) simulation and benchmark tools
+HOST_BUILD_DIR="${PROJECT_ROOT}/build_host"
+
 # Ensure PICO_SDK_PATH is set (it should be from your .bashrc)
 # If it's not set, this script will exit due to 'set -u'
-if [ -z "${PICO_SDK_PATH:-}" ]; then
+# The host build does not need the SDK
+if [ "${1:-}" != "host" ] && [ -z "${PICO_SDK_PATH:-}" ]; then
     echo "Error: PICO_SDK_PATH environment variable is not set."
     echo "Please set it in your .bashrc (e.g., export PICO_SDK_PATH=\"/home/rodrigo/Documents/pico-sdk\") and source it."
     exit 1
 fi
-echo "PICO_SDK_PATH: $PICO_SDK_PATH"
+echo "PICO_SDK_PATH: ${PICO_SDK_PATH:-<not set>}"
 
 
 # --- Functions ---
 
 # Function to display usage information
 usage() {
-    echo "Usage: ./build.sh [clean|build|all]"
+    echo "Usage: ./build.sh [clean|build|all|host]"
     echo "  clean : Removes the build directory."
     echo "  build : Configures and builds the project using CMake."
     echo "  all   : Performs clean and then build."
+    echo "  host  : Builds the Linux simulation and benchmark tools in build_host."
     exit 1
 }
 
@@ -75,6 +80,17 @@ build() {
     echo "Build process complete for RP2040."
 }
 
+# Host build function
+build_host() {
+    echo "--- Configuring host build with CMake ---"
+    cmake -S "${SOURCE_DIR}" -B "${HOST_BUILD_DIR}" -DCAN_BRIDGE_HOST=ON
+
+    echo "--- Building host tools ---"
+    cmake --build "${HOST_BUILD_DIR}" -j$(nproc)
+
+    echo "Host build complete, run ${HOST_BUILD_DIR}/host/can_bridge_bench for the forwarding benchmark."
+}
+
 # --- Main Logic ---
 case "${1:-}" in
     clean)
@@ -87,6 +103,9 @@ case "${1:-}" in
         clean
         build
         ;;
+    host)
+        build_host
+        ;;
     *)
         usage
         ;;
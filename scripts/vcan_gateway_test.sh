@@ -0,0 +1,66 @@
+#!/bin/bash
+set -e
+set -u
+set -o pipefail
+
+# Runs can_gateway between virtual CAN interfaces and checks forwarding with can-utils.
+# Needs root (vcan module, interfaces) and cansend/candump. Build the host tools first: ./build.sh host
+#   vcan0 <-> vcan1   passive bridge
+#   vcan2 <-> vcan3   blacklist with 0x123 on the list, loaded from a control frame file
+
+SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+GATEWAY="${SCRIPT_DIR}/../build_host/host/can_gateway"
+WORK_DIR="$(mktemp -d)"
+GATEWAY_PID=""
+
+cleanup() {
+    if [ -n "$GATEWAY_PID" ]; then
+        kill "$GATEWAY_PID" 2>/dev/null || true
+        wait "$GATEWAY_PID" 2>/dev/null || true
+    fi
+    for i in 0 1 2 3; do
+        ip link delete "vcan$i" 2>/dev/null || true
+    done
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+modprobe vcan
+for i in 0 1 2 3; do
+    ip link add dev "vcan$i" type vcan 2>/dev/null || true
+    ip link set up "vcan$i"
+done
+
+# BLACKLIST_MODE, SET_MODE_ADD_ID, ID 0x123, checksum
+echo "(0.000000) vcan2 700#020600000001232C" > "${WORK_DIR}/blacklist.log"
+
+"$GATEWAY" --pair vcan0,vcan1 --pair "vcan2,vcan3,${WORK_DIR}/blacklist.log" &
+GATEWAY_PID=$!
+sleep 0.5
+
+# Sends a frame on $1 and checks whether it shows up on $3 within a second
+check() {
+    local from="$1" frame="$2" to="$3" expected="$4"
+    timeout 1 candump -n 1 -L "$to" > "${WORK_DIR}/out.log" 2>/dev/null &
+    local dump_pid=$!
+    sleep 0.1
+    cansend "$from" "$frame"
+    wait "$dump_pid" || true
+    local seen=0
+    if grep -q "$to ${frame^^}" "${WORK_DIR}/out.log"; then
+        seen=1
+    fi
+    if [ "$seen" != "$expected" ]; then
+        echo "FAIL: $frame from $from seen on $to: $seen, expected $expected"
+        exit 1
+    fi
+    echo "ok: $frame $from -> $to ($seen)"
+}
+
+check vcan0 123#1122334455667788 vcan1 1
+check vcan1 18FF0001#AABB vcan0 1
+check vcan2 456#01 vcan3 1
+check vcan2 123#01 vcan3 0
+check vcan3 123#02 vcan2 0
+
+echo "--- vcan gateway test passed ---"
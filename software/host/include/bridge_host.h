@@ -0,0 +1,26 @@
+/**
+* DESCRIPTION: Helpers shared by the host tools to drive the bridge the way the
+* supervisor does, by sending CONTROL_ID frames on the computer bus.
+**/
+
+#ifndef BRIDGE_HOST_H
+#define BRIDGE_HOST_H
+
+#include <stdint.h>
+#include "CAN_bridge.h"
+
+// A FEEDBACK_BRIDGE reply of the bridge: [FEEDBACK_BRIDGE, item, index, value(4, big endian), checksum]
+struct host_feedback {
+    uint8_t item;
+    uint8_t index;
+    uint32_t value;
+};
+
+void host_build_command(struct can2040_msg *msg, uint8_t command_mode, uint8_t action, uint8_t param, uint32_t value);
+void host_send_command(uint8_t command_mode, uint8_t action, uint8_t param, uint32_t value);
+void host_rx_frame(uint8_t iface, const struct can2040_msg *msg);
+uint32_t host_bulk_upload(uint8_t list, uint8_t flags, const uint8_t *payload, uint32_t length);
+void host_service_all(void);
+bool host_feedback_decode(const struct can2040_msg *msg, struct host_feedback *feedback);
+
+#endif
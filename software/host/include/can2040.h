@@ -0,0 +1,58 @@
+/**
+* DESCRIPTION: Host stand-in for the can2040 public header.
+* Only the types, flags and calls the bridge uses are declared here, with the same
+* names and values as the real library so CAN_bridge.cpp compiles unchanged.
+**/
+
+#ifndef _CAN2040_H
+#define _CAN2040_H
+
+#include <stdint.h> // uint32_t
+
+struct can2040_msg {
+    uint32_t id;
+    uint32_t dlc;
+    union {
+        uint8_t data[8];
+        uint32_t data32[2];
+    };
+};
+
+enum {
+    CAN2040_ID_RTR = 1u << 30,
+    CAN2040_ID_EFF = 1u << 31,
+};
+
+enum {
+    CAN2040_NOTIFY_RX = 0,
+    CAN2040_NOTIFY_TX = 1 << 20,
+    CAN2040_NOTIFY_ERROR = 1 << 23,
+};
+
+struct can2040;
+typedef void (*can2040_rx_cb)(struct can2040 *cd, uint32_t notify, struct can2040_msg *msg);
+
+struct can2040_stats {
+    uint32_t rx_total, tx_total;
+    uint32_t tx_attempt;
+    uint32_t parse_error;
+};
+
+// Simulated controller: the callback and counters live where the real PIO state would
+struct can2040 {
+    uint32_t pio_num;
+    void *rx_cb;
+    uint32_t iface;
+    struct can2040_stats stats;
+};
+
+void can2040_setup(struct can2040 *cd, uint32_t pio_num);
+void can2040_callback_config(struct can2040 *cd, can2040_rx_cb rx_cb);
+void can2040_start(struct can2040 *cd, uint32_t sys_clock, uint32_t bitrate, uint32_t gpio_rx, uint32_t gpio_tx);
+void can2040_stop(struct can2040 *cd);
+void can2040_get_statistics(struct can2040 *cd, struct can2040_stats *stats);
+void can2040_pio_irq_handler(struct can2040 *cd);
+int can2040_check_transmit(struct can2040 *cd);
+int can2040_transmit(struct can2040 *cd, struct can2040_msg *msg);
+
+#endif
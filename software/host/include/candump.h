@@ -0,0 +1,28 @@
+/**
+* DESCRIPTION: Reader for candump log files ("(sec.usec) ifname ID#DATA") and Vector ASC logs
+* ("sec.usec channel ID Rx d dlc bytes") used by the host tools to feed recorded traffic into the bridge.
+**/
+
+#ifndef CANDUMP_H
+#define CANDUMP_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include "can2040.h"
+}
+
+struct candump_frame {
+    uint64_t timestamp_us;      //Log timestamp in microseconds
+    uint8_t iface;              //Bus index, interfaces are numbered in order of first appearance
+    struct can2040_msg msg;     //id carries CAN2040_ID_EFF/CAN2040_ID_RTR like can2040 does
+};
+
+bool candump_parse_line(const std::string &line, candump_frame *frame, std::vector<std::string> *ifaces);
+bool asc_parse_line(const std::string &line, candump_frame *frame, std::vector<std::string> *ifaces, bool *decimal_ids);
+bool candump_load(const char *path, std::vector<candump_frame> *frames);
+std::string candump_format(uint64_t timestamp_us, const char *ifname, const struct can2040_msg *msg);
+
+#endif
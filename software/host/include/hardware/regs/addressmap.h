@@ -0,0 +1,23 @@
+/**
+* DESCRIPTION: Host stand-in for the Pico SDK hardware/regs/addressmap.h.
+* XIP_BASE is where the simulated flash image lives, so flash contents read the same way as on the board.
+**/
+
+#ifndef _HARDWARE_REGS_ADDRESSMAP_H
+#define _HARDWARE_REGS_ADDRESSMAP_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint8_t *sim_flash_memory(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define XIP_BASE                ((uintptr_t)sim_flash_memory())
+
+#endif
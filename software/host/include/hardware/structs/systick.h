@@ -0,0 +1,31 @@
+/**
+* DESCRIPTION: Host stand-in for the Pico SDK hardware/structs/systick.h.
+* Reading cvr gives a 24-bit down counter running at the RP2040's 125 MHz, derived from the host's
+* monotonic clock (not the simulated microsecond timer), so cycle measurements time the real host code.
+**/
+
+#ifndef _HARDWARE_STRUCTS_SYSTICK_H
+#define _HARDWARE_STRUCTS_SYSTICK_H
+
+#include <stdint.h>
+
+#define M0PLUS_SYST_CSR_ENABLE_BITS     0x00000001u
+#define M0PLUS_SYST_CSR_TICKINT_BITS    0x00000002u
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS  0x00000004u
+
+struct sim_systick_cvr {
+    operator uint32_t() const;                          //Current value
+    sim_systick_cvr &operator=(uint32_t value);         //Any write restarts the count from rvr
+};
+
+typedef struct {
+    uint32_t csr;
+    uint32_t rvr;
+    sim_systick_cvr cvr;
+    uint32_t calib;
+} systick_hw_t;
+
+extern systick_hw_t sim_systick;
+#define systick_hw (&sim_systick)
+
+#endif
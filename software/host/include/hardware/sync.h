@@ -0,0 +1,28 @@
+/**
+* DESCRIPTION: Host stand-in for the Pico SDK hardware/sync.h. The host tools are single threaded,
+* so interrupt masking and event signalling do nothing.
+**/
+
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+    (void)status;
+}
+
+static inline void __sev(void) {
+}
+
+static inline void __wfe(void) {
+}
+
+static inline void __dmb(void) {
+}
+
+#endif
@@ -0,0 +1,21 @@
+/**
+* DESCRIPTION: Host stand-in for the Pico SDK hardware/timer.h, backed by the simulated clock in sim_pico.h.
+**/
+
+#ifndef _HARDWARE_TIMER_H
+#define _HARDWARE_TIMER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,18 @@
+/**
+* DESCRIPTION: Host stand-in for the Pico SDK pico/multicore.h. The host tools run one core at a time,
+* so there is nothing to lock out while flash is written.
+**/
+
+#ifndef _PICO_MULTICORE_H
+#define _PICO_MULTICORE_H
+
+static inline void multicore_lockout_victim_init(void) {
+}
+
+static inline void multicore_lockout_start_blocking(void) {
+}
+
+static inline void multicore_lockout_end_blocking(void) {
+}
+
+#endif
@@ -0,0 +1,27 @@
+/**
+* DESCRIPTION: Host stand-in for the Pico SDK pico/platform.h.
+* get_core_num() returns the core the host tool is currently simulating, see sim_pico.h.
+**/
+
+#ifndef _PICO_PLATFORM_H
+#define _PICO_PLATFORM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned int get_core_num(void);
+
+// Code placement: everything runs from RAM on the host
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) __attribute__((noinline)) func_name
+
+static inline void tight_loop_contents(void) {
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,20 @@
+/**
+* DESCRIPTION: Host stand-in for rp_agrolib_can.h.
+* Declares the two bus objects and the setup/send calls used by the bridge. The
+* implementation in host/src/sim_can.cpp records transmissions instead of driving a PIO.
+**/
+
+#ifndef RP_AGROLIB_CAN_H
+#define RP_AGROLIB_CAN_H
+
+#include <stdint.h>
+#include "can2040.h"
+
+extern struct can2040 cbus0;
+extern struct can2040 cbus1;
+
+void canbus_setup0(uint32_t gpio_rx, uint32_t gpio_tx, uint32_t bitrate, can2040_rx_cb callback);
+void canbus_setup1(uint32_t gpio_rx, uint32_t gpio_tx, uint32_t bitrate, can2040_rx_cb callback);
+int can_send(struct can2040 *cd, struct can2040_msg *msg);
+
+#endif
@@ -0,0 +1,48 @@
+/**
+* DESCRIPTION: Timed CAN segment for the host tools. The other nodes' frames and the bridge's
+* controller queue (the paced sim_can queue of the same interface) contend for the wire: when the bus
+* is idle the frame with the lowest arbitration key goes on it for can_frame_bits() bit times.
+* Nodes are modelled as one queue ordered by arbitration key, frames with the same key in arrival order.
+**/
+
+#ifndef SIM_BUS_H
+#define SIM_BUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <vector>
+
+extern "C" {
+    #include "can2040.h"
+}
+
+struct sim_bus_frame {
+    uint64_t ready_ns;                  //When the node had it ready to send
+    uint64_t order;                     //Arrival order, breaks ties between equal keys
+    struct can2040_msg msg;
+};
+
+struct sim_bus {
+    uint8_t iface;
+    uint32_t bitrate;
+    std::vector<sim_bus_frame> nodes;   //Min-heap of the nodes' waiting frames
+    uint64_t arrivals;
+
+    bool busy;
+    bool from_bridge;                   //The frame on the wire is the head of the controller queue
+    struct sim_bus_frame wire;
+    uint64_t wire_start_ns;
+    uint64_t wire_end_ns;
+
+    uint64_t busy_ns;                   //Time spent transmitting
+    uint32_t node_frames;
+    uint32_t bridge_frames;
+};
+
+void sim_bus_init(struct sim_bus *bus, uint8_t iface, uint32_t bitrate);
+uint64_t sim_bus_frame_ns(const struct sim_bus *bus, const struct can2040_msg *msg);
+void sim_bus_queue(struct sim_bus *bus, const struct can2040_msg *msg, uint64_t ready_ns);
+bool sim_bus_arbitrate(struct sim_bus *bus, uint64_t now_ns);
+bool sim_bus_finish(struct sim_bus *bus, struct sim_bus_frame *done);
+
+#endif
@@ -0,0 +1,29 @@
+/**
+* DESCRIPTION: Control surface of the simulated can2040 backend used by the host build.
+* Lets the host tools inject frames on a bus and observe what the bridge transmitted.
+**/
+
+#ifndef SIM_CAN_H
+#define SIM_CAN_H
+
+#include <stdint.h>
+
+extern "C" {
+    #include "rp_agrolib_can.h"
+}
+
+typedef void (*sim_tx_hook_t)(uint8_t iface, const struct can2040_msg *msg, void *ctx);
+
+void sim_can_reset(void);                                           //Clears counters, hooks and callbacks
+struct can2040 *sim_can_bus(uint8_t iface);                         //cbus0 or cbus1
+void sim_can_deliver(uint8_t iface, const struct can2040_msg *msg); //Runs the bus callback as a CAN2040_NOTIFY_RX
+void sim_can_notify_error(uint8_t iface);                           //Runs the bus callback as a CAN2040_NOTIFY_ERROR
+void sim_can_set_tx_hook(sim_tx_hook_t hook, void *ctx);            //Called for every can_send
+uint32_t sim_can_tx_count(uint8_t iface);                           //Frames sent on a bus since the last reset
+const struct can2040_msg *sim_can_last_tx(uint8_t iface);           //Last frame sent on a bus, NULL if none
+void sim_can_set_paced(uint8_t iface, bool paced);                  //Paced: frames wait in the controller queue
+uint32_t sim_can_wire_step(uint8_t iface, uint32_t frames);         //Puts up to frames queued frames on the wire
+uint32_t sim_can_tx_pending(uint8_t iface);                         //Frames waiting in the paced controller queue
+const struct can2040_msg *sim_can_tx_peek(uint8_t iface);           //Next frame of the paced controller queue, NULL if none
+
+#endif
@@ -0,0 +1,19 @@
+/**
+* DESCRIPTION: Control surface of the simulated flash used by the host build.
+* The image starts erased. Attached to a file, it is loaded from it and every erase and program is
+* written through, so a later run (or a reattach) sees the flash as the last one left it.
+**/
+
+#ifndef SIM_FLASH_H
+#define SIM_FLASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool sim_flash_attach(const char *path);
+void sim_flash_detach(void);
+void sim_flash_wipe(void);                              //Back to erased, the file too if attached
+uint32_t sim_flash_erase_count(uint32_t sector);        //Erases of a sector since the process started
+uint32_t sim_flash_errors(void);                        //Misaligned or out of range erase/program calls
+
+#endif
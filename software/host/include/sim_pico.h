@@ -0,0 +1,19 @@
+/**
+* DESCRIPTION: Control surface of the simulated Pico SDK services used by the host build.
+* The microsecond timer only moves when a host tool advances it, so runs are reproducible, unless a
+* tool that talks to real buses switches it to the monotonic clock. get_core_num() reports whichever
+* core the tool says it is running as.
+**/
+
+#ifndef SIM_PICO_H
+#define SIM_PICO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void sim_time_set_us(uint64_t now_us);
+void sim_time_advance_us(uint64_t delta_us);
+void sim_time_use_clock(bool enabled);                 //Timer follows the monotonic clock from now on
+void sim_set_core(unsigned int core);                  //Core reported by get_core_num()
+
+#endif
@@ -0,0 +1,40 @@
+/**
+* DESCRIPTION: SocketCAN bus port (see CAN_port.h) for running the bridge on a Linux gateway.
+* One non-blocking raw socket per interface. Received frames are read in batches with recvmmsg and
+* fed to bridge_receive(); frames the bridge sends are batched and written with sendmmsg by
+* socketcan_flush(). The socket receives its own frames back once the kernel transmitted them
+* (CAN_RAW_RECV_OWN_MSGS, flagged MSG_CONFIRM): those complete the transmission like CAN2040_NOTIFY_TX.
+**/
+
+#ifndef SOCKETCAN_PORT_H
+#define SOCKETCAN_PORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include "CAN_port.h"
+
+#define SOCKETCAN_BATCH     32      // Frames per recvmmsg/sendmmsg call
+#define SOCKETCAN_TX_DEPTH  64      // Frames the bridge may have handed over and not yet confirmed
+
+struct socketcan_port {
+    int fd;
+    uint8_t iface;                              // Bridge interface the socket is
+    char name[IF_NAMESIZE];
+    struct bus_port port;
+    struct can_frame tx_frames[SOCKETCAN_BATCH];// Waiting for the next socketcan_flush()
+    uint32_t tx_pending;
+    uint32_t tx_done;                           // Confirmed by the kernel, or dropped on a socket error
+    uint64_t rx_frames;
+    uint64_t tx_sent;
+    uint64_t tx_errors;
+    uint64_t syscalls;
+};
+
+bool socketcan_open(struct socketcan_port *port, const char *name, uint8_t iface);
+void socketcan_close(struct socketcan_port *port);
+uint32_t socketcan_receive(struct socketcan_port *port);
+uint32_t socketcan_flush(struct socketcan_port *port);
+
+#endif
@@ -0,0 +1,48 @@
+/**
+* DESCRIPTION: Pairs the frames a bridge trace shows forwarded with their transmissions on the other bus,
+* for the host tools. A transmission is matched by the frame as sent: the received frame, or the
+* TRACE_REWRITTEN record after it when a rewrite rule changed it. Frames alike are matched oldest first.
+**/
+
+#ifndef TRACE_MATCH_H
+#define TRACE_MATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <deque>
+#include <map>
+
+#include "CAN_trace.h"
+
+//A frame as the bridge sends it on one bus
+struct trace_match_key {
+    uint8_t bus;
+    uint32_t id;
+    uint8_t dlc;
+    uint64_t data;
+    bool operator<(const trace_match_key &o) const {
+        if (bus != o.bus) return bus < o.bus;
+        if (id != o.id) return id < o.id;
+        if (dlc != o.dlc) return dlc < o.dlc;
+        return data < o.data;
+    }
+};
+
+//A forwarded frame waiting for its transmission
+struct trace_match_pending {
+    uint64_t rx_us;                     //End of reception
+    uint32_t rx_id;                     //ID as received, before a rewrite rule
+};
+
+struct trace_match {
+    std::map<trace_match_key, std::deque<trace_match_pending>> in_flight;
+    trace_match_key last_key[2];        //Per receiving bus, where its last forwarded frame waits
+    bool has_last[2];
+};
+
+void trace_match_init(struct trace_match *match);
+void trace_match_forwarded(struct trace_match *match, const struct trace_event *event);
+void trace_match_rewritten(struct trace_match *match, const struct trace_event *event);
+bool trace_match_sent(struct trace_match *match, const struct trace_event *event, struct trace_match_pending *pending);
+
+#endif
@@ -0,0 +1,104 @@
+/**
+* DESCRIPTION: Host-side helpers to inject traffic and control frames into the bridge.
+**/
+
+#include "bridge_host.h"
+#include "sim_can.h"
+#include "sim_pico.h"
+#include <string.h>
+
+/**
+* @brief Builds a checksummed control frame: [mode, action, param, value(4, big endian), checksum].
+*/
+void host_build_command(struct can2040_msg *msg, uint8_t command_mode, uint8_t action, uint8_t param, uint32_t value) {
+    memset(msg, 0, sizeof(*msg));
+    msg->id = CONTROL_ID;
+    msg->dlc = 8;
+    msg->data[0] = command_mode;
+    msg->data[1] = action;
+    msg->data[2] = param;
+    msg->data[3] = (uint8_t)(value >> 24);
+    msg->data[4] = (uint8_t)(value >> 16);
+    msg->data[5] = (uint8_t)(value >> 8);
+    msg->data[6] = (uint8_t)value;
+    uint32_t sum = 0;
+    for (int i = 0; i < 7; ++i) {
+        sum += msg->data[i];
+    }
+    msg->data[7] = (uint8_t)(sum % 256);
+}
+
+/**
+* @brief Sends a control frame on the computer bus.
+*/
+void host_send_command(uint8_t command_mode, uint8_t action, uint8_t param, uint32_t value) {
+    struct can2040_msg msg;
+    host_build_command(&msg, command_mode, action, param, value);
+    host_rx_frame(CAN_COMPUTER_IFACE, &msg);
+}
+
+/**
+* @brief Uploads a BULK_COMMAND payload (see CAN_bulk.h) to a list. Returns the number of frames sent.
+*/
+uint32_t host_bulk_upload(uint8_t list, uint8_t flags, const uint8_t *payload, uint32_t length) {
+    host_send_command(BULK_COMMAND, BULK_START, list, ((uint32_t)flags << 24) | length);
+    uint32_t frames = 2;
+    for (uint32_t offset = 0, seq = 0; offset < length; offset += BULK_FRAME_BYTES, ++seq, ++frames) {
+        struct can2040_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.id = CONTROL_ID;
+        msg.dlc = 8;
+        msg.data[0] = BULK_COMMAND;
+        msg.data[1] = (uint8_t)(BULK_DATA | (seq & BULK_SEQ_MASK));
+        uint32_t count = length - offset < BULK_FRAME_BYTES ? length - offset : BULK_FRAME_BYTES;
+        memcpy(&msg.data[2], &payload[offset], count);
+        host_rx_frame(CAN_COMPUTER_IFACE, &msg);
+    }
+    host_send_command(BULK_COMMAND, BULK_END, list, bulk_crc32(payload, length));
+    return frames;
+}
+
+/**
+* @brief Delivers a frame to the bridge as if it had been received on the given bus, on the core that
+* owns it, then lets both cores send what was queued for them.
+*/
+void host_rx_frame(uint8_t iface, const struct can2040_msg *msg) {
+    struct can2040_msg copy = *msg;
+    sim_set_core(iface == CAN_IFACE0 ? CAN_IFACE0_CORE : CAN_IFACE1_CORE);
+    can_rx_callback(sim_can_bus(iface), copy.id, (uint8_t)copy.dlc, copy.data);
+    host_service_all();
+}
+
+/**
+* @brief Runs the queued control frames on CAN_COMMAND_CORE, then bridge_service() for each bus on the
+* core that owns it.
+*/
+void host_service_all(void) {
+    sim_set_core(CAN_COMMAND_CORE);
+    bridge_run_commands();
+    sim_set_core(CAN_IFACE0_CORE);
+    bridge_service(CAN_IFACE0);
+    sim_set_core(CAN_IFACE1_CORE);
+    bridge_service(CAN_IFACE1);
+}
+
+/**
+* @brief Decodes a frame sent to the computer if it is a FEEDBACK_BRIDGE reply with a valid checksum.
+* Returns false (feedback untouched) for any other frame.
+*/
+bool host_feedback_decode(const struct can2040_msg *msg, struct host_feedback *feedback) {
+    if (msg->id != FEEDBACK_ID || msg->dlc != 8 || msg->data[0] != FEEDBACK_BRIDGE) {
+        return false;
+    }
+    uint32_t sum = 0;
+    for (int i = 0; i < 7; ++i) {
+        sum += msg->data[i];
+    }
+    if (msg->data[7] != (uint8_t)(sum % 256)) {
+        return false;
+    }
+    feedback->item = msg->data[1];
+    feedback->index = msg->data[2];
+    feedback->value = ((uint32_t)msg->data[3] << 24) | ((uint32_t)msg->data[4] << 16) | ((uint32_t)msg->data[5] << 8) | msg->data[6];
+    return true;
+}
@@ -0,0 +1,219 @@
+/**
+* DESCRIPTION: candump log parsing and formatting for the host tools.
+**/
+
+#include "candump.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+* @brief Parses one candump log line. Unknown interfaces are appended to ifaces.
+*/
+bool candump_parse_line(const std::string &line, candump_frame *frame, std::vector<std::string> *ifaces) {
+    char ifname[32];
+    char body[64];
+    unsigned long sec = 0, usec = 0;
+    if (sscanf(line.c_str(), " (%lu.%lu) %31s %63s", &sec, &usec, ifname, body) != 4) {
+        return false;
+    }
+
+    const char *hash = strchr(body, '#');
+    if (hash == NULL) {
+        return false;
+    }
+    size_t id_len = (size_t)(hash - body);
+    if (id_len == 0 || id_len > 8) {
+        return false;
+    }
+
+    uint32_t id = 0;
+    for (size_t i = 0; i < id_len; ++i) {
+        int v = hex_value(body[i]);
+        if (v < 0) {
+            return false;
+        }
+        id = (id << 4) | (uint32_t)v;
+    }
+
+    memset(frame, 0, sizeof(*frame));
+    frame->msg.id = (id_len == 8) ? (id | CAN2040_ID_EFF) : id;
+
+    const char *p = hash + 1;
+    if (*p == 'R') {                                    //Remote frame, optional length digit
+        frame->msg.id |= CAN2040_ID_RTR;
+        frame->msg.dlc = (p[1] >= '0' && p[1] <= '8') ? (uint32_t)(p[1] - '0') : 0;
+    } else {
+        uint32_t dlc = 0;
+        while (p[0] != '\0' && p[1] != '\0' && dlc < 8) {
+            if (*p == '.') {
+                p++;
+                continue;
+            }
+            int hi = hex_value(p[0]);
+            int lo = hex_value(p[1]);
+            if (hi < 0 || lo < 0) {
+                return false;
+            }
+            frame->msg.data[dlc++] = (uint8_t)((hi << 4) | lo);
+            p += 2;
+        }
+        frame->msg.dlc = dlc;
+    }
+
+    size_t index = 0;
+    while (index < ifaces->size() && (*ifaces)[index] != ifname) {
+        index++;
+    }
+    if (index == ifaces->size()) {
+        ifaces->push_back(ifname);
+    }
+    frame->iface = (uint8_t)index;
+    frame->timestamp_us = (uint64_t)sec * 1000000ull + usec;
+    return true;
+}
+
+/**
+* @brief Parses one Vector ASC line. Channels are numbered like candump interfaces, by first appearance.
+* The "base dec" header line switches the IDs to decimal (decimal_ids keeps it for the next lines).
+* Error frames, CAN FD and other event lines return false.
+*/
+bool asc_parse_line(const std::string &line, candump_frame *frame, std::vector<std::string> *ifaces, bool *decimal_ids) {
+    std::istringstream in(line);
+    std::string time, channel, id_text, direction, type;
+    if (!(in >> time)) {
+        return false;
+    }
+    if (time == "base") {
+        std::string base;
+        in >> base;
+        *decimal_ids = base == "dec";
+        return false;
+    }
+
+    //Seconds with up to 6 decimals, kept exact
+    const char *dot = strchr(time.c_str(), '.');
+    if (dot == NULL || dot == time.c_str()) {
+        return false;
+    }
+    uint64_t sec = 0, usec = 0;
+    for (const char *p = time.c_str(); p < dot; ++p) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        sec = sec * 10 + (uint64_t)(*p - '0');
+    }
+    uint32_t digits = 0;
+    for (const char *p = dot + 1; *p != '\0'; ++p) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        if (digits++ < 6) {
+            usec = usec * 10 + (uint64_t)(*p - '0');
+        }
+    }
+    for (; digits < 6; ++digits) {
+        usec *= 10;
+    }
+
+    if (!(in >> channel >> id_text >> direction >> type) || channel.find_first_not_of("0123456789") != std::string::npos
+        || (direction != "Rx" && direction != "Tx") || (type != "d" && type != "r")) {
+        return false;
+    }
+    bool extended = id_text.size() > 1 && (id_text.back() == 'x' || id_text.back() == 'X');
+    if (extended) {
+        id_text.pop_back();
+    }
+    char *end = NULL;
+    unsigned long id = strtoul(id_text.c_str(), &end, *decimal_ids ? 10 : 16);
+    if (id_text.empty() || *end != '\0' || id > (extended ? 0x1FFFFFFFul : 0x7FFul)) {
+        return false;
+    }
+
+    memset(frame, 0, sizeof(*frame));
+    frame->msg.id = (uint32_t)id | (extended ? (uint32_t)CAN2040_ID_EFF : 0u);
+    std::string dlc_text;
+    if (type == "r") {
+        frame->msg.id |= CAN2040_ID_RTR;
+        if (in >> dlc_text && dlc_text.size() == 1 && dlc_text[0] >= '0' && dlc_text[0] <= '8') {
+            frame->msg.dlc = (uint32_t)(dlc_text[0] - '0');
+        }
+    } else {
+        if (!(in >> dlc_text) || dlc_text.size() != 1 || hex_value(dlc_text[0]) < 0 || hex_value(dlc_text[0]) > 8) {
+            return false;
+        }
+        frame->msg.dlc = (uint32_t)hex_value(dlc_text[0]);
+        for (uint32_t i = 0; i < frame->msg.dlc; ++i) {
+            std::string byte;
+            if (!(in >> byte) || byte.size() != 2 || hex_value(byte[0]) < 0 || hex_value(byte[1]) < 0) {
+                return false;
+            }
+            frame->msg.data[i] = (uint8_t)((hex_value(byte[0]) << 4) | hex_value(byte[1]));
+        }
+    }
+
+    size_t index = 0;
+    while (index < ifaces->size() && (*ifaces)[index] != channel) {
+        index++;
+    }
+    if (index == ifaces->size()) {
+        ifaces->push_back(channel);
+    }
+    frame->iface = (uint8_t)index;
+    frame->timestamp_us = sec * 1000000ull + usec;
+    return true;
+}
+
+/**
+* @brief Loads every parsable line of a candump or ASC log. Returns false if the file cannot be read.
+*/
+bool candump_load(const char *path, std::vector<candump_frame> *frames) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::vector<std::string> ifaces;
+    std::string line;
+    candump_frame frame;
+    bool decimal_ids = false;
+    while (std::getline(in, line)) {
+        if (candump_parse_line(line, &frame, &ifaces) || asc_parse_line(line, &frame, &ifaces, &decimal_ids)) {
+            frames->push_back(frame);
+        }
+    }
+    return true;
+}
+
+/**
+* @brief Formats a frame as a candump log line (without the trailing newline).
+*/
+std::string candump_format(uint64_t timestamp_us, const char *ifname, const struct can2040_msg *msg) {
+    char out[96];
+    int n;
+    if (msg->id & CAN2040_ID_EFF) {
+        n = snprintf(out, sizeof(out), "(%010llu.%06llu) %s %08X#",
+                     (unsigned long long)(timestamp_us / 1000000ull), (unsigned long long)(timestamp_us % 1000000ull),
+                     ifname, (unsigned)(msg->id & 0x1FFFFFFF));
+    } else {
+        n = snprintf(out, sizeof(out), "(%010llu.%06llu) %s %03X#",
+                     (unsigned long long)(timestamp_us / 1000000ull), (unsigned long long)(timestamp_us % 1000000ull),
+                     ifname, (unsigned)(msg->id & 0x7FF));
+    }
+    if (msg->id & CAN2040_ID_RTR) {
+        snprintf(out + n, sizeof(out) - (size_t)n, "R");
+    } else {
+        for (uint32_t i = 0; i < msg->dlc && i < 8; ++i) {
+            n += snprintf(out + n, sizeof(out) - (size_t)n, "%02X", msg->data[i]);
+        }
+    }
+    return std::string(out);
+}
@@ -0,0 +1,101 @@
+/**
+* DESCRIPTION: Timed CAN segment with arbitration between the other nodes and the bridge controller.
+**/
+
+#include "sim_bus.h"
+#include <algorithm>
+#include "CAN_bridge.h"
+#include "sim_can.h"
+#include "sim_pico.h"
+
+//Heap order: the frame that wins arbitration first on top
+static bool sim_bus_after(const sim_bus_frame &a, const sim_bus_frame &b) {
+    uint32_t ka = can_arbitration_key(a.msg.id);
+    uint32_t kb = can_arbitration_key(b.msg.id);
+    return ka != kb ? ka > kb : a.order > b.order;
+}
+
+void sim_bus_init(struct sim_bus *bus, uint8_t iface, uint32_t bitrate) {
+    bus->iface = iface;
+    bus->bitrate = bitrate;
+    bus->nodes.clear();
+    bus->arrivals = 0;
+    bus->busy = false;
+    bus->from_bridge = false;
+    bus->wire_start_ns = 0;
+    bus->wire_end_ns = 0;
+    bus->busy_ns = 0;
+    bus->node_frames = 0;
+    bus->bridge_frames = 0;
+}
+
+/**
+* @brief Wire time of a frame, worst case stuffing and the interframe space included.
+*/
+uint64_t sim_bus_frame_ns(const struct sim_bus *bus, const struct can2040_msg *msg) {
+    return (uint64_t)can_frame_bits(msg->id, (uint8_t)msg->dlc) * 1000000000ull / bus->bitrate;
+}
+
+/**
+* @brief A node has a frame ready to send from ready_ns on.
+*/
+void sim_bus_queue(struct sim_bus *bus, const struct can2040_msg *msg, uint64_t ready_ns) {
+    sim_bus_frame frame;
+    frame.ready_ns = ready_ns;
+    frame.order = bus->arrivals++;
+    frame.msg = *msg;
+    bus->nodes.push_back(frame);
+    std::push_heap(bus->nodes.begin(), bus->nodes.end(), sim_bus_after);
+}
+
+/**
+* @brief If the bus is idle, puts the winner of arbitration on the wire. Returns true if a frame started.
+*/
+bool sim_bus_arbitrate(struct sim_bus *bus, uint64_t now_ns) {
+    if (bus->busy) {
+        return false;
+    }
+    const struct can2040_msg *head = sim_can_tx_peek(bus->iface);
+    bool node_waiting = !bus->nodes.empty();
+    if (head == NULL && !node_waiting) {
+        return false;
+    }
+    //Equal keys would be an error frame on a real bus, the node goes first here
+    bus->from_bridge = head != NULL && (!node_waiting || can_arbitration_key(head->id) < can_arbitration_key(bus->nodes.front().msg.id));
+    if (bus->from_bridge) {
+        bus->wire.ready_ns = now_ns;
+        bus->wire.order = 0;
+        bus->wire.msg = *head;
+    } else {
+        std::pop_heap(bus->nodes.begin(), bus->nodes.end(), sim_bus_after);
+        bus->wire = bus->nodes.back();
+        bus->nodes.pop_back();
+    }
+    bus->busy = true;
+    bus->wire_start_ns = now_ns;
+    bus->wire_end_ns = now_ns + sim_bus_frame_ns(bus, &bus->wire.msg);
+    bus->busy_ns += bus->wire_end_ns - now_ns;
+    return true;
+}
+
+/**
+* @brief Ends the frame on the wire, call it at wire_end_ns. A node's frame is received by the bridge,
+* the bridge's own frame completes its transmission (CAN2040_NOTIFY_TX), each on the core owning the bus.
+* Returns false if the bus was idle.
+*/
+bool sim_bus_finish(struct sim_bus *bus, struct sim_bus_frame *done) {
+    if (!bus->busy) {
+        return false;
+    }
+    bus->busy = false;
+    *done = bus->wire;
+    sim_set_core(bus->iface == CAN_IFACE0 ? CAN_IFACE0_CORE : CAN_IFACE1_CORE);
+    if (bus->from_bridge) {
+        bus->bridge_frames++;
+        sim_can_wire_step(bus->iface, 1);
+    } else {
+        bus->node_frames++;
+        sim_can_deliver(bus->iface, &done->msg);
+    }
+    return true;
+}
@@ -0,0 +1,179 @@
+/**
+* DESCRIPTION: Simulated can2040/rp_agrolib_can backend for the host build.
+* By default can_send never blocks: every frame is counted, kept as the last transmission of its
+* bus and handed to the optional tx hook. A paced bus models a busy wire instead: frames wait in
+* a controller queue as deep as can2040's until the tool puts them on the wire with sim_can_wire_step().
+**/
+
+#include "sim_can.h"
+#include <string.h>
+
+struct can2040 cbus0;
+struct can2040 cbus1;
+
+static sim_tx_hook_t sim_tx_hook = NULL;
+static void *sim_tx_hook_ctx = NULL;
+static struct can2040_msg sim_last_tx[2];
+static bool sim_has_tx[2];
+
+#define SIM_CAN_TX_QUEUE    4       // can2040 transmit queue depth
+
+static bool sim_paced[2];
+static struct can2040_msg sim_tx_fifo[2][SIM_CAN_TX_QUEUE];
+static uint32_t sim_tx_fifo_count[2];
+
+static uint8_t sim_iface_of(struct can2040 *cd) {
+    return (cd == &cbus1) ? 1 : 0;
+}
+
+void sim_can_reset(void) {
+    memset(&cbus0, 0, sizeof(cbus0));
+    memset(&cbus1, 0, sizeof(cbus1));
+    cbus1.iface = 1;
+    sim_tx_hook = NULL;
+    sim_tx_hook_ctx = NULL;
+    memset(sim_last_tx, 0, sizeof(sim_last_tx));
+    sim_has_tx[0] = sim_has_tx[1] = false;
+    sim_paced[0] = sim_paced[1] = false;
+    sim_tx_fifo_count[0] = sim_tx_fifo_count[1] = 0;
+}
+
+/**
+* @brief A frame leaves the controller: counted, recorded, hooked and notified like a can2040 CAN2040_NOTIFY_TX.
+*/
+static void sim_can_on_wire(uint8_t iface, struct can2040_msg *msg) {
+    struct can2040 *cd = sim_can_bus(iface);
+    cd->stats.tx_total++;
+    sim_last_tx[iface] = *msg;
+    sim_has_tx[iface] = true;
+    if (sim_tx_hook != NULL) {
+        sim_tx_hook(iface, msg, sim_tx_hook_ctx);
+    }
+    if (sim_paced[iface] && cd->rx_cb != NULL) {     //An unpaced send completes inside can_send, nothing to wake
+        ((can2040_rx_cb)cd->rx_cb)(cd, CAN2040_NOTIFY_TX, msg);
+    }
+}
+
+void sim_can_set_paced(uint8_t iface, bool paced) {
+    sim_paced[iface ? 1 : 0] = paced;
+}
+
+uint32_t sim_can_wire_step(uint8_t iface, uint32_t frames) {
+    iface = iface ? 1 : 0;
+    uint32_t sent = 0;
+    while (sent < frames && sim_tx_fifo_count[iface] > 0) {
+        struct can2040_msg msg = sim_tx_fifo[iface][0];
+        sim_tx_fifo_count[iface]--;
+        memmove(&sim_tx_fifo[iface][0], &sim_tx_fifo[iface][1], sim_tx_fifo_count[iface] * sizeof(msg));
+        sim_can_on_wire(iface, &msg);
+        sent++;
+    }
+    return sent;
+}
+
+uint32_t sim_can_tx_pending(uint8_t iface) {
+    return sim_tx_fifo_count[iface ? 1 : 0];
+}
+
+const struct can2040_msg *sim_can_tx_peek(uint8_t iface) {
+    iface = iface ? 1 : 0;
+    return sim_tx_fifo_count[iface] > 0 ? &sim_tx_fifo[iface][0] : NULL;
+}
+
+struct can2040 *sim_can_bus(uint8_t iface) {
+    return iface ? &cbus1 : &cbus0;
+}
+
+void sim_can_deliver(uint8_t iface, const struct can2040_msg *msg) {
+    struct can2040 *cd = sim_can_bus(iface);
+    struct can2040_msg copy = *msg;
+    cd->stats.rx_total++;
+    if (cd->rx_cb != NULL) {
+        ((can2040_rx_cb)cd->rx_cb)(cd, CAN2040_NOTIFY_RX, &copy);
+    }
+}
+
+void sim_can_notify_error(uint8_t iface) {
+    struct can2040 *cd = sim_can_bus(iface);
+    cd->stats.parse_error++;
+    if (cd->rx_cb != NULL) {
+        ((can2040_rx_cb)cd->rx_cb)(cd, CAN2040_NOTIFY_ERROR, NULL);
+    }
+}
+
+void sim_can_set_tx_hook(sim_tx_hook_t hook, void *ctx) {
+    sim_tx_hook = hook;
+    sim_tx_hook_ctx = ctx;
+}
+
+uint32_t sim_can_tx_count(uint8_t iface) {
+    return sim_can_bus(iface)->stats.tx_total;
+}
+
+const struct can2040_msg *sim_can_last_tx(uint8_t iface) {
+    return sim_has_tx[iface ? 1 : 0] ? &sim_last_tx[iface ? 1 : 0] : NULL;
+}
+
+extern "C" {
+
+void can2040_setup(struct can2040 *cd, uint32_t pio_num) {
+    cd->pio_num = pio_num;
+}
+
+void can2040_callback_config(struct can2040 *cd, can2040_rx_cb rx_cb) {
+    cd->rx_cb = (void *)rx_cb;
+}
+
+void can2040_start(struct can2040 *cd, uint32_t sys_clock, uint32_t bitrate, uint32_t gpio_rx, uint32_t gpio_tx) {
+    (void)cd; (void)sys_clock; (void)bitrate; (void)gpio_rx; (void)gpio_tx;
+}
+
+void can2040_stop(struct can2040 *cd) {
+    (void)cd;
+}
+
+void can2040_get_statistics(struct can2040 *cd, struct can2040_stats *stats) {
+    *stats = cd->stats;
+}
+
+void can2040_pio_irq_handler(struct can2040 *cd) {
+    (void)cd;
+}
+
+int can2040_check_transmit(struct can2040 *cd) {
+    uint8_t iface = sim_iface_of(cd);
+    return !sim_paced[iface] || sim_tx_fifo_count[iface] < SIM_CAN_TX_QUEUE;
+}
+
+int can2040_transmit(struct can2040 *cd, struct can2040_msg *msg) {
+    uint8_t iface = sim_iface_of(cd);
+    if (!can2040_check_transmit(cd)) {
+        return -1;
+    }
+    cd->stats.tx_attempt++;
+    if (sim_paced[iface]) {
+        sim_tx_fifo[iface][sim_tx_fifo_count[iface]++] = *msg;
+    } else {
+        sim_can_on_wire(iface, msg);
+    }
+    return 0;
+}
+
+void canbus_setup0(uint32_t gpio_rx, uint32_t gpio_tx, uint32_t bitrate, can2040_rx_cb callback) {
+    can2040_setup(&cbus0, 0);
+    can2040_callback_config(&cbus0, callback);
+    can2040_start(&cbus0, 125000000, bitrate, gpio_rx, gpio_tx);
+}
+
+void canbus_setup1(uint32_t gpio_rx, uint32_t gpio_tx, uint32_t bitrate, can2040_rx_cb callback) {
+    can2040_setup(&cbus1, 1);
+    cbus1.iface = 1;
+    can2040_callback_config(&cbus1, callback);
+    can2040_start(&cbus1, 125000000, bitrate, gpio_rx, gpio_tx);
+}
+
+int can_send(struct can2040 *cd, struct can2040_msg *msg) {
+    return can2040_transmit(cd, msg);
+}
+
+}
@@ -0,0 +1,104 @@
+/**
+* DESCRIPTION: Simulated RP2040 flash for the host build, optionally backed by a file.
+**/
+
+#include "sim_flash.h"
+#include "hardware/flash.h"
+#include "hardware/regs/addressmap.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_FLASH_SECTORS       (PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE)
+
+static uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+static bool sim_flash_ready = false;
+static FILE *sim_flash_file = NULL;
+static uint32_t sim_erase_counts[SIM_FLASH_SECTORS];
+static uint32_t sim_error_count = 0;
+
+static void sim_flash_init(void) {
+    if (!sim_flash_ready) {
+        memset(sim_flash, 0xFF, sizeof(sim_flash));
+        sim_flash_ready = true;
+    }
+}
+
+uint8_t *sim_flash_memory(void) {
+    sim_flash_init();
+    return sim_flash;
+}
+
+static void sim_flash_write_through(uint32_t offset, size_t count) {
+    if (sim_flash_file != NULL) {
+        fseek(sim_flash_file, (long)offset, SEEK_SET);
+        fwrite(&sim_flash[offset], 1, count, sim_flash_file);
+        fflush(sim_flash_file);
+    }
+}
+
+/**
+* @brief Backs the flash with a file, creating it (erased) if it does not exist. Returns false if it cannot be opened.
+*/
+bool sim_flash_attach(const char *path) {
+    sim_flash_detach();
+    sim_flash_ready = false;
+    sim_flash_init();
+    sim_flash_file = fopen(path, "r+b");
+    if (sim_flash_file != NULL) {
+        size_t got = fread(sim_flash, 1, sizeof(sim_flash), sim_flash_file);
+        (void)got;                                      //A short file leaves the rest erased
+        return true;
+    }
+    sim_flash_file = fopen(path, "w+b");
+    if (sim_flash_file == NULL) {
+        return false;
+    }
+    sim_flash_write_through(0, sizeof(sim_flash));
+    return true;
+}
+
+void sim_flash_detach(void) {
+    if (sim_flash_file != NULL) {
+        fclose(sim_flash_file);
+        sim_flash_file = NULL;
+    }
+}
+
+void sim_flash_wipe(void) {
+    sim_flash_init();
+    memset(sim_flash, 0xFF, sizeof(sim_flash));
+    sim_flash_write_through(0, sizeof(sim_flash));
+}
+
+uint32_t sim_flash_erase_count(uint32_t sector) {
+    return sector < SIM_FLASH_SECTORS ? sim_erase_counts[sector] : 0;
+}
+
+uint32_t sim_flash_errors(void) {
+    return sim_error_count;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    sim_flash_init();
+    if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > sizeof(sim_flash)) {
+        sim_error_count++;
+        return;
+    }
+    memset(&sim_flash[flash_offs], 0xFF, count);
+    for (uint32_t sector = flash_offs / FLASH_SECTOR_SIZE; sector < (flash_offs + count) / FLASH_SECTOR_SIZE; ++sector) {
+        sim_erase_counts[sector]++;
+    }
+    sim_flash_write_through(flash_offs, count);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    sim_flash_init();
+    if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > sizeof(sim_flash)) {
+        sim_error_count++;
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        sim_flash[flash_offs + i] &= data[i];           //NOR flash: programming only clears bits
+    }
+    sim_flash_write_through(flash_offs, count);
+}
@@ -0,0 +1,97 @@
+/**
+* DESCRIPTION: Simulated Pico SDK services for the host build: timer, core number and SysTick.
+**/
+
+#include "sim_pico.h"
+#include "hardware/timer.h"
+#include "pico/platform.h"
+#include "hardware/structs/systick.h"
+#include <chrono>
+
+static uint64_t sim_now_us = 0;
+static bool sim_clock = false;
+static std::chrono::steady_clock::time_point sim_clock_start;
+static unsigned int sim_core = 0;
+
+void sim_set_core(unsigned int core) {
+    sim_core = core;
+}
+
+void sim_time_set_us(uint64_t now_us) {
+    sim_now_us = now_us;
+}
+
+void sim_time_advance_us(uint64_t delta_us) {
+    sim_now_us += delta_us;
+}
+
+void sim_time_use_clock(bool enabled) {
+    sim_clock = enabled;
+    sim_clock_start = std::chrono::steady_clock::now();
+}
+
+static inline uint64_t sim_time_now_us(void) {
+    if (!sim_clock) {
+        return sim_now_us;
+    }
+    return sim_now_us + (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - sim_clock_start).count();
+}
+
+systick_hw_t sim_systick;
+
+// SysTick source: the TSC where there is one (reading the OS clock costs more than the code being timed),
+// scaled to 125 MHz once against the monotonic clock
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t sim_ticks(void) {
+    return __rdtsc();
+}
+#else
+static inline uint64_t sim_ticks(void) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+static uint64_t sim_systick_start = sim_ticks();
+static double sim_cycles_per_tick = 0.0;
+
+static double sim_systick_calibrate(void) {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    uint64_t ticks0 = sim_ticks();
+    while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(2)) {
+    }
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    return ns * 0.125 / (double)(sim_ticks() - ticks0);
+}
+
+sim_systick_cvr::operator uint32_t() const {
+    if (sim_cycles_per_tick == 0.0) {
+        sim_cycles_per_tick = sim_systick_calibrate();
+    }
+    uint32_t cycles = (uint32_t)(uint64_t)((double)(sim_ticks() - sim_systick_start) * sim_cycles_per_tick);
+    return (sim_systick.rvr - cycles) & 0x00FFFFFFu;
+}
+
+sim_systick_cvr &sim_systick_cvr::operator=(uint32_t value) {
+    (void)value;
+    sim_systick_start = sim_ticks();
+    return *this;
+}
+
+extern "C" {
+
+uint32_t time_us_32(void) {
+    return (uint32_t)sim_time_now_us();
+}
+
+uint64_t time_us_64(void) {
+    return sim_time_now_us();
+}
+
+unsigned int get_core_num(void) {
+    return sim_core;
+}
+
+}
@@ -0,0 +1,193 @@
+/**
+* DESCRIPTION: SocketCAN bus port: batched non-blocking raw sockets.
+**/
+
+#include "socketcan_port.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can/raw.h>
+#include <linux/can/error.h>
+#include "CAN_bridge.h"
+#include "sim_pico.h"
+
+static int socketcan_send(void *ctx, struct can2040_msg *msg) {
+    struct socketcan_port *port = (struct socketcan_port *)ctx;
+    if (port->tx_pending >= SOCKETCAN_BATCH) {
+        return -1;
+    }
+    struct can_frame *frame = &port->tx_frames[port->tx_pending++];
+    memset(frame, 0, sizeof(*frame));
+    if (msg->id & CAN2040_ID_EFF) {
+        frame->can_id = (msg->id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+    } else {
+        frame->can_id = msg->id & CAN_SFF_MASK;
+    }
+    if (msg->id & CAN2040_ID_RTR) {
+        frame->can_id |= CAN_RTR_FLAG;
+    }
+    frame->can_dlc = (uint8_t)(msg->dlc > 8 ? 8 : msg->dlc);
+    memcpy(frame->data, msg->data, frame->can_dlc);
+    return 0;
+}
+
+static bool socketcan_ready(void *ctx) {
+    return ((struct socketcan_port *)ctx)->tx_pending < SOCKETCAN_BATCH;
+}
+
+static uint32_t socketcan_tx_total(void *ctx) {
+    return ((struct socketcan_port *)ctx)->tx_done;
+}
+
+/**
+* @brief Opens a non-blocking raw socket on a CAN interface for a bridge interface. Returns false
+* (with the reason on stderr) if the interface does not exist or the socket cannot be set up.
+*/
+bool socketcan_open(struct socketcan_port *port, const char *name, uint8_t iface) {
+    memset(port, 0, sizeof(*port));
+    port->fd = -1;
+    port->iface = iface;
+    snprintf(port->name, sizeof(port->name), "%s", name);
+    port->port.send = socketcan_send;
+    port->port.ready = socketcan_ready;
+    port->port.tx_total = socketcan_tx_total;
+    port->port.ctx = port;
+    port->port.tx_depth = SOCKETCAN_TX_DEPTH;
+
+    int fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+    if (fd < 0) {
+        fprintf(stderr, "%s: socket: %s\n", name, strerror(errno));
+        return false;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_CAN_RAW, CAN_RAW_LOOPBACK, &on, sizeof(on));
+    if (setsockopt(fd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &on, sizeof(on)) < 0) {
+        fprintf(stderr, "%s: CAN_RAW_RECV_OWN_MSGS: %s\n", name, strerror(errno));
+        close(fd);
+        return false;
+    }
+    can_err_mask_t errors = CAN_ERR_BUSOFF | CAN_ERR_CRTL;     //Error frames that mark the bus down, see CAN_health.h
+    setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &errors, sizeof(errors));
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", name);
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        close(fd);
+        return false;
+    }
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "%s: bind: %s\n", name, strerror(errno));
+        close(fd);
+        return false;
+    }
+    port->fd = fd;
+    return true;
+}
+
+void socketcan_close(struct socketcan_port *port) {
+    if (port->fd >= 0) {
+        close(port->fd);
+        port->fd = -1;
+    }
+}
+
+/**
+* @brief Reads one batch of frames. Frames from the bus go to bridge_receive(), the bridge's own frames
+* coming back to bridge_tx_done(), both as the core that owns the interface. Returns the frames read.
+*/
+uint32_t socketcan_receive(struct socketcan_port *port) {
+    struct can_frame frames[SOCKETCAN_BATCH];
+    struct iovec iov[SOCKETCAN_BATCH];
+    struct mmsghdr msgs[SOCKETCAN_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for (uint32_t i = 0; i < SOCKETCAN_BATCH; ++i) {
+        iov[i].iov_base = &frames[i];
+        iov[i].iov_len = sizeof(frames[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int count = recvmmsg(port->fd, msgs, SOCKETCAN_BATCH, MSG_DONTWAIT, NULL);
+    port->syscalls++;
+    if (count <= 0) {
+        return 0;
+    }
+
+    sim_set_core(port->iface == CAN_IFACE0 ? CAN_IFACE0_CORE : CAN_IFACE1_CORE);
+    for (int i = 0; i < count; ++i) {
+        const struct can_frame *frame = &frames[i];
+        if (msgs[i].msg_len < sizeof(struct can_frame)) {
+            continue;
+        }
+        if (frame->can_id & CAN_ERR_FLAG) {             //Bus-off or error-passive controller: the bus is down
+            bool passive = (frame->can_id & CAN_ERR_CRTL)
+                && (frame->data[1] & (CAN_ERR_CRTL_TX_PASSIVE | CAN_ERR_CRTL_RX_PASSIVE));
+            if ((frame->can_id & CAN_ERR_BUSOFF) || passive) {
+                bridge_bus_error(port->iface, true);
+            }
+            continue;
+        }
+        struct can2040_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        if (frame->can_id & CAN_EFF_FLAG) {
+            msg.id = (frame->can_id & CAN_EFF_MASK) | CAN2040_ID_EFF;
+        } else {
+            msg.id = frame->can_id & CAN_SFF_MASK;
+        }
+        if (frame->can_id & CAN_RTR_FLAG) {
+            msg.id |= CAN2040_ID_RTR;
+        }
+        msg.dlc = frame->can_dlc > 8 ? 8 : frame->can_dlc;
+        memcpy(msg.data, frame->data, msg.dlc);
+        if (msgs[i].msg_hdr.msg_flags & MSG_CONFIRM) {
+            port->tx_done++;
+            bridge_tx_done(port->iface, &msg);
+        } else {
+            port->rx_frames++;
+            bridge_receive(port->iface, msg.id, (uint8_t)msg.dlc, msg.data);
+        }
+    }
+    return (uint32_t)count;
+}
+
+/**
+* @brief Writes the frames the bridge handed over. A full socket buffer keeps them for the next call,
+* any other error drops the frame. Returns the frames written.
+*/
+uint32_t socketcan_flush(struct socketcan_port *port) {
+    uint32_t written = 0;
+    while (port->tx_pending > 0) {
+        struct iovec iov[SOCKETCAN_BATCH];
+        struct mmsghdr msgs[SOCKETCAN_BATCH];
+        memset(msgs, 0, sizeof(msgs));
+        for (uint32_t i = 0; i < port->tx_pending; ++i) {
+            iov[i].iov_base = &port->tx_frames[i];
+            iov[i].iov_len = sizeof(struct can_frame);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int count = sendmmsg(port->fd, msgs, port->tx_pending, MSG_DONTWAIT);
+        port->syscalls++;
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                break;                                  //The interface queue is full, try again later
+            }
+            count = 1;                                  //The first frame cannot be sent, drop it
+            port->tx_errors++;
+            port->tx_done++;
+        } else {
+            port->tx_sent += (uint64_t)count;
+            written += (uint32_t)count;
+        }
+        port->tx_pending -= (uint32_t)count;
+        memmove(&port->tx_frames[0], &port->tx_frames[count], port->tx_pending * sizeof(struct can_frame));
+    }
+    return written;
+}
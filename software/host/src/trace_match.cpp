@@ -0,0 +1,73 @@
+/**
+* DESCRIPTION: Pairing of the forwarded frames of a bridge trace with their transmissions.
+**/
+
+#include "trace_match.h"
+#include <string.h>
+
+static trace_match_key trace_match_key_of(uint8_t bus, const struct can2040_msg *msg) {
+    trace_match_key key;
+    key.bus = bus;
+    key.id = msg->id;
+    key.dlc = (uint8_t)msg->dlc;
+    key.data = 0;
+    memcpy(&key.data, msg->data, msg->dlc > 8 ? 8 : msg->dlc);
+    return key;
+}
+
+void trace_match_init(struct trace_match *match) {
+    match->in_flight.clear();
+    match->has_last[0] = false;
+    match->has_last[1] = false;
+}
+
+/**
+* @brief A TRACE_FORWARDED record: the received frame waits for its transmission on the other bus.
+*/
+void trace_match_forwarded(struct trace_match *match, const struct trace_event *event) {
+    trace_match_key key = trace_match_key_of(event->bus ^ 1, &event->msg);
+    trace_match_pending pending;
+    pending.rx_us = event->time_us;
+    pending.rx_id = event->msg.id;
+    match->in_flight[key].push_back(pending);
+    match->last_key[event->bus] = key;
+    match->has_last[event->bus] = true;
+}
+
+/**
+* @brief A TRACE_REWRITTEN record: the last frame forwarded from its bus waits as the rewritten frame.
+* The bridge records it right after that TRACE_FORWARDED record, on the same bus.
+*/
+void trace_match_rewritten(struct trace_match *match, const struct trace_event *event) {
+    if (!match->has_last[event->bus]) {
+        return;                                     //Its TRACE_FORWARDED record was lost
+    }
+    match->has_last[event->bus] = false;
+    auto it = match->in_flight.find(match->last_key[event->bus]);
+    if (it == match->in_flight.end() || it->second.empty()) {
+        return;
+    }
+    trace_match_pending pending = it->second.back();
+    it->second.pop_back();
+    if (it->second.empty()) {
+        match->in_flight.erase(it);
+    }
+    match->in_flight[trace_match_key_of(event->bus ^ 1, &event->msg)].push_back(pending);
+}
+
+/**
+* @brief A TRACE_SENT record: returns the oldest forwarded frame it transmits, false if there is none
+* (held latest values, feedback frames, or frames whose records were lost).
+*/
+bool trace_match_sent(struct trace_match *match, const struct trace_event *event, struct trace_match_pending *pending) {
+    auto it = match->in_flight.find(trace_match_key_of(event->bus, &event->msg));
+    if (it == match->in_flight.end() || it->second.empty()) {
+        return false;
+    }
+    *pending = it->second.front();
+    it->second.pop_front();
+    if (it->second.empty()) {
+        match->in_flight.erase(it);
+    }
+    return true;
+}
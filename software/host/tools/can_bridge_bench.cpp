@@ -0,0 +1,2411 @@
+/**
+* DESCRIPTION: Forwarding benchmark for the CAN bridge on the host.
+* Pushes synthetic (and optionally recorded candump) traffic through can_rx_callback
+* for every filter mode and reports throughput, mean and worst-case cost per frame.
+*
+* Usage: can_bridge_bench [--frames N] [--list-size N] [--rules N] [--repeat N] [--trace file.log]
+*                         [--csv out.csv] [--compare baseline.csv] [--tolerance pct]
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "bridge_host.h"
+#include "candump.h"
+#include "sim_bus.h"
+#include "sim_can.h"
+#include "sim_flash.h"
+#include "hardware/flash.h"
+#include "hardware/regs/addressmap.h"
+#include "sim_pico.h"
+#include "hardware/timer.h"
+#include "trace_match.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct bench_mode {
+    const char *name;
+    uint8_t command_mode;       //CONTROL_ID command that selects the mode
+    bool list_based;            //Whether the mode takes an ID list
+};
+
+static const bench_mode bench_modes[] = {
+    {"passive",             PASSIVE_MODE,               false},
+    {"whitelist",           WHITELIST_MODE,             true},
+    {"blacklist",           BLACKLIST_MODE,             true},
+    {"zero_to_one",         ONE_WAY_ZERO_TO_ONE_MODE,   false},
+    {"one_to_zero",         ONE_WAY_ONE_TO_ZERO_MODE,   false},
+    {"ow_1_to_0_blacklist", OW_1_TO_0_BLACKLIST_MODE,   true},
+    {"ow_1_to_0_whitelist", OW_1_TO_0_WHITELIST_MODE,   true},
+    {"ow_0_to_1_blacklist", OW_0_TO_1_BLACKLIST_MODE,   true},
+    {"ow_0_to_1_whitelist", OW_0_TO_1_WHITELIST_MODE,   true},
+    {"ow_1_to_0_except",    OW_1_TO_0_EXCEPT_MODE,      true},
+    {"ow_0_to_1_except",    OW_0_TO_1_EXCEPT_MODE,      true},
+    {"bi_except_ow_1_to_0", BI_EXCEPT_OW_1_TO_0_MODE,   true},
+    {"bi_except_ow_0_to_1", BI_EXCEPT_OW_0_TO_1_MODE,   true},
+    {"j1939_whitelist",     J1939_WHITELIST_MODE,       true},
+    {"j1939_blacklist",     J1939_BLACKLIST_MODE,       true},
+};
+
+struct bench_frame {
+    uint8_t iface;
+    struct can2040_msg msg;
+};
+
+struct bench_result {
+    std::string mode;
+    std::string traffic;
+    uint32_t frames;
+    uint32_t forwarded;
+    double ns_per_frame;
+    double frames_per_s;
+    double p99_ns;
+    double max_ns;
+};
+
+static uint32_t rng_state = 0x2545F491;
+static uint32_t bench_repeat = 5;
+static uint32_t bench_rules = 0;
+
+struct bench_rule {
+    bool is_range;
+    uint32_t a;         //value or lo
+    uint32_t b;         //mask or hi
+};
+static std::vector<bench_rule> rule_list;
+
+/**
+* @brief J1939 style rules: PGN masks (any priority/source) over 4 masks, and PGN/source ranges.
+*/
+static void make_rules(uint32_t count) {
+    static const uint32_t masks[] = {
+        CAN2040_ID_EFF | 0x03FFFF00,    //PGN, any priority and source
+        CAN2040_ID_EFF | 0x03FF0000,    //PDU1 PGN, any destination and source
+        CAN2040_ID_EFF | 0x000000FF,    //Source address
+        0x7F0,                          //Block of 16 standard IDs
+    };
+    rule_list.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        bench_rule r;
+        if (i % 2 == 0) {
+            r.is_range = false;
+            r.b = masks[(i / 2) % 4];
+            r.a = (CAN2040_ID_EFF | (0x00FE0000u + i * 0x1100u) | (i & 0xFF) | ((i & 0xF) << 4)) & r.b;
+            if (!(r.b & CAN2040_ID_EFF)) {
+                r.a = (0x200 + i * 16) & r.b;
+            }
+        } else {
+            r.is_range = true;
+            r.a = CAN2040_ID_EFF | (0x0CF00000u + i * 0x4000u);
+            r.b = r.a + 0x1FFF;
+        }
+        rule_list.push_back(r);
+    }
+}
+
+static bool naive_rule_match(uint32_t id) {
+    for (const bench_rule &r : rule_list) {
+        if (r.is_range ? (id >= r.a && id <= r.b) : ((id & r.b) == r.a)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t bench_rand(void) {     //xorshift32, fixed seed so every run sees the same traffic
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+* @brief IDs loaded into the filter lists. Half standard, half extended (with the EFF flag).
+*/
+static std::vector<uint32_t> make_list_ids(uint32_t count) {
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (i % 2 == 0) {
+            ids.push_back(0x100 + i * 7);
+        } else {
+            ids.push_back(CAN2040_ID_EFF | (0x18FF0000u + i * 13));
+        }
+    }
+    return ids;
+}
+
+/**
+* @brief Synthetic traffic: half of the frames hit a listed ID, the rest are random IDs.
+*/
+static std::vector<bench_frame> make_synthetic(uint32_t frames, const std::vector<uint32_t> &list_ids) {
+    std::vector<bench_frame> out(frames);
+    for (uint32_t i = 0; i < frames; ++i) {
+        bench_frame &f = out[i];
+        memset(&f, 0, sizeof(f));
+        f.iface = (uint8_t)(bench_rand() & 1);
+        uint32_t r = bench_rand();
+        if ((r & 1) && !list_ids.empty()) {
+            f.msg.id = list_ids[(r >> 1) % list_ids.size()];
+        } else if ((r & 4) && !rule_list.empty()) {
+            const bench_rule &rule = rule_list[(r >> 3) % rule_list.size()];
+            f.msg.id = rule.is_range ? rule.a + ((r >> 8) % (rule.b - rule.a + 1)) : (rule.a | ((r >> 8) & ~rule.b));
+        } else if (r & 2) {
+            f.msg.id = CAN2040_ID_EFF | ((r >> 3) & 0x1FFFFFFF);
+        } else {
+            f.msg.id = (r >> 3) & 0x7FF;
+            if (f.msg.id == CONTROL_ID || f.msg.id == FEEDBACK_ID) {
+                f.msg.id = 0x123;
+            }
+        }
+        f.msg.dlc = bench_rand() % 9;
+        uint32_t d0 = bench_rand();
+        uint32_t d1 = bench_rand();
+        memcpy(&f.msg.data[0], &d0, 4);
+        memcpy(&f.msg.data[4], &d1, 4);
+    }
+    return out;
+}
+
+/**
+* @brief Puts the bridge in a mode with a fresh list via the CONTROL_ID protocol.
+*/
+static void configure_mode(const bench_mode &mode, const std::vector<uint32_t> &list_ids) {
+    if (!mode.list_based) {
+        host_send_command(mode.command_mode, 0, 0, 0);
+        return;
+    }
+    host_send_command(mode.command_mode, SET_MODE_AND_CLEAR, 0, 0);
+    bool j1939 = mode.command_mode == J1939_WHITELIST_MODE || mode.command_mode == J1939_BLACKLIST_MODE;
+    for (uint32_t id : list_ids) {
+        if (!j1939) {
+            host_send_command(mode.command_mode, ADD_ID, 0, id);
+        } else if (id & CAN2040_ID_EFF) {                           //The PGN of the listed ID, any source
+            host_send_command(mode.command_mode, ADD_ID, J1939_PGN, (id >> 8) & J1939_PGN_MASK);
+        } else {
+            host_send_command(mode.command_mode, ADD_ID, J1939_SOURCE, id & 0xFF);
+        }
+    }
+
+    uint8_t rule_list_code = RULE_LIST_WHITELIST;
+    if (mode.command_mode == BLACKLIST_MODE || mode.command_mode == OW_1_TO_0_BLACKLIST_MODE ||
+        mode.command_mode == OW_0_TO_1_BLACKLIST_MODE) {
+        rule_list_code = RULE_LIST_BLACKLIST;
+    } else if (mode.command_mode == OW_1_TO_0_EXCEPT_MODE || mode.command_mode == OW_0_TO_1_EXCEPT_MODE) {
+        rule_list_code = RULE_LIST_EXCEPTION;
+    } else if (mode.command_mode == BI_EXCEPT_OW_0_TO_1_MODE || mode.command_mode == BI_EXCEPT_OW_1_TO_0_MODE) {
+        rule_list_code = RULE_LIST_ONE_WAY;
+    } else if (j1939) {
+        rule_list_code = RULE_LIST_J1939;
+    }
+    for (const bench_rule &r : rule_list) {
+        host_send_command(RULE_COMMAND, RULE_SET_VALUE, rule_list_code, r.a);
+        host_send_command(RULE_COMMAND, r.is_range ? RULE_ADD_RANGE : RULE_ADD_MASK, rule_list_code, r.b);
+    }
+}
+
+#define BENCH_FRAME_GAP_US 100     //Simulated time between two received frames
+
+#if CAN_BRIDGE_ISR_BUDGET
+static struct isr_budget bench_budget;      //Worst receive path of each route kind over every case
+#endif
+
+/**
+* @brief One frame through the whole path: RX interrupt on the owner core of the receiving bus,
+* then the owner core of the other bus drains its queue.
+*/
+static inline void run_frame(const bench_frame &f) {
+    sim_time_advance_us(BENCH_FRAME_GAP_US);
+    struct can2040_msg msg = f.msg;
+    uint8_t other = f.iface ^ 1;
+    sim_set_core(f.iface == CAN_IFACE0 ? CAN_IFACE0_CORE : CAN_IFACE1_CORE);
+    can_rx_callback(sim_can_bus(f.iface), msg.id, (uint8_t)msg.dlc, msg.data);
+    sim_set_core(other == CAN_IFACE0 ? CAN_IFACE0_CORE : CAN_IFACE1_CORE);
+    bridge_service(other);
+}
+
+static bench_result run_case(const bench_mode &mode, const char *traffic_name,
+                             const std::vector<bench_frame> &traffic, const std::vector<uint32_t> &list_ids) {
+    sim_can_reset();
+    bridge_init();
+    configure_mode(mode, list_ids);
+
+    for (size_t i = 0; i < traffic.size() && i < 4096; ++i) {     //Warm up caches and branch predictors
+        run_frame(traffic[i]);
+    }
+
+    //Pass 1: throughput over the whole batch, best of bench_repeat runs to keep the numbers stable
+    uint32_t forwarded = 0;
+    double total_ns = 0.0;
+    for (uint32_t run = 0; run < bench_repeat; ++run) {
+        uint32_t tx_before = sim_can_tx_count(0) + sim_can_tx_count(1);
+        bench_clock::time_point start = bench_clock::now();
+        for (const bench_frame &f : traffic) {
+            run_frame(f);
+        }
+        bench_clock::time_point end = bench_clock::now();
+        double run_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        if (run == 0) {
+            forwarded = sim_can_tx_count(0) + sim_can_tx_count(1) - tx_before;
+        }
+        if (run == 0 || run_ns < total_ns) {
+            total_ns = run_ns;
+        }
+    }
+
+    //Pass 2: per frame timing for the tail
+    std::vector<double> samples(traffic.size());
+    for (size_t i = 0; i < traffic.size(); ++i) {
+        bench_clock::time_point t0 = bench_clock::now();
+        run_frame(traffic[i]);
+        bench_clock::time_point t1 = bench_clock::now();
+        samples[i] = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    }
+    std::sort(samples.begin(), samples.end());
+
+#if CAN_BRIDGE_ISR_BUDGET
+    for (uint8_t iface = 0; iface < 2; ++iface) {
+        const struct isr_budget *budget = bridge_isr_budget(iface);
+        for (uint8_t kind = 0; kind < ROUTE_KINDS; ++kind) {
+            bench_budget.worst[kind] = std::max(bench_budget.worst[kind], budget->worst[kind]);
+            bench_budget.frames[kind] += budget->frames[kind];
+        }
+    }
+#endif
+
+    bench_result r;
+    r.mode = mode.name;
+    r.traffic = traffic_name;
+    r.frames = (uint32_t)traffic.size();
+    r.forwarded = forwarded;
+    r.ns_per_frame = traffic.empty() ? 0.0 : total_ns / (double)traffic.size();
+    r.frames_per_s = total_ns > 0.0 ? (double)traffic.size() * 1e9 / total_ns : 0.0;
+    r.p99_ns = samples.empty() ? 0.0 : samples[(samples.size() * 99) / 100];
+    r.max_ns = samples.empty() ? 0.0 : samples.back();
+    return r;
+}
+
+typedef bool (*bench_decision_fn)(uint32_t id, uint8_t rx_interface_id);
+
+#define BENCH_DECISION_MIN_FRAMES   50000   //Per timed run, so a few ns per frame still add up to a stable time
+#define BENCH_DECISION_NOISE        1.05    //Paired runs of one same decision agree within 5%
+#define BENCH_DECISION_TRIES        3       //Measurements of a case before it counts as slower, a busy moment of the host lasts seconds
+
+/**
+* @brief Runs a filter decision over the traffic, looped up to BENCH_DECISION_MIN_FRAMES.
+* Returns the ns per frame, adds the forwarded frames to hits.
+*/
+static double decision_time(bench_decision_fn decide, const std::vector<bench_frame> &traffic, uint32_t *hits) {
+    uint32_t passes = (BENCH_DECISION_MIN_FRAMES + (uint32_t)traffic.size() - 1) / (uint32_t)traffic.size();
+    bench_clock::time_point t0 = bench_clock::now();
+    for (uint32_t pass = 0; pass < passes; ++pass) {
+        for (const bench_frame &f : traffic) {
+            *hits += decide(f.msg.id, f.iface);
+        }
+    }
+    bench_clock::time_point t1 = bench_clock::now();
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / ((double)traffic.size() * passes);
+}
+
+/**
+* @brief Times the routes and the switch in back to back pairs, taking turns running first so neither
+* always gets the traffic warm from the other. Returns the median routes/switch time of the pairs, which
+* a slow moment of the machine moves much less than the times themselves; keeps the fastest times.
+*/
+static double decision_ratio(const std::vector<bench_frame> &traffic, double *route_ns, double *switch_ns,
+                             uint32_t *route_hits, uint32_t *switch_hits) {
+    std::vector<double> ratios;
+    for (uint32_t run = 0; run < 4 * bench_repeat; ++run) {
+        double r, w;
+        if (run & 1) {
+            w = decision_time(bridge_filter_reference, traffic, switch_hits);
+            r = decision_time(bridge_filter_decision, traffic, route_hits);
+        } else {
+            r = decision_time(bridge_filter_decision, traffic, route_hits);
+            w = decision_time(bridge_filter_reference, traffic, switch_hits);
+        }
+        if (*route_ns == 0.0 || r < *route_ns) *route_ns = r;
+        if (*switch_ns == 0.0 || w < *switch_ns) *switch_ns = w;
+        ratios.push_back(w > 0.0 ? r / w : 1.0);
+    }
+    std::sort(ratios.begin(), ratios.end());
+    return ratios[ratios.size() / 2];
+}
+
+/**
+* @brief Times the filter decision alone: compiled routes (the receive path) against the mode switch.
+* Returns false if the two disagree on any frame, or if the routes are slower: more than
+* BENCH_DECISION_NOISE over the switch, in all of BENCH_DECISION_TRIES measurements.
+*/
+static bool run_decision_case(const bench_mode &mode, const std::vector<bench_frame> &traffic,
+                              const std::vector<uint32_t> &list_ids, double *route_ns, double *switch_ns,
+                              double *ratio) {
+    sim_can_reset();
+    bridge_init();
+    configure_mode(mode, list_ids);
+
+    uint32_t route_hits = 0;
+    uint32_t switch_hits = 0;
+    bool match = true;
+    for (const bench_frame &f : traffic) {
+        if (bridge_filter_decision(f.msg.id, f.iface) != bridge_filter_reference(f.msg.id, f.iface)) {
+            match = false;
+        }
+    }
+
+    *route_ns = 0.0;
+    *switch_ns = 0.0;
+    *ratio = decision_ratio(traffic, route_ns, switch_ns, &route_hits, &switch_hits);
+    for (uint32_t tries = 1; tries < BENCH_DECISION_TRIES && *ratio > BENCH_DECISION_NOISE; ++tries) {
+        *ratio = std::min(*ratio, decision_ratio(traffic, route_ns, switch_ns, &route_hits, &switch_hits));
+    }
+    return match && route_hits == switch_hits && *ratio <= BENCH_DECISION_NOISE;
+}
+
+static std::vector<struct can2040_msg> echo_sent;
+
+static void echo_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)ctx;
+    if (iface == CAN_IFACE1) {
+        echo_sent.push_back(*msg);
+    }
+}
+
+/**
+* @brief Echo suppression checks in passive mode:
+* a burst of distinct frames bridged 0->1 and looped back on CAN1 must all be dropped, and a node on CAN1
+* repeating a bridged payload outside the echo window must still be forwarded.
+*/
+static bool run_echo_checks(void) {
+    const uint32_t burst = 32;      //Sent back to back, looped back once the whole burst is out
+    sim_can_reset();
+    bridge_init();
+    echo_sent.clear();
+    sim_can_set_tx_hook(echo_capture, NULL);
+
+    for (uint32_t i = 0; i < burst; ++i) {
+        bench_frame f;
+        memset(&f, 0, sizeof(f));
+        f.iface = CAN_IFACE0;
+        f.msg.id = 0x200 + i;
+        f.msg.dlc = 8;
+        f.msg.data[0] = (uint8_t)i;
+        run_frame(f);
+    }
+    uint32_t back_before = sim_can_tx_count(CAN_IFACE0);
+    std::vector<struct can2040_msg> looped = echo_sent;
+    for (const struct can2040_msg &m : looped) {
+        bench_frame f;
+        f.iface = CAN_IFACE1;
+        f.msg = m;
+        run_frame(f);
+    }
+    uint32_t leaked = sim_can_tx_count(CAN_IFACE0) - back_before;
+
+    uint32_t periodic_forwarded = 0;
+    for (uint32_t i = 0; i < 20; ++i) {
+        bench_frame f;
+        memset(&f, 0, sizeof(f));
+        f.msg.id = 0x321;
+        f.msg.dlc = 2;
+        f.msg.data[0] = 0xAB;
+        f.iface = CAN_IFACE0;
+        run_frame(f);
+        sim_time_advance_us(10000);
+        f.iface = CAN_IFACE1;
+        uint32_t before = sim_can_tx_count(CAN_IFACE0);
+        run_frame(f);
+        periodic_forwarded += sim_can_tx_count(CAN_IFACE0) - before;
+        sim_time_advance_us(10000);
+    }
+    sim_can_set_tx_hook(NULL, NULL);
+
+    printf("\necho: burst of %u looped back, %u leaked; periodic repeats outside the window %u/20 forwarded\n",
+           (unsigned)looped.size(), leaked, periodic_forwarded);
+    return looped.size() == burst && leaked == 0 && periodic_forwarded == 20;
+}
+
+static std::vector<uint32_t> wire_ids;
+
+static void wire_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)ctx;
+    if (iface == CAN_IFACE1) {
+        wire_ids.push_back(msg->id);
+    }
+}
+
+static void sched_frame(uint32_t id) {
+    bench_frame f;
+    memset(&f, 0, sizeof(f));
+    f.iface = CAN_IFACE0;
+    f.msg.id = id;
+    f.msg.dlc = 8;
+    run_frame(f);
+}
+
+/**
+* @brief Puts every frame waiting for CAN1 on the (paced) wire, one at a time.
+*/
+static void sched_drain(void) {
+    while (true) {
+        sim_set_core(CAN_IFACE1_CORE);
+        bridge_service(CAN_IFACE1);
+        if (sim_can_wire_step(CAN_IFACE1, 1) == 0) {
+            break;
+        }
+    }
+}
+
+/**
+* @brief Transmit scheduler checks on a paced (congested) CAN1:
+* a high priority frame queued behind a backlog of telemetry goes out after at most TX_SCHED_HW_DEPTH frames,
+* a full pool drops the lowest priority frames, and frames past their deadline are dropped instead of sent.
+*/
+static bool run_sched_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    sim_can_set_paced(CAN_IFACE1, true);
+    sim_can_set_tx_hook(wire_capture, NULL);
+
+    wire_ids.clear();
+    for (uint32_t i = 0; i < 20; ++i) {
+        sched_frame(0x600 + (i & 3));
+    }
+    sched_frame(0x010);
+    sched_drain();
+    size_t urgent_pos = std::find(wire_ids.begin(), wire_ids.end(), 0x010u) - wire_ids.begin();
+    bool same_id_in_order = true;
+    for (size_t i = 0, last = 0; i < wire_ids.size(); ++i) {
+        if (wire_ids[i] == 0x600) {
+            same_id_in_order = same_id_in_order && i >= last;
+            last = i;
+        }
+    }
+
+    wire_ids.clear();
+    const uint32_t burst = TX_SCHED_DEFAULT_CAPACITY + TX_SCHED_HW_DEPTH + 16;
+    for (uint32_t i = 0; i < burst; ++i) {
+        sched_frame(0x100 + ((i * 37) % burst));            //Every ID once, mixed order
+    }
+    uint32_t overflow_drops = bridge_tx_scheduler(CAN_IFACE1)->overflow_drops;
+    sched_drain();
+    uint32_t highest_sent = wire_ids.empty() ? 0 : *std::max_element(wire_ids.begin() + TX_SCHED_HW_DEPTH, wire_ids.end());
+
+    wire_ids.clear();
+    host_send_command(SCHED_COMMAND, SCHED_SET_ID, 0, 0x650);
+    host_send_command(SCHED_COMMAND, SCHED_SET_DEADLINE, 0, 2000);
+    for (uint32_t i = 0; i < 10; ++i) {
+        sched_frame(0x650);
+    }
+    sim_time_advance_us(5000);
+    sched_drain();
+    uint32_t expired = bridge_tx_scheduler(CAN_IFACE1)->expired;
+
+    sim_can_set_tx_hook(NULL, NULL);
+    sim_can_set_paced(CAN_IFACE1, false);
+
+    printf("\nsched: urgent frame was number %u on the wire after a backlog of 20, overflow dropped %u (highest ID sent 0x%03X), "
+           "%u/10 stale frames expired\n", (unsigned)urgent_pos + 1, overflow_drops, highest_sent, expired);
+    return urgent_pos <= TX_SCHED_HW_DEPTH && same_id_in_order && overflow_drops == burst - TX_SCHED_DEFAULT_CAPACITY - TX_SCHED_HW_DEPTH
+        && highest_sent < 0x100 + TX_SCHED_DEFAULT_CAPACITY + TX_SCHED_HW_DEPTH && expired == 10 - TX_SCHED_HW_DEPTH;
+}
+
+/**
+* @brief Frame pool checks: a backlog on a paced CAN1 uses a fixed number of pool frames and gives every one
+* back once the bus drained, frames waiting for the other core beyond the pool are counted as exhausted,
+* and a held latest value keeps its frame (and only it) until it is forwarded.
+*/
+static bool run_pool_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    const struct frame_pool *pool0 = &frame_pools[CAN_IFACE0_CORE];
+
+    sim_can_set_paced(CAN_IFACE1, true);
+    for (uint32_t i = 0; i < 3 * TX_SCHED_DEFAULT_CAPACITY; ++i) {
+        sched_frame(0x100 + (i & 0xFF));
+    }
+    uint32_t backlog_in_use = frame_pool_in_use(pool0);
+    sched_drain();
+    host_service_all();
+    uint32_t drained_in_use = frame_pool_in_use(pool0);
+    sim_can_set_paced(CAN_IFACE1, false);
+
+    const uint32_t burst = FRAME_POOL_SIZE + 10;
+    uint32_t before = sim_can_tx_count(CAN_IFACE1);
+    sim_set_core(CAN_IFACE0_CORE);
+    for (uint32_t i = 0; i < burst; ++i) {              //CAN1's core is busy: everything waits in the queue
+        struct can2040_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.id = 0x200;
+        msg.dlc = 2;
+        msg.data[0] = (uint8_t)i;
+        msg.data[1] = (uint8_t)(i >> 8);
+        sim_time_advance_us(BENCH_FRAME_GAP_US);
+        can_rx_callback(sim_can_bus(CAN_IFACE0), msg.id, (uint8_t)msg.dlc, msg.data);
+    }
+    uint32_t exhausted = pool0->exhausted;
+    host_service_all();
+    host_service_all();
+    uint32_t burst_sent = sim_can_tx_count(CAN_IFACE1) - before;
+    uint32_t burst_in_use = frame_pool_in_use(pool0);
+
+    host_send_command(FORWARD_COMMAND, FORWARD_SET_ID, 0, 0x300);
+    host_send_command(FORWARD_COMMAND, FORWARD_DOWNSAMPLE, 0, 50);
+    bench_frame f;
+    memset(&f, 0, sizeof(f));
+    f.iface = CAN_IFACE0;
+    f.msg.id = 0x300;
+    f.msg.dlc = 8;
+    run_frame(f);                                       //Forwarded, starts the interval
+    f.msg.data[0] = 1;
+    run_frame(f);
+    f.msg.data[0] = 2;
+    run_frame(f);                                       //Replaces the held value
+    host_service_all();
+    uint32_t held_in_use = frame_pool_in_use(pool0);
+    sim_time_advance_us(60000);
+    host_service_all();
+    host_service_all();
+    uint32_t flushed_in_use = frame_pool_in_use(pool0);
+
+    f.msg.data[0] = 3;
+    run_frame(f);                                       //Held again, then the policy is removed in a transaction
+    host_send_command(CONFIG_COMMAND, CONFIG_BEGIN, 0, 0);
+    host_send_command(FORWARD_COMMAND, FORWARD_EVERY_FRAME, 0, 0);
+    uint32_t staged_in_use = frame_pool_in_use(pool0);
+    before = sim_can_tx_count(CAN_IFACE1);
+    host_send_command(CONFIG_COMMAND, CONFIG_COMMIT, 0, 0);
+    uint32_t dropped_in_use = frame_pool_in_use(pool0);
+    f.msg.data[0] = 4;
+    run_frame(f);
+    host_service_all();
+    uint32_t removed_sent = sim_can_tx_count(CAN_IFACE1) - before;
+
+    printf("\npool: %u of %u frames used by a backlog of %u, %u after draining, burst of %u: %u sent, %u exhausted, "
+           "held value %u frame, %u after its interval, %u while its removal is staged, %u once committed, "
+           "%u bytes per core\n",
+           backlog_in_use, FRAME_POOL_SIZE, 3 * TX_SCHED_DEFAULT_CAPACITY, drained_in_use, burst, burst_sent, exhausted,
+           held_in_use, flushed_in_use, staged_in_use, dropped_in_use, (unsigned)sizeof(struct frame_pool));
+    return backlog_in_use <= TX_SCHED_DEFAULT_CAPACITY + TX_SCHED_HW_DEPTH && drained_in_use == 0
+        && exhausted == burst - FRAME_POOL_SIZE && burst_sent == FRAME_POOL_SIZE && burst_in_use == 0
+        && held_in_use == 1 && flushed_in_use == 0 && staged_in_use == 1 && dropped_in_use == 0
+        && removed_sent == 1;                           //The held value is dropped, the next frame passes
+}
+
+static void bus_bench_callback(struct can2040 *cd, uint32_t notify, struct can2040_msg *msg) {
+    if (notify == CAN2040_NOTIFY_RX) {
+        can_rx_callback(cd, msg->id, (uint8_t)msg->dlc, msg->data);
+    } else if (notify == CAN2040_NOTIFY_TX) {
+        bridge_tx_complete(cd, msg);
+    } else if (notify == CAN2040_NOTIFY_ERROR) {
+        bridge_error_notify(cd);
+    }
+}
+
+static uint32_t load_low_sent;
+static uint32_t load_high_sent;
+static uint32_t load_peak_reply;
+
+static void load_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)ctx;
+    struct host_feedback feedback;
+    if (iface == CAN_IFACE1 && msg->id == 0x6F0) {
+        load_low_sent++;
+    } else if (iface == CAN_IFACE1 && msg->id == 0x100) {
+        load_high_sent++;
+    } else if (host_feedback_decode(msg, &feedback) && feedback.item == FEEDBACK_LOAD_PEAK) {
+        load_peak_reply = feedback.value;
+    }
+}
+
+/**
+* @brief Every period_us for duration_us: 0x100 and 0x6F0 received on CAN0, and if busy a frame of another
+* node on CAN1. The forwarded frames count towards CAN1's load too once on its (paced) wire.
+*/
+static void load_run(uint32_t period_us, uint32_t duration_us, bool busy) {
+    for (uint32_t t = 0, n = 0; t < duration_us; t += period_us, ++n) {
+        bench_frame f;
+        memset(&f, 0, sizeof(f));
+        f.msg.dlc = 8;
+        f.msg.data[0] = (uint8_t)n;
+        f.msg.data[1] = (uint8_t)(n >> 8);
+        f.iface = CAN_IFACE0;
+        f.msg.id = 0x100;
+        run_frame(f);
+        f.msg.id = 0x6F0;
+        run_frame(f);
+        if (busy) {
+            f.iface = CAN_IFACE1;
+            f.msg.id = 0x050;
+            run_frame(f);
+        }
+        sched_drain();
+        sim_time_advance_us(period_us - (busy ? 3 : 2) * BENCH_FRAME_GAP_US);
+        host_service_all();
+    }
+}
+
+/**
+* @brief Load shedding checks on CAN1 at 125 kbit/s, shedding 0x600 and up from 70 %:
+* one second with about 98 % of the bus used (65 % while shedding) sheds the low priority frames after the first window and keeps
+* the others, one second at about 43 % forwards them again after the first window.
+*/
+static bool run_load_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    canbus_setup1(0, 0, 125000, bus_bench_callback);       //Frames on the wire notify the bridge
+    sim_can_set_tx_hook(load_capture, NULL);
+    sim_can_set_paced(CAN_IFACE1, true);
+    host_send_command(LOAD_COMMAND, LOAD_SET_THRESHOLD, CAN_IFACE1, 700);
+    host_send_command(LOAD_COMMAND, LOAD_SET_CLASS, CAN_IFACE1, 0x600);
+
+    load_low_sent = 0;
+    load_high_sent = 0;
+    load_run(3300, 1000000, true);                      //3 frames of 135 bits every 3.3 ms, 2 while shedding
+    uint32_t busy_low = load_low_sent, busy_high = load_high_sent;
+    uint32_t busy_load = bridge_bus_load(CAN_IFACE1)->load_permille;
+    bool busy_shedding = bridge_bus_load(CAN_IFACE1)->shedding.load();
+
+    load_low_sent = 0;
+    load_high_sent = 0;
+    load_run(5000, 1000000, false);
+    uint32_t quiet_low = load_low_sent, quiet_high = load_high_sent;
+    uint32_t quiet_load = bridge_bus_load(CAN_IFACE1)->load_permille;
+    bool quiet_shedding = bridge_bus_load(CAN_IFACE1)->shedding.load();
+
+    load_peak_reply = 0;
+    host_send_command(LOAD_COMMAND, LOAD_QUERY, CAN_IFACE1, 0);
+    host_service_all();
+    sim_can_set_tx_hook(NULL, NULL);
+    sim_can_set_paced(CAN_IFACE1, false);
+
+    const uint32_t busy_frames = 1000000 / 3300 + 1, quiet_frames = 1000000 / 5000;
+    printf("\nload: CAN1 at %u permille sheds (%u/%u low priority frames sent, %u/%u high), at %u permille restores "
+           "(%u/%u low sent), peak reported %u permille\n", busy_load, busy_low, busy_frames, busy_high, busy_frames,
+           quiet_load, quiet_low, quiet_frames, load_peak_reply);
+    return busy_shedding && busy_load >= 600 && busy_high == busy_frames && busy_low * 8 < busy_frames
+        && !quiet_shedding && quiet_load < 600 && quiet_high == quiet_frames && quiet_low * 10 >= quiet_frames * 9
+        && load_peak_reply >= busy_load;
+}
+
+/**
+* @brief A back to back burst of frames received on CAN0 and forwarded to a paced CAN1, which puts one
+* frame on its wire for every ratio frames of CAN0. Returns the frames sent on CAN1; *drops gets the
+* overflow drops of its scheduler.
+*/
+static uint32_t burst_run(uint32_t frames, uint32_t ratio, uint32_t *drops) {
+    sim_can_reset();
+    bridge_init();
+    canbus_setup1(0, 0, 125000, bus_bench_callback);
+    sim_can_set_paced(CAN_IFACE1, true);
+    uint32_t before = sim_can_tx_count(CAN_IFACE1);
+    for (uint32_t i = 0; i < frames; ++i) {
+        bench_frame f;
+        memset(&f, 0, sizeof(f));
+        f.iface = CAN_IFACE0;
+        f.msg.id = 0x120;
+        f.msg.dlc = 8;
+        f.msg.data[0] = (uint8_t)i;
+        f.msg.data[1] = (uint8_t)(i >> 8);
+        run_frame(f);
+        if (i % ratio == ratio - 1) {
+            sim_can_wire_step(CAN_IFACE1, 1);
+        }
+    }
+    sched_drain();
+    *drops = bridge_tx_scheduler(CAN_IFACE1)->overflow_drops;
+    sim_can_set_paced(CAN_IFACE1, false);
+    return sim_can_tx_count(CAN_IFACE1) - before;
+}
+
+/**
+* @brief Burst buffering checks, CAN0 at 500 kbit/s and CAN1 at 125 kbit/s: a burst of 120 frames
+* (about 27 ms of CAN0) builds up a backlog of 90 frames towards CAN1, lost beyond TX_SCHED_DEFAULT_CAPACITY
+* with equal bitrates but absorbed by the burst buffer sized from the ratio.
+*/
+static bool run_burst_checks(void) {
+    const uint32_t burst = 120;
+    uint32_t equal_drops, buffered_drops;
+    uint32_t equal_sent = burst_run(burst, 4, &equal_drops);
+
+    bridge_set_bitrate(CAN_IFACE0, 500000);
+    bridge_set_bitrate(CAN_IFACE1, 125000);
+    uint32_t buffered_sent = burst_run(burst, 4, &buffered_drops);
+    uint32_t capacity = bridge_tx_scheduler(CAN_IFACE1)->capacity;
+    uint32_t reverse_capacity = bridge_tx_scheduler(CAN_IFACE0)->capacity;
+    uint32_t bitrate_reply = bridge_bus_load(CAN_IFACE0)->bitrate;
+    bridge_set_bitrate(CAN_IFACE0, LOAD_DEFAULT_BITRATE);      //Wiring outlives bridge_init(), restore it for the other checks
+    bridge_init();
+
+    printf("\nburst: %u frames from a bus 4x faster, %u sent (%u dropped) with equal bitrates, %u sent (%u dropped) "
+           "with a %u frame burst buffer at 500/125 kbit/s\n", burst, equal_sent, equal_drops, buffered_sent,
+           buffered_drops, capacity);
+    return equal_drops > 0 && equal_sent + equal_drops == burst && buffered_drops == 0 && buffered_sent == burst
+        && capacity == tx_sched_burst_capacity(500000, 125000) && capacity > TX_SCHED_DEFAULT_CAPACITY
+        && reverse_capacity == TX_SCHED_DEFAULT_CAPACITY && bitrate_reply == 500000;
+}
+
+static std::vector<struct can2040_msg> health_sent;
+
+static void health_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)ctx;
+    if (iface == CAN_IFACE1) {
+        health_sent.push_back(*msg);
+    }
+}
+
+/**
+* @brief Forwards one frame of an ID to CAN1 carrying value, then lets both cores run.
+*/
+static void health_frame(uint32_t id, uint8_t value) {
+    bench_frame f;
+    memset(&f, 0, sizeof(f));
+    f.iface = CAN_IFACE0;
+    f.msg.id = id;
+    f.msg.dlc = 8;
+    f.msg.data[0] = value;
+    f.msg.data[1] = (uint8_t)id;
+    run_frame(f);
+}
+
+/**
+* @brief Advances the time by duration_us in steps, servicing both cores.
+*/
+static void health_wait(uint32_t duration_us) {
+    for (uint32_t t = 0; t < duration_us; t += 5000) {
+        sim_time_advance_us(5000);
+        host_service_all();
+    }
+}
+
+/**
+* @brief Store-and-forward checks on a paced CAN1:
+* a harness that stops acknowledging marks the bus down after HEALTH_TX_TIMEOUT_US, the frames for it keep only
+* their latest value per ID, an ID with a 20 ms TTL is dropped, and once a frame goes out again every held ID
+* is sent once with its latest value; HEALTH_ERROR_LIMIT controller errors also mark it down, and the periodic
+* probe (or a frame received on the bus) brings it back.
+*/
+static bool run_health_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    canbus_setup1(0, 0, 125000, bus_bench_callback);
+    sim_can_set_paced(CAN_IFACE1, true);
+    sim_can_set_tx_hook(health_capture, NULL);
+    host_send_command(HEALTH_COMMAND, HEALTH_SET_ID, 0, 0x20F);
+    host_send_command(HEALTH_COMMAND, HEALTH_SET_TTL, 0, 20000);
+    const struct bus_health *health = bridge_bus_health(CAN_IFACE1);
+    const struct outage_buffer *buffer = bridge_outage_buffer(CAN_IFACE1);
+
+    for (uint8_t round = 0; round < 3; ++round) {           //Nobody acknowledges: nothing leaves the controller
+        for (uint32_t id = 0x200; id <= 0x209; ++id) {
+            health_frame(id, round);
+        }
+        health_frame(0x20F, round);
+    }
+    bool up_while_waiting = !health->down;
+    health_wait(HEALTH_TX_TIMEOUT_US + 10000);
+    bool stalled_down = health->down;
+    uint32_t held = buffer->count;
+    for (uint32_t id = 0x200; id <= 0x209; ++id) {          //Newer values while the bus is down
+        health_frame(id, 3);
+    }
+    health_frame(0x20F, 3);
+    health_wait(30000);                                     //Past the TTL of 0x20F only
+
+    health_sent.clear();
+    sim_can_wire_step(CAN_IFACE1, 1);                       //The harness is back
+    bool recovered = !health->down;
+    sched_drain();
+    uint32_t latest = 0, stale = 0, short_ttl = 0;
+    for (size_t i = 0; i < health_sent.size(); ++i) {
+        if (health_sent[i].id == 0x20F) {
+            short_ttl++;
+        } else if (health_sent[i].data[0] == 3) {
+            latest++;
+        } else {
+            stale++;                                        //Only the frames that were already on the controller
+        }
+    }
+    uint32_t stalled_expired = buffer->expired;
+    uint32_t outage_us = health->longest_outage_us;
+
+    for (uint8_t i = 0; i < HEALTH_ERROR_LIMIT - 1; ++i) {
+        sim_can_notify_error(CAN_IFACE1);
+    }
+    bool up_below_limit = !health->down;
+    sim_can_notify_error(CAN_IFACE1);
+    bool errors_down = health->down;
+    health_sent.clear();
+    health_frame(0x300, 7);
+    uint32_t held_on_error = buffer->count;
+    health_wait(HEALTH_PROBE_INTERVAL_US);                  //The idle controller gets the held frame as a probe
+    bool probed = sim_can_tx_pending(CAN_IFACE1) == 1 && health->down;
+    sim_can_wire_step(CAN_IFACE1, 1);
+    bool probe_recovered = !health->down && health_sent.size() == 1 && health_sent[0].id == 0x300;
+
+    for (uint8_t i = 0; i < HEALTH_ERROR_LIMIT; ++i) {
+        sim_can_notify_error(CAN_IFACE1);
+    }
+    health_frame(0x301, 8);
+    bench_frame node;
+    memset(&node, 0, sizeof(node));
+    node.iface = CAN_IFACE1;
+    node.msg.id = 0x050;
+    node.msg.dlc = 8;
+    run_frame(node);                                        //Another node talks on CAN1: it works again
+    bool rx_recovered = !health->down;
+    sched_drain();
+    bool rx_drained = !health_sent.empty() && health_sent.back().id == 0x301;
+
+    sim_can_set_tx_hook(NULL, NULL);
+    sim_can_set_paced(CAN_IFACE1, false);
+
+    printf("\nhealth: stalled bus down after %u ms, %u IDs held, %u/10 latest values sent on recovery "
+           "(+%u already on the controller, %u of the 20 ms TTL ID), outage %u ms, %u lost; %u errors down, "
+           "probe %s, rx %s\n", HEALTH_TX_TIMEOUT_US / 1000, held, latest, stale, short_ttl, outage_us / 1000,
+           buffer->lost, HEALTH_ERROR_LIMIT, probe_recovered ? "recovered" : "FAILED", rx_recovered && rx_drained ? "recovered" : "FAILED");
+    return up_while_waiting && stalled_down && held == 11 && recovered && latest == 10
+        && stale == TX_SCHED_HW_DEPTH && short_ttl == 0 && stalled_expired == 1 && buffer->lost == 0
+        && up_below_limit && errors_down && held_on_error == 1 && probed && probe_recovered && rx_recovered && rx_drained;
+}
+
+static uint32_t latency_replies[FEEDBACK_LATENCY_UNTRACKED - FEEDBACK_LATENCY_COUNT + 1];
+static std::vector<uint32_t> latency_listed;
+
+static void latency_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)ctx;
+    struct host_feedback feedback;
+    if (iface != CAN_COMPUTER_IFACE || !host_feedback_decode(msg, &feedback)
+        || feedback.item < FEEDBACK_LATENCY_COUNT || feedback.item > FEEDBACK_LATENCY_UNTRACKED) {
+        return;
+    }
+    if (feedback.item == FEEDBACK_LATENCY_ID) {
+        latency_listed.push_back(feedback.value);
+    } else {
+        latency_replies[feedback.item - FEEDBACK_LATENCY_COUNT] = feedback.value;
+    }
+}
+
+static uint32_t latency_reply(uint8_t item) {
+    return latency_replies[item - FEEDBACK_LATENCY_COUNT];
+}
+
+/**
+* @brief Receives a frame on CAN0 and puts every frame waiting for the paced CAN1 on its wire after delay_us.
+*/
+static void latency_frame(uint32_t id, uint32_t delay_us) {
+    sched_frame(id);
+    sim_time_advance_us(delay_us);
+    sched_drain();
+}
+
+static bool latency_near(uint32_t value, uint32_t expected) {
+    return value * LATENCY_SUB_BUCKETS >= expected * (LATENCY_SUB_BUCKETS - 1)
+        && value * LATENCY_SUB_BUCKETS <= expected * (LATENCY_SUB_BUCKETS + 1);
+}
+
+/**
+* @brief Latency probe checks on a paced CAN1: frames sent 500 us and 2 ms after they were received are
+* measured to within a sketch bucket in their ID and direction, two frames queued together are matched with
+* their own stamps, frames received while the probe is off are not measured, and the replies over FEEDBACK_ID
+* carry the same sketches.
+*/
+static bool run_latency_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    canbus_setup1(0, 0, 125000, bus_bench_callback);
+    sim_can_set_paced(CAN_IFACE1, true);
+    sim_can_set_tx_hook(latency_capture, NULL);
+
+    latency_frame(0x127, 300);                                  //Probe off: not measured
+    host_send_command(LATENCY_COMMAND, LATENCY_ENABLE, 0, 1);
+    for (uint32_t i = 0; i < 100; ++i) {
+        latency_frame(0x123, 500);
+    }
+    for (uint32_t i = 0; i < 20; ++i) {
+        latency_frame(0x124, 2000);
+    }
+    sched_frame(0x125);                                         //Both on the controller, sent 1 ms apart
+    sched_frame(0x126);
+    sim_time_advance_us(1000);
+    sim_can_wire_step(CAN_IFACE1, 1);
+    sim_time_advance_us(1000);
+    sim_can_wire_step(CAN_IFACE1, 1);
+
+    const struct latency_direction *direction = bridge_latency(CAN_IFACE0);
+    const struct latency_sketch *sketch_123 = latency_find(direction, 0x123);
+    const struct latency_sketch *sketch_125 = latency_find(direction, 0x125);
+    const struct latency_sketch *sketch_126 = latency_find(direction, 0x126);
+    bool local = sketch_123 != NULL && sketch_125 != NULL && sketch_126 != NULL && latency_find(direction, 0x127) == NULL
+        && sketch_123->count == 100 && latency_near(latency_percentile(sketch_123, 500), 500) && sketch_123->max_us == 500
+        && sketch_125->max_us == 1000 + BENCH_FRAME_GAP_US && sketch_126->max_us == 2000
+        && direction->all.count == 122 && bridge_latency(CAN_IFACE1)->all.count == 0;
+
+    memset(latency_replies, 0, sizeof(latency_replies));
+    host_send_command(LATENCY_COMMAND, LATENCY_QUERY_ID, CAN_IFACE0, 0x124);
+    host_service_all();
+    bool id_reply = latency_reply(FEEDBACK_LATENCY_COUNT) == 20 && latency_near(latency_reply(FEEDBACK_LATENCY_P50), 2000)
+        && latency_reply(FEEDBACK_LATENCY_MAX) == 2000;
+    host_send_command(LATENCY_COMMAND, LATENCY_QUERY, CAN_IFACE0, 0);
+    host_service_all();
+    uint32_t p50 = latency_reply(FEEDBACK_LATENCY_P50), p90 = latency_reply(FEEDBACK_LATENCY_P90);
+    uint32_t p99 = latency_reply(FEEDBACK_LATENCY_P99), max_us = latency_reply(FEEDBACK_LATENCY_MAX);
+    bool direction_reply = latency_reply(FEEDBACK_LATENCY_COUNT) == 122 && latency_near(p50, 500)
+        && latency_near(p90, 2000) && latency_near(p99, 2000) && max_us == 2000;
+    latency_listed.clear();
+    host_send_command(LATENCY_COMMAND, LATENCY_LIST, CAN_IFACE0, 0);
+    host_service_all();
+    bool listed = latency_listed.size() == 4 && latency_listed[0] == 0x123 && latency_listed[3] == 0x126
+        && latency_reply(FEEDBACK_LATENCY_UNTRACKED) == 0;
+
+    host_send_command(LATENCY_COMMAND, LATENCY_RESET, CAN_IFACE0, 0);
+    host_service_all();
+    bool reset = direction->all.count == 0 && direction->id_count == 0;
+
+    sim_can_set_tx_hook(NULL, NULL);
+    sim_can_set_paced(CAN_IFACE1, false);
+
+    printf("\nlatency: CAN0 -> CAN1 %u frames, p50 %u us, p90 %u us, p99 %u us, max %u us (sketch %u bytes per direction)\n",
+           122u, p50, p90, p99, max_us, (unsigned)sizeof(struct latency_direction));
+    return local && id_reply && direction_reply && listed && reset;
+}
+
+static uint32_t period_replies[FEEDBACK_PERIOD_SILENT - FEEDBACK_PERIOD_US + 1];
+static std::vector<uint32_t> period_drifting;
+static std::vector<uint32_t> period_silent;
+static std::vector<uint32_t> period_wire;
+
+static void period_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)ctx;
+    if (iface == CAN_IFACE1) {
+        period_wire.push_back(msg->id);
+        return;
+    }
+    struct host_feedback feedback;
+    if (!host_feedback_decode(msg, &feedback) || feedback.item < FEEDBACK_PERIOD_US || feedback.item > FEEDBACK_PERIOD_SILENT) {
+        return;
+    }
+    if (feedback.item == FEEDBACK_PERIOD_DRIFTING) {
+        period_drifting.push_back(feedback.value);
+    } else if (feedback.item == FEEDBACK_PERIOD_SILENT) {
+        period_silent.push_back(feedback.value);
+    } else {
+        period_replies[feedback.item - FEEDBACK_PERIOD_US] = feedback.value;
+    }
+}
+
+static uint32_t period_reply(uint8_t item) {
+    return period_replies[item - FEEDBACK_PERIOD_US];
+}
+
+/**
+* @brief Receives a frame of an ID on CAN0 at at_us.
+*/
+static void period_frame(uint32_t id, uint64_t at_us) {
+    sim_time_set_us(at_us - BENCH_FRAME_GAP_US);
+    sched_frame(id);
+}
+
+/**
+* @brief Asks the learned schedule of an ID received on CAN0. Returns its state.
+*/
+static uint32_t period_query(uint32_t id) {
+    memset(period_replies, 0, sizeof(period_replies));
+    host_send_command(PERIOD_COMMAND, PERIOD_QUERY_ID, CAN_IFACE0, id);
+    return period_reply(FEEDBACK_PERIOD_STATE);
+}
+
+/**
+* @brief With CAN1's controller full, receives 0x080 (learned every 100 ms) then 0x600 (every 5 ms) and
+* returns the order they reach CAN1's wire. If switch_to_edf, the scheduler turns EDF while they wait.
+*/
+static std::vector<uint32_t> period_edf_run(bool switch_to_edf) {
+    sim_can_set_paced(CAN_IFACE1, true);
+    sched_frame(0x7F0);                                         //Fills the controller
+    sched_frame(0x7F1);
+    sched_frame(0x080);
+    sched_frame(0x600);
+    if (switch_to_edf) {
+        host_send_command(SCHED_COMMAND, SCHED_SET_ORDER, CAN_IFACE1, TX_ORDER_EDF);
+    }
+    period_wire.clear();
+    sched_drain();
+    sim_can_set_paced(CAN_IFACE1, false);
+    std::vector<uint32_t> order;
+    for (uint32_t id : period_wire) {
+        if (id == 0x080 || id == 0x600) {
+            order.push_back(id);
+        }
+    }
+    return order;
+}
+
+/**
+* @brief Learned period checks on CAN0 -> CAN1:
+* 0x100 every 10 ms +-300 us and 0x200 every 50 ms are learned to within 1 %, with their jitter; 0x200 moving to
+* 53 ms is reported drifting and 0x100 stopping is reported silent over FEEDBACK_ID, and its return counts as
+* a gap without changing its period. Then with 0x080 learned at 100 ms and 0x600 at 5 ms, the scheduler sends
+* 0x080 first in arbitration order and 0x600 first once switched to EDF.
+*/
+static bool run_period_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    sim_can_set_tx_hook(period_capture, NULL);
+    uint64_t base = time_us_64() + 10000;
+    uint64_t t = base;
+    for (uint32_t step = 0; step < 100; ++step) {               //1 s
+        t = base + step * 10000ull;
+        period_frame(0x100, (step & 1) ? t + 300 : t - 300);
+        if (step % 5 == 0) {
+            period_frame(0x200, t + 5000);
+        }
+    }
+    uint32_t steady_state = period_query(0x100);
+    uint32_t learned_100 = period_reply(FEEDBACK_PERIOD_US), jitter_100 = period_reply(FEEDBACK_PERIOD_JITTER);
+    uint32_t samples_100 = period_reply(FEEDBACK_PERIOD_SAMPLES);
+    uint32_t state_200 = period_query(0x200);
+    uint32_t learned_200 = period_reply(FEEDBACK_PERIOD_US), jitter_200 = period_reply(FEEDBACK_PERIOD_JITTER);
+    bool learned = steady_state == PERIOD_STEADY && learned_100 >= 9900 && learned_100 <= 10100
+        && jitter_100 >= 400 && jitter_100 <= 700 && samples_100 == 99
+        && state_200 == PERIOD_STEADY && learned_200 == 50000 && jitter_200 == 0
+        && period_query(0x123) == PERIOD_STATE_UNTRACKED;
+
+    uint64_t slow = t + 5000;
+    for (uint32_t step = 1; step <= 20; ++step) {               //0x200 slows to 53 ms, 0x100 keeps its pace
+        uint64_t at = t + 5000 + step * 53000ull;
+        for (; slow + 10000 < at; slow += 10000) {
+            period_frame(0x100, slow + 10000);
+        }
+        period_frame(0x200, at);
+    }
+    uint32_t drift_200 = period_query(0x200) == PERIOD_DRIFTING ? period_reply(FEEDBACK_PERIOD_DRIFT) : 0;
+    for (uint32_t step = 21; step <= 25; ++step) {              //0x100 stops
+        period_frame(0x200, t + 5000 + step * 53000ull);
+    }
+    period_drifting.clear();
+    period_silent.clear();
+    host_send_command(PERIOD_COMMAND, PERIOD_ALERTS, CAN_IFACE0, 0);
+    bool alerts = period_drifting.size() == 1 && period_drifting[0] == 0x200
+        && period_silent.size() == 1 && period_silent[0] == 0x100;
+    period_frame(0x100, time_us_64() + 1000);                   //Back: a gap, not a sample
+    uint32_t back_state = period_query(0x100);
+    bool gap = back_state == PERIOD_STEADY && period_reply(FEEDBACK_PERIOD_GAPS) == 1
+        && period_reply(FEEDBACK_PERIOD_US) >= 9900 && period_reply(FEEDBACK_PERIOD_US) <= 10100;
+
+    sim_can_reset();
+    bridge_init();
+    sim_can_set_tx_hook(period_capture, NULL);
+    base = time_us_64() + 10000;
+    for (uint32_t step = 0; step < 200; ++step) {               //1 s: 0x600 every 5 ms, 0x080 every 100 ms
+        period_frame(0x600, base + step * 5000ull);
+        if (step % 20 == 10) {
+            period_frame(0x080, base + step * 5000ull + 1000);
+        }
+    }
+    std::vector<uint32_t> arbitration = period_edf_run(false);
+    std::vector<uint32_t> edf = period_edf_run(true);
+    bool ordered = arbitration.size() == 2 && arbitration[0] == 0x080 && edf.size() == 2 && edf[0] == 0x600
+        && bridge_tx_scheduler(CAN_IFACE1)->order == TX_ORDER_EDF;
+
+    sim_can_set_tx_hook(NULL, NULL);
+    printf("\nperiods: 0x100 learned %u us (jitter %u us), 0x200 %u us, drift %d permille at 53 ms, alerts %s, "
+           "return %s; arbitration sends 0x%03X first, EDF 0x%03X\n", learned_100, jitter_100, learned_200,
+           (int32_t)drift_200, alerts ? "ok" : "FAILED", gap ? "gap" : "FAILED",
+           arbitration.empty() ? 0u : arbitration[0], edf.empty() ? 0u : edf[0]);
+    return learned && (int32_t)drift_200 > PERIOD_DRIFT_PERMILLE && alerts && gap && ordered;
+}
+
+/**
+* @brief Sends one frame every period_us for duration_us on a bus and counts how many were forwarded.
+* ids are used in turn.
+*/
+static uint32_t rate_run(uint8_t iface, const std::vector<uint32_t> &ids, uint32_t period_us, uint32_t duration_us) {
+    uint8_t target = iface == CAN_IFACE0 ? CAN_IFACE1 : CAN_IFACE0;
+    uint32_t before = sim_can_tx_count(target);
+    for (uint32_t t = 0, i = 0; t < duration_us; t += period_us, ++i) {
+        bench_frame f;
+        memset(&f, 0, sizeof(f));
+        f.iface = iface;
+        f.msg.id = ids[i % ids.size()];
+        f.msg.dlc = 8;
+        f.msg.data[0] = (uint8_t)i;                 //Distinct payloads, nothing looks like an echo
+        f.msg.data[1] = (uint8_t)(i >> 8);
+        run_frame(f);                               //Advances BENCH_FRAME_GAP_US itself
+        sim_time_advance_us(period_us - BENCH_FRAME_GAP_US);
+    }
+    return sim_can_tx_count(target) - before;
+}
+
+/**
+* @brief Rate limit checks, one second of 1 kHz traffic each:
+* an 11-bit ID at 10 frames/s (burst 2), a 29-bit ID at 5 frames/s (burst 1), a rule shared by 16 IDs at
+* 20 frames/s (burst 4) and a 12.5 kbit/s cap on the 1->0 direction.
+*/
+static bool run_rate_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    const uint32_t ext_id = 0x18FEF100u | CAN2040_ID_EFF;
+
+    host_send_command(RATE_COMMAND, RATE_SET_BURST, 0, 2);
+    host_send_command(RATE_COMMAND, RATE_SET_ID, 0, 0x123);
+    host_send_command(RATE_COMMAND, RATE_LIMIT, 0, 10);
+    host_send_command(RATE_COMMAND, RATE_SET_BURST, 0, 1);
+    host_send_command(RATE_COMMAND, RATE_SET_ID, 0, ext_id);
+    host_send_command(RATE_COMMAND, RATE_LIMIT, 0, 5);
+    host_send_command(RATE_COMMAND, RATE_SET_BURST, 0, 4);
+    host_send_command(RATE_COMMAND, RATE_SET_ID, 0, 0x200);
+    host_send_command(RATE_COMMAND, RATE_SET_MASK, 0, 0x7F0);
+    host_send_command(RATE_COMMAND, RATE_LIMIT, 0, 20);
+    host_send_command(RATE_COMMAND, RATE_SET_CAP, CAN_IFACE1, 12500);
+
+    uint32_t std_sent = rate_run(CAN_IFACE0, {0x123}, 1000, 1000000);
+    uint32_t ext_sent = rate_run(CAN_IFACE0, {ext_id}, 1000, 1000000);
+    std::vector<uint32_t> rule_ids;
+    for (uint32_t i = 0; i < 16; ++i) {
+        rule_ids.push_back(0x200 + i);
+    }
+    uint32_t rule_sent = rate_run(CAN_IFACE0, rule_ids, 1000, 1000000);
+    uint32_t free_sent = rate_run(CAN_IFACE0, {0x300}, 1000, 1000000);
+    uint32_t cap_sent = rate_run(CAN_IFACE1, {0x300}, 1000, 1000000);
+    uint32_t cap_expected = 12500 / can_frame_bits(0x300, 8);
+
+    printf("\nrate: 10/s id %u, 5/s ext id %u, 20/s rule %u, unlimited %u, 12.5 kbit/s cap %u (about %u) frames in 1 s\n",
+           std_sent, ext_sent, rule_sent, free_sent, cap_sent, cap_expected);
+    return std_sent == 2 + 9 && ext_sent == 1 + 4 && rule_sent == 4 + 19 && free_sent == 1000
+        && cap_sent >= cap_expected && cap_sent <= cap_expected + 1250 / can_frame_bits(0x300, 8) + 1;   //Burst + 999 ms of refill
+}
+
+static int32_t forward_last_402;
+static bool forward_402_in_order;
+static uint32_t forward_sent_403;
+static uint32_t forward_errors;
+
+static void forward_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)ctx;
+    if (iface == CAN_COMPUTER_IFACE && msg->id == FEEDBACK_ID && msg->data[0] == FORWARD_COMMAND
+        && msg->data[1] == ERROR_IN_MESSAGE) {
+        forward_errors++;
+    }
+    if (iface == CAN_IFACE1 && msg->id == 0x403) {
+        forward_sent_403++;
+    }
+    if (iface == CAN_IFACE1 && msg->id == 0x402) {
+        int32_t value = msg->data[0] | (msg->data[1] << 8);
+        forward_402_in_order = forward_402_in_order && value > forward_last_402;
+        forward_last_402 = value;
+    }
+}
+
+/**
+* @brief Forward policy checks on one second of telemetry received on CAN0:
+* 0x400 at 100 Hz whose value changes every 100 ms (change-only, 500 ms refresh),
+* 0x401 at 100 Hz that never changes (change-only, 250 ms refresh),
+* 0x402 at 1 kHz with a counter payload (downsampled to 50 ms, never an older value after a newer one, and the
+* last value must arrive after the traffic stops),
+* 0x403 at 100 Hz, 2 bytes that never change (change-only, no refresh): sent once, whatever the pool slots
+* it lands in held after its DLC. Downsampling it over FORWARD_MAX_INTERVAL_MS is refused and changes nothing.
+*/
+static bool run_forward_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    sim_can_set_tx_hook(forward_capture, NULL);
+    forward_last_402 = -1;
+    forward_402_in_order = true;
+    forward_sent_403 = 0;
+    forward_errors = 0;
+    host_send_command(FORWARD_COMMAND, FORWARD_SET_ID, 0, 0x400);
+    host_send_command(FORWARD_COMMAND, FORWARD_CHANGES, 0, 500);
+    host_send_command(FORWARD_COMMAND, FORWARD_SET_ID, 0, 0x401);
+    host_send_command(FORWARD_COMMAND, FORWARD_CHANGES, 0, 250);
+    host_send_command(FORWARD_COMMAND, FORWARD_SET_ID, 0, 0x402);
+    host_send_command(FORWARD_COMMAND, FORWARD_DOWNSAMPLE, 0, 50);
+    host_send_command(FORWARD_COMMAND, FORWARD_SET_ID, 0, 0x403);
+    host_send_command(FORWARD_COMMAND, FORWARD_CHANGES, 0, 0);
+    host_send_command(FORWARD_COMMAND, FORWARD_DOWNSAMPLE, 0, FORWARD_MAX_INTERVAL_MS + 1);
+
+    uint32_t received = 0;
+    uint32_t before = sim_can_tx_count(CAN_IFACE1);
+    for (uint32_t ms = 0; ms < 1000; ++ms) {
+        bench_frame f;
+        memset(&f, 0, sizeof(f));
+        f.iface = CAN_IFACE0;
+        f.msg.dlc = 8;
+        if (ms % 10 == 0) {
+            f.msg.id = 0x400;
+            f.msg.data[0] = (uint8_t)(ms / 100);
+            run_frame(f);
+            f.msg.id = 0x401;
+            f.msg.data[0] = 0x55;
+            run_frame(f);
+            received += 2;
+        }
+        f.msg.id = 0x402;
+        f.msg.data[0] = (uint8_t)ms;
+        f.msg.data[1] = (uint8_t)(ms >> 8);
+        memset(&f.msg.data[2], (uint8_t)ms, 6);
+        run_frame(f);
+        received++;
+        if (ms % 10 == 0) {                             //Gets the slot of the held 0x402 value it replaced
+            f.msg.id = 0x403;
+            f.msg.dlc = 2;
+            f.msg.data[0] = 0x55;
+            f.msg.data[1] = 0xAA;
+            run_frame(f);
+            received++;
+        }
+        sim_time_advance_us(1000 - (ms % 10 == 0 ? 4 : 1) * BENCH_FRAME_GAP_US);
+    }
+    sim_time_advance_us(100000);
+    host_service_all();                                 //Flushes the held value of 0x402
+    uint32_t forwarded = sim_can_tx_count(CAN_IFACE1) - before;
+    sim_can_set_tx_hook(NULL, NULL);
+
+    printf("\nforward: %u telemetry frames in, %u out (%.1fx less), last downsampled value %d%s, "
+           "unchanged 2-byte ID sent %u time(s), %u too long interval(s) refused\n",
+           received, forwarded, (double)received / (double)forwarded, forward_last_402,
+           forward_402_in_order ? "" : ", OUT OF ORDER", forward_sent_403, forward_errors);
+    return forwarded == 10 + 4 + 21 + 1 && forward_last_402 == 999 && forward_402_in_order && forward_sent_403 == 1
+        && forward_errors == 1;
+}
+
+static uint32_t bulk_acks;
+static uint8_t bulk_ack_status;
+static uint32_t bulk_ack_records;
+
+static void bulk_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)iface;
+    (void)ctx;
+    struct host_feedback feedback;
+    if (host_feedback_decode(msg, &feedback) && feedback.item == FEEDBACK_BULK_ACK) {
+        bulk_acks++;
+        bulk_ack_status = feedback.index;
+        bulk_ack_records = feedback.value;
+    }
+}
+
+struct bulk_table {
+    const char *name;
+    std::vector<uint32_t> ids;                  //Sorted
+    std::vector<std::pair<uint32_t, uint32_t>> masks;
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    uint32_t min_frame_ratio;
+};
+
+/**
+* @brief Decisions of every 11-bit ID, the table IDs and some other extended IDs, for the whitelist.
+*/
+static std::vector<bool> bulk_decisions(const bulk_table &table) {
+    std::vector<bool> out;
+    for (uint32_t id = 0; id < ID_SET_STD_IDS; ++id) {
+        out.push_back(bridge_filter_decision(id, CAN_IFACE0));
+    }
+    for (uint32_t id : table.ids) {
+        out.push_back(bridge_filter_decision(id, CAN_IFACE0));
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        out.push_back(bridge_filter_decision(CAN2040_ID_EFF | (0x0CF00300u + i * 3), CAN_IFACE0));
+        out.push_back(bridge_filter_decision(CAN2040_ID_EFF | (0x18EA0000u + i * 0x101), CAN_IFACE0));
+    }
+    return out;
+}
+
+/**
+* @brief Sends a bulk upload frame by frame, skipping data frame skip_seq and flipping the first
+* payload byte in transit if corrupt is set. Returns the ACK status.
+*/
+static uint8_t bulk_faulty_upload(const uint8_t *payload, uint32_t length, uint32_t skip_seq, bool corrupt) {
+    bulk_acks = 0;
+    host_send_command(BULK_COMMAND, BULK_START, RULE_LIST_WHITELIST, length);
+    for (uint32_t offset = 0, seq = 0; offset < length; offset += BULK_FRAME_BYTES, ++seq) {
+        if (seq == skip_seq) {
+            continue;
+        }
+        struct can2040_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.id = CONTROL_ID;
+        msg.dlc = 8;
+        msg.data[0] = BULK_COMMAND;
+        msg.data[1] = (uint8_t)(BULK_DATA | (seq & BULK_SEQ_MASK));
+        memcpy(&msg.data[2], &payload[offset], std::min<uint32_t>(BULK_FRAME_BYTES, length - offset));
+        if (corrupt && offset == 0) {
+            msg.data[2] ^= 0x01;
+        }
+        host_rx_frame(CAN_COMPUTER_IFACE, &msg);
+    }
+    host_send_command(BULK_COMMAND, BULK_END, RULE_LIST_WHITELIST, bulk_crc32(payload, length));
+    return bulk_acks == 1 ? bulk_ack_status : 0xFF;
+}
+
+/**
+* @brief Loads the same whitelists with one ADD_ID per ID and with one bulk upload, and compares the
+* frames sent on the control bus, the time and the resulting decisions. A corrupted, incomplete or too large
+* upload must be refused and leave the list and an open transaction alone.
+*/
+static bool run_bulk_checks(void) {
+    std::vector<bulk_table> tables(4);
+    tables[0].name = "sparse 100";
+    tables[0].min_frame_ratio = 3;
+    tables[1].name = "blocks 256";
+    tables[1].min_frame_ratio = 10;
+    tables[2].name = "dense 1000";
+    tables[2].min_frame_ratio = 10;
+    tables[3].name = "ext 120 + rules";
+    tables[3].min_frame_ratio = 2;                     //Random 16-bit spread: about 1.3 bytes per ID at best
+
+    std::vector<bool> taken(ID_SET_STD_IDS, false);
+    while (tables[0].ids.size() < 100) {
+        uint32_t id = bench_rand() % ID_SET_STD_IDS;
+        if (id != CONTROL_ID && !taken[id]) {
+            taken[id] = true;
+            tables[0].ids.push_back(id);
+        }
+    }
+    for (uint32_t id = 0x100; id < 0x180; ++id) {
+        tables[1].ids.push_back(id);
+        tables[1].ids.push_back(id + 0x300);
+    }
+    std::fill(taken.begin(), taken.end(), false);
+    while (tables[2].ids.size() < 1000) {
+        uint32_t id = bench_rand() % ID_SET_STD_IDS;
+        if (id != CONTROL_ID && !taken[id]) {
+            taken[id] = true;
+            tables[2].ids.push_back(id);
+        }
+    }
+    while (tables[3].ids.size() < 120) {
+        uint32_t id = CAN2040_ID_EFF | (0x18FE0000u + (bench_rand() & 0xFFFFu));
+        if (std::find(tables[3].ids.begin(), tables[3].ids.end(), id) == tables[3].ids.end()) {
+            tables[3].ids.push_back(id);
+        }
+    }
+    tables[3].ranges.push_back(std::make_pair(CAN2040_ID_EFF | 0x0CF00400u, CAN2040_ID_EFF | 0x0CF004FFu));
+    tables[3].masks.push_back(std::make_pair(CAN2040_ID_EFF | 0x18EA0000u, CAN2040_ID_EFF | 0x1FFF0000u));
+    for (bulk_table &table : tables) {
+        std::sort(table.ids.begin(), table.ids.end());
+    }
+
+    printf("\n%-18s %6s %8s %6s %6s %7s %10s %8s %10s %8s %5s\n", "bulk upload", "IDs", "frames", "bulk", "bytes",
+           "ratio", "bus ms", "bulk ms", "per-ID us", "bulk us", "same");
+    const double frame_ms = can_frame_bits(CONTROL_ID, 8) / 125.0;     //At 125 kbit/s
+    bool ok = true;
+    static uint8_t payload[BULK_MAX_BYTES];
+    for (const bulk_table &table : tables) {
+        sim_can_reset();
+        bridge_init();
+        bench_clock::time_point start = bench_clock::now();
+        host_send_command(WHITELIST_MODE, SET_MODE_AND_CLEAR, 0, 0);
+        uint32_t single_frames = 1;
+        for (uint32_t id : table.ids) {
+            host_send_command(WHITELIST_MODE, ADD_ID, 0, id);
+            single_frames++;
+        }
+        for (const auto &range : table.ranges) {
+            host_send_command(RULE_COMMAND, RULE_SET_VALUE, RULE_LIST_WHITELIST, range.first);
+            host_send_command(RULE_COMMAND, RULE_ADD_RANGE, RULE_LIST_WHITELIST, range.second);
+            single_frames += 2;
+        }
+        for (const auto &mask : table.masks) {
+            host_send_command(RULE_COMMAND, RULE_SET_VALUE, RULE_LIST_WHITELIST, mask.first);
+            host_send_command(RULE_COMMAND, RULE_ADD_MASK, RULE_LIST_WHITELIST, mask.second);
+            single_frames += 2;
+        }
+        double single_us = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count() / 1000.0;
+        std::vector<bool> expected = bulk_decisions(table);
+
+        struct bulk_encoder encoder;                    //Done by the computer, not timed
+        bulk_encoder_init(&encoder, payload, sizeof(payload));
+        bulk_encode_ids(&encoder, table.ids.data(), (uint32_t)table.ids.size());
+        for (const auto &range : table.ranges) {
+            bulk_encode_range(&encoder, range.first, range.second);
+        }
+        for (const auto &mask : table.masks) {
+            bulk_encode_mask(&encoder, mask.first, mask.second);
+        }
+
+        sim_can_reset();
+        bridge_init();
+        sim_can_set_tx_hook(bulk_capture, NULL);
+        bulk_acks = 0;
+        start = bench_clock::now();
+        host_send_command(CONFIG_COMMAND, CONFIG_BEGIN, 0, 0);
+        host_send_command(WHITELIST_MODE, SET_MODE, 0, 0);
+        uint32_t bulk_frames = 3 + host_bulk_upload(RULE_LIST_WHITELIST, BULK_FLAG_CLEAR, payload, encoder.length);
+        host_send_command(CONFIG_COMMAND, CONFIG_COMMIT, 0, 0);
+        double bulk_us = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count() / 1000.0;
+        bool same = !encoder.overflow && bulk_acks == 1 && bulk_ack_status == BULK_OK && bulk_decisions(table) == expected;
+
+        printf("%-18s %6zu %8u %6u %6u %6.1fx %10.1f %8.1f %10.0f %8.0f %5s\n", table.name, table.ids.size(), single_frames,
+               bulk_frames, encoder.length, (double)single_frames / bulk_frames, single_frames * frame_ms,
+               bulk_frames * frame_ms, single_us, bulk_us, same ? "yes" : "NO");
+        ok = ok && same && single_frames >= table.min_frame_ratio * bulk_frames;
+    }
+
+    sim_can_reset();                                    //Faulty uploads of the dense table
+    bridge_init();
+    sim_can_set_tx_hook(bulk_capture, NULL);
+    struct bulk_encoder encoder;
+    bulk_encoder_init(&encoder, payload, sizeof(payload));
+    bulk_encode_ids(&encoder, tables[2].ids.data(), (uint32_t)tables[2].ids.size());
+    host_send_command(WHITELIST_MODE, SET_MODE_AND_CLEAR, 0, 0);
+    uint32_t generation = bridge_config_generation();
+    uint8_t corrupt = bulk_faulty_upload(payload, encoder.length, UINT32_MAX, true);
+    uint8_t lost = bulk_faulty_upload(payload, encoder.length, 3, false);
+    bool untouched = bridge_config_generation() == generation && !bridge_filter_decision(tables[2].ids[0], CAN_IFACE0);
+    uint8_t good = bulk_faulty_upload(payload, encoder.length, UINT32_MAX, false);
+    bool good_listed = bridge_filter_decision(tables[2].ids[0], CAN_IFACE0);
+
+    //A table that does not fit, in an open transaction: refused, the list and the transaction stay as they were
+    std::vector<uint32_t> too_many;
+    for (uint32_t i = 0; i <= ID_SET_MAX_EXT_IDS; ++i) {
+        too_many.push_back(CAN2040_ID_EFF | (0x18FE0000u + i * 7));
+    }
+    bulk_encoder_init(&encoder, payload, sizeof(payload));
+    bulk_encode_ids(&encoder, too_many.data(), (uint32_t)too_many.size());
+    const uint32_t kept_id = CAN2040_ID_EFF | 0x0CF00400u;
+    host_send_command(CONFIG_COMMAND, CONFIG_BEGIN, 0, 0);
+    host_send_command(WHITELIST_MODE, ADD_ID, 0, kept_id);
+    bulk_acks = 0;
+    host_bulk_upload(RULE_LIST_WHITELIST, 0, payload, encoder.length);
+    uint8_t full = bulk_acks == 1 ? bulk_ack_status : 0xFF;
+    host_send_command(CONFIG_COMMAND, CONFIG_COMMIT, 0, 0);
+    bool transaction_kept = bridge_filter_decision(kept_id, CAN_IFACE0) && bridge_filter_decision(tables[2].ids[0], CAN_IFACE0)
+                            && !bridge_filter_decision(too_many[0], CAN_IFACE0);
+    sim_can_set_tx_hook(NULL, NULL);
+
+    printf("bulk errors: corrupted payload status %u, lost frame status %u, list %s, clean retry status %u\n",
+           corrupt, lost, untouched ? "untouched" : "CHANGED", good);
+    printf("bulk errors: table too large in a transaction status %u, transaction %s\n",
+           full, transaction_kept ? "kept" : "LOST");
+    return ok && corrupt == BULK_ERROR_CRC && lost == BULK_ERROR_SEQUENCE && untouched && good == BULK_OK && good_listed
+           && full == BULK_ERROR_FULL && transaction_kept;
+}
+
+/**
+* @brief A 29-bit J1939 ID as can2040 presents it.
+*/
+static uint32_t j1939_id(uint32_t priority, uint32_t pgn, uint32_t destination, uint32_t source) {
+    uint32_t ps = ((pgn >> 8) & 0xFF) < J1939_PDU2_MIN_PF ? destination : (pgn & 0xFF);
+    return CAN2040_ID_EFF | (priority << 26) | ((pgn & 0x3FF00) << 8) | (ps << 8) | source;
+}
+
+/**
+* @brief J1939 modes: a PGN entry covers every priority and source (and destination of a PDU1 PGN),
+* source and destination entries cover every PGN, a PDU2 group extension is not a destination, 11-bit
+* and remote frames are never listed. The list goes through a flash save and load unchanged.
+*/
+static bool run_j1939_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    host_send_command(J1939_WHITELIST_MODE, SET_MODE_AND_CLEAR, 0, 0);
+    host_send_command(J1939_WHITELIST_MODE, ADD_ID, J1939_PGN, 0xFEF1);         //CCVS, PDU2
+    host_send_command(J1939_WHITELIST_MODE, ADD_ID, J1939_PGN, 0xEF33);         //Proprietary A, PDU1: stored as 0xEF00
+    host_send_command(J1939_WHITELIST_MODE, ADD_ID, J1939_SOURCE, 0x25);
+    host_send_command(J1939_WHITELIST_MODE, ADD_ID, J1939_DESTINATION, 0x17);
+
+    struct j1939_case {
+        uint32_t id;
+        bool listed;
+    };
+    const j1939_case cases[] = {
+        {j1939_id(6, 0xFEF1, 0, 0x00), true},           //Listed PGN
+        {j1939_id(3, 0xFEF1, 0, 0x80), true},           //Same PGN, other priority and source
+        {j1939_id(6, 0xEF00, 0x33, 0x10), true},        //PDU1 PGN, any destination
+        {j1939_id(6, 0xEF00, 0xFF, 0x11), true},
+        {j1939_id(6, 0xEA00, 0x17, 0x11), true},        //Request to a listed destination
+        {j1939_id(6, 0xEA00, 0x18, 0x11), false},
+        {j1939_id(7, 0xFEF2, 0, 0x25), true},           //Listed source
+        {j1939_id(6, 0xFE17, 0, 0x01), false},          //PDU2, 0x17 is a group extension
+        {j1939_id(6, 0x1FEF1, 0, 0x00), false},         //Data page 1 is another PGN
+        {CAN2040_ID_RTR | CAN2040_ID_EFF | (j1939_id(6, 0xFEF1, 0, 0) & 0x1FFFFFFF), false},
+        {0x0F1, false},                                 //11-bit frames are not J1939
+        {0x025, false},
+    };
+    bool whitelist_ok = true, blacklist_ok = true, reference_ok = true;
+    for (const j1939_case &c : cases) {
+        for (uint8_t iface = CAN_IFACE0; iface <= CAN_IFACE1; ++iface) {
+            whitelist_ok = whitelist_ok && bridge_filter_decision(c.id, iface) == c.listed;
+            reference_ok = reference_ok && bridge_filter_reference(c.id, iface) == c.listed;
+        }
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/can_bridge_bench_j1939_%d.bin", (int)getpid());
+    remove(path);
+    uint32_t sequence = 0;
+    bool persisted = sim_flash_attach(path) && bridge_config_save(&sequence) == STORE_OK;
+    bridge_init();
+    persisted = persisted && bridge_config_load(&sequence) == STORE_OK;
+    sim_flash_detach();
+    remove(path);
+    host_send_command(J1939_BLACKLIST_MODE, SET_MODE, 0, 0);                  //Same list, opposite verdicts
+    for (const j1939_case &c : cases) {
+        blacklist_ok = blacklist_ok && bridge_filter_decision(c.id, CAN_IFACE0) == !c.listed
+                       && bridge_filter_reference(c.id, CAN_IFACE1) == !c.listed;
+    }
+
+    host_send_command(J1939_BLACKLIST_MODE, REMOVE_ID, J1939_SOURCE, 0x25);
+    bool removed = bridge_filter_decision(j1939_id(7, 0xFEF2, 0, 0x25), CAN_IFACE0);
+
+    printf("\nj1939: whitelist %s, blacklist %s, reference %s, flash %s, remove %s (the 2 PGN entries stand for %u raw IDs)\n",
+           whitelist_ok ? "ok" : "WRONG", blacklist_ok ? "ok" : "WRONG", reference_ok ? "agrees" : "DISAGREES",
+           persisted ? "restored" : "LOST", removed ? "ok" : "FAILED", 8u * 256u + 8u * 256u * 256u);
+    return whitelist_ok && blacklist_ok && reference_ok && persisted && removed;
+}
+
+static std::vector<struct can2040_msg> rewrite_out;
+
+static void rewrite_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)iface;
+    (void)ctx;
+    rewrite_out.push_back(*msg);
+}
+
+/**
+* @brief Sends one frame and returns what the other bus got, id 0xFFFFFFFF if nothing.
+*/
+static struct can2040_msg rewrite_frame(uint8_t iface, uint32_t id, uint8_t dlc, const uint8_t *data) {
+    bench_frame f;
+    memset(&f, 0, sizeof(f));
+    f.iface = iface;
+    f.msg.id = id;
+    f.msg.dlc = dlc;
+    memcpy(f.msg.data, data, dlc);
+    rewrite_out.clear();
+    run_frame(f);
+    struct can2040_msg out;
+    memset(&out, 0, sizeof(out));
+    out.id = 0xFFFFFFFFu;
+    return rewrite_out.size() == 1 ? rewrite_out[0] : out;
+}
+
+static bool rewrite_is(const struct can2040_msg &msg, uint32_t id, uint8_t dlc, const uint8_t *data) {
+    return msg.id == id && msg.dlc == dlc && memcmp(msg.data, data, dlc) == 0;
+}
+
+/**
+* @brief Rewrite rules: an 11-bit ID translated with a masked byte and a longer DLC, an extended ID
+* translated the other way, rules of one direction leave the other alone, a rule inside a transaction waits
+* for the commit, a downsampled value is rewritten when it is flushed, and the rules survive a flash reload.
+* Then times frames through 32 rules against none.
+*/
+static bool run_rewrite_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    sim_can_set_tx_hook(rewrite_capture, NULL);
+    const uint32_t ext_in = CAN2040_ID_EFF | 0x18FEF100u, ext_out = CAN2040_ID_EFF | 0x0CFEF1A0u;
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_ID, 0, 0x100);
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_TARGET, 0, 0x200);
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_BYTE, 0, 0x0FA00000u);     //Byte 0: low nibble kept, 0xA0 set
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_DLC, 4, 0);
+    host_send_command(REWRITE_COMMAND, REWRITE_ADD, CAN_IFACE0, 0);
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_ID, 0, ext_in);
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_TARGET, 0, ext_out);
+    host_send_command(REWRITE_COMMAND, REWRITE_ADD, CAN_IFACE1, 0);
+
+    const uint8_t in[8] = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0};
+    const uint8_t grown[4] = {0xA2, 0x34, 0x00, 0x00};
+    bool translated = rewrite_is(rewrite_frame(CAN_IFACE0, 0x100, 2, in), 0x200, 4, grown);
+    bool extended = rewrite_is(rewrite_frame(CAN_IFACE1, ext_in, 8, in), ext_out, 8, in);
+    bool directions = rewrite_is(rewrite_frame(CAN_IFACE1, 0x100, 2, in), 0x100, 2, in)
+                      && rewrite_is(rewrite_frame(CAN_IFACE0, ext_in, 8, in), ext_in, 8, in)
+                      && rewrite_is(rewrite_frame(CAN_IFACE0, 0x101, 8, in), 0x101, 8, in);
+
+    host_send_command(CONFIG_COMMAND, CONFIG_BEGIN, 0, 0);
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_ID, 0, 0x101);
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_TARGET, 0, 0x301);
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_DLC, 1, 0);
+    host_send_command(REWRITE_COMMAND, REWRITE_ADD, CAN_IFACE0, 0);
+    bool staged = rewrite_is(rewrite_frame(CAN_IFACE0, 0x101, 8, in), 0x101, 8, in);
+    host_send_command(CONFIG_COMMAND, CONFIG_COMMIT, 0, 0);
+    bool committed = staged && rewrite_is(rewrite_frame(CAN_IFACE0, 0x101, 8, in), 0x301, 1, in);
+
+    host_send_command(FORWARD_COMMAND, FORWARD_SET_ID, 0, 0x100);
+    host_send_command(FORWARD_COMMAND, FORWARD_DOWNSAMPLE, 0, 50);
+    const uint8_t first[2] = {0x11, 0x22};                      //in would be an echo of the frame sent on CAN0 above
+    rewrite_frame(CAN_IFACE0, 0x100, 2, first);
+    const uint8_t newer[2] = {0x15, 0x99};
+    bool held = rewrite_frame(CAN_IFACE0, 0x100, 2, newer).id == 0xFFFFFFFFu;
+    rewrite_out.clear();
+    sim_time_advance_us(60000);
+    host_service_all();
+    const uint8_t newer_out[4] = {0xA5, 0x99, 0x00, 0x00};
+    bool flushed = held && rewrite_out.size() == 1 && rewrite_is(rewrite_out[0], 0x200, 4, newer_out);
+    host_send_command(FORWARD_COMMAND, FORWARD_EVERY_FRAME, 0, 0);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/can_bridge_bench_rewrite_%d.bin", (int)getpid());
+    remove(path);
+    uint32_t sequence = 0;
+    bool persisted = sim_flash_attach(path) && bridge_config_save(&sequence) == STORE_OK;
+    bridge_init();
+    persisted = persisted && bridge_config_load(&sequence) == STORE_OK
+                && rewrite_is(rewrite_frame(CAN_IFACE0, 0x100, 2, in), 0x200, 4, grown)
+                && rewrite_is(rewrite_frame(CAN_IFACE1, ext_in, 8, in), ext_out, 8, in)
+                && rewrite_is(rewrite_frame(CAN_IFACE0, 0x101, 8, in), 0x301, 1, in);
+    sim_flash_detach();
+    remove(path);
+    host_send_command(REWRITE_COMMAND, REWRITE_REMOVE, CAN_IFACE0, 0x100);
+    bool removed = rewrite_is(rewrite_frame(CAN_IFACE0, 0x100, 2, in), 0x100, 2, in);
+    sim_can_set_tx_hook(NULL, NULL);
+
+    //Cost: every frame hits one of 32 rules (each byte rewritten) against the same traffic without rules
+    std::vector<bench_frame> traffic(4096);
+    for (size_t i = 0; i < traffic.size(); ++i) {
+        memset(&traffic[i], 0, sizeof(traffic[i]));
+        traffic[i].iface = CAN_IFACE0;
+        traffic[i].msg.id = 0x400 + (uint32_t)(i % REWRITE_MAX_RULES) * 3;
+        traffic[i].msg.dlc = 8;
+    }
+    double ns[2];
+    for (uint32_t with_rules = 0; with_rules < 2; ++with_rules) {
+        sim_can_reset();
+        bridge_init();
+        for (uint32_t r = 0; with_rules && r < REWRITE_MAX_RULES; ++r) {
+            host_send_command(REWRITE_COMMAND, REWRITE_SET_ID, 0, 0x400 + r * 3);
+            host_send_command(REWRITE_COMMAND, REWRITE_SET_TARGET, 0, 0x600 + r);
+            for (uint8_t b = 0; b < 8; ++b) {
+                host_send_command(REWRITE_COMMAND, REWRITE_SET_BYTE, b, 0xF0010000u);
+            }
+            host_send_command(REWRITE_COMMAND, REWRITE_ADD, CAN_IFACE0, 0);
+        }
+        double best = 0.0;
+        for (uint32_t run = 0; run < bench_repeat; ++run) {
+            bench_clock::time_point start = bench_clock::now();
+            for (const bench_frame &f : traffic) {
+                run_frame(f);
+            }
+            double run_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+            best = (run == 0 || run_ns < best) ? run_ns : best;
+        }
+        ns[with_rules] = best / (double)traffic.size();
+    }
+
+    printf("\nrewrite: translated %s, extended %s, other direction %s, transaction %s, downsampled %s, flash %s, remove %s\n",
+           translated ? "ok" : "WRONG", extended ? "ok" : "WRONG", directions ? "untouched" : "CHANGED",
+           committed ? "ok" : "LEAKED", flushed ? "rewritten" : "WRONG", persisted ? "restored" : "LOST",
+           removed ? "ok" : "FAILED");
+    printf("rewrite: %.1f ns/frame through %u rules, %.1f ns/frame without\n", ns[1], REWRITE_MAX_RULES, ns[0]);
+    return translated && extended && directions && committed && flushed && persisted && removed;
+}
+
+static uint32_t store_replies;
+static uint8_t store_status;
+static uint32_t store_sequence;
+
+static void store_capture(uint8_t iface, const struct can2040_msg *msg, void *ctx) {
+    (void)iface;
+    (void)ctx;
+    struct host_feedback feedback;
+    if (host_feedback_decode(msg, &feedback) && feedback.item == FEEDBACK_STORE) {
+        store_replies++;
+        store_status = feedback.index;
+        store_sequence = feedback.value;
+    }
+}
+
+/**
+* @brief Sends a STORE_COMMAND and returns the status it replied, 0xFF if there was no single reply.
+*/
+static uint8_t store_command(uint8_t action) {
+    sim_can_set_tx_hook(store_capture, NULL);
+    store_replies = 0;
+    host_send_command(STORE_COMMAND, action, 0, 0);
+    return store_replies == 1 ? store_status : 0xFF;
+}
+
+/**
+* @brief Decisions of every 11-bit ID and a spread of extended IDs, in both directions.
+*/
+static std::vector<bool> store_decisions(void) {
+    std::vector<bool> out;
+    for (uint8_t iface = CAN_IFACE0; iface <= CAN_IFACE1; ++iface) {
+        for (uint32_t id = 0; id < ID_SET_STD_IDS; ++id) {
+            out.push_back(bridge_filter_decision(id, iface));
+        }
+        for (uint32_t i = 0; i < 512; ++i) {
+            out.push_back(bridge_filter_decision(CAN2040_ID_EFF | (0x18FE0000u + i * 0x7F), iface));
+        }
+    }
+    return out;
+}
+
+/**
+* @brief Saves a configuration to a file-backed flash, "reboots" (reloads the file, resets the bridge,
+* loads the newest record) and checks the bridge filters as before from the first frame. Then checks the
+* record format: wear spread over the sectors, a corrupted newest record falls back to the previous one,
+* an interrupted write leaves the newest valid record usable, and records of another version are skipped.
+*/
+static bool run_store_checks(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/can_bridge_bench_flash_%d.bin", (int)getpid());
+    remove(path);
+    bool ok = sim_flash_attach(path);
+    uint32_t sequence = 0;
+
+    sim_can_reset();
+    bridge_init();
+    ok = ok && bridge_config_load(&sequence) == STORE_EMPTY;      //Blank flash: defaults
+    host_send_command(OW_0_TO_1_BLACKLIST_MODE, SET_MODE_AND_CLEAR, 0, 0);
+    for (uint32_t id = 0x200; id < 0x300; id += 3) {
+        host_send_command(OW_0_TO_1_BLACKLIST_MODE, ADD_ID, 0, id);
+    }
+    host_send_command(OW_0_TO_1_BLACKLIST_MODE, ADD_ID, 0, CAN2040_ID_EFF | 0x18FE1234u);
+    host_send_command(RULE_COMMAND, RULE_SET_VALUE, RULE_LIST_BLACKLIST, CAN2040_ID_EFF | 0x18FE4000u);
+    host_send_command(RULE_COMMAND, RULE_ADD_RANGE, RULE_LIST_BLACKLIST, CAN2040_ID_EFF | 0x18FE40FFu);
+    host_send_command(WHITELIST_MODE, ADD_ID, 0, 0x123);           //Another list, kept too
+    std::vector<bool> expected = store_decisions();
+    uint8_t saved = store_command(STORE_SAVE);
+
+    sim_flash_detach();                                             //Power cycle
+    sim_flash_attach(path);
+    sim_can_reset();
+    bridge_init();
+    StoreStatus_t loaded = bridge_config_load(&sequence);
+    bool restored = loaded == STORE_OK && store_decisions() == expected;
+    uint32_t before = sim_can_tx_count(CAN_IFACE1);
+    bench_frame f;
+    memset(&f, 0, sizeof(f));
+    f.iface = CAN_IFACE0;
+    f.msg.dlc = 8;
+    f.msg.id = 0x203;                                               //Blacklisted
+    run_frame(f);
+    f.msg.id = 0x204;
+    run_frame(f);
+    bool first_frames = sim_can_tx_count(CAN_IFACE1) - before == 1;
+
+    host_send_command(TURNOFF, CONFIRM, 0, 0);                      //The enable state is saved too
+    uint8_t saved_off = store_command(STORE_SAVE);
+    bridge_init();
+    bool off_restored = bridge_config_load(&sequence) == STORE_OK && sequence == 2;
+    host_send_command(PASSIVE_MODE, 0, 0, 0);                       //Ignored while turned off
+    off_restored = off_restored && !bridge_filter_decision(0x203, CAN_IFACE0);
+    host_send_command(TURNON, CONFIRM, 0, 0);
+
+    uint32_t region_sector = store_region_offset() / FLASH_SECTOR_SIZE;
+    uint32_t erases_before[STORE_SECTORS];
+    for (uint32_t i = 0; i < STORE_SECTORS; ++i) {
+        erases_before[i] = sim_flash_erase_count(region_sector + i);
+    }
+    const uint32_t saves = 200;
+    for (uint32_t i = 0; i < saves; ++i) {
+        host_send_command(WHITELIST_MODE, ADD_ID, 0, 0x400 + i);
+        ok = ok && bridge_config_save(&sequence) == STORE_OK;
+    }
+    uint32_t min_erases = UINT32_MAX, max_erases = 0;
+    for (uint32_t i = 0; i < STORE_SECTORS; ++i) {
+        uint32_t erases = sim_flash_erase_count(region_sector + i) - erases_before[i];
+        min_erases = std::min(min_erases, erases);
+        max_erases = std::max(max_erases, erases);
+    }
+    bool levelled = max_erases - min_erases <= 1 && max_erases < saves / 4;
+    uint32_t newest = sequence;
+
+    const uint8_t *payload;                                         //Corrupt the newest record
+    uint32_t length;
+    store_read_latest(&payload, &length, &sequence);
+    uint8_t *flash = sim_flash_memory();
+    flash[payload - flash] ^= 0x40;
+    bridge_init();
+    bool fallback = bridge_config_load(&sequence) == STORE_OK && sequence == newest - 1;
+
+    store_read_latest(&payload, &length, &sequence);                //Torn write after it: garbage in blank pages
+    uint32_t garbage = (uint32_t)(payload - flash) + 2 * FLASH_PAGE_SIZE;
+    garbage -= garbage % FLASH_PAGE_SIZE;
+    memset(&flash[garbage], 0x5A, 40);
+    bool torn = bridge_config_save(&sequence) == STORE_OK && sequence == newest;   //Replaces the corrupted one
+    bridge_init();
+    torn = torn && bridge_config_load(&sequence) == STORE_OK && sequence == newest;
+
+    struct store_record_header header;                              //A newer record of another version
+    store_read_latest(&payload, &length, &sequence);
+    memcpy(&header, payload - sizeof(header), sizeof(header));
+    header.version = STORE_VERSION + 1;
+    header.sequence += 1;
+    uint32_t next_page = (uint32_t)(payload - flash) - (uint32_t)sizeof(header) + header.pages * FLASH_PAGE_SIZE;
+    header.crc = bulk_crc32_update(0xFFFFFFFFu, (const uint8_t *)&header, offsetof(struct store_record_header, crc));
+    header.crc = bulk_crc32_update(header.crc, payload, header.length) ^ 0xFFFFFFFFu;
+    bool injected = next_page % FLASH_SECTOR_SIZE + header.pages * FLASH_PAGE_SIZE <= FLASH_SECTOR_SIZE;
+    if (injected) {
+        memcpy(&flash[next_page], &header, sizeof(header));
+        memcpy(&flash[next_page + sizeof(header)], payload, header.length);
+    }
+    bool versioned = injected && bridge_config_load(&sequence) == STORE_OK && sequence == newest
+                     && bridge_config_save(&sequence) == STORE_OK && sequence == newest + 2;
+
+    uint8_t erased = store_command(STORE_ERASE);
+    bridge_init();
+    bool forgotten = bridge_config_load(&sequence) == STORE_EMPTY;
+    sim_can_set_tx_hook(NULL, NULL);
+    sim_flash_detach();
+    remove(path);
+
+    printf("\nstore: saved %s, reboot %s, first frames %s, turned-off state %s, %u saves erased each sector %u-%u times\n",
+           saved == STORE_OK && saved_off == STORE_OK ? "ok" : "FAILED", restored ? "restored" : "NOT RESTORED",
+           first_frames ? "filtered" : "LEAKED", off_restored ? "restored" : "LOST", saves, min_erases, max_erases);
+    printf("store: corrupt newest %s, torn write %s, other version %s, erase %s, %u flash errors\n",
+           fallback ? "fell back" : "NOT HANDLED", torn ? "recovered" : "NOT HANDLED", versioned ? "skipped" : "NOT SKIPPED",
+           erased == STORE_EMPTY && forgotten ? "ok" : "FAILED", sim_flash_errors());
+    return ok && saved == STORE_OK && restored && first_frames && saved_off == STORE_OK && off_restored && levelled
+           && fallback && torn && versioned && erased == STORE_EMPTY && forgotten && sim_flash_errors() == 0;
+}
+
+/**
+* @brief Filter commands between CONFIG_BEGIN and CONFIG_COMMIT must not reach the receive path before
+* the commit, an aborted transaction never, and a command outside a transaction right away.
+*/
+static bool run_config_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    uint32_t before = sim_can_tx_count(CAN_IFACE1);
+    bench_frame f;
+    memset(&f, 0, sizeof(f));
+    f.iface = CAN_IFACE0;
+    f.msg.dlc = 8;
+    f.msg.id = 0x456;
+
+    host_send_command(CONFIG_COMMAND, CONFIG_BEGIN, 0, 0);
+    host_send_command(WHITELIST_MODE, SET_MODE_AND_CLEAR, 0, 0);
+    host_send_command(WHITELIST_MODE, ADD_ID, 0, 0x123);
+    run_frame(f);                                       //Still passive: forwarded
+    bool staged = bridge_filter_decision(0x456, CAN_IFACE0) && bridge_config_generation() == 0;
+    host_send_command(CONFIG_COMMAND, CONFIG_COMMIT, 0, 0);
+    run_frame(f);                                       //Whitelist without 0x456: filtered
+    bool committed = bridge_filter_decision(0x123, CAN_IFACE0) && !bridge_filter_decision(0x456, CAN_IFACE0)
+                     && bridge_config_generation() == 1;
+
+    host_send_command(CONFIG_COMMAND, CONFIG_BEGIN, 0, 0);
+    host_send_command(PASSIVE_MODE, 0, 0, 0);
+    host_send_command(CONFIG_COMMAND, CONFIG_ABORT, 0, 0);
+    bool aborted = !bridge_filter_decision(0x456, CAN_IFACE0) && bridge_config_generation() == 1;
+
+    host_send_command(WHITELIST_MODE, ADD_ID, 0, 0x456);
+    run_frame(f);                                       //Outside a transaction a command commits itself
+    bool immediate = bridge_filter_decision(0x456, CAN_IFACE0) && bridge_config_generation() == 2;
+    uint32_t forwarded = sim_can_tx_count(CAN_IFACE1) - before;
+
+    printf("\nconfig: staged edits %s before commit, %s after, abort %s, single command %s, %u/3 frames forwarded\n",
+           staged ? "hidden" : "VISIBLE", committed ? "applied" : "NOT APPLIED", aborted ? "discarded" : "APPLIED",
+           immediate ? "applied" : "NOT APPLIED", forwarded);
+    return staged && committed && aborted && immediate && forwarded == 2;
+}
+
+static void trace_bench_callback(struct can2040 *cd, uint32_t notify, struct can2040_msg *msg) {
+    if (notify == CAN2040_NOTIFY_TX) {
+        bridge_tx_complete(cd, msg);
+    }
+}
+
+/**
+* @brief Timed bus model used by can_bridge_replay: lowest key first, can_frame_bits() bit times per
+* frame, and the bridge's frame waits for a node with a lower ID.
+*/
+static bool run_bus_model_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    canbus_setup0(0, 0, 125000, bus_bench_callback);
+    canbus_setup1(0, 0, 125000, bus_bench_callback);
+    sim_can_set_paced(CAN_IFACE0, true);
+    sim_can_set_paced(CAN_IFACE1, true);
+    struct sim_bus buses[2];
+    sim_bus_init(&buses[CAN_IFACE0], CAN_IFACE0, 125000);
+    sim_bus_init(&buses[CAN_IFACE1], CAN_IFACE1, 125000);
+
+    struct can2040_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.dlc = 8;
+    msg.id = 0x300;
+    sim_bus_queue(&buses[CAN_IFACE0], &msg, 0);
+    msg.id = 0x100;
+    sim_bus_queue(&buses[CAN_IFACE0], &msg, 0);
+    const uint64_t frame_ns = sim_bus_frame_ns(&buses[CAN_IFACE0], &msg);
+    struct sim_bus_frame done;
+
+    sim_bus_arbitrate(&buses[CAN_IFACE0], 0);
+    bool order = buses[CAN_IFACE0].wire.msg.id == 0x100 && buses[CAN_IFACE0].wire_end_ns == frame_ns
+                 && frame_ns == can_frame_bits(0x100, 8) * 8000ull;
+    sim_time_set_us(frame_ns / 1000);
+    sim_bus_finish(&buses[CAN_IFACE0], &done);          //The bridge receives 0x100 and queues it for CAN1
+    host_service_all();
+    msg.id = 0x080;
+    sim_bus_queue(&buses[CAN_IFACE1], &msg, frame_ns);  //A node of CAN1 with a lower ID is ready at the same time
+    sim_bus_arbitrate(&buses[CAN_IFACE1], frame_ns);
+    bool node_first = !buses[CAN_IFACE1].from_bridge && buses[CAN_IFACE1].wire.msg.id == 0x080;
+    sim_time_set_us(2 * frame_ns / 1000);
+    sim_bus_finish(&buses[CAN_IFACE1], &done);
+    sim_bus_arbitrate(&buses[CAN_IFACE1], 2 * frame_ns);
+    bool bridge_next = buses[CAN_IFACE1].from_bridge && buses[CAN_IFACE1].wire.msg.id == 0x100;
+    sim_time_set_us(3 * frame_ns / 1000);
+    sim_bus_finish(&buses[CAN_IFACE1], &done);
+    bool sent = sim_can_tx_count(CAN_IFACE1) == 1 && buses[CAN_IFACE1].busy_ns == 2 * frame_ns;
+    sim_bus_arbitrate(&buses[CAN_IFACE0], frame_ns);
+    order = order && buses[CAN_IFACE0].wire.msg.id == 0x300;
+    sim_can_set_paced(CAN_IFACE0, false);
+    sim_can_set_paced(CAN_IFACE1, false);
+
+    printf("\nbus model: %s, %.0f us per 8-byte frame, lower node ID %s the bridge, forwarded frame %s\n",
+           order ? "lowest ID first" : "WRONG ORDER", frame_ns / 1000.0, node_first ? "beats" : "DOES NOT BEAT",
+           bridge_next && sent ? "sent next" : "NOT SENT");
+    return order && node_first && bridge_next && sent;
+}
+
+/**
+* @brief Decodes a drained trace stream into events, adding the lost record counts per bus.
+*/
+static std::vector<trace_event> trace_collect(uint32_t chunk, uint32_t *lost) {
+    std::vector<uint8_t> stream(chunk);
+    std::vector<uint8_t> all;
+    uint32_t length;
+    while ((length = bridge_trace_drain(stream.data(), chunk)) > 0) {
+        all.insert(all.end(), stream.begin(), stream.begin() + length);
+    }
+    std::vector<trace_event> events;
+    uint32_t pos = 0;
+    uint64_t time_us = 0;
+    trace_event event;
+    while (trace_decode(all.data(), (uint32_t)all.size(), &pos, &time_us, &event)) {
+        if (event.verdict == TRACE_LOST) {
+            lost[event.bus] += event.msg.id;
+        } else {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+/**
+* @brief The trace must give back every frame with its bus, verdict, time and payload, in order, across
+* small drains; and a ring the drain does not keep up with must lose records, not forwarded frames.
+*/
+static bool run_trace_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    sim_can_set_paced(CAN_IFACE1, true);                //Sent frames are traced when they leave the controller
+    can2040_callback_config(sim_can_bus(CAN_IFACE1), trace_bench_callback);
+    host_send_command(WHITELIST_MODE, SET_MODE_AND_CLEAR, 0, 0);
+    host_send_command(WHITELIST_MODE, ADD_ID, 0, 0x100);
+    host_send_command(TRACE_COMMAND, TRACE_START, 0, 0);
+
+    std::vector<trace_event> expected;
+    for (uint32_t i = 0; i < 100; ++i) {
+        bench_frame f;
+        memset(&f, 0, sizeof(f));
+        f.iface = CAN_IFACE0;
+        f.msg.id = (i % 2 == 0) ? 0x100 : (0x1ABCDE00u | CAN2040_ID_EFF);
+        f.msg.dlc = i % 9;
+        for (uint8_t b = 0; b < 8; ++b) {
+            f.msg.data[b] = (uint8_t)(i * 7 + b);
+        }
+        run_frame(f);
+        sim_can_wire_step(CAN_IFACE1, 1);
+        trace_event e;
+        memset(&e, 0, sizeof(e));
+        e.time_us = time_us_32();
+        e.msg = f.msg;
+        memset(e.msg.data + f.msg.dlc, 0, 8 - f.msg.dlc);
+        e.bus = CAN_IFACE0;
+        e.verdict = (i % 2 == 0) ? TRACE_FORWARDED : TRACE_FILTERED;
+        expected.push_back(e);
+        if (i % 2 == 0) {
+            e.bus = CAN_IFACE1;
+            e.verdict = TRACE_SENT;
+            expected.push_back(e);
+        }
+    }
+    uint32_t lost[2] = {0, 0};
+    std::vector<trace_event> events = trace_collect(4 * TRACE_MAX_ENCODED, lost);
+    bool match = events.size() == expected.size() && lost[0] == 0 && lost[1] == 0;
+    for (size_t i = 0; match && i < events.size(); ++i) {
+        match = events[i].bus == expected[i].bus && events[i].verdict == expected[i].verdict
+                && events[i].time_us == expected[i].time_us && events[i].msg.id == expected[i].msg.id
+                && events[i].msg.dlc == expected[i].msg.dlc
+                && memcmp(events[i].msg.data, expected[i].msg.data, 8) == 0;
+    }
+
+    //Overflow: nothing drains while 400 frames are forwarded
+    uint32_t before = sim_can_tx_count(CAN_IFACE1);
+    for (uint32_t i = 0; i < 400; ++i) {
+        bench_frame f;
+        memset(&f, 0, sizeof(f));
+        f.iface = CAN_IFACE0;
+        f.msg.id = 0x100;
+        f.msg.dlc = 8;
+        f.msg.data[0] = (uint8_t)i;
+        run_frame(f);
+        sim_can_wire_step(CAN_IFACE1, 1);
+    }
+    uint32_t forwarded = sim_can_tx_count(CAN_IFACE1) - before;
+    uint32_t overflow_lost[2] = {0, 0};
+    std::vector<trace_event> kept = trace_collect(512, overflow_lost);
+    bool overflow = forwarded == 400 && kept.size() == 2 * TRACE_RING_RECORDS
+                    && overflow_lost[0] == 400 - TRACE_RING_RECORDS && overflow_lost[1] == 400 - TRACE_RING_RECORDS;
+    host_send_command(TRACE_COMMAND, TRACE_STOP, 0, 0);
+    sim_can_set_paced(CAN_IFACE1, false);
+
+    printf("\ntrace: %zu/%zu records %s, overflow forwarded %u/400, kept %zu, lost %u + %u\n",
+           events.size(), expected.size(), match ? "match" : "DIFFER", forwarded, kept.size(),
+           overflow_lost[0], overflow_lost[1]);
+    return match && overflow;
+}
+
+/**
+* @brief Replay pairing (can_bridge_replay): frames forwarded on timed buses, one ID rewritten on CAN0
+* (0x100 -> 0x200), must each be paired with their transmission under the received ID, none left lost.
+*/
+static bool run_replay_match_checks(void) {
+    sim_can_reset();
+    sim_time_set_us(0);
+    bridge_init();
+    canbus_setup0(0, 0, 125000, bus_bench_callback);
+    canbus_setup1(0, 0, 125000, bus_bench_callback);
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_ID, 0, 0x100);
+    host_send_command(REWRITE_COMMAND, REWRITE_SET_TARGET, 0, 0x200);
+    host_send_command(REWRITE_COMMAND, REWRITE_ADD, CAN_IFACE0, 0);
+    sim_can_set_paced(CAN_IFACE0, true);
+    sim_can_set_paced(CAN_IFACE1, true);
+    bridge_trace_set(true);
+    struct sim_bus buses[2];
+    sim_bus_init(&buses[CAN_IFACE0], CAN_IFACE0, 125000);
+    sim_bus_init(&buses[CAN_IFACE1], CAN_IFACE1, 125000);
+
+    const uint32_t ids[5] = {0x100, 0x101, 0x100, 0x100, 0x100};   //The last one on CAN1, no rule there
+    struct can2040_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.dlc = 8;
+    for (uint8_t i = 0; i < 5; ++i) {
+        msg.id = ids[i];
+        msg.data[0] = i;
+        sim_bus_queue(&buses[i == 4 ? CAN_IFACE1 : CAN_IFACE0], &msg, 0);
+    }
+    uint64_t now_ns = 0;
+    while (true) {
+        sim_bus_arbitrate(&buses[CAN_IFACE0], now_ns);
+        sim_bus_arbitrate(&buses[CAN_IFACE1], now_ns);
+        uint64_t t = UINT64_MAX;
+        for (uint8_t b = 0; b < 2; ++b) {
+            t = buses[b].busy ? std::min(t, buses[b].wire_end_ns) : t;
+        }
+        if (t == UINT64_MAX) {
+            break;
+        }
+        now_ns = t;
+        sim_time_set_us(now_ns / 1000);
+        for (uint8_t b = 0; b < 2; ++b) {
+            struct sim_bus_frame done;
+            if (buses[b].busy && buses[b].wire_end_ns <= now_ns) {
+                sim_bus_finish(&buses[b], &done);
+            }
+        }
+        host_service_all();
+    }
+
+    uint32_t lost[2] = {0, 0};
+    std::vector<trace_event> events = trace_collect(4096, lost);
+    struct trace_match match;
+    trace_match_init(&match);
+    uint32_t forwarded = 0, rewritten = 0, paired = 0, unpaired = 0;
+    bool received_ids = true;
+    for (const trace_event &e : events) {
+        struct trace_match_pending pending;
+        if (e.verdict == TRACE_FORWARDED) {
+            trace_match_forwarded(&match, &e);
+            forwarded++;
+        } else if (e.verdict == TRACE_REWRITTEN) {
+            trace_match_rewritten(&match, &e);
+            rewritten++;
+        } else if (e.verdict == TRACE_SENT && trace_match_sent(&match, &e, &pending)) {
+            paired++;
+            received_ids = received_ids && (e.msg.id == 0x200 ? pending.rx_id == 0x100 && e.bus == CAN_IFACE1
+                                                              : pending.rx_id == e.msg.id)
+                           && e.time_us > pending.rx_us;
+        } else if (e.verdict == TRACE_SENT) {
+            unpaired++;
+        }
+    }
+    bool none_waiting = match.in_flight.empty() && lost[0] == 0 && lost[1] == 0;
+    bridge_trace_set(false);
+    sim_can_set_paced(CAN_IFACE0, false);
+    sim_can_set_paced(CAN_IFACE1, false);
+
+    printf("\nreplay pairing: %u/%u forwarded frames paired (%u rewritten), %u transmissions unpaired, %s\n",
+           paired, forwarded, rewritten, unpaired, received_ids && none_waiting ? "under the received IDs" : "WRONG IDS OR LOST");
+    return forwarded == 5 && rewritten == 3 && paired == 5 && unpaired == 0 && received_ids && none_waiting;
+}
+
+#if CAN_BRIDGE_STATS
+/**
+* @brief Instrumentation checks in whitelist mode on traffic with a known mix: every received frame lands in
+* exactly one outcome counter, the top talkers come out in order (a 29-bit ID among them) and every
+* can_rx_callback is in the histogram.
+*/
+static bool run_stats_checks(void) {
+    sim_can_reset();
+    bridge_init();
+    const uint32_t ext_id = 0x18FEF100u | CAN2040_ID_EFF;
+    host_send_command(WHITELIST_MODE, SET_MODE_ADD_ID, 0, 0x100);
+    host_send_command(WHITELIST_MODE, ADD_ID, 0, ext_id);
+    host_send_command(WHITELIST_MODE, ADD_ID, 0, 0x200);
+
+    const struct { uint32_t id; uint32_t count; } mix[] = {{0x100, 50}, {ext_id, 40}, {0x200, 30}, {0x300, 10}};
+    for (uint32_t round = 0; round < 50; ++round) {
+        for (const auto &m : mix) {
+            if (round < m.count) {
+                bench_frame f;
+                memset(&f, 0, sizeof(f));
+                f.iface = CAN_IFACE0;
+                f.msg.id = m.id;
+                f.msg.dlc = 8;
+                f.msg.data[0] = (uint8_t)round;
+                run_frame(f);
+            }
+        }
+    }
+
+    const struct direction_stats *stats = bridge_rx_stats(CAN_IFACE0);
+    uint32_t outcomes = stats->forwarded + stats->filtered + stats->echo_dropped + stats->shaped + stats->control;
+    uint32_t timed = 0;
+    for (uint8_t i = 0; i < STATS_HIST_BUCKETS; ++i) {
+        timed += stats->hist[i];
+    }
+    struct stats_talker top[4];
+    uint8_t found = direction_stats_top(stats, top, 4);
+    bool top_ok = found == 4 && top[0].id == 0x100 && top[1].id == ext_id && top[2].id == 0x200 && top[3].id == 0x300
+        && top[1].hits == 40;
+
+    printf("\nstats: rx %u = forwarded %u + filtered %u + control %u, top talker 0x%X (%u), %u calls timed, "
+           "slowest %u cycles\n", stats->rx, stats->forwarded, stats->filtered, stats->control, top[0].id, top[0].hits,
+           timed, stats->hist_max);
+    return stats->rx == 133 && outcomes == stats->rx && stats->forwarded == 120 && stats->filtered == 10
+        && stats->control == 3 && top_ok && timed == stats->rx;
+}
+#endif
+
+/**
+* @brief Two real threads through one frame_queue: checks ordering and that no frame is lost or duplicated.
+*/
+static bool run_queue_stress(void) {
+    static struct frame_queue queue;
+    const uint32_t total = 200000;
+    frame_queue_init(&queue);
+
+    uint32_t accepted = 0;
+    bench_clock::time_point start = bench_clock::now();
+    std::thread producer([&]() {
+        struct can2040_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        for (uint32_t i = 0; i < total; ++i) {
+            msg.id = i;
+            while (!frame_queue_push(&queue, &msg)) {
+                std::this_thread::yield();  //The RX interrupt would drop here, the stress test retries
+            }
+            accepted++;
+        }
+    });
+
+    bool ordered = true;
+    uint32_t received = 0;
+    struct can2040_msg msg;
+    while (received < total) {
+        if (frame_queue_pop(&queue, &msg)) {
+            ordered = ordered && (msg.id == received);
+            received++;
+        } else {
+            std::this_thread::yield();      //Single core hosts need the producer to run
+        }
+    }
+    producer.join();
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+
+    printf("\nspsc queue: %u frames across threads, %.1f ns/frame, high-water %u, %s\n", received,
+           ns / (double)total, queue.high_water, ordered ? "in order" : "OUT OF ORDER");
+    return ordered && accepted == total;
+}
+
+static bool load_baseline(const char *path, std::map<std::string, bench_result> *out) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char mode[64], traffic[64];
+        bench_result r;
+        if (sscanf(line, "%63[^,],%63[^,],%u,%u,%lf,%lf,%lf,%lf", mode, traffic, &r.frames, &r.forwarded,
+                   &r.ns_per_frame, &r.frames_per_s, &r.p99_ns, &r.max_ns) == 8) {
+            r.mode = mode;
+            r.traffic = traffic;
+            (*out)[r.mode + "/" + r.traffic] = r;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = 200000;
+    uint32_t list_size = 10;
+    const char *trace_path = NULL;
+    const char *csv_path = NULL;
+    const char *compare_path = NULL;
+    double tolerance = 15.0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--list-size") && i + 1 < argc) {
+            list_size = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--rules") && i + 1 < argc) {
+            bench_rules = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            bench_repeat = std::max(1u, (uint32_t)strtoul(argv[++i], NULL, 0));
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (!strcmp(argv[i], "--compare") && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            tolerance = strtod(argv[++i], NULL);
+        } else {
+            fprintf(stderr, "usage: %s [--frames N] [--list-size N] [--rules N] [--repeat N] [--trace file.log] "
+                            "[--csv out.csv] [--compare baseline.csv] [--tolerance pct]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<uint32_t> list_ids = make_list_ids(list_size);
+    make_rules(bench_rules);
+    std::vector<std::pair<std::string, std::vector<bench_frame>>> traffics;
+    traffics.push_back(std::make_pair(std::string("synthetic"), make_synthetic(frames, list_ids)));
+
+    if (trace_path != NULL) {
+        std::vector<candump_frame> recorded;
+        if (!candump_load(trace_path, &recorded) || recorded.empty()) {
+            fprintf(stderr, "cannot read frames from %s\n", trace_path);
+            return 2;
+        }
+        std::vector<bench_frame> replay;
+        for (uint32_t i = 0; i < frames; ++i) {         //Loop the recording up to the requested frame count
+            const candump_frame &c = recorded[i % recorded.size()];
+            bench_frame f;
+            f.iface = (uint8_t)(c.iface & 1);
+            f.msg = c.msg;
+            replay.push_back(f);
+        }
+        traffics.push_back(std::make_pair(std::string("recorded"), replay));
+    }
+
+    std::vector<bench_result> results;
+    printf("%-22s %-10s %9s %9s %10s %12s %9s %10s\n",
+           "mode", "traffic", "frames", "forwarded", "ns/frame", "frames/s", "p99 ns", "max ns");
+    for (const bench_mode &mode : bench_modes) {
+        for (const auto &traffic : traffics) {
+            bench_result r = run_case(mode, traffic.first.c_str(), traffic.second, list_ids);
+            printf("%-22s %-10s %9u %9u %10.1f %12.0f %9.0f %10.0f\n", r.mode.c_str(), r.traffic.c_str(),
+                   r.frames, r.forwarded, r.ns_per_frame, r.frames_per_s, r.p99_ns, r.max_ns);
+            results.push_back(r);
+        }
+    }
+
+#if CAN_BRIDGE_ISR_BUDGET
+    printf("\n%-22s %14s %14s\n", "receive budget", "worst cycles", "frames");
+    for (uint8_t kind = 0; kind < ROUTE_KINDS; ++kind) {
+        if (bench_budget.frames[kind] != 0) {
+            printf("%-22s %14u %14u\n", route_kind_name(kind), bench_budget.worst[kind], bench_budget.frames[kind]);
+        }
+    }
+#endif
+
+    printf("\n%-22s %14s %14s %14s %8s\n", "decision only", "routes ns", "switch ns", "routes/switch", "ok");
+    bool decisions_match = true;
+    for (const bench_mode &mode : bench_modes) {
+        double route_ns, switch_ns, ratio;
+        bool ok = run_decision_case(mode, traffics[0].second, list_ids, &route_ns, &switch_ns, &ratio);
+        printf("%-22s %14.2f %14.2f %14.2f %8s\n", mode.name, route_ns, switch_ns, ratio,
+               ok ? "yes" : ratio > BENCH_DECISION_NOISE ? "SLOWER" : "NO");
+        decisions_match = decisions_match && ok;
+    }
+
+    decisions_match = run_echo_checks() && decisions_match;
+    decisions_match = run_sched_checks() && decisions_match;
+    decisions_match = run_pool_checks() && decisions_match;
+    decisions_match = run_load_checks() && decisions_match;
+    decisions_match = run_burst_checks() && decisions_match;
+    decisions_match = run_health_checks() && decisions_match;
+    decisions_match = run_latency_checks() && decisions_match;
+    decisions_match = run_period_checks() && decisions_match;
+    decisions_match = run_rate_checks() && decisions_match;
+    decisions_match = run_forward_checks() && decisions_match;
+    decisions_match = run_rewrite_checks() && decisions_match;
+    decisions_match = run_j1939_checks() && decisions_match;
+    decisions_match = run_config_checks() && decisions_match;
+    decisions_match = run_bulk_checks() && decisions_match;
+    decisions_match = run_store_checks() && decisions_match;
+    decisions_match = run_trace_checks() && decisions_match;
+    decisions_match = run_bus_model_checks() && decisions_match;
+    decisions_match = run_replay_match_checks() && decisions_match;
+#if CAN_BRIDGE_STATS
+    decisions_match = run_stats_checks() && decisions_match;
+#endif
+    decisions_match = run_queue_stress() && decisions_match;
+
+    if (!rule_list.empty()) {                       //The compiled rules must agree with a plain scan of the configured ones
+        sim_can_reset();
+        bridge_init();
+        configure_mode(bench_modes[1], std::vector<uint32_t>());
+        uint32_t mismatches = 0;
+        for (const auto &f : traffics[0].second) {
+            if (f.msg.id != CONTROL_ID && bridge_filter_decision(f.msg.id, f.iface) != naive_rule_match(f.msg.id)) {
+                mismatches++;
+            }
+        }
+        printf("\nrules: %zu loaded, %u mismatches against a linear scan\n", rule_list.size(), mismatches);
+        decisions_match = decisions_match && mismatches == 0;
+    }
+
+    if (csv_path != NULL) {
+        FILE *csv = fopen(csv_path, "w");
+        if (csv == NULL) {
+            fprintf(stderr, "cannot write %s\n", csv_path);
+            return 2;
+        }
+        fprintf(csv, "mode,traffic,frames,forwarded,ns_per_frame,frames_per_s,p99_ns,max_ns\n");
+        for (const bench_result &r : results) {
+            fprintf(csv, "%s,%s,%u,%u,%.1f,%.0f,%.0f,%.0f\n", r.mode.c_str(), r.traffic.c_str(), r.frames,
+                    r.forwarded, r.ns_per_frame, r.frames_per_s, r.p99_ns, r.max_ns);
+        }
+        fclose(csv);
+    }
+
+    int status = decisions_match ? 0 : 1;
+    if (compare_path != NULL) {
+        std::map<std::string, bench_result> baseline;
+        if (!load_baseline(compare_path, &baseline)) {
+            fprintf(stderr, "cannot read %s\n", compare_path);
+            return 2;
+        }
+        printf("\nagainst %s (tolerance %.1f%%):\n", compare_path, tolerance);
+        for (const bench_result &r : results) {
+            auto it = baseline.find(r.mode + "/" + r.traffic);
+            if (it == baseline.end()) {
+                continue;
+            }
+            const bench_result &b = it->second;
+            double delta = b.ns_per_frame > 0.0 ? (r.ns_per_frame - b.ns_per_frame) * 100.0 / b.ns_per_frame : 0.0;
+            bool behaviour_changed = (b.frames == r.frames && b.forwarded != r.forwarded);
+            bool slower = delta > tolerance;
+            printf("%-22s %-10s %+7.1f%%%s%s\n", r.mode.c_str(), r.traffic.c_str(), delta,
+                   slower ? "  SLOWER" : "", behaviour_changed ? "  FORWARDED COUNT CHANGED" : "");
+            if (slower || behaviour_changed) {
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
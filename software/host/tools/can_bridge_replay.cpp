@@ -0,0 +1,391 @@
+/**
+* DESCRIPTION: Replays a recorded candump or ASC log through the bridge on two simulated buses to see
+* how a filter configuration behaves on real traffic before it is deployed.
+* The log's first two interfaces are CAN0 and CAN1. Each logged frame is sent by a node of its bus at
+* its logged time (divided by --speed), the buses serialize frames at --bitrate (or --bitrate0/--bitrate1
+* for buses of different speeds) and arbitrate between the
+* nodes and the bridge, and the bridge runs its receive path, scheduler and policies as on the board.
+* Reports, per direction and per received ID (also for frames a rewrite rule changed), what was forwarded
+* and dropped, the forwarding latency (end of reception to end of transmission) percentiles, the occupancy
+* of the transmit queues and the bus load.
+* The latency is also reported as the bridge's own latency probe (LATENCY_COMMAND) measured it.
+*
+* Usage: can_bridge_replay [--speed X] [--bitrate N] [--bitrate0 N] [--bitrate1 N] [--config commands.log] [--flash image.bin]
+*                          [--top N] [--csv per_id.csv] traffic.log
+*   --config  control frames (candump/ASC lines) delivered before the replay
+*   --flash   flash image holding a saved configuration (STORE_COMMAND), loaded before --config
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bridge_host.h"
+#include "candump.h"
+#include "sim_bus.h"
+#include "sim_can.h"
+#include "sim_flash.h"
+#include "sim_pico.h"
+#include "trace_match.h"
+
+#define REPLAY_DEFAULT_BITRATE  125000      //BITRATE_CAN0 and BITRATE_CAN1 of the firmware
+#define REPLAY_TICK_NS          1000000ull  //Step while only held latest values are waiting
+#define REPLAY_IDLE_LIMIT_NS    10000000000ull  //Stop ticking this long after the last frame
+#define REPLAY_DEPTH_MAX        (TX_SCHED_POOL_SIZE + 8)
+
+struct id_report {
+    uint32_t rx = 0;
+    uint32_t forwarded = 0;
+    uint32_t filtered = 0;
+    uint32_t shaped = 0;
+    uint32_t lost = 0;                          //Forwarded, never transmitted
+    std::vector<uint32_t> latency_us;
+};
+
+struct direction_report {
+    uint32_t rx = 0;
+    uint32_t forwarded = 0;
+    uint32_t filtered = 0;
+    uint32_t shaped = 0;
+    uint32_t control = 0;
+    uint32_t sent_other = 0;                    //Transmitted without a matching forwarded frame (held values, feedback)
+    std::vector<uint32_t> latency_us;
+    uint64_t depth_ns[REPLAY_DEPTH_MAX + 1];    //Time spent with each number of frames waiting towards the other bus
+};
+
+static std::map<uint32_t, id_report> id_reports;
+static direction_report directions[2];                      //Indexed by the receiving interface
+static struct trace_match matches;                          //Forwarded frames waiting for their transmission
+static std::vector<uint32_t> node_wait_us[2];               //Arbitration wait of the nodes' frames, per bus
+
+static void replay_callback(struct can2040 *cd, uint32_t notify, struct can2040_msg *msg) {
+    if (notify == CAN2040_NOTIFY_RX) {
+        can_rx_callback(cd, msg->id, (uint8_t)msg->dlc, msg->data);
+    } else if (notify == CAN2040_NOTIFY_TX) {
+        bridge_tx_complete(cd, msg);
+    }
+}
+
+/**
+* @brief Drains the bridge trace and accounts its records. The trace gives the verdict of every received
+* frame and the time each transmission completed.
+*/
+static void replay_collect(uint64_t *trace_time_us) {
+    static uint8_t stream[4096];
+    uint32_t length;
+    while ((length = bridge_trace_drain(stream, sizeof(stream))) > 0) {
+        uint32_t pos = 0;
+        struct trace_event e;
+        while (trace_decode(stream, length, &pos, trace_time_us, &e)) {
+            if (e.verdict == TRACE_LOST) {
+                fprintf(stderr, "warning: %u trace records lost on bus %u, counts are incomplete\n", e.msg.id, e.bus);
+                continue;
+            }
+            direction_report &dir = directions[e.bus];
+            if (e.verdict == TRACE_SENT) {
+                struct trace_match_pending pending;
+                if (!trace_match_sent(&matches, &e, &pending)) {
+                    directions[e.bus ^ 1].sent_other++;
+                    continue;
+                }
+                uint32_t latency = (uint32_t)(e.time_us - pending.rx_us);
+                directions[e.bus ^ 1].latency_us.push_back(latency);
+                id_reports[pending.rx_id].latency_us.push_back(latency);   //Reported under the received ID
+                continue;
+            }
+            if (e.verdict == TRACE_REWRITTEN) {
+                trace_match_rewritten(&matches, &e);
+                continue;
+            }
+            dir.rx++;
+            id_report &id = id_reports[e.msg.id];
+            id.rx++;
+            switch (e.verdict) {
+                case TRACE_FORWARDED:
+                    dir.forwarded++;
+                    id.forwarded++;
+                    trace_match_forwarded(&matches, &e);
+                    break;
+                case TRACE_FILTERED:
+                    dir.filtered++;
+                    id.filtered++;
+                    break;
+                case TRACE_SHAPED:
+                    dir.shaped++;
+                    id.shaped++;
+                    break;
+                case TRACE_CONTROL:
+                    dir.control++;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+static uint32_t percentile(std::vector<uint32_t> &values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)(p * (double)values.size() + 0.999999);
+    return values[rank == 0 ? 0 : std::min(rank, values.size()) - 1];
+}
+
+static uint32_t maximum(const std::vector<uint32_t> &values) {
+    return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+}
+
+static uint32_t depth_percentile(const uint64_t *depth_ns, double p) {
+    uint64_t total = 0;
+    for (uint32_t d = 0; d <= REPLAY_DEPTH_MAX; ++d) {
+        total += depth_ns[d];
+    }
+    uint64_t seen = 0;
+    for (uint32_t d = 0; d <= REPLAY_DEPTH_MAX; ++d) {
+        seen += depth_ns[d];
+        if (total > 0 && (double)seen >= p * (double)total) {
+            return d;
+        }
+    }
+    return 0;
+}
+
+static std::string id_text(uint32_t id) {
+    char text[16];
+    snprintf(text, sizeof(text), (id & CAN2040_ID_EFF) ? "%08X" : "%03X", (unsigned)(id & 0x1FFFFFFF));
+    return std::string(text);
+}
+
+int main(int argc, char **argv) {
+    double speed = 1.0;
+    uint32_t bitrate = REPLAY_DEFAULT_BITRATE;
+    uint32_t bus_bitrate[2] = {0, 0};                   //0: --bitrate
+    uint32_t top = 20;
+    const char *config_path = NULL;
+    const char *flash_path = NULL;
+    const char *csv_path = NULL;
+    const char *log_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+            speed = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "--bitrate") && i + 1 < argc) {
+            bitrate = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if ((!strcmp(argv[i], "--bitrate0") || !strcmp(argv[i], "--bitrate1")) && i + 1 < argc) {
+            bus_bitrate[argv[i][9] - '0'] = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+            i++;
+        } else if (!strcmp(argv[i], "--config") && i + 1 < argc) {
+            config_path = argv[++i];
+        } else if (!strcmp(argv[i], "--flash") && i + 1 < argc) {
+            flash_path = argv[++i];
+        } else if (!strcmp(argv[i], "--top") && i + 1 < argc) {
+            top = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (argv[i][0] != '-' && log_path == NULL) {
+            log_path = argv[i];
+        } else {
+            log_path = NULL;
+            break;
+        }
+    }
+    for (uint8_t b = 0; b < 2; ++b) {
+        if (bus_bitrate[b] == 0) {
+            bus_bitrate[b] = bitrate;
+        }
+    }
+    if (log_path == NULL || speed <= 0.0 || bitrate == 0) {
+        fprintf(stderr, "usage: %s [--speed X] [--bitrate N] [--bitrate0 N] [--bitrate1 N] [--config commands.log] [--flash image.bin] "
+                        "[--top N] [--csv per_id.csv] traffic.log\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<candump_frame> frames;
+    if (!candump_load(log_path, &frames) || frames.empty()) {
+        fprintf(stderr, "cannot read frames from %s\n", log_path);
+        return 2;
+    }
+    std::stable_sort(frames.begin(), frames.end(),
+                     [](const candump_frame &a, const candump_frame &b) { return a.timestamp_us < b.timestamp_us; });
+
+    sim_can_reset();
+    sim_time_set_us(0);
+    bridge_set_bitrate(CAN_IFACE0, bus_bitrate[CAN_IFACE0]);
+    bridge_set_bitrate(CAN_IFACE1, bus_bitrate[CAN_IFACE1]);
+    bridge_init();
+    canbus_setup0(0, 0, bus_bitrate[CAN_IFACE0], replay_callback);
+    canbus_setup1(0, 0, bus_bitrate[CAN_IFACE1], replay_callback);
+    if (flash_path != NULL) {
+        uint32_t sequence = 0;
+        StoreStatus_t status = sim_flash_attach(flash_path) ? bridge_config_load(&sequence) : STORE_EMPTY;
+        sim_flash_detach();
+        if (status != STORE_OK) {
+            fprintf(stderr, "no saved configuration in %s (status %d)\n", flash_path, (int)status);
+            return 2;
+        }
+    }
+    if (config_path != NULL) {
+        std::vector<candump_frame> commands;
+        if (!candump_load(config_path, &commands)) {
+            fprintf(stderr, "cannot read %s\n", config_path);
+            return 2;
+        }
+        for (const candump_frame &c : commands) {
+            host_rx_frame((uint8_t)(c.iface & 1), &c.msg);
+        }
+    }
+    sim_can_set_paced(CAN_IFACE0, true);
+    sim_can_set_paced(CAN_IFACE1, true);
+    trace_match_init(&matches);
+    bridge_trace_set(true);
+    bridge_latency_set(true);
+
+    struct sim_bus buses[2];
+    sim_bus_init(&buses[CAN_IFACE0], CAN_IFACE0, bus_bitrate[CAN_IFACE0]);
+    sim_bus_init(&buses[CAN_IFACE1], CAN_IFACE1, bus_bitrate[CAN_IFACE1]);
+
+    const uint64_t first_us = frames.front().timestamp_us;
+    uint32_t skipped = 0;
+    size_t next = 0;
+    uint64_t now_ns = 0, last_activity_ns = 0, trace_time_us = 0;
+    while (true) {
+        uint64_t t = UINT64_MAX;
+        if (next < frames.size()) {
+            t = (uint64_t)((double)(frames[next].timestamp_us - first_us) * 1000.0 / speed);
+        }
+        for (uint8_t b = 0; b < 2; ++b) {
+            if (buses[b].busy) {
+                t = std::min(t, buses[b].wire_end_ns);
+            }
+        }
+        if (t == UINT64_MAX && (bridge_has_held(CAN_IFACE0) || bridge_has_held(CAN_IFACE1))
+            && now_ns - last_activity_ns < REPLAY_IDLE_LIMIT_NS) {
+            t = now_ns + REPLAY_TICK_NS;
+        }
+        if (t == UINT64_MAX) {
+            break;
+        }
+        for (uint8_t b = 0; b < 2; ++b) {               //Frames waiting towards bus b since the last event
+            uint32_t depth = tx_sched_depth(bridge_tx_scheduler(b)) + sim_can_tx_pending(b);
+            directions[b ^ 1].depth_ns[std::min<uint32_t>(depth, REPLAY_DEPTH_MAX)] += t - now_ns;
+        }
+        now_ns = t;
+        sim_time_set_us(now_ns / 1000);
+
+        for (uint8_t b = 0; b < 2; ++b) {
+            struct sim_bus_frame done;
+            if (buses[b].busy && buses[b].wire_end_ns <= now_ns && sim_bus_finish(&buses[b], &done)) {
+                if (!buses[b].from_bridge) {
+                    node_wait_us[b].push_back((uint32_t)((buses[b].wire_start_ns - done.ready_ns) / 1000));
+                }
+                last_activity_ns = now_ns;
+            }
+        }
+        while (next < frames.size() && (uint64_t)((double)(frames[next].timestamp_us - first_us) * 1000.0 / speed) <= now_ns) {
+            if (frames[next].iface > CAN_IFACE1) {
+                skipped++;
+            } else {
+                sim_bus_queue(&buses[frames[next].iface], &frames[next].msg, now_ns);
+            }
+            next++;
+        }
+        host_service_all();
+        replay_collect(&trace_time_us);
+        sim_bus_arbitrate(&buses[CAN_IFACE0], now_ns);
+        sim_bus_arbitrate(&buses[CAN_IFACE1], now_ns);
+    }
+    host_service_all();
+    replay_collect(&trace_time_us);
+
+    for (const auto &entry : matches.in_flight) {       //Forwarded frames that never made it to the wire
+        for (const trace_match_pending &pending : entry.second) {
+            id_reports[pending.rx_id].lost++;
+        }
+    }
+    double span_s = (double)now_ns / 1e9;
+
+    printf("replay: %s, %zu frames (%u on other interfaces skipped), %.3f s at speed %.2f, %u/%u bit/s\n",
+           log_path, frames.size(), skipped, span_s, speed, bus_bitrate[CAN_IFACE0], bus_bitrate[CAN_IFACE1]);
+    printf("\n%-5s %11s %13s %7s %24s\n", "bus", "node frames", "bridge frames", "load %", "node wait p50/p99/max us");
+    for (uint8_t b = 0; b < 2; ++b) {
+        char wait[48];
+        snprintf(wait, sizeof(wait), "%u/%u/%u", percentile(node_wait_us[b], 0.50), percentile(node_wait_us[b], 0.99),
+                 maximum(node_wait_us[b]));
+        printf("can%-2u %11u %13u %7.1f %24s\n", b, buses[b].node_frames, buses[b].bridge_frames,
+               now_ns > 0 ? 100.0 * (double)buses[b].busy_ns / (double)now_ns : 0.0, wait);
+    }
+
+    printf("\n%-9s %7s %9s %8s %7s %5s %7s %7s %29s %17s\n", "direction", "rx", "forwarded", "filtered", "shaped",
+           "lost", "dropped", "expired", "latency p50/p90/p99/max us", "queue mean/p99/max");
+    for (uint8_t d = 0; d < 2; ++d) {
+        direction_report &dir = directions[d];
+        const struct tx_scheduler *sched = bridge_tx_scheduler(d ^ 1);
+        uint32_t lost = 0;
+        for (const auto &entry : matches.in_flight) {
+            lost += entry.first.bus == (d ^ 1) ? (uint32_t)entry.second.size() : 0;
+        }
+        double weighted = 0.0;
+        uint32_t deepest = 0;
+        for (uint32_t i = 0; i <= REPLAY_DEPTH_MAX; ++i) {
+            weighted += (double)i * (double)dir.depth_ns[i];
+            deepest = dir.depth_ns[i] > 0 ? i : deepest;
+        }
+        char latency[48], queue[32];
+        snprintf(latency, sizeof(latency), "%u/%u/%u/%u", percentile(dir.latency_us, 0.50), percentile(dir.latency_us, 0.90),
+                 percentile(dir.latency_us, 0.99), maximum(dir.latency_us));
+        snprintf(queue, sizeof(queue), "%.2f/%u/%u", now_ns > 0 ? weighted / (double)now_ns : 0.0,
+                 depth_percentile(dir.depth_ns, 0.99), deepest);
+        printf("can%u->can%u %7u %9u %8u %7u %5u %7u %7u %29s %17s\n", d, d ^ 1, dir.rx, dir.forwarded, dir.filtered,
+               dir.shaped, lost, sched->overflow_drops, sched->expired, latency, queue);
+    }
+    printf("\n%-9s %9s %29s\n", "direction", "probed", "probe p50/p90/p99/max us");
+    for (uint8_t d = 0; d < 2; ++d) {
+        const struct latency_sketch *sketch = &bridge_latency(d)->all;
+        char latency[48];
+        snprintf(latency, sizeof(latency), "%u/%u/%u/%u", latency_percentile(sketch, 500), latency_percentile(sketch, 900),
+                 latency_percentile(sketch, 990), sketch->max_us);
+        printf("can%u->can%u %9u %29s\n", d, d ^ 1, sketch->count, latency);
+    }
+
+    std::vector<std::pair<uint32_t, id_report *>> ids;
+    for (auto &entry : id_reports) {
+        ids.push_back(std::make_pair(entry.first, &entry.second));
+    }
+    std::stable_sort(ids.begin(), ids.end(), [](const std::pair<uint32_t, id_report *> &a, const std::pair<uint32_t, id_report *> &b) {
+        return a.second->rx > b.second->rx;
+    });
+    printf("\n%-9s %7s %9s %8s %7s %5s %29s\n", "id", "rx", "forwarded", "filtered", "shaped", "lost", "latency p50/p90/p99/max us");
+    for (size_t i = 0; i < ids.size() && i < top; ++i) {
+        id_report &r = *ids[i].second;
+        char latency[48];
+        snprintf(latency, sizeof(latency), "%u/%u/%u/%u", percentile(r.latency_us, 0.50), percentile(r.latency_us, 0.90),
+                 percentile(r.latency_us, 0.99), maximum(r.latency_us));
+        printf("%-9s %7u %9u %8u %7u %5u %29s\n", id_text(ids[i].first).c_str(), r.rx, r.forwarded, r.filtered,
+               r.shaped, r.lost, latency);
+    }
+    if (ids.size() > top) {
+        printf("(%zu more IDs, --top to show them)\n", ids.size() - top);
+    }
+
+    if (csv_path != NULL) {
+        FILE *csv = fopen(csv_path, "w");
+        if (csv == NULL) {
+            fprintf(stderr, "cannot write %s\n", csv_path);
+            return 2;
+        }
+        fprintf(csv, "id,rx,forwarded,filtered,shaped,lost,p50_us,p90_us,p99_us,max_us\n");
+        for (auto &entry : ids) {
+            id_report &r = *entry.second;
+            fprintf(csv, "%s,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", id_text(entry.first).c_str(), r.rx, r.forwarded, r.filtered,
+                    r.shaped, r.lost, percentile(r.latency_us, 0.50), percentile(r.latency_us, 0.90),
+                    percentile(r.latency_us, 0.99), maximum(r.latency_us));
+        }
+        fclose(csv);
+    }
+    return 0;
+}
@@ -0,0 +1,243 @@
+/**
+* DESCRIPTION: Runs the bridge on Linux between SocketCAN interfaces (see socketcan_port.h), with the
+* same filtering, scheduling and control frames as the firmware.
+* Each --pair is one bridge with its own configuration: the first interface is CAN0 (it also takes the
+* control frames), the second CAN1. With several pairs each runs in its own process, so pairs use
+* separate cores; an interface can be in several pairs, the frames one pair sends on it are received by
+* the others like frames of any other node.
+*
+* Usage: can_gateway [--stats seconds] --pair can0,can1[,commands.log[,state.bin]] [--pair ...]
+*   commands.log  control frames (candump/ASC lines) applied at start, after the saved configuration
+*   state.bin     flash image of the pair: STORE_SAVE writes it, the next start loads it
+**/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+#include "bridge_host.h"
+#include "candump.h"
+#include "sim_flash.h"
+#include "sim_pico.h"
+#include "socketcan_port.h"
+#include "hardware/timer.h"
+
+#define GATEWAY_IDLE_WAIT_MS    100     //epoll timeout with nothing scheduled
+#define GATEWAY_BUSY_WAIT_MS    1       //epoll timeout while held values or scheduled frames wait
+
+struct gateway_pair {
+    std::string ifname[2];
+    std::string commands;
+    std::string state;
+};
+
+static volatile sig_atomic_t gateway_stop = 0;
+
+static void gateway_signal(int sig) {
+    (void)sig;
+    gateway_stop = 1;
+}
+
+static bool parse_pair(const char *text, gateway_pair *pair) {
+    std::vector<std::string> fields;
+    std::string field;
+    for (const char *p = text;; ++p) {
+        if (*p == ',' || *p == '\0') {
+            fields.push_back(field);
+            field.clear();
+            if (*p == '\0') {
+                break;
+            }
+        } else {
+            field += *p;
+        }
+    }
+    if (fields.size() < 2 || fields.size() > 4 || fields[0].empty() || fields[1].empty() || fields[0] == fields[1]) {
+        return false;
+    }
+    pair->ifname[0] = fields[0];
+    pair->ifname[1] = fields[1];
+    pair->commands = fields.size() > 2 ? fields[2] : "";
+    pair->state = fields.size() > 3 ? fields[3] : "";
+    return true;
+}
+
+static void print_stats(const gateway_pair &pair, const struct socketcan_port *ports) {
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        const struct tx_scheduler *sched = bridge_tx_scheduler(i);
+        fprintf(stderr, "%s<->%s %s: rx %llu, tx %llu, tx errors %llu, syscalls %llu, scheduler drops %u, expired %u\n",
+                pair.ifname[0].c_str(), pair.ifname[1].c_str(), ports[i].name, (unsigned long long)ports[i].rx_frames,
+                (unsigned long long)ports[i].tx_sent, (unsigned long long)ports[i].tx_errors,
+                (unsigned long long)ports[i].syscalls, sched->overflow_drops, sched->expired);
+    }
+}
+
+/**
+* @brief Runs one bridge until a stop signal. Returns the process exit status.
+*/
+static int run_pair(const gateway_pair &pair, uint32_t stats_s) {
+    static struct socketcan_port ports[2];
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        if (!socketcan_open(&ports[i], pair.ifname[i].c_str(), i)) {
+            return 1;
+        }
+        bridge_attach_port(i, &ports[i].port);
+    }
+    sim_time_use_clock(true);
+    bridge_init();
+    if (!pair.state.empty()) {
+        uint32_t sequence = 0;
+        sim_set_core(CAN_COMMAND_CORE);
+        if (!sim_flash_attach(pair.state.c_str())) {
+            fprintf(stderr, "cannot open %s\n", pair.state.c_str());
+            return 1;
+        }
+        bridge_config_load(&sequence);
+    }
+    if (!pair.commands.empty()) {
+        std::vector<candump_frame> commands;
+        if (!candump_load(pair.commands.c_str(), &commands)) {
+            fprintf(stderr, "cannot read %s\n", pair.commands.c_str());
+            return 1;
+        }
+        for (candump_frame &c : commands) {
+            uint8_t iface = (uint8_t)(c.iface & 1);
+            sim_set_core(iface == CAN_IFACE0 ? CAN_IFACE0_CORE : CAN_IFACE1_CORE);
+            bridge_receive(iface, c.msg.id, (uint8_t)c.msg.dlc, c.msg.data);
+            host_service_all();
+        }
+    }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    uint32_t watched[2];
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ports[i].fd, &event);
+        watched[i] = EPOLLIN;
+    }
+
+    uint64_t next_stats_us = time_us_64() + (uint64_t)stats_s * 1000000ull;
+    while (!gateway_stop) {
+        bool busy = bridge_has_held(CAN_IFACE0) || bridge_has_held(CAN_IFACE1)
+                    || tx_sched_depth(bridge_tx_scheduler(CAN_IFACE0)) > 0 || tx_sched_depth(bridge_tx_scheduler(CAN_IFACE1)) > 0
+                    || bridge_health_pending(CAN_IFACE0) || bridge_health_pending(CAN_IFACE1);
+        struct epoll_event events[2];
+        int ready = epoll_wait(epoll_fd, events, 2, busy ? GATEWAY_BUSY_WAIT_MS : GATEWAY_IDLE_WAIT_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for (int e = 0; e < ready; ++e) {
+            if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+                fprintf(stderr, "%s: interface error\n", ports[events[e].data.u32].name);
+            }
+        }
+
+        //Read a batch from each interface in turn, the bridge schedules, then both sockets are written
+        uint32_t moved;
+        do {
+            moved = socketcan_receive(&ports[CAN_IFACE0]) + socketcan_receive(&ports[CAN_IFACE1]);
+            host_service_all();
+            moved += socketcan_flush(&ports[CAN_IFACE0]) + socketcan_flush(&ports[CAN_IFACE1]);
+        } while (moved > 0 && !gateway_stop);
+
+        for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {   //Wait for room only while frames are left over
+            uint32_t wanted = ports[i].tx_pending > 0 ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+            if (wanted != watched[i]) {
+                struct epoll_event event;
+                memset(&event, 0, sizeof(event));
+                event.events = wanted;
+                event.data.u32 = i;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, ports[i].fd, &event);
+                watched[i] = wanted;
+            }
+        }
+        if (stats_s > 0 && time_us_64() >= next_stats_us) {
+            print_stats(pair, ports);
+            next_stats_us += (uint64_t)stats_s * 1000000ull;
+        }
+    }
+    print_stats(pair, ports);
+    close(epoll_fd);
+    socketcan_close(&ports[CAN_IFACE0]);
+    socketcan_close(&ports[CAN_IFACE1]);
+    sim_flash_detach();
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::vector<gateway_pair> pairs;
+    uint32_t stats_s = 0;
+    for (int i = 1; i < argc; ++i) {
+        gateway_pair pair;
+        if (!strcmp(argv[i], "--pair") && i + 1 < argc && parse_pair(argv[i + 1], &pair)) {
+            pairs.push_back(pair);
+            i++;
+        } else if (!strcmp(argv[i], "--stats") && i + 1 < argc) {
+            stats_s = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else {
+            pairs.clear();
+            break;
+        }
+    }
+    if (pairs.empty()) {
+        fprintf(stderr, "usage: %s [--stats seconds] --pair can0,can1[,commands.log[,state.bin]] [--pair ...]\n", argv[0]);
+        return 2;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = gateway_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    if (pairs.size() == 1) {
+        return run_pair(pairs[0], stats_s);
+    }
+    std::vector<pid_t> children;
+    for (const gateway_pair &pair : pairs) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(run_pair(pair, stats_s));
+        }
+        if (pid < 0) {
+            perror("fork");
+            gateway_stop = 1;
+            break;
+        }
+        children.push_back(pid);
+    }
+    int status = 0;
+    size_t running = children.size();
+    bool stopping = false;
+    while (running > 0) {
+        int child_status;
+        pid_t pid = waitpid(-1, &child_status, 0);
+        if (pid > 0) {
+            running--;
+            if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+                status = 1;
+                gateway_stop = 1;                       //One pair failed: stop the others too
+            }
+        } else if (errno != EINTR) {
+            break;
+        }
+        if (gateway_stop && !stopping) {
+            stopping = true;
+            for (pid_t child : children) {
+                kill(child, SIGTERM);
+            }
+        }
+    }
+    return status;
+}
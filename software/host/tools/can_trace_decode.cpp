@@ -0,0 +1,78 @@
+/**
+* DESCRIPTION: Converts the binary frame trace the bridge streams over USB (see CAN_trace.h) to
+* candump log lines: "(sec.usec) canN ID#DATA R|T", T for the frames the bridge transmitted.
+* Records the bridge had to drop are reported on stderr. --verdicts also lists, after a forwarded frame
+* a rewrite rule changed, the frame as the other bus gets it ("rewritten", on the receiving bus).
+*
+* Usage: can_trace_decode [--verdicts] [trace.bin]     (standard input without a file, e.g. the USB port)
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "CAN_trace.h"
+#include "candump.h"
+
+static const char *const verdict_names[] = {
+    "forwarded", "filtered", "echo", "shaped", "control", "sent", "time", "lost", "rewritten",
+};
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    bool verdicts = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--verdicts")) {
+            verdicts = true;
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [--verdicts] [trace.bin]\n", argv[0]);
+            return 2;
+        }
+    }
+    FILE *in = path != NULL ? fopen(path, "rb") : stdin;
+    if (in == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 2;
+    }
+
+    std::vector<uint8_t> buffer;
+    uint8_t chunk[4096];
+    uint64_t time_us = 0;
+    uint32_t frames = 0, lost[2] = {0, 0};
+    ssize_t count;
+    while ((count = read(fileno(in), chunk, sizeof(chunk))) > 0) {    //Returns what a live port has so far
+        buffer.insert(buffer.end(), chunk, chunk + count);
+        uint32_t pos = 0;
+        struct trace_event event;
+        while (trace_decode(buffer.data(), (uint32_t)buffer.size(), &pos, &time_us, &event)) {
+            if (event.verdict == TRACE_LOST) {
+                lost[event.bus] += event.msg.id;
+                fprintf(stderr, "can%u: %u trace records lost\n", event.bus, event.msg.id);
+                continue;
+            }
+            if (event.verdict == TRACE_REWRITTEN && !verdicts) {
+                continue;                               //Never on the bus it is recorded for
+            }
+            char ifname[8];
+            snprintf(ifname, sizeof(ifname), "can%u", event.bus);
+            std::string line = candump_format(event.time_us, ifname, &event.msg);
+            if (verdicts) {
+                printf("%s %s %s\n", line.c_str(), event.verdict == TRACE_SENT ? "T" : "R", verdict_names[event.verdict]);
+            } else {
+                printf("%s %s\n", line.c_str(), event.verdict == TRACE_SENT ? "T" : "R");
+            }
+            frames++;
+        }
+        buffer.erase(buffer.begin(), buffer.begin() + pos);    //Keep a record cut at the end of the chunk
+        fflush(stdout);
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+    fprintf(stderr, "%u frames, %u + %u records lost\n", frames, lost[0], lost[1]);
+    return 0;
+}
@@ -2,6 +2,22 @@
 #define CAN_BRIDGE_H
 #include <stdio.h>
 #include <string.h>
+#include "CAN_filter.h"
+#include "CAN_echo.h"
+#include "CAN_queue.h"
+#include "CAN_pool.h"
+#include "CAN_load.h"
+#include "CAN_health.h"
+#include "CAN_latency.h"
+#include "CAN_period.h"
+#include "CAN_sched.h"
+#include "CAN_policy.h"
+#include "CAN_stats.h"
+#include "CAN_bulk.h"
+#include "CAN_store.h"
+#include "CAN_trace.h"
+#include "CAN_port.h"
+#include "CAN_rewrite.h"
 
 extern "C" {
     #include "rp_agrolib_can.h"
@@ -16,18 +32,14 @@ extern "C" {
 #define CAN_IFACE0 0
 #define CAN_IFACE1 1
 
+// Core that owns (sets up, receives from and transmits on) each bus
+#define CAN_IFACE0_CORE 0
+#define CAN_IFACE1_CORE 1
+#define CAN_COMMAND_CORE CAN_IFACE0_CORE    //Runs the control frames, see bridge_run_commands()
+
 #define CAN_COMPUTER_IFACE  0
 #define CAN_COMPUTER_BUS    cbus0 
 
-#define RECENT_MESSAGES_BUFFER_SIZE 5 // Store 5 recent messages for echo checking
-
-// Struct to store transmitted message details for echo checking
-struct transmitted_msg_info {
-    uint32_t id;
-    uint8_t dlc;
-    uint8_t data[8];
-};
-
 
 
 // Bi directional modes
@@ -51,6 +63,15 @@ struct transmitted_msg_info {
 #define OW_1_TO_0_EXCEPT_MODE       0x0C // Bridge CAN1 to CAN0 by default; bridge CAN0 to CAN1 if ID IS in exception_list
 #define OW_0_TO_1_EXCEPT_MODE       0x0D // Bridge CAN0 to CAN1 by default; bridge CAN1 to CAN0 if ID IS in exception_list
 
+// J1939 modes: j1939_ids holds PGNs, source and destination addresses (see CAN_filter.h) instead of IDs.
+// ADD_ID, REMOVE_ID and SET_MODE_ADD_ID take data[2] = J1939_KEY_* kind and the PGN or address as value.
+#define J1939_WHITELIST_MODE        0x0E // Bridge 29-bit frames whose PGN, source or destination IS in j1939_ids
+#define J1939_BLACKLIST_MODE        0x0F // Bridge every frame except 29-bit frames whose PGN, source or destination IS in j1939_ids
+
+#define J1939_PGN                   0x00    //data[2] of a J1939 list command: value is a PGN
+#define J1939_SOURCE                0x01    //value is a source address
+#define J1939_DESTINATION           0x02    //value is a destination address (PDU1 frames)
+
 
 
 // Commands
@@ -61,14 +82,232 @@ struct transmitted_msg_info {
 #define SET_MODE_AND_CLEAR          0x05    //Used to clear the list right away and set the mode
 #define SET_MODE_ADD_ID             0x06    //Used to add an ID to the list right away and set the mode
 
+// Rule commands: data[0] = RULE_COMMAND, data[1] = rule action, data[2] = rule list, data[3..6] = value
+#define RULE_COMMAND                0x10    //Mask and range rules on the filter lists
+#define RULE_SET_VALUE              0x01    //Stores the value: the ID of the next mask rule or the low end of the next range rule
+#define RULE_ADD_MASK               0x02    //Adds the rule (stored value, mask = value)
+#define RULE_REMOVE_MASK            0x03    //Removes the rule (stored value, mask = value)
+#define RULE_ADD_RANGE              0x04    //Adds the rule [stored value, value]
+#define RULE_REMOVE_RANGE           0x05    //Removes the rule [stored value, value]
+#define RULE_CLEAR                  0x06    //Removes every rule of the list, exact IDs are kept
+
+#define RULE_LIST_WHITELIST         0x01
+#define RULE_LIST_BLACKLIST         0x02
+#define RULE_LIST_EXCEPTION         0x03
+#define RULE_LIST_ONE_WAY           0x04    //one_way_restricted_ids
+#define RULE_LIST_J1939             0x05    //j1939_ids, the rules compare J1939_KEY_* keys
+
+// Echo commands: data[0] = ECHO_COMMAND, data[1] = echo action, data[2] = interface, data[3..6] = value
+#define ECHO_COMMAND                0x11    //Echo suppression settings and counters
+#define ECHO_SET_WINDOW             0x01    //Sets the echo window of both interfaces to value microseconds
+#define ECHO_QUERY                  0x02    //Replies the counters of the interface in data[2]
+#define ECHO_RESET_COUNTERS         0x03    //Clears the counters of both interfaces
+
+// Stats commands: data[0] = STATS_COMMAND, data[1] = stats action, data[2] = interface
+#define STATS_COMMAND               0x12    //Bridge counters
+#define STATS_QUERY_QUEUES          0x01    //Replies depth, high-water mark and drops of the queue towards the interface
+#define STATS_QUERY_COUNTERS        0x02    //Replies the counters of the frames received on the interface
+#define STATS_QUERY_TOP             0x03    //Replies the value (at most STATS_TOP_MAX) most frequent IDs received on the interface
+#define STATS_QUERY_HISTOGRAM       0x04    //Replies the can_rx_callback cycle histogram of the interface
+#define STATS_RESET                 0x05    //Clears the counters, talkers and histogram of the interface
+#define STATS_DUMP                  0x06    //Prints everything on USB stdio
+#define STATS_QUERY_POOL            0x07    //Replies frames in use, high-water mark and exhausted count of the frame pool receiving the interface
+
+// Scheduler commands: data[0] = SCHED_COMMAND, data[1] = sched action, data[2] = interface, data[3..6] = value
+// SCHED_SET_DEADLINE and SCHED_CLEAR_DEADLINES edit the configuration (or the open CONFIG_BEGIN transaction).
+#define SCHED_COMMAND               0x13    //Transmit scheduler of each output bus
+#define SCHED_SET_POLICY            0x01    //Overflow policy of the bus in data[2]: 0 drop lowest priority, 1 drop oldest
+#define SCHED_SET_ID                0x02    //Stores the ID of the next SCHED_SET_DEADLINE
+#define SCHED_SET_DEADLINE          0x03    //Frames of the stored ID not sent within value microseconds are dropped, 0 removes
+#define SCHED_CLEAR_DEADLINES       0x04    //Removes every deadline
+#define SCHED_QUERY                 0x05    //Replies depth, high-water mark, overflow drops, expired frames, capacity and order of the bus in data[2]
+#define SCHED_SET_ORDER             0x06    //Release order of the bus in data[2]: 0 arbitration, 1 earliest deadline first (learned periods)
+
+// Rate commands: data[0] = RATE_COMMAND, data[1] = rate action, data[2] = interface, data[3..6] = value
+// RATE_LIMIT and RATE_CLEAR edit the configuration (or the open CONFIG_BEGIN transaction) like the filter commands.
+#define RATE_COMMAND                0x14    //Per-ID token bucket limits and per-direction bandwidth caps
+#define RATE_SET_ID                 0x01    //Stores the ID (or rule value) of the next RATE_LIMIT, the mask goes back to exact
+#define RATE_SET_MASK               0x02    //Stores a mask: the next RATE_LIMIT is shared by every ID matching (stored ID, mask)
+#define RATE_SET_BURST              0x03    //Stores the burst, in frames, of the next RATE_LIMIT
+#define RATE_LIMIT                  0x04    //Limits the stored ID or rule to value frames per second, 0 removes the limit
+#define RATE_SET_CAP                0x05    //Caps the frames received on data[2] to value bits per second on the other bus, 0 removes
+#define RATE_CLEAR                  0x06    //Removes every ID and rule limit
+#define RATE_QUERY                  0x07    //Replies the limit drops, cap drops and cap of the frames received on data[2]
+#define RATE_QUERY_ID               0x08    //Replies the drops of the stored ID or rule for the frames received on data[2]
+
+#define RATE_EXACT_MASK             POLICY_EXACT_MASK
+#define RATE_DEFAULT_BURST          4       //Frames
+#define RATE_CAP_BURST_MS           100     //A cap lets this much of its rate through at once
+
+// Forward commands: data[0] = FORWARD_COMMAND, data[1] = forward action, data[2] = interface, data[3..6] = value
+// FORWARD_EVERY_FRAME, FORWARD_CHANGES and FORWARD_DOWNSAMPLE edit the configuration like RATE_LIMIT.
+#define FORWARD_COMMAND             0x15    //Per-ID change-only forwarding and latest-value downsampling
+#define FORWARD_SET_ID              0x01    //Stores the ID of the next forward action
+#define FORWARD_EVERY_FRAME         0x02    //The stored ID forwards every frame again
+#define FORWARD_CHANGES             0x03    //The stored ID forwards only changed payloads, and unchanged ones every value ms (0 = never)
+#define FORWARD_DOWNSAMPLE          0x04    //The stored ID forwards at most one frame every value ms, the latest value wins
+#define FORWARD_QUERY               0x05    //Replies the frames of the stored ID received on data[2] that were not forwarded
+
+#define FORWARD_MAX_INTERVAL_MS     (INT32_MAX / 1000)  //Longest interval (about 24 days), compared in 32-bit microseconds; longer is refused with ERROR_IN_MESSAGE
+
+// Feedback items: FEEDBACK_ID frames [FEEDBACK_BRIDGE, item, index, value(4, big endian), checksum]
+#define FEEDBACK_ECHO_HITS          0x10    //Received frames dropped as echoes
+#define FEEDBACK_ECHO_MISSES        0x11    //Received frames that were not echoes
+#define FEEDBACK_ECHO_EVICTIONS     0x12    //Echo fingerprints lost to a full bucket
+#define FEEDBACK_ECHO_WINDOW        0x13    //Echo window in microseconds
+#define FEEDBACK_QUEUE_DEPTH        0x20    //Frames waiting in the cross-core queue
+#define FEEDBACK_QUEUE_HIGH_WATER   0x21    //Deepest the cross-core queue has been
+#define FEEDBACK_QUEUE_DROPS        0x22    //Frames lost to a full cross-core queue
+#define FEEDBACK_POOL_IN_USE        0x23    //Frames of the receiving core's pool in use
+#define FEEDBACK_POOL_HIGH_WATER    0x24    //Most frames of the pool in use at once
+#define FEEDBACK_POOL_EXHAUSTED     0x25    //Frames lost because the pool was empty
+#define FEEDBACK_SCHED_DEPTH        0x30    //Frames waiting in the transmit scheduler
+#define FEEDBACK_SCHED_HIGH_WATER   0x31    //Most frames the transmit scheduler has held
+#define FEEDBACK_SCHED_DROPS        0x32    //Frames dropped by the overflow policy
+#define FEEDBACK_SCHED_EXPIRED      0x33    //Frames dropped because their deadline passed
+#define FEEDBACK_SCHED_CAPACITY     0x34    //Frames the transmit scheduler holds at most (burst buffer included)
+#define FEEDBACK_SCHED_ORDER        0x35    //TxOrder_t of the transmit scheduler
+#define FEEDBACK_RATE_ID_DROPS      0x40    //Frames dropped by ID or rule limits
+#define FEEDBACK_RATE_CAP_DROPS     0x41    //Frames dropped by the direction's bandwidth cap
+#define FEEDBACK_RATE_CAP           0x42    //Bandwidth cap of the direction in bits per second, 0 = none
+#define FEEDBACK_FORWARD_SUPPRESSED 0x50    //Unchanged frames dropped, or held values replaced by a newer one
+#define FEEDBACK_STATS_RX           0x60    //Frames received
+#define FEEDBACK_STATS_FORWARDED    0x61    //Frames passed to the other bus
+#define FEEDBACK_STATS_FILTERED     0x62    //Frames dropped by the mode and lists
+#define FEEDBACK_STATS_ECHO         0x63    //Frames dropped as echoes
+#define FEEDBACK_STATS_SHAPED       0x64    //Frames dropped or held by the policies and caps
+#define FEEDBACK_STATS_CONTROL      0x65    //CONTROL_ID frames
+#define FEEDBACK_STATS_TOP_ID       0x66    //ID of the top talker of rank index
+#define FEEDBACK_STATS_TOP_HITS     0x67    //Frames of the top talker of rank index
+#define FEEDBACK_STATS_HIST_BUCKET  0x68    //can_rx_callback calls in the histogram bucket index
+#define FEEDBACK_STATS_HIST_MAX     0x69    //Slowest can_rx_callback, in cycles
+#define FEEDBACK_STATS_REWRITTEN    0x6A    //Forwarded frames changed by a rewrite rule
+
+#define CONFIG_COMMAND              0x16    //Transactions on the filter configuration (mode, lists, rules, rewrites, policies, deadlines, TTLs)
+#define CONFIG_BEGIN                0x01    //Following filter commands edit a shadow copy, the bridge keeps the current one
+#define CONFIG_COMMIT               0x02    //Publishes the shadow copy, replies its generation
+#define CONFIG_ABORT                0x03    //Drops the shadow copy
+
+// Bulk upload of a list, see CAN_bulk.h: BULK_START, the data frames, BULK_END
+#define BULK_COMMAND                0x17    //Loads many IDs and rules into the list in data[2] (RULE_LIST_*)
+#define BULK_START                  0x01    //data[3] = BULK_FLAG_*, data[4..6] = payload bytes
+#define BULK_END                    0x02    //data[3..6] = CRC-32 of the payload, applies it and replies FEEDBACK_BULK_ACK
+#define BULK_ABORT                  0x03
+#define BULK_DATA                   0x80    //data[1] = BULK_DATA | sequence (from 0, 7 bits), data[2..7] = payload, no checksum
+#define BULK_FLAG_CLEAR             0x01    //Empties the list (IDs and rules) before the table is added
+
+#define STORE_COMMAND               0x18    //Flash copy of the mode, lists, rules, rewrites and enable state, also accepted while turned off
+#define STORE_SAVE                  0x01    //Writes the active configuration, replies FEEDBACK_STORE
+#define STORE_LOAD                  0x02    //Replaces the active configuration with the saved one, replies FEEDBACK_STORE
+#define STORE_ERASE                 0x03    //Forgets the saved configuration, the next boot starts passive
+
+#define FEEDBACK_CONFIG_GENERATION  0x70    //Configurations published since bridge_init
+#define FEEDBACK_BULK_ACK           0x71    //index = BulkStatus_t, value = records applied (0 on error)
+#define FEEDBACK_STORE              0x72    //index = StoreStatus_t, value = sequence number of the record
+
+#define TRACE_COMMAND               0x19    //Frame trace streamed over USB, see CAN_trace.h
+#define TRACE_START                 0x01
+#define TRACE_STOP                  0x02
+#define TRACE_QUERY                 0x03    //Replies FEEDBACK_TRACE_DROPS for both buses
+
+#define FEEDBACK_TRACE_DROPS        0x73    //index = bus, value = trace records dropped because the USB drain fell behind
+
+// Rewrite commands: data[0] = REWRITE_COMMAND, data[1] = rewrite action, data[2] = interface or parameter, data[3..6] = value
+// Build a rule with REWRITE_SET_ID, then SET_TARGET/SET_BYTE/SET_DLC, then REWRITE_ADD. Like the filter commands
+// they edit the configuration (or the open CONFIG_BEGIN transaction).
+#define REWRITE_COMMAND             0x1A    //ID translation and payload rewrite of forwarded frames, see CAN_rewrite.h
+#define REWRITE_SET_ID              0x01    //Starts a rule for the received ID value: same ID, payload and DLC
+#define REWRITE_SET_TARGET          0x02    //The rule sends the frame with ID value
+#define REWRITE_SET_BYTE            0x03    //Byte data[2] of the payload becomes (byte & data[3]) | data[4]
+#define REWRITE_SET_DLC             0x04    //The rule sends data[2] bytes (0..8), REWRITE_KEEP_DLC keeps the received DLC
+#define REWRITE_ADD                 0x05    //Adds the rule (or replaces the rule of its ID) for frames received on data[2]
+#define REWRITE_REMOVE              0x06    //Removes the rule of ID value for frames received on data[2]
+#define REWRITE_CLEAR               0x07    //Removes every rule for frames received on data[2]
+
+// Load commands: data[0] = LOAD_COMMAND, data[1] = load action, data[2] = bus, data[3..6] = value. Loads are in permille.
+#define LOAD_COMMAND                0x1B    //Bus load monitor and load shedding, see CAN_load.h
+#define LOAD_SET_BITRATE            0x01    //Bitrate of the bus in data[2], in bits per second (load and burst buffer, not the controller)
+#define LOAD_SET_THRESHOLD          0x02    //Frames of the low priority class are shed while the load is at or above value, 0 never sheds.
+                                            //Forwarding restores below value - LOAD_DEFAULT_HYSTERESIS
+#define LOAD_SET_RESTORE            0x03    //Shedding stops below value instead
+#define LOAD_SET_CLASS              0x04    //The class is ID value and every ID that loses arbitration to it, LOAD_NO_CLASS for none
+#define LOAD_QUERY                  0x05    //Replies load, peak load, frames shed, shedding state and bitrate of the bus in data[2]
+#define LOAD_RESET_PEAK             0x06    //Clears the peak load and the shed frames of the bus in data[2]
+
+#define LOAD_DEFAULT_HYSTERESIS     100     //Permille
+
+#define FEEDBACK_LOAD               0x80    //Load of the last window
+#define FEEDBACK_LOAD_PEAK          0x81    //Highest window load
+#define FEEDBACK_LOAD_SHED          0x82    //Frames to the bus dropped by load shedding
+#define FEEDBACK_LOAD_SHEDDING      0x83    //1 while the bus sheds
+#define FEEDBACK_LOAD_BITRATE       0x84    //Bitrate of the bus in bits per second
+
+// Health commands: data[0] = HEALTH_COMMAND, data[1] = health action, data[2] = bus, data[3..6] = value
+// The TTL settings edit the configuration (or the open CONFIG_BEGIN transaction) like SCHED_SET_DEADLINE.
+#define HEALTH_COMMAND              0x1C    //Bus health and store-and-forward while a bus is down, see CAN_health.h
+#define HEALTH_SET_ID               0x01    //Stores the ID of the next HEALTH_SET_TTL
+#define HEALTH_SET_TTL              0x02    //Frames of the stored ID are held at most value microseconds for a down bus, 0 removes
+#define HEALTH_SET_DEFAULT_TTL      0x03    //TTL of the IDs without their own, 0 drops them instead of holding them
+#define HEALTH_CLEAR_TTLS           0x04    //Removes every per-ID TTL
+#define HEALTH_QUERY                0x05    //Replies the state, outages, errors and outage buffer counters of the bus in data[2]
+
+#define FEEDBACK_HEALTH_DOWN        0x90    //1 while the bus is down
+#define FEEDBACK_HEALTH_OUTAGES     0x91    //Times the bus went down
+#define FEEDBACK_HEALTH_ERRORS      0x92    //Errors reported by the controller
+#define FEEDBACK_HEALTH_LONGEST     0x93    //Longest outage in microseconds
+#define FEEDBACK_HEALTH_HELD        0x94    //Frames held for the bus now
+#define FEEDBACK_HEALTH_EXPIRED     0x95    //Held frames dropped because their TTL ran out
+#define FEEDBACK_HEALTH_LOST        0x96    //Frames for the down bus not held: full buffer or TTL of 0
+#define FEEDBACK_HEALTH_DRAINED     0x97    //Held frames sent once the bus was back
+
+// Latency commands: data[0] = LATENCY_COMMAND, data[1] = latency action, data[2] = receiving interface, data[3..6] = value
+#define LATENCY_COMMAND             0x1D    //Latency probe: receive to transmit-complete time of forwarded frames, see CAN_latency.h
+#define LATENCY_ENABLE              0x01    //value 1 stamps the frames received from now on, 0 stops
+#define LATENCY_RESET               0x02    //Clears the sketches of the frames received on data[2]
+#define LATENCY_QUERY               0x03    //Replies frames, p50, p90, p99 and max latency of the frames received on data[2]
+#define LATENCY_QUERY_ID            0x04    //Same for the frames of ID value (as sent) received on data[2], frames 0 if untracked
+#define LATENCY_LIST                0x05    //Replies the tracked IDs of data[2] (index = slot) and the frames of the others
+
+#define FEEDBACK_LATENCY_COUNT      0xA0    //Frames measured
+#define FEEDBACK_LATENCY_P50        0xA1    //Median latency in microseconds
+#define FEEDBACK_LATENCY_P90        0xA2
+#define FEEDBACK_LATENCY_P99        0xA3
+#define FEEDBACK_LATENCY_MAX        0xA4    //Exact
+#define FEEDBACK_LATENCY_ID         0xA5    //ID with its own sketch, index = slot
+#define FEEDBACK_LATENCY_UNTRACKED  0xA6    //Frames of IDs that found no free sketch
+
+// Period commands: data[0] = PERIOD_COMMAND, data[1] = period action, data[2] = receiving interface, data[3..6] = value
+#define PERIOD_COMMAND              0x1E    //Learned period and jitter of the forwarded IDs, see CAN_period.h
+#define PERIOD_QUERY_ID             0x01    //Replies period, jitter, samples, gaps, drift, age and state of ID value received on data[2]
+#define PERIOD_LIST                 0x02    //Replies the tracked IDs of data[2] (index = n), how many and the frames untracked
+#define PERIOD_ALERTS               0x03    //Replies the drifting and the silent IDs of data[2] (index = n)
+#define PERIOD_RESET                0x04    //Forgets the IDs received on data[2]
+
+#define PERIOD_STATE_UNTRACKED      0xFF    //FEEDBACK_PERIOD_STATE of an ID without an entry, else PeriodState_t
+
+#define FEEDBACK_PERIOD_US          0xB0    //Learned period in microseconds
+#define FEEDBACK_PERIOD_JITTER      0xB1    //Mean deviation from the period in microseconds
+#define FEEDBACK_PERIOD_SAMPLES     0xB2    //Intervals measured (saturates at 65535)
+#define FEEDBACK_PERIOD_GAPS        0xB3    //Intervals over PERIOD_GAP_FACTOR periods
+#define FEEDBACK_PERIOD_DRIFT       0xB4    //Signed permille from the period first learned (two's complement)
+#define FEEDBACK_PERIOD_AGE         0xB5    //Microseconds since the last frame
+#define FEEDBACK_PERIOD_STATE       0xB6    //PeriodState_t or PERIOD_STATE_UNTRACKED
+#define FEEDBACK_PERIOD_ID          0xB7    //Tracked ID
+#define FEEDBACK_PERIOD_TRACKED     0xB8    //IDs tracked
+#define FEEDBACK_PERIOD_UNTRACKED   0xB9    //Frames whose ID found no slot
+#define FEEDBACK_PERIOD_DRIFTING    0xBA    //ID whose period drifted
+#define FEEDBACK_PERIOD_SILENT      0xBB    //ID that went silent
+
 #define FEEDBACK_BRIDGE             0xFC    //To feedback to the computer
 #define FEEDBACK_COMPUTER           0xFD    //To feedback to the computer
 #define TURNON                      0xFE    //Turn On the bridge
 #define TURNOFF                     0xFF    //Turn Off the bridge
 
-#define ERROR_IN_MESSAGE            0xFE    //When checksum fails send back this code to COMPUTER_ID with bit 0 as the error command
+#define ERROR_IN_MESSAGE            0xFE    //When checksum fails or a value is out of range send back this code to COMPUTER_ID with bit 0 as the error command
 #define CONFIRM                     0xFF    //Used in Turn On and Turn Off to guarantee it was not an accident
-#define MAX_LIST_SIZE               20
+
+//The lists (struct filter_list): every 11-bit ID fits, plus this many IDs above 0x7FF per list, plus the rules
+#define MAX_LIST_SIZE               ID_SET_MAX_EXT_IDS
 
 
 typedef enum {
@@ -85,46 +324,111 @@ typedef enum {
     FILTER_MODE_ONE_WAY_0_TO_1_EXCEPT,
     FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_1_TO_0,
     FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_0_TO_1,
+    FILTER_MODE_J1939_WHITELIST,
+    FILTER_MODE_J1939_BLACKLIST,
 
 } FilterMode_t;
 
-static uint32_t whitelist_ids[MAX_LIST_SIZE];
-static uint8_t whitelist_count = 0;
-
-static uint32_t blacklist_ids[MAX_LIST_SIZE];
-static uint8_t blacklist_count = 0;
-
-static uint32_t exception_ids[MAX_LIST_SIZE]; 
-static uint8_t exception_count = 0;
-
-static uint32_t one_way_restricted_ids[MAX_LIST_SIZE];
-static uint8_t one_way_restricted_count = 0;
-
-
-static FilterMode_t current_filter_state = FILTER_MODE_PASSIVE;
-
-static bool bridge_enabled = true;
-
-//The lists 
-#define MAX_LIST_SIZE               10
-
-
-
+// Everything the receive path needs to decide whether (and as what) a frame is forwarded. The bridge keeps two: the
+// active one, read by both cores, and a shadow one the commands edit before it is published.
+struct bridge_config {
+    FilterMode_t current_filter_state;
+    struct filter_list whitelist_ids;
+    struct filter_list blacklist_ids;
+    struct filter_list exception_ids;
+    struct filter_list one_way_restricted_ids;
+    struct filter_list j1939_ids;               // J1939 keys, see j1939_listed()
+    struct route_direction routes[2];           // Compiled from the mode and lists, indexed by the receiving interface
+    struct rewrite_table rewrites[2];           // ID/payload rewrite of forwarded frames, indexed by the receiving interface
+    struct policy_table policies;               // Per-ID rate limits and forward policies, see CAN_policy.h
+    struct tx_deadline_table deadlines;         // Per-ID deadlines of the frames sent on either bus, see CAN_sched.h
+    struct tx_deadline_table outage_ttls;       // TTL of the frames held for a down bus per ID (same table as the deadlines)
+    uint32_t outage_default_ttl_us;             // TTL of the other IDs, see CAN_health.h
+    uint32_t generation;                        // Configurations published before this one
+};
 
 //END OF FILTER DEFINES
 
 /*Standard bridge funcions*/
+void bridge_init(void);
+void bridge_set_bitrate(uint8_t interface_id, uint32_t bitrate);
+static void bus_bitrate_apply(uint8_t interface_id);
+static void bus_bitrates_apply(void);
+static void bridge_owner_command(uint8_t interface_id, const struct can2040_msg *msg);
+static void bridge_owner_post(uint8_t interface_id, const struct can2040_msg *msg);
 void add_recent_tx_message(const struct can2040_msg *msg, uint8_t dlc, uint8_t tx_interface_id);
-bool is_echo(const struct can2040_msg *received_msg, uint8_t received_dlc, uint8_t rx_interface_id);
+bool is_echo(uint32_t id, uint8_t received_dlc, const uint8_t *data, uint8_t rx_interface_id);
+void bridge_tx_complete(struct can2040 *can_instance_ptr, const struct can2040_msg *msg);
+void bridge_tx_done(uint8_t tx_interface_id, const struct can2040_msg *msg);
+void bridge_error_notify(struct can2040 *can_instance_ptr);
+void bridge_bus_error(uint8_t interface_id, bool bus_off);
+bool bridge_health_pending(uint8_t interface_id);
+static void bridge_outage_hold(frame_handle_t frame, uint8_t tx_interface_id, uint32_t now_us);
+static void bridge_outage_begin(uint8_t interface_id);
+static void bridge_outage_end(uint8_t interface_id);
+static uint32_t bridge_health_poll(uint8_t interface_id);
+static void bridge_latency_handoff(uint8_t interface_id, frame_handle_t frame);
+static void bridge_send_latency(const struct latency_sketch *sketch, uint8_t index);
+static void bridge_send_period(const struct period_entry *entry, uint8_t index, uint32_t now_us);
+void bridge_send_feedback(uint8_t item, uint8_t index, uint32_t value);
+void bridge_send_error(uint8_t command_mode);
 void bridge_transmit(struct can2040 *target_bus, struct can2040_msg *msg, uint8_t dlc, uint8_t tx_interface_id);
+uint32_t bridge_service(uint8_t interface_id);
+uint32_t bridge_release(uint8_t interface_id);
+bool bridge_has_held(uint8_t rx_interface_id);
+void bridge_stats_dump(void);
+#if CAN_BRIDGE_STATS
+const struct direction_stats *bridge_rx_stats(uint8_t rx_interface_id);
+#endif
+#if CAN_BRIDGE_ISR_BUDGET
+const struct isr_budget *bridge_isr_budget(uint8_t rx_interface_id);
+#endif
+static uint32_t bridge_flush_held(uint8_t rx_interface_id);
+static void bridge_forward(frame_handle_t frame, uint8_t tx_interface_id);
 void can_rx_callback(struct can2040 *can_instance_ptr, uint32_t id, uint8_t dlc, uint8_t *data_payload);
+void bridge_receive(uint8_t rx_interface_id, uint32_t id, uint8_t dlc, uint8_t *data_payload);
+void bridge_attach_port(uint8_t interface_id, const struct bus_port *port);
+uint32_t bridge_run_commands(void);
+uint32_t bridge_config_generation(void);
+StoreStatus_t bridge_config_save(uint32_t *sequence);
+StoreStatus_t bridge_config_load(uint32_t *sequence);
+void bridge_trace_set(bool enabled);
+bool bridge_trace_enabled(void);
+uint32_t bridge_trace_drain(uint8_t *out, uint32_t capacity);
+void bridge_latency_set(bool enabled);
+void bridge_latency_reset(uint8_t rx_interface_id);
+const struct latency_direction *bridge_latency(uint8_t rx_interface_id);
+const struct period_table *bridge_period_table(uint8_t rx_interface_id);
 
 
 /*Bridge filtering functions*/
 static uint32_t get_id_from_data(const uint8_t *data);
-static int8_t find_id_in_list(uint32_t id, const uint32_t *list, uint8_t count);
-static bool add_id_to_list(uint32_t id, uint32_t *list, uint8_t *count, uint8_t max_size);
-static bool remove_id_from_list(uint32_t id, uint32_t *list, uint8_t *count);
+static uint32_t get_list_key(const struct bridge_config *config, const struct filter_list *list, const uint8_t *data);
+static void get_rule_command(struct bridge_config *config, const struct can2040_msg *received_msg);
+static void get_rewrite_command(struct bridge_config *config, const struct can2040_msg *received_msg);
+static bool get_bridge_command(const struct can2040_msg *received_msg);
+static void get_config_command(const struct can2040_msg *received_msg);
+static void get_bulk_command(const struct can2040_msg *received_msg);
+static void get_store_command(const struct can2040_msg *received_msg);
+static void get_trace_command(const struct can2040_msg *received_msg);
+static void get_echo_command(const struct can2040_msg *received_msg);
+static void get_stats_command(const struct can2040_msg *received_msg);
+static bool get_sched_command(const struct can2040_msg *received_msg);
+static void get_deadline_command(struct bridge_config *config, const struct can2040_msg *received_msg);
+static bool get_rate_command(const struct can2040_msg *received_msg);
+static bool get_forward_command(const struct can2040_msg *received_msg);
+static void get_policy_command(struct bridge_config *config, const struct can2040_msg *received_msg);
+static void get_load_command(const struct can2040_msg *received_msg);
+static bool get_health_command(const struct can2040_msg *received_msg);
+static void get_latency_command(const struct can2040_msg *received_msg);
+static void get_period_command(const struct can2040_msg *received_msg);
 void get_command(const struct can2040_msg *received_msg);
+bool bridge_filter_decision(uint32_t id, uint8_t rx_interface_id);
+bool bridge_filter_reference(uint32_t id, uint8_t rx_interface_id);
+static bool j1939_reference_listed(const struct filter_list *list, uint32_t id);
+const struct tx_scheduler *bridge_tx_scheduler(uint8_t interface_id);
+const struct bus_load *bridge_bus_load(uint8_t interface_id);
+const struct bus_health *bridge_bus_health(uint8_t interface_id);
+const struct outage_buffer *bridge_outage_buffer(uint8_t interface_id);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef CAN_BULK_H
+#define CAN_BULK_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "CAN_filter.h"
+
+// Segmented upload of an ID/rule table over CONTROL_ID. The computer announces the payload length,
+// streams it 6 bytes per frame with a 7-bit sequence number and closes with the CRC-32 of the whole
+// payload, which replaces the per-frame checksum. The table is only applied once the CRC matches.
+//
+// Payload: a list of records. Every record starts with a varint tag = (delta << 2) | kind, where delta
+// is added to the previous value of its group: for IDs the last ID the previous record added, for rules
+// the previous mask value or range start. Sorted tables cost about one byte per record for close values.
+// Varints are LEB128 (7 bits per byte, low bits first).
+
+#define BULK_MAX_BYTES              4096        // Largest payload, a full bitmap of 11-bit IDs is 256
+#define BULK_FRAME_BYTES            6           // Payload bytes per data frame
+#define BULK_SEQ_MASK               0x7F
+#define BULK_MAX_RUN                ID_SET_STD_IDS
+
+#define BULK_RECORD_ID              0           // The ID prev + delta
+#define BULK_RECORD_RUN             1           // varint n follows: the n + 1 IDs from prev + delta
+#define BULK_RECORD_BITMAP          2           // varint n follows, then n bytes: bit i is the ID prev + delta + i
+#define BULK_RECORD_RULE            3           // varint (x << 1 | is_range) follows: mask rule (prev + delta, x)
+                                                // or range rule [prev + delta, prev + delta + x]
+
+typedef enum {
+    BULK_OK,
+    BULK_ERROR_SEQUENCE,                        // A data frame was lost or repeated
+    BULK_ERROR_LENGTH,                          // Too long, or not all bytes arrived
+    BULK_ERROR_CRC,
+    BULK_ERROR_FORMAT,                          // The payload does not decode
+    BULK_ERROR_FULL,                            // The list has no room for the table
+    BULK_ERROR_NO_TRANSFER,                     // BULK_END or data without BULK_START
+} BulkStatus_t;
+
+struct bulk_transfer {
+    uint8_t data[BULK_MAX_BYTES];
+    uint32_t length;                            // Announced by BULK_START
+    uint32_t received;
+    uint32_t crc;                               // Running CRC of the bytes received so far
+    uint8_t next_seq;
+    uint8_t list;                               // Target list, as given by BULK_START
+    uint8_t flags;
+    bool active;
+    BulkStatus_t status;                        // First error of the transfer
+};
+
+// Writes records into a caller buffer. Values of each group must be added in ascending order.
+struct bulk_encoder {
+    uint8_t *out;
+    uint32_t capacity;
+    uint32_t length;
+    uint32_t prev_id;
+    uint32_t prev_rule;
+    bool overflow;                              // Out of room or not ascending, the payload is incomplete
+};
+
+uint32_t bulk_crc32_update(uint32_t crc, const uint8_t *data, uint32_t length);
+
+static inline uint32_t bulk_crc32(const uint8_t *data, uint32_t length) {
+    return bulk_crc32_update(0xFFFFFFFFu, data, length) ^ 0xFFFFFFFFu;
+}
+
+void bulk_begin(struct bulk_transfer *transfer, uint32_t length, uint8_t list, uint8_t flags);
+void bulk_receive(struct bulk_transfer *transfer, uint8_t seq, const uint8_t *payload);
+BulkStatus_t bulk_finish(struct bulk_transfer *transfer, uint32_t crc);
+BulkStatus_t bulk_apply(const uint8_t *data, uint32_t length, struct filter_list *list, uint32_t *records);
+
+void bulk_encoder_init(struct bulk_encoder *encoder, uint8_t *out, uint32_t capacity);
+void bulk_encode_ids(struct bulk_encoder *encoder, const uint32_t *ids, uint32_t count);
+void bulk_encode_mask(struct bulk_encoder *encoder, uint32_t value, uint32_t mask);
+void bulk_encode_range(struct bulk_encoder *encoder, uint32_t lo, uint32_t hi);
+void bulk_encode_list(struct bulk_encoder *encoder, const struct filter_list *list);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef CAN_ECHO_H
+#define CAN_ECHO_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Echo suppression table, one per interface.
+// Every frame the bridge transmits leaves a fingerprint (hash of id, dlc and data) with a timestamp.
+// A frame received within the window that has the same fingerprint is an echo and is consumed.
+// Each fingerprint maps to a 2-slot bucket, so a lookup costs two compares whatever the burst size,
+// and entries older than the window are ignored, so periodic frames with a constant payload pass.
+
+#define ECHO_TABLE_SLOTS            128         // Per interface, power of two
+#define ECHO_DEFAULT_WINDOW_US      5000        // Default echo window
+#define ECHO_EMPTY                  0           // Fingerprint of a free slot
+
+struct echo_entry {
+    uint32_t fingerprint;
+    uint32_t timestamp_us;                      // Time of the transmission (or of its TX-complete)
+};
+
+struct echo_table {
+    struct echo_entry slots[ECHO_TABLE_SLOTS];
+    uint32_t window_us;
+    uint32_t hits;                              // Received frames dropped as echoes
+    uint32_t misses;                            // Received frames that were not echoes
+    uint32_t evictions;                         // Live fingerprints overwritten by a full bucket
+};
+
+void echo_table_init(struct echo_table *table, uint32_t window_us);
+void echo_table_record(struct echo_table *table, uint32_t fingerprint, uint32_t now_us);
+bool echo_table_confirm(struct echo_table *table, uint32_t fingerprint, uint32_t now_us);
+bool echo_table_consume(struct echo_table *table, uint32_t fingerprint, uint32_t now_us);
+
+/**
+* @brief Fingerprint of a frame (never ECHO_EMPTY). data must point to the 8 byte can2040 payload,
+* bytes past dlc are ignored.
+*/
+static inline uint32_t echo_fingerprint(uint32_t id, uint8_t dlc, const uint8_t *data) {
+    uint32_t words[2];
+    memcpy(words, data, sizeof(words));
+    if (dlc < 8) {                                                  // Clear the bytes past dlc
+        uint64_t mask = (1ull << (dlc * 8)) - 1;
+        words[0] &= (uint32_t)mask;
+        words[1] &= (uint32_t)(mask >> 32);
+    }
+    uint32_t h = (id * 0x9E3779B1u) ^ dlc;
+    h = (h ^ words[0]) * 0x85EBCA6Bu;
+    h = (h ^ words[1]) * 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h ? h : 1;
+}
+
+#endif
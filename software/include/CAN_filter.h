@@ -0,0 +1,265 @@
+#ifndef CAN_FILTER_H
+#define CAN_FILTER_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "pico/platform.h"
+
+extern "C" {
+    #include "can2040.h"
+}
+
+// Constant time ID membership set used by the filter lists.
+// 11-bit IDs (0x000..0x7FF, no flags) live in a 2048-bit bitmap, every other 32-bit ID value
+// (extended IDs with CAN2040_ID_EFF, RTR flagged IDs) in an open addressing hash table.
+// The probe length is capped so a lookup never touches more than ID_SET_MAX_PROBE slots.
+// A zero initialised id_set is empty.
+
+#define ID_SET_STD_IDS          2048        // Number of 11-bit IDs
+#define ID_SET_EXT_SLOTS        512         // Hash slots for the other IDs, power of two
+#define ID_SET_EXT_SHIFT        23          // 32 - log2(ID_SET_EXT_SLOTS)
+#define ID_SET_MAX_EXT_IDS      256         // Keeps the hash table at most half full
+#define ID_SET_MAX_PROBE        8           // Slots looked at before giving up
+#define ID_SET_EMPTY_SLOT       0           // Free hash slot, 0 always lives in the bitmap
+
+struct id_set {
+    uint32_t std_bitmap[ID_SET_STD_IDS / 32];
+    uint32_t ext_slots[ID_SET_EXT_SLOTS];
+    uint16_t std_count;
+    uint16_t ext_count;
+};
+
+void id_set_clear(struct id_set *set);
+bool id_set_add(struct id_set *set, uint32_t id);
+bool id_set_remove(struct id_set *set, uint32_t id);
+
+static inline uint32_t id_set_hash(uint32_t id) {
+    return (id * 2654435761u) >> ID_SET_EXT_SHIFT;      // Fibonacci hashing
+}
+
+/**
+* @brief Checks if an ID is in the set. At most one bitmap read or ID_SET_MAX_PROBE slot reads.
+*/
+static inline bool id_set_contains(const struct id_set *set, uint32_t id) {
+    if (id < ID_SET_STD_IDS) {
+        return (set->std_bitmap[id >> 5] >> (id & 31)) & 1u;
+    }
+    uint32_t slot = id_set_hash(id);
+    for (uint8_t probe = 0; probe < ID_SET_MAX_PROBE; ++probe) {
+        uint32_t value = set->ext_slots[slot];
+        if (value == id) {
+            return true;
+        }
+        if (value == ID_SET_EMPTY_SLOT) {
+            return false;
+        }
+        slot = (slot + 1) & (ID_SET_EXT_SLOTS - 1);
+    }
+    return false;
+}
+
+static inline uint16_t id_set_count(const struct id_set *set) {
+    return (uint16_t)(set->std_count + set->ext_count);
+}
+
+
+// Mask and range rules attached to a filter list, for blocks of IDs such as J1939 PGNs or
+// source addresses. IDs are compared as can2040 presents them (extended IDs carry CAN2040_ID_EFF).
+// id_rules_compile() groups the mask rules by mask (one sorted table each) and merges the ranges
+// into a sorted, disjoint interval table, so a lookup is at most ID_RULES_MAX_MASKS + 1 binary searches.
+
+#define ID_RULES_MAX_MASK_RULES 64          // id/mask rules per list
+#define ID_RULES_MAX_RANGES     32          // [lo,hi] rules per list
+#define ID_RULES_MAX_MASKS      4           // Distinct masks per list
+
+struct id_mask_rule {
+    uint32_t value;                         // Already ANDed with mask
+    uint32_t mask;
+};
+
+struct id_range_rule {
+    uint32_t lo;
+    uint32_t hi;
+};
+
+struct id_mask_group {
+    uint32_t mask;
+    uint8_t first;                          // First value of this group in group_values
+    uint8_t count;
+};
+
+struct id_rules {
+    // As configured
+    struct id_mask_rule mask_rules[ID_RULES_MAX_MASK_RULES];
+    uint8_t mask_rule_count;
+    struct id_range_rule range_rules[ID_RULES_MAX_RANGES];
+    uint8_t range_rule_count;
+
+    // Compiled
+    struct id_mask_group groups[ID_RULES_MAX_MASKS];
+    uint8_t group_count;
+    uint32_t group_values[ID_RULES_MAX_MASK_RULES];     // Sorted within each group
+    struct id_range_rule merged[ID_RULES_MAX_RANGES];   // Sorted by lo, not overlapping
+    uint8_t merged_count;
+    uint32_t std_match[ID_SET_STD_IDS / 32];            // Rule verdict of every 11-bit ID
+};
+
+void id_rules_clear(struct id_rules *rules);
+bool id_rules_add_mask(struct id_rules *rules, uint32_t value, uint32_t mask);
+bool id_rules_remove_mask(struct id_rules *rules, uint32_t value, uint32_t mask);
+bool id_rules_add_range(struct id_rules *rules, uint32_t lo, uint32_t hi);
+bool id_rules_remove_range(struct id_rules *rules, uint32_t lo, uint32_t hi);
+void id_rules_compile(struct id_rules *rules);
+
+static inline bool id_sorted_contains(const uint32_t *values, uint8_t count, uint32_t value) {
+    uint8_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint8_t mid = (uint8_t)((lo + hi) >> 1);
+        if (values[mid] < value) {
+            lo = (uint8_t)(mid + 1);
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && values[lo] == value;
+}
+
+/**
+* @brief Checks an ID against the compiled rules.
+*/
+static inline bool id_rules_match(const struct id_rules *rules, uint32_t id) {
+    for (uint8_t g = 0; g < rules->group_count; ++g) {
+        const struct id_mask_group *group = &rules->groups[g];
+        if (id_sorted_contains(&rules->group_values[group->first], group->count, id & group->mask)) {
+            return true;
+        }
+    }
+    uint8_t lo = 0, hi = rules->merged_count;       //Last interval with merged.lo <= id
+    while (lo < hi) {
+        uint8_t mid = (uint8_t)((lo + hi) >> 1);
+        if (rules->merged[mid].lo <= id) {
+            lo = (uint8_t)(mid + 1);
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 && id <= rules->merged[lo - 1].hi;
+}
+
+// A filter list: exact IDs plus rules
+struct filter_list {
+    struct id_set ids;
+    struct id_rules rules;
+};
+
+void filter_list_clear(struct filter_list *list);
+
+static inline bool filter_list_contains(const struct filter_list *list, uint32_t id) {
+    if (id < ID_SET_STD_IDS) {
+        return ((list->ids.std_bitmap[id >> 5] | list->rules.std_match[id >> 5]) >> (id & 31)) & 1u;
+    }
+    return id_set_contains(&list->ids, id) || id_rules_match(&list->rules, id);
+}
+
+// J1939 lists: a filter_list whose values are keys decoded from 29-bit J1939 IDs instead of IDs.
+// An ID is priority(3) EDP/DP(2) PF(8) PS(8) SA(8); the PGN is EDP/DP, PF and, for PDU2 (PF >= 240), PS.
+// For PDU1 (PF < 240) PS is the destination address, the PGN has 0 there. A frame is listed if its source
+// address, its destination address (PDU1 only) or its PGN is in the list, so one PGN key covers every
+// priority, source and destination. Keys, also for the rules and bulk uploads of the list:
+#define J1939_KEY_DA            0x000       // + destination address, in the bitmap
+#define J1939_KEY_SA            0x100       // + source address, in the bitmap
+#define J1939_KEY_PGN           0x800       // + PGN (18 bits), in the hash table and the rules
+#define J1939_PDU2_MIN_PF       240
+#define J1939_PGN_MASK          0x3FFFF
+
+static inline bool filter_list_std_contains(const struct filter_list *list, uint32_t key) {
+    return ((list->ids.std_bitmap[key >> 5] | list->rules.std_match[key >> 5]) >> (key & 31)) & 1u;
+}
+
+/**
+* @brief Checks a J1939 frame against a J1939 list: two bitmap reads and one filter_list lookup.
+* 11-bit IDs and remote frames are never listed.
+*/
+static inline bool j1939_listed(const struct filter_list *list, uint32_t id) {
+    if ((id & (CAN2040_ID_EFF | CAN2040_ID_RTR)) != CAN2040_ID_EFF) {
+        return false;
+    }
+    if (filter_list_std_contains(list, J1939_KEY_SA + (id & 0xFF))) {
+        return true;
+    }
+    uint32_t pgn = (id >> 8) & J1939_PGN_MASK;
+    if (((pgn >> 8) & 0xFF) < J1939_PDU2_MIN_PF) {                 // PDU1: PS is the destination
+        if (filter_list_std_contains(list, J1939_KEY_DA + (pgn & 0xFF))) {
+            return true;
+        }
+        pgn &= ~0xFFu;
+    }
+    return filter_list_contains(list, J1939_KEY_PGN + pgn);
+}
+
+// Compiled routing decision for one direction (frames received on one interface).
+// Rebuilt from the filter mode and lists whenever a command changes them. The receive path branches on
+// one dispatch byte, picked for both directions of a mode together so the branch is the same whichever bus
+// a frame comes from, then returns a constant (passive and one-way modes), reads one bitmap bit (11-bit IDs)
+// or looks the ID up in the list. kind names the policy (and J1939 keys) for the reports only.
+
+typedef enum {
+    ROUTE_NEVER,            // Drop every frame
+    ROUTE_ALWAYS,           // Forward every frame
+    ROUTE_IF_LISTED,        // Forward only IDs in the list
+    ROUTE_IF_NOT_LISTED,    // Forward only IDs not in the list
+} RoutePolicy_t;
+
+#define ROUTE_KINDS         6       // Kinds: never, always, listed, not listed, J1939 listed, J1939 not listed
+
+#define ROUTE_DISPATCH_DROP     0   // Neither direction uses a list, this one drops every frame
+#define ROUTE_DISPATCH_FORWARD  1   // Neither direction uses a list, this one forwards every frame
+#define ROUTE_DISPATCH_SPLIT    2   // Both directions use a plain list: the bitmap below 0x800, the list above
+#define ROUTE_DISPATCH_BOUNDED  3   // One of them does, or both use a J1939 list: the bitmap up to bitmap_max_id,
+                                    // route_list_forward() above
+
+struct route_direction {
+    uint8_t dispatch;                           // ROUTE_DISPATCH_*, see route_dispatch_pair()
+    bool listed_forward;                        // Decision for a listed ID above 0x7FF: true for ROUTE_IF_LISTED
+    bool j1939;                                 // list is a J1939 list, see j1939_listed()
+    uint8_t kind;                               // Below ROUTE_KINDS, for the reports
+    uint32_t bitmap_max_id;                     // Highest ID decided by std_forward alone, UINT32_MAX for never and always
+    uint32_t std_forward[ID_SET_STD_IDS / 32];  // Forward bit per 11-bit ID, all alike for never and always
+    const struct filter_list *list;             // Consulted for IDs above 0x7FF, NULL if the policy ignores lists
+};
+
+void route_compile(struct route_direction *route, RoutePolicy_t policy, const struct filter_list *list, bool j1939);
+void route_dispatch_pair(struct route_direction routes[2]);
+bool route_list_forward(const struct route_direction *route, uint32_t id);
+bool route_j1939_forward(const struct route_direction *route, uint32_t id);
+const char *route_kind_name(uint8_t kind);
+
+/**
+* @brief Decision of a plain (not J1939) list for an ID above 0x7FF.
+*/
+static inline bool route_list_decision(const struct route_direction *route, uint32_t id) {
+    const struct filter_list *list = route->list;
+    return (id_set_contains(&list->ids, id) || id_rules_match(&list->rules, id)) == route->listed_forward;
+}
+
+/**
+* @brief Decides if a frame is forwarded in this direction.
+*/
+static inline bool route_forward(const struct route_direction *route, uint32_t id) {
+    uint8_t dispatch = route->dispatch;
+    if (dispatch == ROUTE_DISPATCH_SPLIT) {
+        if (id < ID_SET_STD_IDS) {                          //Tested on the ID alone, a mispredict resolves at once
+            return (route->std_forward[id >> 5] >> (id & 31)) & 1u;
+        }
+        return route_list_decision(route, id);
+    }
+    if (dispatch == ROUTE_DISPATCH_BOUNDED) {
+        if (id > route->bitmap_max_id) {                    //The listed direction of a one-way mode, J1939 lists
+            return route_list_forward(route, id);
+        }
+        return (route->std_forward[(id & (ID_SET_STD_IDS - 1)) >> 5] >> (id & 31)) & 1u;   //Never and always: all bits alike
+    }
+    return dispatch == ROUTE_DISPATCH_FORWARD;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef CAN_HEALTH_H
+#define CAN_HEALTH_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "CAN_sched.h"
+
+// Health of each bus and store-and-forward while it is down, used only by the core that owns the bus.
+// can2040 has no error-passive or bus-off state: it retries a frame nobody acknowledges forever. A bus is
+// down when its controller reports HEALTH_ERROR_LIMIT errors in a row, when a port reports bus-off, or when
+// frames wait on the controller and nothing was received or sent on the bus for HEALTH_TX_TIMEOUT_US
+// (a disconnected harness). Any frame seen on the bus brings it back up.
+// While a bus is down, the frames for it are held in its outage buffer instead of the transmit scheduler:
+// only the latest frame of each ID, until its TTL runs out. On recovery every frame still valid goes to the
+// scheduler at once and leaves at the full rate of the bus, in arbitration order.
+
+#define HEALTH_TX_TIMEOUT_US        50000       // Frames on the controller and no frame on the bus for this long: down
+#define HEALTH_ERROR_LIMIT          4           // Controller errors with no frame seen in between: down
+#define HEALTH_PROBE_INTERVAL_US    100000      // While down with an idle controller, one held frame is sent this often
+#define OUTAGE_BUFFER_SIZE          32          // IDs held per bus while it is down
+#define OUTAGE_DEFAULT_TTL_US       1000000     // How long a held frame stays worth sending, unless its ID has a TTL
+
+struct bus_health {
+    bool down;
+    uint8_t errors;                             // Controller errors since the last frame seen on the bus
+    uint32_t last_seen_us;                      // Last frame received or sent on the bus, or start of a transmission
+    uint32_t down_since_us;
+    uint32_t last_probe_us;
+    uint32_t outages;                           // Times the bus went down
+    uint32_t error_total;                       // Controller errors reported
+    uint32_t longest_outage_us;
+};
+
+struct outage_entry {
+    uint32_t id;
+    uint32_t expires_us;
+    frame_handle_t frame;
+};
+
+struct outage_buffer {
+    struct outage_entry entries[OUTAGE_BUFFER_SIZE];
+    uint8_t count;
+    uint32_t stored;                            // Frames taken while the bus was down
+    uint32_t replaced;                          // Held frames replaced by a newer frame of the same ID
+    uint32_t expired;                           // Held frames whose TTL ran out
+    uint32_t lost;                              // Frames dropped by a full buffer or a TTL of 0
+    uint32_t drained;                           // Held frames sent on after recovery (or as probes)
+};
+
+void bus_health_init(struct bus_health *health, uint32_t now_us);
+bool bus_health_error(struct bus_health *health, bool bus_off, uint32_t now_us);
+bool bus_health_check(struct bus_health *health, bool tx_pending, uint32_t now_us);
+void bus_health_recover(struct bus_health *health, uint32_t now_us);
+
+void outage_init(struct outage_buffer *buffer);
+void outage_put(struct outage_buffer *buffer, frame_handle_t frame, uint32_t ttl_us, uint32_t now_us);
+void outage_expire(struct outage_buffer *buffer, uint32_t now_us);
+bool outage_take(struct outage_buffer *buffer, frame_handle_t *frame, uint32_t now_us);
+
+/**
+* @brief A frame was received or sent on the bus. Returns true if the bus was down: call bus_health_recover()
+* and drain the outage buffer.
+*/
+static inline bool bus_health_seen(struct bus_health *health, uint32_t now_us) {
+    health->last_seen_us = now_us;
+    health->errors = 0;
+    return health->down;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef CAN_LATENCY_H
+#define CAN_LATENCY_H
+#include <stdint.h>
+#include <stdbool.h>
+
+// End-to-end forwarding latency, one latency_direction per receiving interface, written only by the core
+// that owns the target bus (from its TX-complete notification).
+// A forwarded frame is stamped when it is received; when the controller reports it sent, the time since is
+// added to a sketch of its direction and of its ID: queueing, held values, arbitration losses and
+// retransmissions included. A sketch is a log-linear histogram, LATENCY_SUB_BUCKETS buckets per power of
+// two, so a percentile is known within 1/LATENCY_SUB_BUCKETS of its value in a fixed LATENCY_BUCKETS counters.
+// Controllers complete their frames in the order they took them: the stamp of the n-th frame handed to a bus
+// waits in slot n % LATENCY_INFLIGHT until its tx_total reaches n + 1.
+
+#define LATENCY_SUB_BITS            3           // 8 buckets per power of two: percentiles within 12.5 %
+#define LATENCY_SUB_BUCKETS         (1u << LATENCY_SUB_BITS)
+#define LATENCY_OCTAVES             18          // Up to 2^20 us (about 1 s), slower frames count in the last bucket
+#define LATENCY_BUCKETS             (LATENCY_OCTAVES * LATENCY_SUB_BUCKETS)
+#define LATENCY_MAX_IDS             8           // IDs with their own sketch per direction, the first ones forwarded
+#define LATENCY_NO_STAMP            0           // Frame without a receive time (made by the bridge, or the probe was off)
+#define LATENCY_INFLIGHT            64          // Stamps of the frames on a controller, at least the tx_depth of any bus port
+
+struct latency_sketch {
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+};
+
+struct latency_direction {
+    struct latency_sketch all;
+    uint32_t ids[LATENCY_MAX_IDS];
+    struct latency_sketch per_id[LATENCY_MAX_IDS];
+    uint8_t id_count;
+    uint32_t untracked;                         // Frames of IDs that found no free sketch
+};
+
+void latency_direction_reset(struct latency_direction *direction);
+void latency_record(struct latency_direction *direction, uint32_t id, uint32_t latency_us);
+uint32_t latency_percentile(const struct latency_sketch *sketch, uint32_t permille);
+const struct latency_sketch *latency_find(const struct latency_direction *direction, uint32_t id);
+void latency_direction_print(const struct latency_direction *direction, uint8_t interface_id);
+
+/**
+* @brief Receive time of a frame for the latency probe, never LATENCY_NO_STAMP (1 us late once per wrap).
+*/
+static inline uint32_t latency_stamp(uint32_t now_us) {
+    return now_us == LATENCY_NO_STAMP ? 1 : now_us;
+}
+
+/**
+* @brief Bucket of a latency: exact below 2 * LATENCY_SUB_BUCKETS, then LATENCY_SUB_BUCKETS per power of two.
+*/
+static inline uint32_t latency_bucket(uint32_t latency_us) {
+    if (latency_us < 2 * LATENCY_SUB_BUCKETS) {
+        return latency_us;
+    }
+    uint32_t msb = 31u - (uint32_t)__builtin_clz(latency_us);
+    uint32_t bucket = ((msb - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+                    | ((latency_us >> (msb - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef CAN_LOAD_H
+#define CAN_LOAD_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <atomic>
+#include "CAN_sched.h"
+
+// Load monitor of one bus, updated by the core that owns it: the wire bits of every frame seen on the bus
+// (received from the other nodes or sent by the bridge, see can_frame_bits()) are summed over a window
+// and divided by what the bitrate could carry in that time.
+// Load shedding: while the load of a bus is at or above shed_permille, the frames forwarded to it that
+// lose arbitration to shed_id (shed_id itself and every lower priority ID) are dropped, until the load
+// falls below restore_permille. The settings are written by the owner core too (LOAD_COMMAND goes through it),
+// the other core reads the shedding flag and shed_key, each as a single word.
+
+#define LOAD_DEFAULT_BITRATE        125000      // Bits per second until bridge_set_bitrate(), as BITRATE_CAN0/1 in main.cpp
+#define LOAD_WINDOW_US              100000      // Length of a measurement window
+#define LOAD_NO_CLASS               0xFFFFFFFF  // shed_id of a bus that never sheds
+
+struct bus_load {
+    uint32_t bitrate;
+    uint32_t window_start_us;
+    uint32_t window_bits;                       // Bits seen since window_start_us
+    uint32_t load_permille;                     // Load of the last complete window
+    uint32_t peak_permille;                     // Highest window load since the last reset
+    uint32_t shed_permille;                     // Load that starts shedding, 0 = never
+    uint32_t restore_permille;                  // Load under which shedding stops
+    uint32_t shed_id;                           // First ID of the low priority class, LOAD_NO_CLASS for none
+    uint32_t shed_key;                          // can_arbitration_key(shed_id)
+    std::atomic<bool> shedding;
+};
+
+void bus_load_init(struct bus_load *load, uint32_t bitrate, uint32_t now_us);
+void bus_load_set_class(struct bus_load *load, uint32_t shed_id);
+void bus_load_tick(struct bus_load *load, uint32_t now_us);
+
+/**
+* @brief A frame of bits took the bus at now_us. Owner core only.
+*/
+static inline void bus_load_add(struct bus_load *load, uint32_t bits, uint32_t now_us) {
+    bus_load_tick(load, now_us);
+    load->window_bits += bits;
+}
+
+/**
+* @brief True if a frame with this ID must not be sent to the bus now. Either core.
+*/
+static inline bool bus_load_sheds(const struct bus_load *load, uint32_t id) {
+    return load->shedding.load(std::memory_order_relaxed) && can_arbitration_key(id) >= load->shed_key;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef CAN_PERIOD_H
+#define CAN_PERIOD_H
+#include <stdint.h>
+#include <stdbool.h>
+
+// Learned schedule of the forwarded IDs, one period_table per receiving interface, written only by the core
+// that owns the bus from its receive interrupt.
+// Each ID gets an online estimate of its period and jitter: every interval between two of its frames moves the
+// period 1/2^PERIOD_GAIN_SHIFT of the way to it, and the jitter (mean deviation from the period, as in RFC 3550)
+// 1/2^PERIOD_JITTER_SHIFT. Once PERIOD_LEARN_SAMPLES intervals were seen the period is trusted and kept as the
+// reference, so a node whose period moves away from it is drifting; one that sent nothing for
+// PERIOD_SILENT_FACTOR periods is silent. An interval over PERIOD_GAP_FACTOR periods (a silent node coming
+// back) is counted as a gap instead of a sample; PERIOD_LEARN_SAMPLES of them in a row start learning again.
+// The table is a fixed hash table: an ID is looked for in PERIOD_PROBES slots only, so an update is O(1) in the
+// receive interrupt. When they are all taken, a stale entry gives its slot, otherwise the ID is not tracked.
+
+#define PERIOD_TABLE_BITS           6
+#define PERIOD_TABLE_SIZE           (1u << PERIOD_TABLE_BITS)   // IDs tracked per direction
+#define PERIOD_PROBES               4           // Slots an ID may use
+#define PERIOD_FRAC_BITS            4           // Periods and jitter kept in 1/16 us
+#define PERIOD_GAIN_SHIFT           3           // The period follows 1/8 of each interval's error
+#define PERIOD_JITTER_SHIFT         4           // The jitter follows 1/16 of each deviation
+#define PERIOD_LEARN_SAMPLES        8           // Intervals before the period is trusted
+#define PERIOD_GAP_FACTOR           4           // Intervals over 4 periods are gaps
+#define PERIOD_SILENT_FACTOR        3           // No frame for 3 periods: silent
+#define PERIOD_DRIFT_PERMILLE       20          // Period 2 % away from its reference: drifting
+#define PERIOD_STALE_US             1000000     // An ID not learned and not seen for this long gives its slot
+
+typedef enum {
+    PERIOD_LEARNING,                // Fewer than PERIOD_LEARN_SAMPLES intervals
+    PERIOD_STEADY,
+    PERIOD_DRIFTING,                // Period away from its reference
+    PERIOD_SILENT,                  // No frame for PERIOD_SILENT_FACTOR periods
+} PeriodState_t;
+
+struct period_entry {
+    uint32_t id;
+    uint32_t last_us;               // Last frame
+    uint32_t period_q;              // Estimated period, 1/16 us
+    uint32_t jitter_q;              // Mean deviation from the period, 1/16 us
+    uint32_t reference_us;          // Period when it was learned, 0 while learning
+    uint16_t samples;               // Intervals seen, saturates
+    uint16_t gaps;                  // Intervals over PERIOD_GAP_FACTOR periods
+    uint8_t gaps_in_row;
+    bool used;
+};
+
+struct period_table {
+    struct period_entry entries[PERIOD_TABLE_SIZE];
+    uint8_t count;
+    uint32_t untracked;             // Frames whose ID found no slot
+};
+
+void period_table_init(struct period_table *table);
+uint32_t period_update(struct period_table *table, uint32_t id, uint32_t now_us);
+const struct period_entry *period_find(const struct period_table *table, uint32_t id);
+PeriodState_t period_state(const struct period_entry *entry, uint32_t now_us);
+int32_t period_drift_permille(const struct period_entry *entry);
+void period_table_print(const struct period_table *table, uint8_t interface_id, uint32_t now_us);
+
+static inline uint32_t period_us(const struct period_entry *entry) {
+    return entry->period_q >> PERIOD_FRAC_BITS;
+}
+
+static inline uint32_t period_jitter_us(const struct period_entry *entry) {
+    return entry->jitter_q >> PERIOD_FRAC_BITS;
+}
+
+static inline bool period_learned(const struct period_entry *entry) {
+    return entry->samples >= PERIOD_LEARN_SAMPLES;
+}
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef CAN_POLICY_H
+#define CAN_POLICY_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "CAN_filter.h"
+#include "CAN_pool.h"
+
+extern "C" {
+    #include "can2040.h"
+}
+
+// Per-ID forwarding policies, applied to frames the routes already let through: a token bucket rate
+// limit, and for single IDs change-only forwarding or latest-value downsampling.
+// A policy belongs to one ID or to an id/mask rule (all matching IDs share it). Like the filter lists,
+// every 11-bit ID resolves with one table read (std_entry, compiled from the IDs and the rules) and the
+// other IDs with a hash probe (the table is at most half full), then the rules.
+// The table only holds the definitions and is published with the filter configuration (see struct
+// bridge_config), so it is never edited while a core reads it. The state of each entry (struct policy_state)
+// belongs to the core receiving the frames, indexed like the entries: an entry keeps its slot until it is
+// removed, and its serial and revision tell that core to set the state up again once the entry was
+// added or edited.
+
+#define POLICY_MAX_ENTRIES          64          // IDs and rules with a policy
+#define POLICY_MAX_RULES            8           // Of which id/mask rules
+#define POLICY_EXT_SLOTS            128         // Hash slots for IDs above 0x7FF, power of two
+#define POLICY_EXT_SHIFT            25          // 32 - log2(POLICY_EXT_SLOTS)
+#define POLICY_EXACT_MASK           0xFFFFFFFFu // Mask of a single ID policy
+
+// Token bucket. Credit is kept as time (1/16 us units) so refilling is one add, no divide.
+#define TOKEN_Q                     4           // Fraction bits of the credit
+#define TOKEN_MAX_CREDIT            0x7FFFFFFFu // Largest bucket, about 134 s of credit
+
+struct token_bucket {
+    uint32_t token_q;               // Cost of one token, 0 = no limit
+    uint32_t burst_q;               // Bucket size
+    uint32_t credit_q;
+    uint32_t last_us;
+};
+
+void token_bucket_config(struct token_bucket *bucket, uint32_t tokens_per_s, uint32_t burst_tokens, uint32_t now_us);
+
+/**
+* @brief Takes tokens from a bucket. Returns false (and takes nothing) if there are not enough.
+*/
+static inline bool token_bucket_take(struct token_bucket *bucket, uint32_t tokens, uint32_t now_us) {
+    if (bucket->token_q == 0) {
+        return true;
+    }
+    uint32_t elapsed = now_us - bucket->last_us;
+    bucket->last_us = now_us;
+    if (elapsed >= (bucket->burst_q >> TOKEN_Q)) {
+        bucket->credit_q = bucket->burst_q;                 // Idle long enough to be full
+    } else {
+        bucket->credit_q += elapsed << TOKEN_Q;
+        if (bucket->credit_q > bucket->burst_q) {
+            bucket->credit_q = bucket->burst_q;
+        }
+    }
+    uint32_t cost = tokens * bucket->token_q;
+    if (bucket->credit_q < cost) {
+        return false;
+    }
+    bucket->credit_q -= cost;
+    return true;
+}
+
+/**
+* @brief Bits a frame occupies on the wire, worst case bit stuffing, including the interframe space.
+*/
+static inline uint32_t can_frame_bits(uint32_t id, uint8_t dlc) {
+    uint32_t data_bits = 8u * (dlc > 8 ? 8u : dlc);
+    if (id & CAN2040_ID_EFF) {
+        return 67u + data_bits + (54u + data_bits - 1u) / 4u;
+    }
+    return 47u + data_bits + (34u + data_bits - 1u) / 4u;
+}
+
+typedef enum {
+    FORWARD_EVERY,                  // Every frame
+    FORWARD_ON_CHANGE,              // Only when dlc or payload changed, or when interval_us passed since the last one
+    FORWARD_LATEST,                 // At most one frame per interval_us, the latest value wins
+} ForwardPolicy_t;
+
+typedef enum {
+    POLICY_PASS,                    // Forward the frame now
+    POLICY_SUPPRESS,                // Same value as the last forwarded frame, drop it
+    POLICY_HOLD,                    // Keep it as the latest value, it is forwarded when the interval ends
+} PolicyVerdict_t;
+
+// State of one policy for the frames received on one interface
+struct policy_state {
+    uint32_t serial;                // Of the entry the state was set up for, 0 = none
+    uint32_t revision;              // Of its last edit applied
+    struct token_bucket bucket;
+    uint32_t rate_drops;            // Dropped by the rate limit
+    uint32_t suppressed;            // Dropped as unchanged, or replaced by a newer value while held
+    uint32_t last_us;               // Time the last frame was forwarded
+    uint8_t last_data[8];           // The first last_dlc bytes only
+    uint8_t last_dlc;
+    bool has_last;
+};
+
+struct id_policy {
+    uint32_t id;                    // The ID, or the rule value (already ANDed with mask)
+    uint32_t mask;                  // POLICY_EXACT_MASK for a single ID
+    uint32_t rate;                  // Frames per second, 0 = no limit
+    uint32_t burst;                 // Frames
+    ForwardPolicy_t forward;        // Single IDs only, rules always FORWARD_EVERY
+    uint32_t interval_us;
+    uint32_t serial;                // Table revision that added it, rules match in this order
+    uint32_t revision;              // Table revision of its last edit
+    bool used;
+};
+
+struct policy_table {
+    struct id_policy entries[POLICY_MAX_ENTRIES];   // Slots, see used
+    uint8_t count;
+    uint8_t rule_count;
+    uint32_t revision;              // Bumped by every change
+
+    // Compiled, entry index + 1 (0 = no policy)
+    uint8_t std_entry[ID_SET_STD_IDS];
+    uint32_t ext_ids[POLICY_EXT_SLOTS];
+    uint8_t ext_entry[POLICY_EXT_SLOTS];
+    uint8_t rule_entry[POLICY_MAX_RULES];   // Rules in the order they were added (serial)
+};
+
+void policy_table_clear(struct policy_table *table);
+const struct id_policy *policy_table_find(const struct policy_table *table, uint32_t id, uint32_t mask);
+struct id_policy *policy_table_get(struct policy_table *table, uint32_t id, uint32_t mask);
+void policy_table_edited(struct policy_table *table, struct id_policy *entry);
+void policy_table_remove(struct policy_table *table, uint32_t id, uint32_t mask);
+void policy_table_compile(struct policy_table *table);
+
+static inline bool id_policy_is_empty(const struct id_policy *policy) {
+    return policy->rate == 0 && policy->forward == FORWARD_EVERY;
+}
+
+static inline uint8_t policy_data_len(const struct can2040_msg *msg) {
+    return msg->dlc > 8 ? 8 : (uint8_t)msg->dlc;
+}
+
+/**
+* @brief What the forward policy does with a frame. Does not change the state, see policy_commit().
+* Only the dlc bytes of the payload count, a pool slot keeps older bytes after them.
+*/
+static inline PolicyVerdict_t policy_check(const struct id_policy *policy, const struct policy_state *state,
+                                           const struct can2040_msg *msg, uint32_t now_us) {
+    switch (policy->forward) {
+        case FORWARD_ON_CHANGE:
+            if (state->has_last && state->last_dlc == msg->dlc && memcmp(state->last_data, msg->data, policy_data_len(msg)) == 0
+                && (policy->interval_us == 0 || now_us - state->last_us < policy->interval_us)) {
+                return POLICY_SUPPRESS;
+            }
+            return POLICY_PASS;
+        case FORWARD_LATEST:
+            if (state->has_last && now_us - state->last_us < policy->interval_us) {
+                return POLICY_HOLD;
+            }
+            return POLICY_PASS;
+        default:
+            return POLICY_PASS;
+    }
+}
+
+/**
+* @brief Records a frame that was forwarded.
+*/
+static inline void policy_commit(struct policy_state *state, const struct can2040_msg *msg, uint32_t now_us) {
+    state->last_us = now_us;
+    state->last_dlc = (uint8_t)msg->dlc;
+    memcpy(state->last_data, msg->data, policy_data_len(msg));
+    state->has_last = true;
+}
+
+static inline uint32_t policy_hash(uint32_t id) {
+    return (id * 2654435761u) >> POLICY_EXT_SHIFT;
+}
+
+/**
+* @brief Policy of an ID: its own entry, else the first rule it matches. NULL if none.
+*/
+static inline const struct id_policy *policy_lookup(const struct policy_table *table, uint32_t id) {
+    if (id < ID_SET_STD_IDS) {
+        uint8_t entry = table->std_entry[id];
+        return entry ? &table->entries[entry - 1] : NULL;
+    }
+    uint32_t slot = policy_hash(id);
+    while (true) {                                          // Ends at a free slot, more than half are
+        uint8_t entry = table->ext_entry[slot];
+        if (entry == 0) {
+            break;
+        }
+        if (table->ext_ids[slot] == id) {
+            return &table->entries[entry - 1];
+        }
+        slot = (slot + 1) & (POLICY_EXT_SLOTS - 1);
+    }
+    for (uint8_t r = 0; r < table->rule_count; ++r) {
+        const struct id_policy *rule = &table->entries[table->rule_entry[r] - 1];
+        if ((id & rule->mask) == rule->id) {
+            return rule;
+        }
+    }
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef CAN_POOL_H
+#define CAN_POOL_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "CAN_queue.h"
+
+extern "C" {
+    #include "can2040.h"
+}
+
+// Fixed pool of frames shared by the receive path, the held latest values and the transmit schedulers.
+// A received frame is written once into a slot; the cross-core queues and the schedulers pass a one byte
+// handle to it instead of copying the frame at every hop, and the slot is free again when the last
+// reference is released. RAM use is fixed, FRAME_POOL_SIZE frames per core whatever the traffic.
+// Each core allocates from its own pool (bit 7 of the handle). Only that core changes the reference counts
+// and the free list, from its CAN interrupt or with interrupts masked, so no read-modify-write crosses the
+// cores: the other core gives its references back through the pool's return queue, drained on allocation
+// and by bridge_service().
+// A frame is only written while a single reference holds it.
+
+#define FRAME_POOL_SIZE             120     // Frames per core, at most 127
+#define FRAME_POOL_CORE_SHIFT       7       // Handle = core << 7 | slot
+#define FRAME_NONE                  0xFF    // No frame, never a valid handle
+
+typedef uint8_t frame_handle_t;
+
+struct frame_pool {
+    struct can2040_msg frames[FRAME_POOL_SIZE];
+    uint32_t rx_us[FRAME_POOL_SIZE];        // Receive time for the latency probe, see CAN_latency.h
+    uint32_t due_us[FRAME_POOL_SIZE];       // Send-by time for TX_ORDER_EDF, see CAN_sched.h
+    uint8_t refs[FRAME_POOL_SIZE];
+    uint8_t free_slots[FRAME_POOL_SIZE];    // Stack of unused slots
+    uint8_t free_count;
+    struct handle_queue returned;           // References the other core released, it holds at most one per frame
+    uint32_t high_water;                    // Most frames in use at once
+    uint32_t exhausted;                     // Allocations refused because every frame was in use
+};
+
+extern struct frame_pool frame_pools[2];    // Indexed by core
+
+void frame_pool_init(void);
+void frame_pool_collect(void);
+frame_handle_t frame_alloc(void);
+void frame_ref(frame_handle_t frame);
+void frame_release(frame_handle_t frame);
+
+static inline struct can2040_msg *frame_get(frame_handle_t frame) {
+    return &frame_pools[frame >> FRAME_POOL_CORE_SHIFT].frames[frame & ((1u << FRAME_POOL_CORE_SHIFT) - 1)];
+}
+
+static inline uint32_t *frame_rx_us(frame_handle_t frame) {
+    return &frame_pools[frame >> FRAME_POOL_CORE_SHIFT].rx_us[frame & ((1u << FRAME_POOL_CORE_SHIFT) - 1)];
+}
+
+static inline uint32_t *frame_due_us(frame_handle_t frame) {
+    return &frame_pools[frame >> FRAME_POOL_CORE_SHIFT].due_us[frame & ((1u << FRAME_POOL_CORE_SHIFT) - 1)];
+}
+
+static inline uint32_t frame_pool_in_use(const struct frame_pool *pool) {
+    return FRAME_POOL_SIZE - pool->free_count;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef CAN_PORT_H
+#define CAN_PORT_H
+#include <stdint.h>
+#include <stdbool.h>
+
+extern "C" {
+    #include "can2040.h"
+}
+
+// Bus port: how the bridge reaches the controller of a bus, so the same filtering core runs over
+// can2040 on the RP2040 or over SocketCAN on Linux. Received frames enter the bridge through
+// bridge_receive(), completed transmissions through bridge_tx_done(). The bridge hands a port
+// frames while fewer than tx_depth of them are still waiting for the wire.
+// Both interfaces start on the can2040 ports (can_rx_callback()/bridge_tx_complete() feed them).
+
+struct bus_port {
+    int (*send)(void *ctx, struct can2040_msg *msg);    // 0 when the controller took the frame
+    bool (*ready)(void *ctx);                           // Room for one more frame
+    uint32_t (*tx_total)(void *ctx);                    // Transmissions completed so far, wraps
+    void *ctx;
+    uint32_t tx_depth;                                  // Frames handed over and not yet on the wire
+};
+
+extern const struct bus_port can2040_ports[2];          // cbus0 and cbus1
+
+#endif
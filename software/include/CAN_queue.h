@@ -0,0 +1,106 @@
+#ifndef CAN_QUEUE_H
+#define CAN_QUEUE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <atomic>
+
+extern "C" {
+    #include "can2040.h"
+}
+
+// Lock-free single producer / single consumer frame queue.
+// The producer (the RX interrupt of one core) only writes head, the consumer (the core that owns the
+// target bus) only writes tail, so no lock or read-modify-write is needed across the cores.
+// head/tail are free running, the slot is the low bits.
+
+#define FRAME_QUEUE_SIZE            64      // Power of two
+
+struct frame_queue {
+    struct can2040_msg slots[FRAME_QUEUE_SIZE];
+    std::atomic<uint32_t> head;             // Next slot to write, producer only
+    std::atomic<uint32_t> tail;             // Next slot to read, consumer only
+    uint32_t high_water;                    // Deepest the queue has been, producer only
+    uint32_t drops;                         // Frames lost because the queue was full, producer only
+};
+
+void frame_queue_init(struct frame_queue *queue);
+
+/**
+* @brief Producer side: copies a frame into the queue. Returns false (and counts a drop) if it is full.
+*/
+static inline bool frame_queue_push(struct frame_queue *queue, const struct can2040_msg *msg) {
+    uint32_t head = queue->head.load(std::memory_order_relaxed);
+    uint32_t depth = head - queue->tail.load(std::memory_order_acquire);
+    if (depth >= FRAME_QUEUE_SIZE) {
+        queue->drops++;
+        return false;
+    }
+    queue->slots[head & (FRAME_QUEUE_SIZE - 1)] = *msg;
+    queue->head.store(head + 1, std::memory_order_release);    // Publishes the slot
+    if (depth + 1 > queue->high_water) {
+        queue->high_water = depth + 1;
+    }
+    return true;
+}
+
+/**
+* @brief Consumer side: takes the oldest frame. Returns false if the queue is empty.
+*/
+static inline bool frame_queue_pop(struct frame_queue *queue, struct can2040_msg *msg) {
+    uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail == queue->head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    *msg = queue->slots[tail & (FRAME_QUEUE_SIZE - 1)];
+    queue->tail.store(tail + 1, std::memory_order_release);    // Gives the slot back
+    return true;
+}
+
+static inline uint32_t frame_queue_depth(const struct frame_queue *queue) {
+    return queue->head.load(std::memory_order_acquire) - queue->tail.load(std::memory_order_acquire);
+}
+
+// The same queue for one byte frame handles (see CAN_pool.h): the frame stays in its pool slot.
+
+#define HANDLE_QUEUE_SIZE           128     // Power of two, at least a frame pool
+
+struct handle_queue {
+    uint8_t slots[HANDLE_QUEUE_SIZE];
+    std::atomic<uint32_t> head;             // Next slot to write, producer only
+    std::atomic<uint32_t> tail;             // Next slot to read, consumer only
+    uint32_t high_water;                    // Deepest the queue has been, producer only
+    uint32_t drops;                         // Handles refused because the queue was full, producer only
+};
+
+void handle_queue_init(struct handle_queue *queue);
+
+static inline bool handle_queue_push(struct handle_queue *queue, uint8_t handle) {
+    uint32_t head = queue->head.load(std::memory_order_relaxed);
+    uint32_t depth = head - queue->tail.load(std::memory_order_acquire);
+    if (depth >= HANDLE_QUEUE_SIZE) {
+        queue->drops++;
+        return false;
+    }
+    queue->slots[head & (HANDLE_QUEUE_SIZE - 1)] = handle;
+    queue->head.store(head + 1, std::memory_order_release);
+    if (depth + 1 > queue->high_water) {
+        queue->high_water = depth + 1;
+    }
+    return true;
+}
+
+static inline bool handle_queue_pop(struct handle_queue *queue, uint8_t *handle) {
+    uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail == queue->head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    *handle = queue->slots[tail & (HANDLE_QUEUE_SIZE - 1)];
+    queue->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+static inline uint32_t handle_queue_depth(const struct handle_queue *queue) {
+    return queue->head.load(std::memory_order_acquire) - queue->tail.load(std::memory_order_acquire);
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef CAN_REWRITE_H
+#define CAN_REWRITE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "CAN_filter.h"
+
+extern "C" {
+    #include "can2040.h"
+}
+
+// ID translation and payload rewrite of forwarded frames, one table per direction (frames received on
+// one interface). A rule maps one received ID to the ID sent on the other bus, and can rewrite the payload
+// (data = (data & keep) | set, byte by byte) and change the DLC. Bytes past the received DLC read as 0.
+// Lookup like the filter lists: 11-bit IDs without a rule cost one bitmap read, the others a hash probe
+// in a table that is at most a quarter full.
+
+#define REWRITE_MAX_RULES           32          // Rules per direction
+#define REWRITE_SLOTS               128         // Hash slots, power of two
+#define REWRITE_SHIFT               25          // 32 - log2(REWRITE_SLOTS)
+#define REWRITE_KEEP_DLC            0xFF        // The rule leaves the DLC alone
+
+struct rewrite_rule {
+    uint32_t id;                                // As received, with the can2040 flags
+    uint32_t new_id;                            // As sent
+    union {
+        uint8_t keep[8];                        // Bits of the received payload that stay
+        uint32_t keep32[2];
+    };
+    union {
+        uint8_t set[8];                         // Bits set after the mask
+        uint32_t set32[2];
+    };
+    uint8_t dlc;                                // 0..8, or REWRITE_KEEP_DLC
+    bool payload;                               // keep/set change something
+};
+
+struct rewrite_table {
+    struct rewrite_rule rules[REWRITE_MAX_RULES];
+    uint8_t count;
+
+    // Compiled
+    uint32_t std_present[ID_SET_STD_IDS / 32];  // 11-bit IDs that have a rule
+    uint32_t slot_ids[REWRITE_SLOTS];
+    uint8_t slot_rule[REWRITE_SLOTS];           // Rule index + 1, 0 = free
+};
+
+void rewrite_rule_init(struct rewrite_rule *rule, uint32_t id);
+void rewrite_table_clear(struct rewrite_table *table);
+bool rewrite_table_set(struct rewrite_table *table, const struct rewrite_rule *rule);
+bool rewrite_table_remove(struct rewrite_table *table, uint32_t id);
+void rewrite_table_compile(struct rewrite_table *table);
+
+static inline uint32_t rewrite_hash(uint32_t id) {
+    return (id * 2654435761u) >> REWRITE_SHIFT;
+}
+
+/**
+* @brief Rule of a received ID, NULL if the frame goes out unchanged.
+*/
+static inline const struct rewrite_rule *rewrite_lookup(const struct rewrite_table *table, uint32_t id) {
+    if (table->count == 0) {
+        return NULL;
+    }
+    if (id < ID_SET_STD_IDS && !((table->std_present[id >> 5] >> (id & 31)) & 1u)) {
+        return NULL;
+    }
+    uint32_t slot = rewrite_hash(id);
+    while (table->slot_rule[slot] != 0) {                   // Ends at a free slot, most are
+        if (table->slot_ids[slot] == id) {
+            return &table->rules[table->slot_rule[slot] - 1];
+        }
+        slot = (slot + 1) & (REWRITE_SLOTS - 1);
+    }
+    return NULL;
+}
+
+/**
+* @brief Rewrites a frame in place.
+*/
+static inline void rewrite_apply(const struct rewrite_rule *rule, struct can2040_msg *msg) {
+    msg->id = rule->new_id;
+    if (rule->dlc != REWRITE_KEEP_DLC) {
+        uint32_t dlc = msg->dlc > 8 ? 8 : msg->dlc;
+        if (rule->dlc > dlc) {
+            memset(&msg->data[dlc], 0, rule->dlc - dlc);    // Grown frames get zeros, then the rule's bits
+        }
+        msg->dlc = rule->dlc;
+    }
+    if (rule->payload) {
+        msg->data32[0] = (msg->data32[0] & rule->keep32[0]) | rule->set32[0];
+        msg->data32[1] = (msg->data32[1] & rule->keep32[1]) | rule->set32[1];
+    }
+}
+
+#endif
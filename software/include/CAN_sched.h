@@ -0,0 +1,105 @@
+#ifndef CAN_SCHED_H
+#define CAN_SCHED_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "CAN_pool.h"
+
+extern "C" {
+    #include "can2040.h"
+}
+
+// Transmit scheduler, one per output bus, used only by the core that owns the bus.
+// Frames wait in a fixed pool (as CAN_pool.h handles, the frame stays where it was received) and are released in CAN arbitration order (the frame that would win
+// arbitration first), frames with the same ID in arrival order. The pool is a binary min-heap of
+// slot indices, so push and pop cost O(log TX_SCHED_POOL_SIZE). The bridge only hands a few frames
+// at a time to the controller (its own queue is FIFO), so a high priority frame waits behind at most
+// TX_SCHED_HW_DEPTH frames when the bus is congested.
+// A frame may carry a deadline: if it has not been released by then it is stale and is dropped.
+// The scheduler owns one reference of each frame it holds: a dropped frame is released, a popped one passes to the caller.
+// Burst buffering: a bus slower than the one its frames come from holds more of them (its capacity, see
+// tx_sched_burst_capacity()), so a burst of the fast bus waits for the slow wire instead of overflowing.
+// Earliest deadline first (TX_ORDER_EDF): frames are released by the time they should be sent by instead,
+// given by the bridge from the learned period of their ID (see CAN_period.h) or their deadline if it is
+// earlier, and in arbitration order among equal deadlines. A full pool then drops the latest deadline.
+
+#define TX_SCHED_POOL_SIZE          112     // Most frames waiting per bus, at most 255 and below FRAME_POOL_SIZE
+#define TX_SCHED_DEFAULT_CAPACITY   64      // Frames waiting on a bus at least as fast as its source
+#define TX_BURST_WINDOW_US          10000   // Longest burst at the full rate of the faster bus absorbed without loss
+#define TX_BURST_FRAME_BITS         111     // Shortest wire length of an 8 byte standard frame (no stuff bits)
+#define TX_SCHED_HW_DEPTH           2       // Frames handed to can2040 and not yet on the wire
+#define TX_SCHED_MAX_DEADLINES      32      // IDs with a deadline
+#define TX_SCHED_NO_DEADLINE        0
+#define TX_EDF_DEFAULT_DUE_US       100000  // Send-by time, after reception, of a frame whose ID has no learned period
+
+typedef enum {
+    TX_SCHED_DROP_LOWEST_PRIORITY,  // A full pool drops the frame that would lose arbitration to all the others
+    TX_SCHED_DROP_OLDEST,           // A full pool drops the frame that has waited the longest
+} TxOverflowPolicy_t;
+
+typedef enum {
+    TX_ORDER_ARBITRATION,           // The frame that would win arbitration first
+    TX_ORDER_EDF,                   // The frame with the earliest due time first
+} TxOrder_t;
+
+struct tx_sched_entry {
+    frame_handle_t frame;
+    uint32_t key;                   // can_arbitration_key() of the frame's ID
+    uint32_t seq;                   // Arrival order
+    uint32_t deadline_us;           // Absolute, only if has_deadline
+    uint32_t due_us;                // Absolute send-by time, orders TX_ORDER_EDF
+    bool has_deadline;
+};
+
+struct tx_scheduler {
+    struct tx_sched_entry pool[TX_SCHED_POOL_SIZE];
+    uint8_t heap[TX_SCHED_POOL_SIZE];       // Pool indices, heap[0] is released next
+    uint8_t free_slots[TX_SCHED_POOL_SIZE]; // Stack of unused pool indices
+    uint8_t count;
+    uint8_t free_count;
+    uint8_t capacity;                       // Frames waiting at most, up to TX_SCHED_POOL_SIZE
+    uint32_t next_seq;
+    TxOverflowPolicy_t policy;
+    TxOrder_t order;
+    uint32_t high_water;                    // Most frames waiting at once
+    uint32_t overflow_drops;                // Frames dropped because the pool was full
+    uint32_t expired;                       // Frames dropped because their deadline passed
+};
+
+// Deadline of each configured ID, relative to the time the bridge queued the frame. Sorted by ID.
+struct tx_deadline_table {
+    uint32_t ids[TX_SCHED_MAX_DEADLINES];
+    uint32_t deadline_us[TX_SCHED_MAX_DEADLINES];
+    uint8_t count;
+};
+
+void tx_sched_init(struct tx_scheduler *sched, TxOverflowPolicy_t policy);
+void tx_sched_set_capacity(struct tx_scheduler *sched, uint32_t capacity);
+uint32_t tx_sched_burst_capacity(uint32_t source_bitrate, uint32_t bitrate);
+void tx_sched_set_order(struct tx_scheduler *sched, TxOrder_t order);
+bool tx_sched_push(struct tx_scheduler *sched, frame_handle_t frame, uint32_t now_us, uint32_t deadline_us, uint32_t due_us);
+bool tx_sched_pop(struct tx_scheduler *sched, frame_handle_t *frame, uint32_t now_us);
+
+void tx_deadline_clear(struct tx_deadline_table *table);
+bool tx_deadline_set(struct tx_deadline_table *table, uint32_t id, uint32_t deadline_us);
+uint32_t tx_deadline_lookup(const struct tx_deadline_table *table, uint32_t id);
+
+/**
+* @brief Orders frames like the bus does: a lower key wins arbitration.
+* Layout: base ID (11 bits) | format (2 bits: standard data, standard remote, extended) | extension (18 bits) | RTR.
+* A standard frame beats an extended one with the same base ID, and a data frame beats a remote one.
+*/
+static inline uint32_t can_arbitration_key(uint32_t id) {
+    uint32_t rtr = (id & CAN2040_ID_RTR) ? 1u : 0u;
+    if (id & CAN2040_ID_EFF) {
+        uint32_t ext = id & 0x1FFFFFFFu;
+        return ((ext >> 18) << 21) | (2u << 19) | ((ext & 0x3FFFFu) << 1) | rtr;
+    }
+    return ((id & 0x7FFu) << 21) | (rtr << 19);
+}
+
+static inline uint8_t tx_sched_depth(const struct tx_scheduler *sched) {
+    return sched->count;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef CAN_STATS_H
+#define CAN_STATS_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "CAN_filter.h"
+#include "hardware/structs/systick.h"
+
+// Bridge instrumentation, one direction_stats per receiving interface (only its core writes it).
+// Per frame it costs a few increments: the outcome counter, the hit counter of the ID (a plain array for
+// 11-bit IDs, a small space-saving table for the others) and one histogram bucket of the time spent in
+// can_rx_callback, read from the SysTick of the core (processor clock, 24-bit down counter).
+// Building with CAN_BRIDGE_STATS=0 removes all of it: the STATS_* macros expand to nothing.
+
+#ifndef CAN_BRIDGE_STATS
+#define CAN_BRIDGE_STATS            1
+#endif
+
+// CAN_BRIDGE_ISR_BUDGET=1 also records the worst bridge_receive() of each route kind (see
+// CAN_filter.h), from the first cycle to the forwarding decision carried out, to check the interrupt budget.
+#ifndef CAN_BRIDGE_ISR_BUDGET
+#define CAN_BRIDGE_ISR_BUDGET       0
+#endif
+
+#define STATS_HIST_BUCKETS          16          // Last bucket also counts everything slower
+#define STATS_HIST_SHIFT            6           // 64 cycles per bucket (0.5 us at 125 MHz)
+#define STATS_EXT_TALKERS           8           // IDs above 0x7FF tracked per direction
+#define STATS_TOP_MAX               8           // Top talkers a query can ask for
+#define STATS_SYSTICK_MASK          0x00FFFFFFu
+
+struct direction_stats {
+    uint32_t rx;                                // Frames received on the interface
+    uint32_t forwarded;                         // Passed to the other bus
+    uint32_t filtered;                          // Dropped by the routes (mode and lists)
+    uint32_t echo_dropped;                      // Dropped as echoes of our own transmissions
+    uint32_t shaped;                            // Dropped or held by the per-ID policies and the bandwidth cap
+    uint32_t control;                           // CONTROL_ID frames
+    uint32_t rewritten;                         // Forwarded frames changed by a rewrite rule (also in forwarded)
+    uint32_t std_hits[ID_SET_STD_IDS];          // Frames per 11-bit ID
+    uint32_t ext_ids[STATS_EXT_TALKERS];        // Space-saving counters for the other IDs
+    uint32_t ext_hits[STATS_EXT_TALKERS];
+    uint32_t hist[STATS_HIST_BUCKETS];          // can_rx_callback cycles
+    uint32_t hist_max;
+};
+
+struct isr_budget {
+    uint32_t worst[ROUTE_KINDS];                // Cycles, indexed by route_direction.kind
+    uint32_t frames[ROUTE_KINDS];               // Frames timed
+};
+
+struct stats_talker {
+    uint32_t id;
+    uint32_t hits;
+};
+
+void stats_cycle_counter_init(void);
+void direction_stats_reset(struct direction_stats *stats);
+void direction_stats_count_ext(struct direction_stats *stats, uint32_t id);
+uint8_t direction_stats_top(const struct direction_stats *stats, struct stats_talker *top, uint8_t count);
+void direction_stats_print(const struct direction_stats *stats, uint8_t interface_id);
+void isr_budget_reset(struct isr_budget *budget);
+void isr_budget_print(const struct isr_budget *budget, uint8_t interface_id);
+
+static inline void direction_stats_count_id(struct direction_stats *stats, uint32_t id) {
+    if (id < ID_SET_STD_IDS) {
+        stats->std_hits[id]++;
+    } else {
+        direction_stats_count_ext(stats, id);
+    }
+}
+
+static inline uint32_t stats_cycles_now(void) {
+    return systick_hw->cvr;
+}
+
+/**
+* @brief Adds the cycles since start (a stats_cycles_now() value) to the histogram.
+*/
+static inline void direction_stats_time(struct direction_stats *stats, uint32_t start) {
+    uint32_t cycles = (start - stats_cycles_now()) & STATS_SYSTICK_MASK;       // SysTick counts down
+    uint32_t bucket = cycles >> STATS_HIST_SHIFT;
+    stats->hist[bucket < STATS_HIST_BUCKETS ? bucket : STATS_HIST_BUCKETS - 1]++;
+    if (cycles > stats->hist_max) {
+        stats->hist_max = cycles;
+    }
+}
+
+/**
+* @brief Records the cycles since start for a route kind.
+*/
+static inline void isr_budget_time(struct isr_budget *budget, uint8_t kind, uint32_t start) {
+    uint32_t cycles = (start - stats_cycles_now()) & STATS_SYSTICK_MASK;
+    budget->frames[kind]++;
+    if (cycles > budget->worst[kind]) {
+        budget->worst[kind] = cycles;
+    }
+}
+
+#if CAN_BRIDGE_ISR_BUDGET
+#define BUDGET_TIME_START(start)            uint32_t start = stats_cycles_now()
+#define BUDGET_TIME_END(budget, kind, start) isr_budget_time((budget), (kind), (start))
+#else
+#define BUDGET_TIME_START(start)            ((void)0)
+#define BUDGET_TIME_END(budget, kind, start) ((void)0)
+#endif
+
+#if CAN_BRIDGE_STATS
+#define STATS_COUNT(stats, field)           ((stats)->field++)
+#define STATS_COUNT_ID(stats, id)           direction_stats_count_id((stats), (id))
+#define STATS_TIME_START(start)             uint32_t start = stats_cycles_now()
+#define STATS_TIME_END(stats, start)        direction_stats_time((stats), (start))
+#else
+#define STATS_COUNT(stats, field)           ((void)0)
+#define STATS_COUNT_ID(stats, id)           ((void)0)
+#define STATS_TIME_START(start)             ((void)0)
+#define STATS_TIME_END(stats, start)        ((void)0)
+#endif
+
+#endif
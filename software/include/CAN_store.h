@@ -0,0 +1,40 @@
+#ifndef CAN_STORE_H
+#define CAN_STORE_H
+#include <stdint.h>
+#include <stdbool.h>
+
+// Persistent records in the last STORE_SECTORS sectors of the flash.
+// Records are appended one after the other (each padded to whole pages, never across a sector), and
+// the one with the highest sequence number wins. A sector is only erased when writing moves into it,
+// and that sector holds the oldest records, so the erases go round all the sectors and the newest valid
+// record survives a power loss at any point. Each record carries a CRC-32 of its header and payload,
+// and a payload version: records of another version are skipped.
+
+#define STORE_SECTORS               4
+#define STORE_MAGIC                 0x46434243u // "CBCF"
+#define STORE_VERSION               1           // Layout of the payload
+#define STORE_MAX_PAYLOAD           (4096 - 20) // One sector minus the header
+
+struct store_record_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t pages;                             // Flash pages the record takes, header included
+    uint32_t sequence;                          // Incremented by every write
+    uint32_t length;                            // Payload bytes after the header
+    uint32_t crc;                               // CRC-32 of the fields above and the payload
+};
+
+typedef enum {
+    STORE_OK,
+    STORE_EMPTY,                                // No valid record of this version
+    STORE_TOO_LARGE,
+    STORE_VERIFY_FAILED,                        // The record read back differs from what was written
+    STORE_BAD_PAYLOAD,                          // The record is valid but its contents could not be applied
+} StoreStatus_t;
+
+StoreStatus_t store_read_latest(const uint8_t **payload, uint32_t *length, uint32_t *sequence);
+StoreStatus_t store_write(const uint8_t *payload, uint32_t length, uint32_t *sequence);
+void store_erase_all(void);
+uint32_t store_region_offset(void);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef CAN_TRACE_H
+#define CAN_TRACE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <atomic>
+
+extern "C" {
+    #include "can2040.h"
+}
+
+// Frame trace. The receive and transmit-complete interrupts of each bus write fixed size records
+// straight into that bus's ring (single producer: the core that owns the bus). The main loop of core 0
+// drains both rings, oldest record first, into a dense byte stream for the USB port.
+// A full ring drops the new record and counts it, the interrupt never waits. The stream reports the
+// number of dropped records.
+//
+// Stream: records of
+//   0xA5, flags (bit 0 bus, bits 1-3 TraceVerdict_t, bit 4 extended, bit 5 remote, bit 6 transmitted,
+//   bit 7 rewritten: a TRACE_REWRITTEN record, sent with TRACE_FORWARDED in bits 1-3),
+//   dlc, time (varint: microseconds since the previous record, absolute for TRACE_TIME),
+//   id (2 bytes big endian, 4 if extended), dlc data bytes.
+// TRACE_LOST records carry the number of dropped records as a 4 byte id. Each drain starts with a
+// TRACE_TIME record so a reader can join the stream at any drain.
+
+#define TRACE_RING_RECORDS          256         // Per bus, power of two
+#define TRACE_SYNC                  0xA5
+#define TRACE_MAX_ENCODED           21          // Longest record in the stream
+
+typedef enum {
+    TRACE_FORWARDED,                // Received and passed to the other bus
+    TRACE_FILTERED,                 // Received and dropped by the routes
+    TRACE_ECHO,                     // Received and dropped as an echo
+    TRACE_SHAPED,                   // Received and dropped or held by the policies and caps
+    TRACE_CONTROL,                  // CONTROL_ID frame
+    TRACE_SENT,                     // Transmitted by the bridge
+    TRACE_TIME,                     // Stream only: time base
+    TRACE_LOST,                     // Stream only: records dropped on this bus
+    TRACE_REWRITTEN,                // The frame a rewrite rule made of the TRACE_FORWARDED record before it,
+                                    // as the other bus gets it
+} TraceVerdict_t;
+
+struct trace_record {
+    uint32_t time_us;
+    uint32_t id;                    // As can2040 gives it, with CAN2040_ID_EFF/CAN2040_ID_RTR
+    uint8_t data[8];
+    uint8_t dlc;
+    uint8_t verdict;                // TraceVerdict_t
+};
+
+struct trace_ring {
+    struct trace_record slots[TRACE_RING_RECORDS];
+    std::atomic<uint32_t> head;     // Next record to write, producer only
+    std::atomic<uint32_t> tail;     // Next record to read, consumer only
+    std::atomic<uint32_t> drops;    // Records lost because the ring was full, producer only
+};
+
+// Drain side state, one per output stream
+struct trace_stream {
+    uint32_t last_us;
+    uint32_t reported_drops[2];
+};
+
+// One decoded stream record
+struct trace_event {
+    uint64_t time_us;               // Extended past the 32-bit wrap
+    uint8_t bus;
+    uint8_t verdict;
+    struct can2040_msg msg;         // For TRACE_LOST, msg.id is the number of records lost
+};
+
+void trace_ring_init(struct trace_ring *ring);
+void trace_stream_init(struct trace_stream *stream);
+uint32_t trace_drain(struct trace_ring *rings, struct trace_stream *stream, uint8_t *out, uint32_t capacity, uint32_t now_us);
+bool trace_decode(const uint8_t *data, uint32_t length, uint32_t *pos, uint64_t *time_us, struct trace_event *event);
+
+/**
+* @brief Producer side: writes a record in place. A full ring counts a drop instead.
+*/
+static inline void trace_ring_put(struct trace_ring *ring, uint8_t verdict, uint32_t id, uint8_t dlc,
+                                  const uint8_t *data, uint32_t now_us) {
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= TRACE_RING_RECORDS) {
+        ring->drops.store(ring->drops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    struct trace_record *record = &ring->slots[head & (TRACE_RING_RECORDS - 1)];
+    record->time_us = now_us;
+    record->id = id;
+    record->dlc = dlc > 8 ? 8 : dlc;
+    record->verdict = verdict;
+    memcpy(record->data, data, 8);
+    ring->head.store(head + 1, std::memory_order_release);     // Publishes the record
+}
+
+#endif
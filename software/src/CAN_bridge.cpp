@@ -12,279 +12,1854 @@
 #include "CAN_bridge.h" 
 #include <string.h>    // For memcmp and memcpy
 #include <stdio.h>
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+#include "pico/platform.h"
 
-// Separate circular buffers for messages transmitted *out* of each CAN interface
-volatile struct transmitted_msg_info recent_tx_can0_msgs[RECENT_MESSAGES_BUFFER_SIZE];
-volatile int recent_tx_can0_idx = 0;
+// Frames waiting for the core that owns the target bus, indexed by the target interface. The queues carry
+// handles of frames in the pool of the receiving core (see CAN_pool.h), each with one reference.
+static struct handle_queue tx_queues[2];
 
-volatile struct transmitted_msg_info recent_tx_can1_msgs[RECENT_MESSAGES_BUFFER_SIZE];
-volatile int recent_tx_can1_idx = 0;
- 
+static const uint8_t bus_owner_core[2] = {CAN_IFACE0_CORE, CAN_IFACE1_CORE};
+
+// Controller of each bus, see CAN_port.h. Wiring rather than state: bridge_init() keeps them.
+static const struct bus_port *bus_ports[2] = {&can2040_ports[CAN_IFACE0], &can2040_ports[CAN_IFACE1]};
+
+// Frames waiting for their bus, released in arbitration order, see CAN_sched.h. Owner core only.
+static struct tx_scheduler tx_schedulers[2];
+
+// Bitrate each bus was started with, see bridge_set_bitrate(). Wiring like bus_ports, bridge_init() keeps them.
+static uint32_t bus_bitrates[2] = {LOAD_DEFAULT_BITRATE, LOAD_DEFAULT_BITRATE};
+
+// Frames handed to can2040 on each bus, compared with its tx_total to know how many are not yet on the wire
+static uint32_t tx_released[2];
+
+static uint32_t sched_stored_id = 0;        //Set by SCHED_SET_ID, used by SCHED_SET_DEADLINE
+
+// Release order asked for each bus by SCHED_SET_ORDER, applied by its owner core in bridge_service()
+static std::atomic<uint8_t> sched_orders[2];
+
+// Learned period of the forwarded IDs, indexed by the receiving interface (its core only), see CAN_period.h
+static struct period_table period_tables[2];
+static std::atomic<bool> period_reset_pending[2];       //Indexed by the receiving interface, see PERIOD_RESET
+
+#if CAN_BRIDGE_STATS
+// Counters, top talkers and RX timing of the frames received on each interface, see CAN_stats.h
+static struct direction_stats rx_stats[2];
+#endif
+
+#if CAN_BRIDGE_ISR_BUDGET
+// Worst receive path per route kind, indexed by the receiving interface, see CAN_stats.h
+static struct isr_budget isr_budgets[2];
+#endif
+
+// State of the per-ID and per-rule policies (rate limits, change-only, downsampling) of the frames the routes
+// let through, whose definitions are published with the configuration (see CAN_policy.h). Indexed by the
+// receiving interface (its core only), then the entry index; policy_revisions is the table revision each
+// core last set its states up for, see bridge_policies_sync().
+static struct policy_state policy_states[2][POLICY_MAX_ENTRIES];
+static uint32_t policy_revisions[2];
+
+// FORWARD_LATEST values waiting for their interval to end, one reference each, in the pool of the core
+// receiving the interface. Indexed like policy_states; held_entries has the bit of each entry holding one.
+static frame_handle_t held_frames[2][POLICY_MAX_ENTRIES];
+static uint64_t held_entries[2];
+
+// Bandwidth cap of each direction, indexed by the receiving interface, in bits of the destination bus
+static struct token_bucket direction_caps[2];
+static uint32_t direction_cap_bps[2];
+static uint32_t direction_cap_drops[2];
+
+// Load of each bus (owner core), and the frames shed towards it (written by the core receiving the other bus).
+// LOAD_RESET_PEAK does not write the other core's counter: the query replies the drops since load_shed_base.
+static struct bus_load bus_loads[2];
+static uint32_t load_shed_drops[2];
+static uint32_t load_shed_base[2];                      //CAN_COMMAND_CORE only
+
+// Health of each bus and the frames held for it while it is down, see CAN_health.h. Owner core only.
+static struct bus_health bus_healths[2];
+static struct outage_buffer outage_buffers[2];
+
+static uint32_t health_stored_id = 0;                   //Set by HEALTH_SET_ID, used by HEALTH_SET_TTL
+
+// Latency probe, see CAN_latency.h. latency_dirs is indexed by the receiving interface and written by the core
+// owning the other bus, tx_stamps holds the receive time of the frames on each controller (owner core only).
+static bool latency_enabled = false;
+static struct latency_direction latency_dirs[2];
+static uint32_t tx_stamps[2][LATENCY_INFLIGHT];
+static std::atomic<bool> latency_reset_pending[2];      //Indexed by the receiving interface, see bridge_latency_reset()
+
+static uint32_t rate_stored_id = 0;                     //Set by RATE_SET_ID
+static uint32_t rate_stored_mask = RATE_EXACT_MASK;     //Set by RATE_SET_MASK, back to exact on RATE_SET_ID
+static uint32_t rate_stored_burst = RATE_DEFAULT_BURST; //Set by RATE_SET_BURST
+static uint32_t forward_stored_id = 0;                  //Set by FORWARD_SET_ID
+
+// Fingerprints of the messages transmitted *out* of each CAN interface, see CAN_echo.h
+static struct echo_table echo_tables[2];
+
+// Filter configuration (mode, lists, compiled routes), double buffered, see struct bridge_config.
+// The receive path of both cores reads *active_config. Commands run on CAN_COMMAND_CORE outside the
+// interrupts and edit the other buffer (the shadow), then publish it with one atomic pointer store.
+// A core announces the config it is reading in config_readers, so the old buffer is only edited again
+// once neither core still uses it.
+static struct bridge_config configs[2];
+static std::atomic<const struct bridge_config *> active_config;
+static std::atomic<const struct bridge_config *> config_readers[2];    // Indexed by core
+static uint8_t config_read_depth[2];                                    // Indexed by core, nested reads share the outer one
+static struct bridge_config *config_shadow = NULL;                     // Open transaction, NULL if none
+
+// Control frames waiting for CAN_COMMAND_CORE, indexed by the interface they were received on
+static struct frame_queue command_queues[2];
+
+// Commands that change the state of a bus owner (scheduler, load monitor, echo table, cap and counters of the
+// frames it receives), waiting for the core that owns the bus, see bridge_owner_post(). Indexed by the bus.
+static struct frame_queue owner_commands[2];
+
+static struct bulk_transfer bulk_upload;   //Table being received by BULK_COMMAND
+static struct filter_list bulk_list;       //Copy of the target list the table is added to, kept only if it fits
+
+// Configuration as saved in flash: mode, enable state, 2 reserved bytes, then for each list
+// (RULE_LIST_WHITELIST to RULE_LIST_ONE_WAY) a 16-bit little endian length and its CAN_bulk.h records,
+// then for each receiving interface a rule count and the rewrite rules, then j1939_ids like the other lists.
+// Records saved before the rewrite rules or the J1939 list end early and load without them.
+#define CONFIG_STORE_HEADER_BYTES   4
+#define CONFIG_STORE_REWRITE_BYTES  25          //id, new_id (little endian), keep, set, dlc
+static uint8_t config_store_payload[STORE_MAX_PAYLOAD];
+
+// Frame trace, one ring per bus written by the interrupts of the core that owns it, see CAN_trace.h
+static struct trace_ring trace_rings[2];
+static struct trace_stream trace_output;    //Drained by the main loop of CAN_COMMAND_CORE
+static bool trace_enabled = false;
+
+static uint32_t rule_stored_value = 0;      //Set by RULE_SET_VALUE, used by the next rule command
+static struct rewrite_rule rewrite_stored;  //Built by REWRITE_SET_*, added by REWRITE_ADD
+
+static bool bridge_enabled = true;
+
+// How each filter mode routes the frames received on CAN0 and on CAN1, and which list it uses
+typedef enum {
+    MODE_LIST_NONE,
+    MODE_LIST_WHITELIST,
+    MODE_LIST_BLACKLIST,
+    MODE_LIST_EXCEPTION,
+    MODE_LIST_ONE_WAY,
+    MODE_LIST_J1939,
+} ModeList_t;
+
+struct mode_route {
+    RoutePolicy_t policy[2];    // Indexed by the receiving interface
+    ModeList_t list;
+};
+
+static const struct mode_route mode_routes[] = {
+    /* FILTER_MODE_PASSIVE */                           {{ROUTE_ALWAYS,         ROUTE_ALWAYS},          MODE_LIST_NONE},
+    /* FILTER_MODE_WHITELIST */                         {{ROUTE_IF_LISTED,      ROUTE_IF_LISTED},       MODE_LIST_WHITELIST},
+    /* FILTER_MODE_BLACKLIST */                         {{ROUTE_IF_NOT_LISTED,  ROUTE_IF_NOT_LISTED},   MODE_LIST_BLACKLIST},
+    /* FILTER_MODE_ZERO_TO_ONE */                       {{ROUTE_ALWAYS,         ROUTE_NEVER},           MODE_LIST_NONE},
+    /* FILTER_MODE_ONE_TO_ZERO */                       {{ROUTE_NEVER,          ROUTE_ALWAYS},          MODE_LIST_NONE},
+    /* FILTER_MODE_ONE_WAY_1_TO_0_BLACKLIST */          {{ROUTE_NEVER,          ROUTE_IF_NOT_LISTED},   MODE_LIST_BLACKLIST},
+    /* FILTER_MODE_ONE_WAY_1_TO_0_WHITELIST */          {{ROUTE_NEVER,          ROUTE_IF_LISTED},       MODE_LIST_WHITELIST},
+    /* FILTER_MODE_ONE_WAY_0_TO_1_BLACKLIST */          {{ROUTE_IF_NOT_LISTED,  ROUTE_NEVER},           MODE_LIST_BLACKLIST},
+    /* FILTER_MODE_ONE_WAY_0_TO_1_WHITELIST */          {{ROUTE_IF_LISTED,      ROUTE_NEVER},           MODE_LIST_WHITELIST},
+    /* FILTER_MODE_ONE_WAY_1_TO_0_EXCEPT */             {{ROUTE_IF_LISTED,      ROUTE_ALWAYS},          MODE_LIST_EXCEPTION},
+    /* FILTER_MODE_ONE_WAY_0_TO_1_EXCEPT */             {{ROUTE_ALWAYS,         ROUTE_IF_LISTED},       MODE_LIST_EXCEPTION},
+    /* FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_1_TO_0 */    {{ROUTE_IF_NOT_LISTED,  ROUTE_ALWAYS},          MODE_LIST_ONE_WAY},
+    /* FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_0_TO_1 */    {{ROUTE_ALWAYS,         ROUTE_IF_NOT_LISTED},   MODE_LIST_ONE_WAY},
+    /* FILTER_MODE_J1939_WHITELIST */                   {{ROUTE_IF_LISTED,      ROUTE_IF_LISTED},       MODE_LIST_J1939},
+    /* FILTER_MODE_J1939_BLACKLIST */                   {{ROUTE_IF_NOT_LISTED,  ROUTE_IF_NOT_LISTED},   MODE_LIST_J1939},
+};
+
+/**
+* @brief A list of a configuration, NULL for MODE_LIST_NONE. The RULE_LIST_* values select the same lists.
+*/
+static struct filter_list *config_list(struct bridge_config *config, uint8_t list) {
+    switch (list) {
+        case MODE_LIST_WHITELIST:   return &config->whitelist_ids;
+        case MODE_LIST_BLACKLIST:   return &config->blacklist_ids;
+        case MODE_LIST_EXCEPTION:   return &config->exception_ids;
+        case MODE_LIST_ONE_WAY:     return &config->one_way_restricted_ids;
+        case MODE_LIST_J1939:       return &config->j1939_ids;
+        default:                    return NULL;
+    }
+}
+
+/**
+* @brief Rebuilds the compiled routes of a configuration from its mode and lists.
+*/
+static void routes_rebuild(struct bridge_config *config) {
+    if ((unsigned)config->current_filter_state >= sizeof(mode_routes) / sizeof(mode_routes[0])) {
+        route_compile(&config->routes[CAN_IFACE0], ROUTE_NEVER, NULL, false);
+        route_compile(&config->routes[CAN_IFACE1], ROUTE_NEVER, NULL, false);
+        route_dispatch_pair(config->routes);
+        return;
+    }
+    const struct mode_route *mode = &mode_routes[config->current_filter_state];
+    const struct filter_list *list = config_list(config, mode->list);
+    bool j1939 = mode->list == MODE_LIST_J1939;
+    route_compile(&config->routes[CAN_IFACE0], mode->policy[CAN_IFACE0], list, j1939);
+    route_compile(&config->routes[CAN_IFACE1], mode->policy[CAN_IFACE1], list, j1939);
+    route_dispatch_pair(config->routes);
+}
+
+/**
+* @brief Route of the frames received on an interface. Selected rather than indexed, so its address
+* does not wait for a multiply by the size of a route.
+*/
+static inline const struct route_direction *config_route(const struct bridge_config *config, uint8_t rx_interface_id) {
+    return (rx_interface_id & 1) ? &config->routes[CAN_IFACE1] : &config->routes[CAN_IFACE0];
+}
+
+/**
+* @brief Starts reading the active configuration on this core. The config stays valid until config_read_end().
+* From a CAN interrupt or with interrupts masked. A read started inside another one gets the same config.
+*/
+static inline const struct bridge_config *config_read_begin(unsigned int core) {
+    if (config_read_depth[core] != 0) {
+        config_read_depth[core]++;
+        return config_readers[core].load(std::memory_order_relaxed);
+    }
+    const struct bridge_config *config = active_config.load(std::memory_order_seq_cst);
+    while (true) {
+        config_readers[core].store(config, std::memory_order_seq_cst);
+        const struct bridge_config *again = active_config.load(std::memory_order_seq_cst);
+        if (again == config) {                  //Announced before the writer could look, it will wait for us
+            config_read_depth[core] = 1;
+            return config;
+        }
+        config = again;
+    }
+}
+
+static inline void config_read_end(unsigned int core) {
+    if (--config_read_depth[core] == 0) {
+        config_readers[core].store(NULL, std::memory_order_release);
+    }
+}
 
 /**
-* @brief Adds a message to the recent transmissions buffer for a specific interface.
+* @brief Opens the shadow configuration as a copy of the active one.
+* Waits (for at most one can_rx_callback of the other core) until no core reads the buffer any more.
 */
-void add_recent_tx_message(const struct can2040_msg *msg, uint8_t dlc, uint8_t tx_interface_id) {
-   if (tx_interface_id == CAN_IFACE0) {
-        recent_tx_can0_msgs[recent_tx_can0_idx].id = msg->id;
-        recent_tx_can0_msgs[recent_tx_can0_idx].dlc = dlc;
-        memcpy((void *)recent_tx_can0_msgs[recent_tx_can0_idx].data, (const void *)msg->data, dlc);
-        recent_tx_can0_idx = (recent_tx_can0_idx + 1) % RECENT_MESSAGES_BUFFER_SIZE;
-    } else if (tx_interface_id == CAN_IFACE1) {
-        recent_tx_can1_msgs[recent_tx_can1_idx].id = msg->id;
-        recent_tx_can1_msgs[recent_tx_can1_idx].dlc = dlc;
-        memcpy((void *)recent_tx_can1_msgs[recent_tx_can1_idx].data, (const void *)msg->data, dlc);
-        recent_tx_can1_idx = (recent_tx_can1_idx + 1) % RECENT_MESSAGES_BUFFER_SIZE;
+static struct bridge_config *config_open_shadow(void) {
+    const struct bridge_config *active = active_config.load(std::memory_order_seq_cst);
+    struct bridge_config *shadow = (active == &configs[0]) ? &configs[1] : &configs[0];
+    while (config_readers[0].load(std::memory_order_seq_cst) == shadow
+           || config_readers[1].load(std::memory_order_seq_cst) == shadow) {
+        tight_loop_contents();
     }
+    memcpy(shadow, active, sizeof(*shadow));
+    return shadow;
+}
+
+/**
+* @brief Compiles the routes of the shadow and makes it the active configuration.
+*/
+static void config_publish(struct bridge_config *shadow) {
+    routes_rebuild(shadow);
+    rewrite_table_compile(&shadow->rewrites[CAN_IFACE0]);
+    rewrite_table_compile(&shadow->rewrites[CAN_IFACE1]);
+    policy_table_compile(&shadow->policies);
+    shadow->generation++;
+    active_config.store(shadow, std::memory_order_seq_cst);
+}
+
+/**
+* @brief Sizes the transmit scheduler of a bus from its bitrate and the bitrate of the bus its frames come from.
+* Owner core, or before the other core runs.
+*/
+static void bus_bitrate_apply(uint8_t interface_id) {
+    bus_loads[interface_id].bitrate = bus_bitrates[interface_id];
+    tx_sched_set_capacity(&tx_schedulers[interface_id],
+                          tx_sched_burst_capacity(bus_bitrates[interface_id ^ 1], bus_bitrates[interface_id]));
+}
+
+static void bus_bitrates_apply(void) {
+    bus_bitrate_apply(CAN_IFACE0);
+    bus_bitrate_apply(CAN_IFACE1);
+}
+
+/**
+* @brief Resets the bridge to its power-on state: enabled, passive mode, empty lists.
+*/
+void bridge_init(void) {
+    handle_queue_init(&tx_queues[CAN_IFACE0]);
+    handle_queue_init(&tx_queues[CAN_IFACE1]);
+    frame_pool_init();
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        tx_sched_init(&tx_schedulers[i], TX_SCHED_DROP_LOWEST_PRIORITY);
+        tx_released[i] = bus_ports[i]->tx_total(bus_ports[i]->ctx);
+    }
+    sched_stored_id = 0;
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        sched_orders[i].store(TX_ORDER_ARBITRATION, std::memory_order_relaxed);
+        period_table_init(&period_tables[i]);
+        period_reset_pending[i].store(false, std::memory_order_relaxed);
+    }
+
+#if CAN_BRIDGE_STATS
+    direction_stats_reset(&rx_stats[CAN_IFACE0]);
+    direction_stats_reset(&rx_stats[CAN_IFACE1]);
+#endif
+#if CAN_BRIDGE_ISR_BUDGET
+    isr_budget_reset(&isr_budgets[CAN_IFACE0]);
+    isr_budget_reset(&isr_budgets[CAN_IFACE1]);
+#endif
+
+    memset(policy_states, 0, sizeof(policy_states));    //Set up for the empty table of the configs below
+    policy_revisions[CAN_IFACE0] = 0;
+    policy_revisions[CAN_IFACE1] = 0;
+    held_entries[CAN_IFACE0] = 0;                   //The frame pool was emptied above
+    held_entries[CAN_IFACE1] = 0;
+    forward_stored_id = 0;
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        token_bucket_config(&direction_caps[i], 0, 0, 0);
+        direction_cap_bps[i] = 0;
+        direction_cap_drops[i] = 0;
+    }
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        bus_load_init(&bus_loads[i], bus_bitrates[i], time_us_32());
+        load_shed_drops[i] = 0;
+        load_shed_base[i] = 0;
+    }
+    bus_bitrates_apply();
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        bus_health_init(&bus_healths[i], time_us_32());
+        outage_init(&outage_buffers[i]);                //The frame pool was emptied above
+    }
+    health_stored_id = 0;
+    latency_enabled = false;
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        latency_direction_reset(&latency_dirs[i]);
+        memset(tx_stamps[i], 0, sizeof(tx_stamps[i]));
+        latency_reset_pending[i].store(false, std::memory_order_relaxed);
+    }
+    rate_stored_id = 0;
+    rate_stored_mask = RATE_EXACT_MASK;
+    rate_stored_burst = RATE_DEFAULT_BURST;
+    echo_table_init(&echo_tables[CAN_IFACE0], ECHO_DEFAULT_WINDOW_US);
+    echo_table_init(&echo_tables[CAN_IFACE1], ECHO_DEFAULT_WINDOW_US);
+
+    frame_queue_init(&command_queues[CAN_IFACE0]);
+    frame_queue_init(&command_queues[CAN_IFACE1]);
+    frame_queue_init(&owner_commands[CAN_IFACE0]);
+    frame_queue_init(&owner_commands[CAN_IFACE1]);
+    config_readers[0].store(NULL);
+    config_readers[1].store(NULL);
+    config_read_depth[0] = 0;
+    config_read_depth[1] = 0;
+    memset(&configs[1], 0, sizeof(configs[1]));
+    memset(&configs[0], 0, sizeof(configs[0]));     //Empty lists (see CAN_filter.h)
+    configs[0].current_filter_state = FILTER_MODE_PASSIVE;
+    configs[0].outage_default_ttl_us = OUTAGE_DEFAULT_TTL_US;
+    routes_rebuild(&configs[0]);
+    active_config.store(&configs[0]);
+    config_shadow = NULL;
+    bulk_upload.active = false;
+    rule_stored_value = 0;
+    rewrite_rule_init(&rewrite_stored, 0);
+    trace_enabled = false;
+    trace_ring_init(&trace_rings[CAN_IFACE0]);
+    trace_ring_init(&trace_rings[CAN_IFACE1]);
+    trace_stream_init(&trace_output);
+
+    bridge_enabled = true;
+}
+
+
+/**
+* @brief Tells the bridge the bitrate a bus runs at, before or after bridge_init(): it measures the load
+* against it and gives the slower bus a burst buffer for the frames of the faster one.
+* Does not change the controller, which keeps the bitrate it was started with. Before the other core runs,
+* LOAD_SET_BITRATE goes through the owner of each bus instead.
+*/
+void bridge_set_bitrate(uint8_t interface_id, uint32_t bitrate) {
+    if (interface_id > CAN_IFACE1 || bitrate == 0) {
+        return;
+    }
+    bus_bitrates[interface_id] = bitrate;
+    bus_bitrates_apply();
+}
+
+/**
+* @brief Adds a message to the recent transmissions of a specific interface.
+*/
+void __not_in_flash_func(add_recent_tx_message)(const struct can2040_msg *msg, uint8_t dlc, uint8_t tx_interface_id) {
+    if (tx_interface_id > CAN_IFACE1) {
+        return;
+    }
+    echo_table_record(&echo_tables[tx_interface_id], echo_fingerprint(msg->id, dlc, msg->data), time_us_32());
 }
 
  /**
   * @brief Checks if a received message is an echo of a message recently transmitted.
   */
-bool is_echo(const struct can2040_msg *received_msg, uint8_t received_dlc, uint8_t rx_interface_id) {
-    volatile struct transmitted_msg_info *buffer_to_check;
-    int buffer_size = RECENT_MESSAGES_BUFFER_SIZE;
-
-    if (rx_interface_id == CAN_IFACE0) {
-        buffer_to_check = recent_tx_can0_msgs;
-    } else if (rx_interface_id == CAN_IFACE1) {
-        buffer_to_check = recent_tx_can1_msgs;
-    } else {
+bool __not_in_flash_func(is_echo)(uint32_t id, uint8_t received_dlc, const uint8_t *data, uint8_t rx_interface_id) {
+    if (rx_interface_id > CAN_IFACE1) {
         return false;
     }
-    for (int i = 0; i < buffer_size; i++) {
-        if (buffer_to_check[i].id == received_msg->id &&
-            buffer_to_check[i].dlc == received_dlc) {
-            if (memcmp((void *)buffer_to_check[i].data, (const void *)received_msg->data, received_dlc) == 0) {
-                return true;
-            }
+    return echo_table_consume(&echo_tables[rx_interface_id], echo_fingerprint(id, received_dlc, data), time_us_32());
+}
+
+/**
+* @brief Records a frame in the trace ring of a bus, from the interrupt of the core that owns the bus.
+* Reads the payload where it is, a full ring only loses the record.
+*/
+static inline void bridge_trace(uint8_t interface_id, uint8_t verdict, uint32_t id, uint8_t dlc, const uint8_t *data) {
+    if (trace_enabled) {
+        trace_ring_put(&trace_rings[interface_id], verdict, id, dlc, data, time_us_32());
+    }
+}
+
+/**
+* @brief A frame the bridge sent left the controller of a bus: the echo window of the frame restarts now.
+* Runs on the core that owns the bus.
+*/
+void __not_in_flash_func(bridge_tx_done)(uint8_t tx_interface_id, const struct can2040_msg *msg) {
+    if (tx_interface_id > CAN_IFACE1) {
+        return;
+    }
+    uint8_t dlc = msg->dlc > 8 ? 8 : (uint8_t)msg->dlc;
+    uint32_t now_us = time_us_32();
+    bus_load_add(&bus_loads[tx_interface_id], can_frame_bits(msg->id, dlc), now_us);
+    if (bus_health_seen(&bus_healths[tx_interface_id], now_us)) {
+        bridge_outage_end(tx_interface_id);         //Released below
+    }
+    if (latency_enabled) {                          //This is the oldest frame handed to the controller
+        const struct bus_port *port = bus_ports[tx_interface_id];
+        uint32_t stamp = tx_stamps[tx_interface_id][(port->tx_total(port->ctx) - 1) & (LATENCY_INFLIGHT - 1)];
+        if (stamp != LATENCY_NO_STAMP) {
+            latency_record(&latency_dirs[tx_interface_id ^ 1], msg->id, now_us - stamp);
         }
     }
-    return false;
-} 
+    echo_table_confirm(&echo_tables[tx_interface_id], echo_fingerprint(msg->id, dlc, msg->data), time_us_32());
+    bridge_trace(tx_interface_id, TRACE_SENT, msg->id, dlc, msg->data);
+    bridge_release(tx_interface_id);                //A controller slot is free, hand over the next frame
+}
 
 /**
-* @brief Passes a CAN message from one bus to another and records it.
+* @brief Sends a FEEDBACK_BRIDGE frame to the computer: [FEEDBACK_BRIDGE, item, index, value(4, big endian), checksum].
 */
-void bridge_transmit(struct can2040 *target_bus, struct can2040_msg *msg, uint8_t dlc, uint8_t tx_interface_id){
+void bridge_send_feedback(uint8_t item, uint8_t index, uint32_t value) {
+    struct can2040_msg feedback_msg;
+    memset(&feedback_msg, 0, sizeof(feedback_msg));
+    feedback_msg.id = FEEDBACK_ID;
+    feedback_msg.data[0] = FEEDBACK_BRIDGE;
+    feedback_msg.data[1] = item;
+    feedback_msg.data[2] = index;
+    feedback_msg.data[3] = (uint8_t)(value >> 24);
+    feedback_msg.data[4] = (uint8_t)(value >> 16);
+    feedback_msg.data[5] = (uint8_t)(value >> 8);
+    feedback_msg.data[6] = (uint8_t)value;
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < 7; ++i) {
+        sum += feedback_msg.data[i];
+    }
+    feedback_msg.data[7] = (uint8_t)(sum % 256);
+    bridge_transmit(NULL, &feedback_msg, 8, CAN_COMPUTER_IFACE);
+}
 
-    msg->dlc = dlc;
+/**
+* @brief Tells the computer a command was refused: [command, ERROR_IN_MESSAGE, 0, 0, 0, 0, 0, checksum].
+*/
+void bridge_send_error(uint8_t command_mode) {
+    struct can2040_msg error_msg;
+    memset(&error_msg, 0, sizeof(error_msg));
+    error_msg.id = FEEDBACK_ID;
+    error_msg.dlc = 8;
+    error_msg.data[0] = command_mode;
+    error_msg.data[1] = ERROR_IN_MESSAGE;
+    error_msg.data[7] = (error_msg.data[0] + error_msg.data[1]) % 256;
+
+    bridge_transmit(NULL, &error_msg, error_msg.dlc, CAN_COMPUTER_IFACE);
+}
+
+/**
+* @brief Keeps the receive time of a frame handed to the controller of a bus until bridge_tx_done() sees it sent.
+* Call it before counting the frame in tx_released.
+*/
+static inline void bridge_latency_handoff(uint8_t interface_id, frame_handle_t frame) {
+    tx_stamps[interface_id][tx_released[interface_id] & (LATENCY_INFLIGHT - 1)] = *frame_rx_us(frame);
+}
+
+/**
+* @brief Hands scheduled frames to the bus port while fewer than its tx_depth are waiting for the wire.
+* Runs on the core that owns the bus with interrupts masked (or from its CAN interrupt).
+* Returns the number of frames handed over.
+*/
+static uint32_t __not_in_flash_func(bridge_release_locked)(uint8_t interface_id) {
+    const struct bus_port *port = bus_ports[interface_id];
+    struct tx_scheduler *sched = &tx_schedulers[interface_id];
+    if (tx_sched_depth(sched) == 0 || bus_healths[interface_id].down) {
+        return 0;
+    }
+    uint32_t tx_total = port->tx_total(port->ctx);
+    uint32_t now_us = time_us_32();
+    uint32_t released = 0;
+    frame_handle_t frame;
+    while (tx_released[interface_id] - tx_total < port->tx_depth && port->ready(port->ctx)) {
+        if (!tx_sched_pop(sched, &frame, now_us)) {
+            break;
+        }
+        if (tx_released[interface_id] == tx_total) {
+            bus_healths[interface_id].last_seen_us = now_us;   //An idle controller: the transmission timeout starts now
+        }
+        struct can2040_msg *msg = frame_get(frame);
+        if (port->send(port->ctx, msg) == 0) {           //The controller keeps its own copy
+            add_recent_tx_message(msg, (uint8_t)msg->dlc, interface_id);
+            bridge_latency_handoff(interface_id, frame);
+            tx_released[interface_id]++;
+            released++;
+        }
+        frame_release(frame);
+        tx_total = port->tx_total(port->ctx);
+    }
+    return released;
+}
+
+/**
+* @brief Releases scheduled frames of a bus owned by the calling core.
+*/
+uint32_t __not_in_flash_func(bridge_release)(uint8_t interface_id) {
+    if (interface_id > CAN_IFACE1) {
+        return 0;
+    }
+    uint32_t irq_state = save_and_disable_interrupts();
+    uint32_t released = bridge_release_locked(interface_id);
+    restore_interrupts(irq_state);
+    return released;
+}
 
-    can_send(target_bus, msg);
-    add_recent_tx_message(msg, dlc, tx_interface_id);
+/**
+* @brief Schedules a frame on a bus owned by the calling core and releases what the bus can take.
+* Takes over the caller's reference of the frame.
+* Interrupts are masked so the RX interrupt of this core never sees a half updated scheduler or echo entry.
+*/
+static void __not_in_flash_func(bridge_send_owned)(frame_handle_t frame, uint8_t tx_interface_id) {
+    uint32_t irq_state = save_and_disable_interrupts();
+    uint32_t now_us = time_us_32();
+    if (bus_healths[tx_interface_id].down) {
+        bridge_outage_hold(frame, tx_interface_id, now_us);
+    } else {
+        unsigned int core = get_core_num();
+        const struct bridge_config *config = config_read_begin(core);
+        uint32_t deadline_us = tx_deadline_lookup(&config->deadlines, frame_get(frame)->id);
+        config_read_end(core);
+        tx_sched_push(&tx_schedulers[tx_interface_id], frame, now_us, deadline_us, *frame_due_us(frame));
+        bridge_release_locked(tx_interface_id);
+    }
+    restore_interrupts(irq_state);
 }
 
+/**
+* @brief Holds a frame for a bus that is down, with the TTL of its ID. Takes over the caller's reference.
+* Owner core, from its CAN interrupt or with interrupts masked.
+*/
+static void bridge_outage_hold(frame_handle_t frame, uint8_t tx_interface_id, uint32_t now_us) {
+    unsigned int core = get_core_num();
+    const struct bridge_config *config = config_read_begin(core);
+    uint32_t ttl_us = tx_deadline_lookup(&config->outage_ttls, frame_get(frame)->id);
+    if (ttl_us == TX_SCHED_NO_DEADLINE) {
+        ttl_us = config->outage_default_ttl_us;
+    }
+    config_read_end(core);
+    outage_put(&outage_buffers[tx_interface_id], frame, ttl_us, now_us);
+}
 
+/**
+* @brief A bus just went down: the frames waiting in its scheduler move to its outage buffer.
+* Frames already on the controller stay there. Owner core, from its CAN interrupt or with interrupts masked.
+*/
+static void bridge_outage_begin(uint8_t interface_id) {
+    uint32_t now_us = time_us_32();
+    frame_handle_t frame;
+    while (tx_sched_pop(&tx_schedulers[interface_id], &frame, now_us)) {
+        bridge_outage_hold(frame, interface_id, now_us);
+    }
+}
 
 /**
-* @brief Processes a CAN message received on a specific bus.
+* @brief A bus is back: every held frame still within its TTL goes to the scheduler, the caller releases them.
+* Owner core, from its CAN interrupt or with interrupts masked.
 */
-void can_rx_callback(struct can2040 *can_instance_ptr, uint32_t id, uint8_t dlc, uint8_t *data_payload){
-    struct can2040_msg received_msg;
-    received_msg.id = id;
-    received_msg.dlc = dlc;
-    memcpy(received_msg.data, data_payload, dlc);
+static void __not_in_flash_func(bridge_outage_end)(uint8_t interface_id) {
+    uint32_t now_us = time_us_32();
+    bus_health_recover(&bus_healths[interface_id], now_us);
+    unsigned int core = get_core_num();
+    const struct bridge_config *config = config_read_begin(core);
+    frame_handle_t frame;
+    while (outage_take(&outage_buffers[interface_id], &frame, now_us)) {
+        tx_sched_push(&tx_schedulers[interface_id], frame, now_us, tx_deadline_lookup(&config->deadlines, frame_get(frame)->id),
+                      *frame_due_us(frame));
+    }
+    config_read_end(core);
+}
 
-    uint8_t rx_interface_id;
-    struct can2040 *target_can_instance_ptr;
-    uint8_t tx_interface_id;
+/**
+* @brief Notices a bus whose controller stopped sending and, while it is down, expires the held frames and
+* sends one of them now and then to find out when it is back. Owner core with interrupts masked.
+* Returns the frames handed to the controller.
+*/
+static uint32_t bridge_health_poll(uint8_t interface_id) {
+    const struct bus_port *port = bus_ports[interface_id];
+    struct bus_health *health = &bus_healths[interface_id];
+    uint32_t now_us = time_us_32();
+    bool tx_pending = tx_released[interface_id] != port->tx_total(port->ctx);
+    if (bus_health_check(health, tx_pending, now_us)) {
+        bridge_outage_begin(interface_id);
+    }
+    if (!health->down) {
+        return 0;
+    }
+    outage_expire(&outage_buffers[interface_id], now_us);
+    if (tx_pending || now_us - health->last_probe_us < HEALTH_PROBE_INTERVAL_US || !port->ready(port->ctx)) {
+        return 0;
+    }
+    health->last_probe_us = now_us;
+    frame_handle_t frame;
+    if (!outage_take(&outage_buffers[interface_id], &frame, now_us)) {
+        return 0;
+    }
+    struct can2040_msg *msg = frame_get(frame);
+    uint32_t sent = 0;
+    if (port->send(port->ctx, msg) == 0) {
+        add_recent_tx_message(msg, (uint8_t)msg->dlc, interface_id);
+        bridge_latency_handoff(interface_id, frame);
+        tx_released[interface_id]++;
+        sent = 1;
+    }
+    frame_release(frame);
+    return sent;
+}
 
-    //checkprint(&received_msg);
+/**
+* @brief The controller of a bus reported an error, bus_off if it stopped transmitting.
+* Runs on the core that owns the bus.
+*/
+void bridge_bus_error(uint8_t interface_id, bool bus_off) {
+    if (interface_id > CAN_IFACE1) {
+        return;
+    }
+    uint32_t irq_state = save_and_disable_interrupts();
+    if (bus_health_error(&bus_healths[interface_id], bus_off, time_us_32())) {
+        bridge_outage_begin(interface_id);
+    }
+    restore_interrupts(irq_state);
+}
+
+/**
+* @brief True while frames wait on the controller of a bus or the bus is down: the owner core must keep
+* calling bridge_service() to notice a stalled bus or its recovery, instead of sleeping.
+*/
+bool bridge_health_pending(uint8_t interface_id) {
+    if (interface_id > CAN_IFACE1) {
+        return false;
+    }
+    const struct bus_port *port = bus_ports[interface_id];
+    return bus_healths[interface_id].down || tx_released[interface_id] != port->tx_total(port->ctx);
+}
 
-    if (can_instance_ptr == &cbus0) {           //If the message was received on the CAN bus 0 
-        rx_interface_id = CAN_IFACE0;   
-        target_can_instance_ptr = &cbus1;       //set bus 1 as the target
-        tx_interface_id = CAN_IFACE1;
-    } else if (can_instance_ptr == &cbus1) {    //If the message was received on the CAN bus 1
-        rx_interface_id = CAN_IFACE1;
-        target_can_instance_ptr = &cbus0;       //set bus 0 as the target
-        tx_interface_id = CAN_IFACE0;
+/**
+* @brief Passes a pool frame to a bus, taking over one reference of it.
+* Only the core that owns the target bus touches it: from the other core the handle goes through
+* that bus's SPSC queue and is scheduled by bridge_service(). From the CAN interrupt or with interrupts masked.
+*/
+static void __not_in_flash_func(bridge_forward)(frame_handle_t frame, uint8_t tx_interface_id) {
+    if (get_core_num() == bus_owner_core[tx_interface_id]) {
+        bridge_send_owned(frame, tx_interface_id);
+    } else if (handle_queue_push(&tx_queues[tx_interface_id], frame)) {
+        __sev();                                //Wake the owner core if it is waiting in bridge_service
     } else {
+        frame_release(frame);
+    }
+}
+
+/**
+* @brief Sends a CAN message the bridge made itself (feedback, errors): copies it into a pool frame.
+*/
+void bridge_transmit(struct can2040 *target_bus, struct can2040_msg *msg, uint8_t dlc, uint8_t tx_interface_id){
+    (void)target_bus;                           //tx_interface_id selects the bus and its scheduler
+    msg->dlc = dlc;
+
+    uint32_t irq_state = save_and_disable_interrupts();     //The RX interrupt of this core allocates from the same pool
+    frame_handle_t frame = frame_alloc();
+    if (frame != FRAME_NONE) {
+        *frame_get(frame) = *msg;
+        *frame_rx_us(frame) = LATENCY_NO_STAMP;
+        *frame_due_us(frame) = time_us_32() + TX_EDF_DEFAULT_DUE_US;
+        bridge_forward(frame, tx_interface_id);
+    }
+    restore_interrupts(irq_state);
+}
+
+/**
+* @brief Applies a command to the state of a bus that its owner core keeps, see bridge_owner_post().
+* Owner core with interrupts masked.
+*/
+static void bridge_owner_command(uint8_t interface_id, const struct can2040_msg *msg) {
+    uint32_t value = get_id_from_data(msg->data);
+    struct bus_load *load = &bus_loads[interface_id];
+    switch (msg->data[0]) {
+        case ECHO_COMMAND:
+            if (msg->data[1] == ECHO_SET_WINDOW) {
+                echo_tables[interface_id].window_us = value;
+            } else {                                        //ECHO_RESET_COUNTERS
+                echo_tables[interface_id].hits = 0;
+                echo_tables[interface_id].misses = 0;
+                echo_tables[interface_id].evictions = 0;
+            }
+            break;
+#if CAN_BRIDGE_STATS
+        case STATS_COMMAND:                                 //STATS_RESET
+            direction_stats_reset(&rx_stats[interface_id]);
+            break;
+#endif
+        case SCHED_COMMAND:                                 //SCHED_SET_POLICY
+            tx_schedulers[interface_id].policy = (TxOverflowPolicy_t)value;
+            break;
+        case RATE_COMMAND:                                  //RATE_SET_CAP, the frames received on the bus
+            direction_cap_bps[interface_id] = value;
+            token_bucket_config(&direction_caps[interface_id], value, value / (1000 / RATE_CAP_BURST_MS), time_us_32());
+            break;
+        case LOAD_COMMAND:
+            switch (msg->data[1]) {
+                case LOAD_SET_BITRATE:                      //bus_bitrates was set by CAN_COMMAND_CORE
+                    bus_bitrate_apply(interface_id);
+                    break;
+                case LOAD_SET_THRESHOLD:
+                    load->shed_permille = value;
+                    load->restore_permille = value > LOAD_DEFAULT_HYSTERESIS ? value - LOAD_DEFAULT_HYSTERESIS : 0;
+                    break;
+                case LOAD_SET_RESTORE:
+                    load->restore_permille = value;
+                    break;
+                case LOAD_SET_CLASS:
+                    bus_load_set_class(load, value);
+                    break;
+                case LOAD_RESET_PEAK:
+                    load->peak_permille = load->load_permille;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+* @brief Runs a command on the core that owns a bus: right away on CAN_COMMAND_CORE (get_bridge_command()
+* masked its interrupts), else from the owner's next bridge_service(). Lost if the owner's queue is full.
+*/
+static void bridge_owner_post(uint8_t interface_id, const struct can2040_msg *msg) {
+    if (get_core_num() == bus_owner_core[interface_id]) {
+        bridge_owner_command(interface_id, msg);
+    } else if (frame_queue_push(&owner_commands[interface_id], msg)) {
+        __sev();                                        //Wakes the owner if it waits in its main loop
+    }
+}
+
+/**
+* @brief Schedules the messages the other core queued for a bus and releases what the bus can take,
+* and forwards the held latest values of the frames received on it. Must run on the core that owns it. Returns the number of messages moved or released, so the caller
+* can wait for an event when there was nothing to do.
+*/
+uint32_t bridge_service(uint8_t interface_id) {
+    if (interface_id > CAN_IFACE1) {
+        return 0;
+    }
+    uint32_t irq_state = save_and_disable_interrupts();
+    frame_pool_collect();                               //Frames of this core the other one has sent
+    bus_load_tick(&bus_loads[interface_id], time_us_32());  //An idle bus still closes its windows
+    uint32_t done = bridge_health_poll(interface_id);
+    if (latency_reset_pending[interface_id ^ 1].exchange(false, std::memory_order_relaxed)) {
+        latency_direction_reset(&latency_dirs[interface_id ^ 1]);  //Only this core records it
+    }
+    if (period_reset_pending[interface_id].exchange(false, std::memory_order_relaxed)) {
+        period_table_init(&period_tables[interface_id]);            //Only this core receives interface_id
+    }
+    tx_sched_set_order(&tx_schedulers[interface_id], (TxOrder_t)sched_orders[interface_id].load(std::memory_order_relaxed));
+    struct can2040_msg command;
+    while (frame_queue_pop(&owner_commands[interface_id], &command)) {
+        bridge_owner_command(interface_id, &command);
+    }
+    restore_interrupts(irq_state);
+    frame_handle_t frame;
+    while (done < HANDLE_QUEUE_SIZE && handle_queue_pop(&tx_queues[interface_id], &frame)) {
+        bridge_send_owned(frame, interface_id);
+        done++;
+    }
+    done += bridge_flush_held(interface_id);            //This core also receives interface_id
+    return done + bridge_release(interface_id);
+}
+
+
+
+/**
+* @brief Sets the policy states of the frames received on an interface up for a published table, once per
+* revision. An added entry starts with zero counters, an edited one with a full bucket and no last value;
+* either drops its held value. Must run on the core that receives that interface, from its CAN interrupt
+* or with interrupts masked.
+*/
+static void bridge_policies_sync(const struct policy_table *table, uint8_t rx_interface_id, uint32_t now_us) {
+    if (policy_revisions[rx_interface_id] == table->revision) {
+        return;
+    }
+    policy_revisions[rx_interface_id] = table->revision;
+    for (uint8_t i = 0; i < POLICY_MAX_ENTRIES; ++i) {
+        const struct id_policy *policy = &table->entries[i];
+        struct policy_state *state = &policy_states[rx_interface_id][i];
+        if (state->serial == policy->serial && state->revision == policy->revision) {
+            continue;
+        }
+        if (held_entries[rx_interface_id] & (1ull << i)) {
+            held_entries[rx_interface_id] &= ~(1ull << i);
+            frame_release(held_frames[rx_interface_id][i]);
+        }
+        if (state->serial != policy->serial) {
+            memset(state, 0, sizeof(*state));
+            state->serial = policy->serial;
+        }
+        state->revision = policy->revision;
+        token_bucket_config(&state->bucket, policy->rate, policy->burst, now_us);
+        state->has_last = false;
+    }
+}
+
+/**
+* @brief State of an entry for the frames received on an interface, NULL until that core set it up.
+* For the counters, read on CAN_COMMAND_CORE while the other core may update them.
+*/
+static const struct policy_state *policy_state_of(const struct id_policy *policy, uint8_t index, uint8_t rx_interface_id) {
+    const struct policy_state *state = &policy_states[rx_interface_id][index];
+    return (policy->used && state->serial == policy->serial) ? state : NULL;
+}
+
+/**
+* @brief Applies the policy of the frame's ID (or rule) and the bandwidth cap of its direction.
+* Returns false if the frame must not be forwarded now: dropped, or held (with a reference of its own)
+* as the latest value of its ID.
+*/
+static inline bool bridge_shape(frame_handle_t frame, uint8_t rx_interface_id, const struct policy_table *table) {
+    const struct can2040_msg *msg = frame_get(frame);
+    uint32_t now_us = time_us_32();
+    bridge_policies_sync(table, rx_interface_id, now_us);
+    const struct id_policy *policy = policy_lookup(table, msg->id);
+    struct policy_state *state = NULL;
+    uint8_t index = 0;
+    if (policy != NULL) {
+        index = (uint8_t)(policy - table->entries);
+        state = &policy_states[rx_interface_id][index];
+        PolicyVerdict_t verdict = policy_check(policy, state, msg, now_us);
+        if (verdict == POLICY_SUPPRESS) {
+            state->suppressed++;
+            return false;
+        }
+        if (verdict == POLICY_HOLD) {
+            if (held_entries[rx_interface_id] & (1ull << index)) {
+                state->suppressed++;                    //The held value is replaced, the latest wins
+                frame_release(held_frames[rx_interface_id][index]);
+            }
+            frame_ref(frame);
+            held_frames[rx_interface_id][index] = frame;
+            held_entries[rx_interface_id] |= 1ull << index;
+            return false;
+        }
+        if (!token_bucket_take(&state->bucket, 1, now_us)) {
+            state->rate_drops++;
+            return false;
+        }
+    }
+    if (!token_bucket_take(&direction_caps[rx_interface_id], can_frame_bits(msg->id, (uint8_t)msg->dlc), now_us)) {
+        direction_cap_drops[rx_interface_id]++;
+        return false;
+    }
+    if (state != NULL) {
+        policy_commit(state, msg, now_us);
+        if (held_entries[rx_interface_id] & (1ull << index)) {     //A newer value goes out first, the held one is stale
+            held_entries[rx_interface_id] &= ~(1ull << index);
+            frame_release(held_frames[rx_interface_id][index]);
+            state->suppressed++;
+        }
+    }
+    return true;
+}
+
+/**
+* @brief Forwards the held latest values of the frames received on an interface whose interval ended.
+* Must run on the core that receives that interface. Returns the number of frames forwarded.
+*/
+static uint32_t bridge_flush_held(uint8_t rx_interface_id) {
+    if (held_entries[rx_interface_id] == 0) {
+        return 0;
+    }
+    uint8_t tx_interface_id = rx_interface_id ^ 1;
+    uint32_t forwarded = 0;
+
+    uint32_t irq_state = save_and_disable_interrupts();     //The RX interrupt of this core updates the held values
+    unsigned int core = get_core_num();
+    const struct bridge_config *config = config_read_begin(core);
+    uint32_t now_us = time_us_32();
+    bridge_policies_sync(&config->policies, rx_interface_id, now_us);
+    uint64_t pending = held_entries[rx_interface_id];
+    while (pending != 0) {
+        uint8_t index = (uint8_t)__builtin_ctzll(pending);
+        pending &= pending - 1;
+        const struct id_policy *policy = &config->policies.entries[index];
+        struct policy_state *state = &policy_states[rx_interface_id][index];
+        if (now_us - state->last_us < policy->interval_us) {
+            continue;
+        }
+        frame_handle_t held = held_frames[rx_interface_id][index];
+        struct can2040_msg *msg = frame_get(held);
+        if (!token_bucket_take(&state->bucket, 1, now_us)
+            || !token_bucket_take(&direction_caps[rx_interface_id], can_frame_bits(msg->id, (uint8_t)msg->dlc), now_us)) {
+            continue;                                       //Stays held until the limits allow it
+        }
+        held_entries[rx_interface_id] &= ~(1ull << index);
+        policy_commit(state, msg, now_us);
+        const struct rewrite_rule *rule = rewrite_lookup(&config->rewrites[rx_interface_id], msg->id);
+        if (rule != NULL) {                                 //The held reference is the only one left
+            rewrite_apply(rule, msg);
+            STATS_COUNT(&rx_stats[rx_interface_id], rewritten);
+        }
+        bridge_forward(held, tx_interface_id);              //Passes the held reference on
+        forwarded++;
+    }
+    config_read_end(core);
+    restore_interrupts(irq_state);
+    return forwarded;
+}
+
+/**
+* @brief True while frames received on an interface are held for a later interval, the caller must not sleep.
+*/
+bool bridge_has_held(uint8_t rx_interface_id) {
+    return rx_interface_id <= CAN_IFACE1 && held_entries[rx_interface_id] != 0;
+}
+
+/**
+* @brief Processes a CAN message received on a bus, on the core that owns it. data_payload holds 8 bytes.
+*/
+void __not_in_flash_func(bridge_receive)(uint8_t rx_interface_id, uint32_t id, uint8_t dlc, uint8_t *data_payload){
+    STATS_TIME_START(rx_start);
+    BUDGET_TIME_START(budget_start);
+    if (rx_interface_id > CAN_IFACE1) {
         return;
     }
+    if (dlc > 8) {                                      //DLC 9 to 15 still carries 8 bytes
+        dlc = 8;
+    }
+    uint8_t tx_interface_id = rx_interface_id ^ 1;      //The other bus is the target
+
+    //checkprint(&received_msg);
+    STATS_COUNT(&rx_stats[rx_interface_id], rx);
+    STATS_COUNT_ID(&rx_stats[rx_interface_id], id);
+    uint32_t now_us = time_us_32();
+    bus_load_add(&bus_loads[rx_interface_id], can_frame_bits(id, dlc), now_us);   //Every frame took the bus, echoes too
+    if (bus_health_seen(&bus_healths[rx_interface_id], now_us)) {   //The bus works again
+        bridge_outage_end(rx_interface_id);
+        bridge_release_locked(rx_interface_id);
+    }
 
-    if (is_echo(&received_msg, dlc, rx_interface_id)) { //If the message is an echo, ignore it
+    if (is_echo(id, dlc, data_payload, rx_interface_id)) { //If the message is an echo, ignore it
+        STATS_COUNT(&rx_stats[rx_interface_id], echo_dropped);
+        bridge_trace(rx_interface_id, TRACE_ECHO, id, dlc, data_payload);
+        STATS_TIME_END(&rx_stats[rx_interface_id], rx_start);
         return;
     }
 
-    if (id == CONTROL_ID) {                             //If the message is a control message act on it
-        get_command(&received_msg);
+    if (id == CONTROL_ID) {                             //If the message is a control message queue it for CAN_COMMAND_CORE
+        STATS_COUNT(&rx_stats[rx_interface_id], control);
+        bridge_trace(rx_interface_id, TRACE_CONTROL, id, dlc, data_payload);
+        struct can2040_msg control_msg;
+        control_msg.id = id;
+        control_msg.dlc = dlc;
+        memcpy(control_msg.data, data_payload, dlc);
+        if (frame_queue_push(&command_queues[rx_interface_id], &control_msg)) {
+            __sev();                                    //Wakes the main loop of CAN_COMMAND_CORE
+        }
     } else {
+        bool should_bridge = false;
+        unsigned int core = get_core_num();
 
-        switch (current_filter_state) {
-            case FILTER_MODE_PASSIVE:                   //If the filter mode is passive, bridge all messages
-                should_bridge = true;
-                break;
+        const struct bridge_config *config = config_read_begin(core);
+        should_bridge = route_forward(config_route(config, rx_interface_id), id);     //Compiled decision for this direction
+        bool shed = should_bridge && bus_load_sheds(&bus_loads[tx_interface_id], id);   //The target bus is overloaded
+        uint32_t learned_us = should_bridge ? period_update(&period_tables[rx_interface_id], id, now_us) : 0;
 
-            case FILTER_MODE_WHITELIST:             
-                if (find_id_in_list(id, whitelist_ids, whitelist_count) != -1) {
-                    should_bridge = true;               //If the ID is in the whitelist, bridge the message
-                }
-                break;
-            case FILTER_MODE_BLACKLIST:
-                if (find_id_in_list(id, blacklist_ids, blacklist_count) == -1) {
-                    should_bridge = true;               //If the ID is not in the blacklist, bridge the message
-                }
-                break;
-            case FILTER_MODE_ZERO_TO_ONE: // Only CAN0 -> CAN1
-                if (rx_interface_id == CAN_IFACE0) {
-                    should_bridge = true;               //If the message was received on CAN0, bridge the message
-                }
-                break;
-            case FILTER_MODE_ONE_TO_ZERO: // Only CAN1 -> CAN0
-                if (rx_interface_id == CAN_IFACE1) {
-                    should_bridge = true;               //If the message was received on CAN1, bridge the message
+        //The frame is written once into the pool, the held value and the target scheduler share it
+        frame_handle_t frame = should_bridge && !shed ? frame_alloc() : FRAME_NONE;
+        if (frame != FRAME_NONE) {
+            struct can2040_msg *msg = frame_get(frame);
+            msg->id = id;
+            msg->dlc = dlc;
+            memcpy(msg->data, data_payload, dlc);
+            *frame_rx_us(frame) = latency_enabled ? latency_stamp(now_us) : LATENCY_NO_STAMP;
+            *frame_due_us(frame) = now_us + (learned_us != 0 ? learned_us : TX_EDF_DEFAULT_DUE_US);   //Before the next one
+        }
+
+        if (!should_bridge) {
+            STATS_COUNT(&rx_stats[rx_interface_id], filtered);
+            bridge_trace(rx_interface_id, TRACE_FILTERED, id, dlc, data_payload);
+        } else if (shed) {
+            load_shed_drops[tx_interface_id]++;
+            STATS_COUNT(&rx_stats[rx_interface_id], shaped);
+            bridge_trace(rx_interface_id, TRACE_SHAPED, id, dlc, data_payload);
+        } else if (frame == FRAME_NONE) {
+            //Every frame of the pool is waiting for a bus, counted in its exhausted counter
+        } else if (!bridge_shape(frame, rx_interface_id, &config->policies)) {
+            STATS_COUNT(&rx_stats[rx_interface_id], shaped);
+            bridge_trace(rx_interface_id, TRACE_SHAPED, id, dlc, data_payload);
+        } else {
+            STATS_COUNT(&rx_stats[rx_interface_id], forwarded);
+            bridge_trace(rx_interface_id, TRACE_FORWARDED, id, dlc, data_payload);
+            const struct rewrite_rule *rule = rewrite_lookup(&config->rewrites[rx_interface_id], id);
+            if (rule != NULL) {                         //Policies saw the received frame, the other bus gets the rewritten one
+                struct can2040_msg *sent = frame_get(frame);
+                rewrite_apply(rule, sent);              //Not shared yet, rewritten in place
+                STATS_COUNT(&rx_stats[rx_interface_id], rewritten);
+                bridge_trace(rx_interface_id, TRACE_REWRITTEN, sent->id, (uint8_t)sent->dlc, sent->data);
+            }
+            frame_ref(frame);
+            bridge_forward(frame, tx_interface_id);     //Bridge the message
+        }
+        frame_release(frame);                           //The receive path's own reference
+        BUDGET_TIME_END(&isr_budgets[rx_interface_id], config->routes[rx_interface_id].kind, budget_start);
+        config_read_end(core);                          //The rule stays valid until here
+    }
+    STATS_TIME_END(&rx_stats[rx_interface_id], rx_start);
+}
+
+/**
+* @brief Prints the counters, top talkers and RX timing of both directions on stdio (USB on the board).
+*/
+void bridge_stats_dump(void) {
+#if CAN_BRIDGE_STATS
+    direction_stats_print(&rx_stats[CAN_IFACE0], CAN_IFACE0);
+    direction_stats_print(&rx_stats[CAN_IFACE1], CAN_IFACE1);
+#else
+    printf("bridge statistics not compiled in (CAN_BRIDGE_STATS=0)\n");
+#endif
+#if CAN_BRIDGE_ISR_BUDGET
+    isr_budget_print(&isr_budgets[CAN_IFACE0], CAN_IFACE0);
+    isr_budget_print(&isr_budgets[CAN_IFACE1], CAN_IFACE1);
+#endif
+    period_table_print(&period_tables[CAN_IFACE0], CAN_IFACE0, time_us_32());
+    period_table_print(&period_tables[CAN_IFACE1], CAN_IFACE1, time_us_32());
+    if (latency_dirs[CAN_IFACE0].all.count != 0 || latency_dirs[CAN_IFACE1].all.count != 0) {
+        latency_direction_print(&latency_dirs[CAN_IFACE0], CAN_IFACE0);
+        latency_direction_print(&latency_dirs[CAN_IFACE1], CAN_IFACE1);
+    }
+}
+
+#if CAN_BRIDGE_STATS
+/**
+* @brief Statistics of the frames received on an interface.
+*/
+const struct direction_stats *bridge_rx_stats(uint8_t rx_interface_id) {
+    return &rx_stats[rx_interface_id & 1];
+}
+#endif
+
+#if CAN_BRIDGE_ISR_BUDGET
+/**
+* @brief Worst receive path per route kind of the frames received on an interface.
+*/
+const struct isr_budget *bridge_isr_budget(uint8_t rx_interface_id) {
+    return &isr_budgets[rx_interface_id & 1];
+}
+#endif
+
+/**
+* @brief Filter decision for a frame received on rx_interface_id, from the compiled routes.
+*/
+bool bridge_filter_decision(uint32_t id, uint8_t rx_interface_id) {
+    return route_forward(config_route(active_config.load(std::memory_order_acquire), rx_interface_id), id);
+}
+
+/**
+* @brief Transmit scheduler of a bus, for its counters.
+*/
+const struct tx_scheduler *bridge_tx_scheduler(uint8_t interface_id) {
+    return &tx_schedulers[interface_id & 1];
+}
+
+/**
+* @brief Load monitor of a bus, for its counters.
+*/
+const struct bus_load *bridge_bus_load(uint8_t interface_id) {
+    return &bus_loads[interface_id & 1];
+}
+
+/**
+* @brief Health of a bus, for its counters.
+*/
+const struct bus_health *bridge_bus_health(uint8_t interface_id) {
+    return &bus_healths[interface_id & 1];
+}
+
+/**
+* @brief Frames held for a bus while it is down, for the counters.
+*/
+const struct outage_buffer *bridge_outage_buffer(uint8_t interface_id) {
+    return &outage_buffers[interface_id & 1];
+}
+
+/**
+* @brief Field by field J1939 decode of an ID checked against a J1939 list, the reference of j1939_listed().
+*/
+static bool j1939_reference_listed(const struct filter_list *list, uint32_t id) {
+    if (!(id & CAN2040_ID_EFF) || (id & CAN2040_ID_RTR)) {
+        return false;                               //Not a J1939 frame
+    }
+    uint32_t source = id & 0xFF;
+    uint32_t ps = (id >> 8) & 0xFF;
+    uint32_t pf = (id >> 16) & 0xFF;
+    uint32_t dp = (id >> 24) & 0x3;                 //EDP and DP
+    uint32_t pgn = (dp << 16) | (pf << 8);
+    if (pf >= J1939_PDU2_MIN_PF) {
+        pgn |= ps;                                  //PDU2: PS is the group extension
+    } else if (filter_list_contains(list, J1939_KEY_DA + ps)) {
+        return true;                                //PDU1: PS is the destination address
+    }
+    return filter_list_contains(list, J1939_KEY_SA + source) || filter_list_contains(list, J1939_KEY_PGN + pgn);
+}
+
+/**
+* @brief Filter decision computed straight from the mode switch.
+* The receive path uses the compiled routes instead, this is kept as the reference they must match
+* (the host benchmark checks and times both).
+*/
+bool bridge_filter_reference(uint32_t id, uint8_t rx_interface_id) {
+    const struct bridge_config *config = active_config.load(std::memory_order_acquire);
+    bool should_bridge = false;
+
+    switch (config->current_filter_state) {
+        case FILTER_MODE_PASSIVE:                   //If the filter mode is passive, bridge all messages
+            should_bridge = true;
+            break;
+
+        case FILTER_MODE_WHITELIST:             
+            if (filter_list_contains(&config->whitelist_ids, id)) {
+                should_bridge = true;               //If the ID is in the whitelist, bridge the message
+            }
+            break;
+        case FILTER_MODE_BLACKLIST:
+            if (!filter_list_contains(&config->blacklist_ids, id)) {
+                should_bridge = true;               //If the ID is not in the blacklist, bridge the message
+            }
+            break;
+        case FILTER_MODE_ZERO_TO_ONE: // Only CAN0 -> CAN1
+            if (rx_interface_id == CAN_IFACE0) {
+                should_bridge = true;               //If the message was received on CAN0, bridge the message
+            }
+            break;
+        case FILTER_MODE_ONE_TO_ZERO: // Only CAN1 -> CAN0
+            if (rx_interface_id == CAN_IFACE1) {
+                should_bridge = true;               //If the message was received on CAN1, bridge the message
+            }
+            break;
+        case FILTER_MODE_ONE_WAY_1_TO_0_BLACKLIST:
+            if (rx_interface_id == CAN_IFACE1) {
+                if (!filter_list_contains(&config->blacklist_ids, id)) { 
+                    should_bridge = true;           //If the ID is not in the blacklist and the message was received on CAN1, bridge the message
                 }
-                break;
-            case FILTER_MODE_ONE_WAY_1_TO_0_BLACKLIST:
-                if (rx_interface_id == CAN_IFACE1) {
-                    if (find_id_in_list(id, blacklist_ids, blacklist_count) == -1) { 
-                        should_bridge = true;           //If the ID is not in the blacklist and the message was received on CAN1, bridge the message
-                    }
+            }
+            break;
+        case FILTER_MODE_ONE_WAY_1_TO_0_WHITELIST:
+            if (rx_interface_id == CAN_IFACE1) {
+                if (filter_list_contains(&config->whitelist_ids, id)) { 
+                    should_bridge = true;           //If the ID is in the whitelist and the message was received on CAN1, bridge the message
                 }
-                break;
-            case FILTER_MODE_ONE_WAY_1_TO_0_WHITELIST:
-                if (rx_interface_id == CAN_IFACE1) {
-                    if (find_id_in_list(id, whitelist_ids, whitelist_count) != -1) { 
-                        should_bridge = true;           //If the ID is in the whitelist and the message was received on CAN1, bridge the message
-                    }
+            }
+            break;
+        case FILTER_MODE_ONE_WAY_0_TO_1_BLACKLIST:
+            if (rx_interface_id == CAN_IFACE0) { 
+                if (!filter_list_contains(&config->blacklist_ids, id)) { 
+                    should_bridge = true;           //If the ID is not in the blacklist and the message was received on CAN0, bridge the message
                 }
-                break;
-            case FILTER_MODE_ONE_WAY_0_TO_1_BLACKLIST:
-                if (rx_interface_id == CAN_IFACE0) { 
-                    if (find_id_in_list(id, blacklist_ids, blacklist_count) == -1) { 
-                        should_bridge = true;           //If the ID is not in the blacklist and the message was received on CAN0, bridge the message
-                    }
+            }
+            break;
+        case FILTER_MODE_ONE_WAY_0_TO_1_WHITELIST:
+            if (rx_interface_id == CAN_IFACE0) { 
+                if (filter_list_contains(&config->whitelist_ids, id)) { 
+                    should_bridge = true;           //If the ID is in the whitelist and the message was received on CAN0, bridge the message
                 }
-                break;
-            case FILTER_MODE_ONE_WAY_0_TO_1_WHITELIST:
-                if (rx_interface_id == CAN_IFACE0) { 
-                    if (find_id_in_list(id, whitelist_ids, whitelist_count) != -1) { 
-                        should_bridge = true;           //If the ID is in the whitelist and the message was received on CAN0, bridge the message
-                    }
+            }
+            break;
+        case FILTER_MODE_ONE_WAY_1_TO_0_EXCEPT:
+            if (rx_interface_id == CAN_IFACE1) { 
+                should_bridge = true;
+            } else if (rx_interface_id == CAN_IFACE0) { 
+                if (filter_list_contains(&config->exception_ids, id)) { 
+                    should_bridge = true;           //If the ID is in the exception list and the message was received on CAN0, bridge the message
+                                                    //If the message was received on CAN1, bridge the message
                 }
-                break;
-            case FILTER_MODE_ONE_WAY_1_TO_0_EXCEPT:
-                if (rx_interface_id == CAN_IFACE1) { 
-                    should_bridge = true;
-                } else if (rx_interface_id == CAN_IFACE0) { 
-                    if (find_id_in_list(id, exception_ids, exception_count) != -1) { 
-                        should_bridge = true;           //If the ID is in the exception list and the message was received on CAN0, bridge the message
-                                                        //If the message was received on CAN1, bridge the message
-                    }
+            }
+            break;
+        case FILTER_MODE_ONE_WAY_0_TO_1_EXCEPT:
+            if (rx_interface_id == CAN_IFACE0) {
+                should_bridge = true;
+            } else if (rx_interface_id == CAN_IFACE1) { 
+                if (filter_list_contains(&config->exception_ids, id)) {
+                    should_bridge = true;           //If the ID is in the exception list and the message was received on CAN1, bridge the message
+                                                    //If the message was received on CAN0, bridge the message
                 }
-                break;
-            case FILTER_MODE_ONE_WAY_0_TO_1_EXCEPT:
+            }
+            break;
+        case FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_0_TO_1:
+            if (filter_list_contains(&config->one_way_restricted_ids, id)) {
                 if (rx_interface_id == CAN_IFACE0) {
-                    should_bridge = true;
-                } else if (rx_interface_id == CAN_IFACE1) { 
-                    if (find_id_in_list(id, exception_ids, exception_count) != -1) {
-                        should_bridge = true;           //If the ID is in the exception list and the message was received on CAN1, bridge the message
-                                                        //If the message was received on CAN0, bridge the message
-                    }
+                    should_bridge = true;           //If the message was received on CAN0, bridge the message
+                } else { 
+                    should_bridge = false;          //Block 1->0 for this ID
                 }
-                break;
-            case FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_0_TO_1:
-                if (find_id_in_list(id, one_way_restricted_ids, one_way_restricted_count) != -1) {
-                    if (rx_interface_id == CAN_IFACE0) {
-                        should_bridge = true;           //If the message was received on CAN0, bridge the message
-                    } else { 
-                        should_bridge = false;          //Block 1->0 for this ID
-                    }
+            } else {
+                should_bridge = true;               //Not restricted, allow bidirectional
+            }
+            break;
+        case FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_1_TO_0:
+            if (filter_list_contains(&config->one_way_restricted_ids, id)) {
+                if (rx_interface_id == CAN_IFACE1) {
+                    should_bridge = true;           //If the message was received on CAN1, bridge the message
                 } else {
-                    should_bridge = true;               //Not restricted, allow bidirectional
+                    should_bridge = false;          //Block 0->1 for this ID
                 }
+            } else {
+                should_bridge = true;               //Not restricted, allow bidirectional
+            }
+            break;
+
+        case FILTER_MODE_J1939_WHITELIST:
+            should_bridge = j1939_reference_listed(&config->j1939_ids, id);
+            break;
+        case FILTER_MODE_J1939_BLACKLIST:
+            should_bridge = !j1939_reference_listed(&config->j1939_ids, id);
+            break;
+
+        default:
+            should_bridge = false;                  //Default, don't bridge
+            break;
+    }
+    return should_bridge;
+}
+
+/**
+* @brief Gets the ID from the CAN message data.
+*/
+static uint32_t get_id_from_data(const uint8_t *data) {
+    return (uint32_t)((data[3] << 24) | (data[4] << 16) | (data[5] << 8) | data[6]);
+}
+
+
+/**
+* @brief Gets the value of a list command: the ID, or for j1939_ids the key of the PGN or address
+* selected by data[2] (J1939_PGN, J1939_SOURCE, J1939_DESTINATION).
+*/
+static uint32_t get_list_key(const struct bridge_config *config, const struct filter_list *list, const uint8_t *data) {
+    uint32_t value = get_id_from_data(data);
+    if (list != &config->j1939_ids) {
+        return value;
+    }
+    switch (data[2]) {
+        case J1939_SOURCE:
+            return J1939_KEY_SA + (value & 0xFF);
+        case J1939_DESTINATION:
+            return J1939_KEY_DA + (value & 0xFF);
+        default: {
+            uint32_t pgn = value & J1939_PGN_MASK;
+            if (((pgn >> 8) & 0xFF) < J1939_PDU2_MIN_PF) {
+                pgn &= ~0xFFu;                          //A PDU1 PGN has no destination
+            }
+            return J1939_KEY_PGN + pgn;
+        }
+    }
+}
+
+/**
+* @brief Handles a RULE_COMMAND frame.
+*/
+static void get_rule_command(struct bridge_config *config, const struct can2040_msg *received_msg) {
+    struct filter_list *list = config_list(config, received_msg->data[2]);     //RULE_LIST_* match ModeList_t
+    if (list == NULL) {
+        return;
+    }
+
+    uint32_t value = get_id_from_data(received_msg->data);
+    switch (received_msg->data[1]) {
+        case RULE_SET_VALUE:
+            rule_stored_value = value;
+            break;
+        case RULE_ADD_MASK:
+            id_rules_add_mask(&list->rules, rule_stored_value, value);
+            break;
+        case RULE_REMOVE_MASK:
+            id_rules_remove_mask(&list->rules, rule_stored_value, value);
+            break;
+        case RULE_ADD_RANGE:
+            id_rules_add_range(&list->rules, rule_stored_value, value);
+            break;
+        case RULE_REMOVE_RANGE:
+            id_rules_remove_range(&list->rules, rule_stored_value, value);
+            break;
+        case RULE_CLEAR:
+            id_rules_clear(&list->rules);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+* @brief Handles a REWRITE_COMMAND frame.
+*/
+static void get_rewrite_command(struct bridge_config *config, const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    uint8_t param = received_msg->data[2];
+    switch (received_msg->data[1]) {
+        case REWRITE_SET_ID:
+            rewrite_rule_init(&rewrite_stored, value);
+            break;
+        case REWRITE_SET_TARGET:
+            rewrite_stored.new_id = value;
+            break;
+        case REWRITE_SET_BYTE:                                      //Byte param, keep mask in data[3], set bits in data[4]
+            if (param < 8) {
+                rewrite_stored.keep[param] = received_msg->data[3];
+                rewrite_stored.set[param] = received_msg->data[4];
+            }
+            break;
+        case REWRITE_SET_DLC:
+            rewrite_stored.dlc = param <= 8 ? param : REWRITE_KEEP_DLC;
+            break;
+        case REWRITE_ADD:
+            if (param <= CAN_IFACE1) {
+                rewrite_table_set(&config->rewrites[param], &rewrite_stored);
+            }
+            break;
+        case REWRITE_REMOVE:
+            if (param <= CAN_IFACE1) {
+                rewrite_table_remove(&config->rewrites[param], value);
+            }
+            break;
+        case REWRITE_CLEAR:
+            if (param <= CAN_IFACE1) {
+                rewrite_table_clear(&config->rewrites[param]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+* @brief Handles a STATS_COMMAND frame.
+*/
+static void get_stats_command(const struct can2040_msg *received_msg) {
+    uint8_t interface_id = received_msg->data[2];
+    if (interface_id > CAN_IFACE1) {
+        return;
+    }
+    switch (received_msg->data[1]) {
+        case STATS_QUERY_QUEUES:                                    //Queue towards the interface in data[2]
+            bridge_send_feedback(FEEDBACK_QUEUE_DEPTH, interface_id, handle_queue_depth(&tx_queues[interface_id]));
+            bridge_send_feedback(FEEDBACK_QUEUE_HIGH_WATER, interface_id, tx_queues[interface_id].high_water);
+            bridge_send_feedback(FEEDBACK_QUEUE_DROPS, interface_id, tx_queues[interface_id].drops);
+            break;
+        case STATS_QUERY_POOL: {                                    //Frame pool of the core receiving data[2]
+            const struct frame_pool *pool = &frame_pools[bus_owner_core[interface_id]];
+            bridge_send_feedback(FEEDBACK_POOL_IN_USE, interface_id, frame_pool_in_use(pool));
+            bridge_send_feedback(FEEDBACK_POOL_HIGH_WATER, interface_id, pool->high_water);
+            bridge_send_feedback(FEEDBACK_POOL_EXHAUSTED, interface_id, pool->exhausted);
+            break;
+        }
+#if CAN_BRIDGE_STATS
+        case STATS_QUERY_COUNTERS: {                                //Frames received on the interface in data[2]
+            const struct direction_stats *stats = &rx_stats[interface_id];
+            bridge_send_feedback(FEEDBACK_STATS_RX, interface_id, stats->rx);
+            bridge_send_feedback(FEEDBACK_STATS_FORWARDED, interface_id, stats->forwarded);
+            bridge_send_feedback(FEEDBACK_STATS_FILTERED, interface_id, stats->filtered);
+            bridge_send_feedback(FEEDBACK_STATS_ECHO, interface_id, stats->echo_dropped);
+            bridge_send_feedback(FEEDBACK_STATS_SHAPED, interface_id, stats->shaped);
+            bridge_send_feedback(FEEDBACK_STATS_CONTROL, interface_id, stats->control);
+            bridge_send_feedback(FEEDBACK_STATS_REWRITTEN, interface_id, stats->rewritten);
+            break;
+        }
+        case STATS_QUERY_TOP: {                                     //value most frequent IDs, index = rank
+            struct stats_talker top[STATS_TOP_MAX];
+            uint32_t wanted = get_id_from_data(received_msg->data);
+            uint8_t found = direction_stats_top(&rx_stats[interface_id], top, wanted < STATS_TOP_MAX ? (uint8_t)wanted : STATS_TOP_MAX);
+            for (uint8_t i = 0; i < found; ++i) {
+                bridge_send_feedback(FEEDBACK_STATS_TOP_ID, i, top[i].id);
+                bridge_send_feedback(FEEDBACK_STATS_TOP_HITS, i, top[i].hits);
+            }
+            break;
+        }
+        case STATS_QUERY_HISTOGRAM: {                               //index = bucket, then the slowest call
+            const struct direction_stats *stats = &rx_stats[interface_id];
+            for (uint8_t i = 0; i < STATS_HIST_BUCKETS; ++i) {
+                bridge_send_feedback(FEEDBACK_STATS_HIST_BUCKET, i, stats->hist[i]);
+            }
+            bridge_send_feedback(FEEDBACK_STATS_HIST_MAX, interface_id, stats->hist_max);
+            break;
+        }
+        case STATS_RESET:                                           //Only the core receiving data[2] counts
+            bridge_owner_post(interface_id, received_msg);
+            break;
+#endif
+        case STATS_DUMP:
+            bridge_stats_dump();
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+* @brief Handles a SCHED_COMMAND frame. Returns false for SCHED_SET_DEADLINE and SCHED_CLEAR_DEADLINES,
+* which edit the configuration, see get_deadline_command().
+*/
+static bool get_sched_command(const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    uint8_t interface_id = received_msg->data[2];
+    switch (received_msg->data[1]) {
+        case SCHED_SET_POLICY:                                      //Overflow policy of the bus in data[2], applied by its owner
+            if (interface_id <= CAN_IFACE1 && value <= TX_SCHED_DROP_OLDEST) {
+                bridge_owner_post(interface_id, received_msg);
+            }
+            break;
+        case SCHED_SET_ID:
+            sched_stored_id = value;
+            break;
+        case SCHED_SET_DEADLINE:
+        case SCHED_CLEAR_DEADLINES:
+            return false;
+        case SCHED_QUERY:                                           //Counters of the bus in data[2]
+            if (interface_id <= CAN_IFACE1) {
+                const struct tx_scheduler *sched = &tx_schedulers[interface_id];
+                bridge_send_feedback(FEEDBACK_SCHED_DEPTH, interface_id, tx_sched_depth(sched));
+                bridge_send_feedback(FEEDBACK_SCHED_HIGH_WATER, interface_id, sched->high_water);
+                bridge_send_feedback(FEEDBACK_SCHED_DROPS, interface_id, sched->overflow_drops);
+                bridge_send_feedback(FEEDBACK_SCHED_EXPIRED, interface_id, sched->expired);
+                bridge_send_feedback(FEEDBACK_SCHED_CAPACITY, interface_id, sched->capacity);
+                bridge_send_feedback(FEEDBACK_SCHED_ORDER, interface_id, sched->order);
+            }
+            break;
+        case SCHED_SET_ORDER:                                       //Applied by the core that owns the bus
+            if (interface_id <= CAN_IFACE1 && value <= TX_ORDER_EDF) {
+                sched_orders[interface_id].store((uint8_t)value, std::memory_order_relaxed);
+            }
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+/**
+* @brief Handles the SCHED_COMMAND and HEALTH_COMMAND frames that edit the deadlines or the outage TTLs
+* of a configuration.
+*/
+static void get_deadline_command(struct bridge_config *config, const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    if (received_msg->data[0] == HEALTH_COMMAND) {
+        switch (received_msg->data[1]) {
+            case HEALTH_SET_TTL:                                    //TTL of the stored ID, 0 removes it
+                tx_deadline_set(&config->outage_ttls, health_stored_id, value);
                 break;
-            case FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_1_TO_0:
-                if (find_id_in_list(id, one_way_restricted_ids, one_way_restricted_count) != -1) {
-                    if (rx_interface_id == CAN_IFACE1) {
-                        should_bridge = true;           //If the message was received on CAN1, bridge the message
-                    } else { /
-                        should_bridge = false;          //Block 0->1 for this ID
-                    }
-                } else {
-                    should_bridge = true;               //Not restricted, allow bidirectional
-                }
+            case HEALTH_SET_DEFAULT_TTL:
+                config->outage_default_ttl_us = value;
+                break;
+            case HEALTH_CLEAR_TTLS:
+                tx_deadline_clear(&config->outage_ttls);
                 break;
-
             default:
-                should_bridge = false;                  //Default, don't bridge
                 break;
         }
-        if (should_bridge) {
-            bridge_transmit(target_can_instance_ptr, &received_msg, dlc, tx_interface_id);  //Bridge the message
+        return;
+    }
+    switch (received_msg->data[1]) {
+        case SCHED_SET_DEADLINE:                                    //Deadline of the stored ID, 0 removes it
+            tx_deadline_set(&config->deadlines, sched_stored_id, value);
+            break;
+        case SCHED_CLEAR_DEADLINES:
+            tx_deadline_clear(&config->deadlines);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+* @brief Handles a RATE_COMMAND frame. Returns false for RATE_LIMIT and RATE_CLEAR, which edit the
+* configuration, see get_policy_command().
+*/
+static bool get_rate_command(const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    uint8_t interface_id = received_msg->data[2];
+    const struct policy_table *policies = &active_config.load(std::memory_order_acquire)->policies;
+    switch (received_msg->data[1]) {
+        case RATE_SET_ID:
+            rate_stored_id = value;
+            rate_stored_mask = RATE_EXACT_MASK;
+            break;
+        case RATE_SET_MASK:
+            rate_stored_mask = value;
+            break;
+        case RATE_SET_BURST:
+            rate_stored_burst = value ? value : 1;
+            break;
+        case RATE_LIMIT:
+        case RATE_CLEAR:
+            return false;
+        case RATE_SET_CAP:                                          //value bits/s for frames received on data[2], 0 removes
+            if (interface_id <= CAN_IFACE1) {
+                bridge_owner_post(interface_id, received_msg);
+            }
+            break;
+        case RATE_QUERY:                                            //Counters of the direction received on data[2]
+            if (interface_id <= CAN_IFACE1) {
+                uint32_t id_drops = 0;
+                for (uint8_t i = 0; i < POLICY_MAX_ENTRIES; ++i) {
+                    const struct policy_state *state = policy_state_of(&policies->entries[i], i, interface_id);
+                    id_drops += state ? state->rate_drops : 0;
+                }
+                bridge_send_feedback(FEEDBACK_RATE_ID_DROPS, interface_id, id_drops);
+                bridge_send_feedback(FEEDBACK_RATE_CAP_DROPS, interface_id, direction_cap_drops[interface_id]);
+                bridge_send_feedback(FEEDBACK_RATE_CAP, interface_id, direction_cap_bps[interface_id]);
+            }
+            break;
+        case RATE_QUERY_ID:                                         //Drops of the stored ID or rule, direction in data[2]
+            if (interface_id <= CAN_IFACE1) {
+                const struct id_policy *policy = policy_table_find(policies, rate_stored_id, rate_stored_mask);
+                const struct policy_state *state = policy ? policy_state_of(policy, (uint8_t)(policy - policies->entries), interface_id) : NULL;
+                bridge_send_feedback(FEEDBACK_RATE_ID_DROPS, interface_id, state ? state->rate_drops : 0);
+            }
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+/**
+* @brief Handles a FORWARD_COMMAND frame. Returns false for the forward policies, which edit the
+* configuration, see get_policy_command().
+*/
+static bool get_forward_command(const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    uint8_t interface_id = received_msg->data[2];
+    switch (received_msg->data[1]) {
+        case FORWARD_SET_ID:
+            forward_stored_id = value;
+            return true;
+        case FORWARD_CHANGES:
+        case FORWARD_DOWNSAMPLE:
+            if (value > FORWARD_MAX_INTERVAL_MS) {                  //Refused before the configuration is opened
+                bridge_send_error(FORWARD_COMMAND);
+                return true;
+            }
+            return false;
+        case FORWARD_EVERY_FRAME:
+            return false;
+        case FORWARD_QUERY:                                         //Counters of the stored ID, direction in data[2]
+            if (interface_id <= CAN_IFACE1) {
+                const struct policy_table *policies = &active_config.load(std::memory_order_acquire)->policies;
+                const struct id_policy *policy = policy_table_find(policies, forward_stored_id, POLICY_EXACT_MASK);
+                const struct policy_state *state = policy ? policy_state_of(policy, (uint8_t)(policy - policies->entries), interface_id) : NULL;
+                bridge_send_feedback(FEEDBACK_FORWARD_SUPPRESSED, interface_id, state ? state->suppressed : 0);
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+/**
+* @brief Handles the RATE_COMMAND and FORWARD_COMMAND frames that edit the policies of a configuration.
+* The cores set the states of the changed entries up again once it is published, see bridge_policies_sync().
+* Forward policies are per ID, rules only take rate limits.
+*/
+static void get_policy_command(struct bridge_config *config, const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    struct policy_table *policies = &config->policies;
+    if (received_msg->data[0] == RATE_COMMAND && received_msg->data[1] == RATE_CLEAR) {   //Rate limits only, forward policies stay
+        for (uint8_t i = 0; i < POLICY_MAX_ENTRIES; ++i) {
+            struct id_policy *policy = &policies->entries[i];
+            if (!policy->used || policy->rate == 0) {
+                continue;
+            }
+            policy->rate = 0;
+            policy_table_edited(policies, policy);
+            if (id_policy_is_empty(policy)) {
+                policy_table_remove(policies, policy->id, policy->mask);
+            }
+        }
+        return;
+    }
+    if (received_msg->data[0] == RATE_COMMAND) {                    //RATE_LIMIT: value frames/s for the stored ID or rule, 0 removes
+        struct id_policy *policy = policy_table_get(policies, rate_stored_id, rate_stored_mask);
+        if (policy == NULL) {
+            return;
         }
+        policy->rate = value;
+        policy->burst = rate_stored_burst;
+        if (id_policy_is_empty(policy)) {
+            policy_table_remove(policies, rate_stored_id, rate_stored_mask);
+        }
+        return;
+    }
+
+    ForwardPolicy_t forward;
+    switch (received_msg->data[1]) {
+        case FORWARD_EVERY_FRAME:   forward = FORWARD_EVERY;        break;
+        case FORWARD_CHANGES:       forward = FORWARD_ON_CHANGE;    break;
+        case FORWARD_DOWNSAMPLE:    forward = FORWARD_LATEST;       break;
+        default:                    return;
+    }
+    struct id_policy *policy = policy_table_get(policies, forward_stored_id, POLICY_EXACT_MASK);
+    if (policy == NULL) {
+        return;
+    }
+    policy->forward = forward;
+    policy->interval_us = forward == FORWARD_EVERY ? 0 : value * 1000;     //At most FORWARD_MAX_INTERVAL_MS, see get_forward_command()
+    if (id_policy_is_empty(policy)) {
+        policy_table_remove(policies, forward_stored_id, POLICY_EXACT_MASK);
     }
 }
 
 /**
-* @brief Gets the ID from the CAN message data.
+* @brief Handles a LOAD_COMMAND frame.
 */
-static uint32_t get_id_from_data(const uint8_t *data) {
-    return (uint32_t)((data[3] << 24) | (data[4] << 16) | (data[5] << 8) | data[6]);
+static void get_load_command(const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    uint8_t interface_id = received_msg->data[2];
+    if (interface_id > CAN_IFACE1) {
+        return;
+    }
+    const struct bus_load *load = &bus_loads[interface_id];
+    switch (received_msg->data[1]) {
+        case LOAD_SET_BITRATE:                                      //Both schedulers depend on it, see bus_bitrate_apply()
+            if (value != 0) {
+                bus_bitrates[interface_id] = value;
+                bridge_owner_post(CAN_IFACE0, received_msg);
+                bridge_owner_post(CAN_IFACE1, received_msg);
+            }
+            break;
+        case LOAD_SET_THRESHOLD:                                    //Applied by the owner of the bus
+        case LOAD_SET_RESTORE:
+        case LOAD_SET_CLASS:
+            bridge_owner_post(interface_id, received_msg);
+            break;
+        case LOAD_QUERY:
+            bridge_send_feedback(FEEDBACK_LOAD, interface_id, load->load_permille);
+            bridge_send_feedback(FEEDBACK_LOAD_PEAK, interface_id, load->peak_permille);
+            bridge_send_feedback(FEEDBACK_LOAD_SHED, interface_id, load_shed_drops[interface_id] - load_shed_base[interface_id]);
+            bridge_send_feedback(FEEDBACK_LOAD_SHEDDING, interface_id, load->shedding.load(std::memory_order_relaxed) ? 1 : 0);
+            bridge_send_feedback(FEEDBACK_LOAD_BITRATE, interface_id, load->bitrate);
+            break;
+        case LOAD_RESET_PEAK:
+            bridge_owner_post(interface_id, received_msg);
+            load_shed_base[interface_id] = load_shed_drops[interface_id];
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+* @brief Handles a HEALTH_COMMAND frame. Returns false for the TTL settings, which edit the configuration,
+* see get_deadline_command().
+*/
+static bool get_health_command(const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    uint8_t interface_id = received_msg->data[2];
+    switch (received_msg->data[1]) {
+        case HEALTH_SET_ID:
+            health_stored_id = value;
+            break;
+        case HEALTH_SET_TTL:
+        case HEALTH_SET_DEFAULT_TTL:
+        case HEALTH_CLEAR_TTLS:
+            return false;
+        case HEALTH_QUERY:                                          //State and counters of the bus in data[2]
+            if (interface_id <= CAN_IFACE1) {
+                const struct bus_health *health = &bus_healths[interface_id];
+                const struct outage_buffer *buffer = &outage_buffers[interface_id];
+                bridge_send_feedback(FEEDBACK_HEALTH_DOWN, interface_id, health->down ? 1 : 0);
+                bridge_send_feedback(FEEDBACK_HEALTH_OUTAGES, interface_id, health->outages);
+                bridge_send_feedback(FEEDBACK_HEALTH_ERRORS, interface_id, health->error_total);
+                bridge_send_feedback(FEEDBACK_HEALTH_LONGEST, interface_id, health->longest_outage_us);
+                bridge_send_feedback(FEEDBACK_HEALTH_HELD, interface_id, buffer->count);
+                bridge_send_feedback(FEEDBACK_HEALTH_EXPIRED, interface_id, buffer->expired);
+                bridge_send_feedback(FEEDBACK_HEALTH_LOST, interface_id, buffer->lost);
+                bridge_send_feedback(FEEDBACK_HEALTH_DRAINED, interface_id, buffer->drained);
+            }
+            break;
+        default:
+            break;
+    }
+    return true;
 }
 
+/**
+* @brief Replies the frames, percentiles and maximum of a latency sketch.
+*/
+static void bridge_send_latency(const struct latency_sketch *sketch, uint8_t index) {
+    bridge_send_feedback(FEEDBACK_LATENCY_COUNT, index, sketch->count);
+    bridge_send_feedback(FEEDBACK_LATENCY_P50, index, latency_percentile(sketch, 500));
+    bridge_send_feedback(FEEDBACK_LATENCY_P90, index, latency_percentile(sketch, 900));
+    bridge_send_feedback(FEEDBACK_LATENCY_P99, index, latency_percentile(sketch, 990));
+    bridge_send_feedback(FEEDBACK_LATENCY_MAX, index, sketch->max_us);
+}
 
 /**
-* @brief Finds the index of an ID in a list.
+* @brief Handles a LATENCY_COMMAND frame.
 */
-static int8_t find_id_in_list(uint32_t id, const uint32_t *list, uint8_t count) {
-    for (uint8_t i = 0; i < count; ++i) {
-        if (list[i] == id) {
-            return i;       //If the ID is found, return the index
+static void get_latency_command(const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    uint8_t interface_id = received_msg->data[2];
+    if (received_msg->data[1] == LATENCY_ENABLE) {
+        bridge_latency_set(value != 0);
+        return;
+    }
+    if (interface_id > CAN_IFACE1) {
+        return;
+    }
+    const struct latency_direction *direction = &latency_dirs[interface_id];
+    switch (received_msg->data[1]) {
+        case LATENCY_RESET:
+            bridge_latency_reset(interface_id);
+            break;
+        case LATENCY_QUERY:
+            bridge_send_latency(&direction->all, interface_id);
+            break;
+        case LATENCY_QUERY_ID: {
+            static const struct latency_sketch untracked = {};
+            const struct latency_sketch *sketch = latency_find(direction, value);
+            bridge_send_latency(sketch != NULL ? sketch : &untracked, interface_id);
+            break;
         }
+        case LATENCY_LIST:
+            for (uint8_t i = 0; i < direction->id_count; ++i) {
+                bridge_send_feedback(FEEDBACK_LATENCY_ID, i, direction->ids[i]);
+            }
+            bridge_send_feedback(FEEDBACK_LATENCY_UNTRACKED, interface_id, direction->untracked);
+            break;
+        default:
+            break;
     }
-    return -1;              //If the ID is not found, return -1
 }
 
+/**
+* @brief Replies the learned schedule of an ID, only its state (PERIOD_STATE_UNTRACKED) if entry is NULL.
+*/
+static void bridge_send_period(const struct period_entry *entry, uint8_t index, uint32_t now_us) {
+    if (entry == NULL) {
+        bridge_send_feedback(FEEDBACK_PERIOD_STATE, index, PERIOD_STATE_UNTRACKED);
+        return;
+    }
+    bridge_send_feedback(FEEDBACK_PERIOD_US, index, period_us(entry));
+    bridge_send_feedback(FEEDBACK_PERIOD_JITTER, index, period_jitter_us(entry));
+    bridge_send_feedback(FEEDBACK_PERIOD_SAMPLES, index, entry->samples);
+    bridge_send_feedback(FEEDBACK_PERIOD_GAPS, index, entry->gaps);
+    bridge_send_feedback(FEEDBACK_PERIOD_DRIFT, index, (uint32_t)period_drift_permille(entry));
+    bridge_send_feedback(FEEDBACK_PERIOD_AGE, index, now_us - entry->last_us);
+    bridge_send_feedback(FEEDBACK_PERIOD_STATE, index, period_state(entry, now_us));
+}
 
 /**
-* @brief Adds an ID to a list.
+* @brief Handles a PERIOD_COMMAND frame.
 */
-static bool add_id_to_list(uint32_t id, uint32_t *list, uint8_t *count, uint8_t max_size) {
-    if (*count >= max_size) {
-        return false;       //If the list is full, return false
+static void get_period_command(const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    uint8_t interface_id = received_msg->data[2];
+    if (interface_id > CAN_IFACE1) {
+        return;
     }
-    if (find_id_in_list(id, list, *count) != -1) {
-        return false;       //If the ID is already in the list, return false
+    const struct period_table *table = &period_tables[interface_id];
+    uint32_t now_us = time_us_32();
+    switch (received_msg->data[1]) {
+        case PERIOD_QUERY_ID:
+            bridge_send_period(period_find(table, value), interface_id, now_us);
+            break;
+        case PERIOD_LIST: {
+            uint8_t listed = 0;
+            for (uint32_t i = 0; i < PERIOD_TABLE_SIZE; ++i) {
+                if (table->entries[i].used) {
+                    bridge_send_feedback(FEEDBACK_PERIOD_ID, listed++, table->entries[i].id);
+                }
+            }
+            bridge_send_feedback(FEEDBACK_PERIOD_TRACKED, interface_id, table->count);
+            bridge_send_feedback(FEEDBACK_PERIOD_UNTRACKED, interface_id, table->untracked);
+            break;
+        }
+        case PERIOD_ALERTS: {
+            uint8_t drifting = 0, silent = 0;
+            for (uint32_t i = 0; i < PERIOD_TABLE_SIZE; ++i) {
+                const struct period_entry *entry = &table->entries[i];
+                if (!entry->used) {
+                    continue;
+                }
+                PeriodState_t state = period_state(entry, now_us);
+                if (state == PERIOD_DRIFTING) {
+                    bridge_send_feedback(FEEDBACK_PERIOD_DRIFTING, drifting++, entry->id);
+                } else if (state == PERIOD_SILENT) {
+                    bridge_send_feedback(FEEDBACK_PERIOD_SILENT, silent++, entry->id);
+                }
+            }
+            break;
+        }
+        case PERIOD_RESET:
+            period_reset_pending[interface_id].store(true, std::memory_order_relaxed);
+            break;
+        default:
+            break;
     }
-    list[*count] = id;      
-    (*count)++;
-    return true;            //If the ID is added successfully, return true
 }
 
 /**
-* @brief Removes an ID from a list.
+* @brief Handles an ECHO_COMMAND frame.
 */
-static bool remove_id_from_list(uint32_t id, uint32_t *list, uint8_t *count) {
-    int8_t index = find_id_in_list(id, list, *count);
-    if (index != -1) {
-        for (uint8_t i = (uint8_t)index; i < (*count - 1); ++i) {   
-            //Shift all IDs after the removed ID to the left
-            list[i] = list[i+1];
-        }
-        (*count)--;
-        return true;        //If the ID is removed successfully, return true
+static void get_echo_command(const struct can2040_msg *received_msg) {
+    switch (received_msg->data[1]) {
+        case ECHO_SET_WINDOW:                                       //Same window on both interfaces, applied by their owners
+            bridge_owner_post(CAN_IFACE0, received_msg);
+            bridge_owner_post(CAN_IFACE1, received_msg);
+            break;
+        case ECHO_QUERY:                                            //Counters of the interface in data[2]
+            if (received_msg->data[2] <= CAN_IFACE1) {
+                const struct echo_table *table = &echo_tables[received_msg->data[2]];
+                bridge_send_feedback(FEEDBACK_ECHO_HITS, received_msg->data[2], table->hits);
+                bridge_send_feedback(FEEDBACK_ECHO_MISSES, received_msg->data[2], table->misses);
+                bridge_send_feedback(FEEDBACK_ECHO_EVICTIONS, received_msg->data[2], table->evictions);
+                bridge_send_feedback(FEEDBACK_ECHO_WINDOW, received_msg->data[2], table->window_us);
+            }
+            break;
+        case ECHO_RESET_COUNTERS:
+            bridge_owner_post(CAN_IFACE0, received_msg);
+            bridge_owner_post(CAN_IFACE1, received_msg);
+            break;
+        default:
+            break;
     }
-    return false;           //If the ID is not in the list, return false
 }
 
 /** 
 *   @brief Gets the command from the CAN message data. 
 */
 void get_command(const struct can2040_msg *received_msg) {
+
+    if (received_msg->data[0] == BULK_COMMAND && (received_msg->data[1] & BULK_DATA)) {
+        //Bulk data frames use all 6 bytes for payload, the CRC in BULK_END protects them instead of the checksum
+        bulk_receive(&bulk_upload, received_msg->data[1] & BULK_SEQ_MASK, &received_msg->data[2]);
+        return;
+    }
     
-    if(received_msg->data[7] != (received_msg->data[0]+received_msg->data[1]+received_msg->data[2]+received_msg->data[3]+received_msg->data[4]+received_msg->data[5]+received_msg->data[6] % 255)){
+    if(received_msg->data[7] != (received_msg->data[0]+received_msg->data[1]+received_msg->data[2]+received_msg->data[3]+received_msg->data[4]+received_msg->data[5]+received_msg->data[6]) % 256){
         //Checksum calculation and error handling
-        struct can2040_msg error_msg;
-        error_msg.id = FEEDBACK_ID;
-        error_msg.data[0] = received_msg->data[0];
-        error_msg.data[1] = ERROR_IN_MESSAGE;
-        error_msg.data[7] = (error_msg.data[0] + error_msg.data[1]) % 256;
-   
-        struct can2040 *feedback_bus;
-        bridge_transmit( &CAN_COMPUTER_BUS, &error_msg, error_msg.dlc, CAN_COMPUTER_IFACE); 
-
+        bridge_send_error(received_msg->data[0]);
         return;
     }
     
@@ -293,141 +1868,567 @@ void get_command(const struct can2040_msg *received_msg) {
     uint8_t action = received_msg->data[1];         //Check the action
     uint32_t id_to_process;                         //Check the ID if applicable
 
-    if (!bridge_enabled && command_mode != TURNON) {    //If the bridge is disabled and the command is not to turn it on, return
+    if (!bridge_enabled && command_mode != TURNON && command_mode != STORE_COMMAND) {    //If the bridge is disabled and the command is not to turn it on, return
+        return;
+    }
+
+    if (get_bridge_command(received_msg)) {         //Commands that leave the filter configuration alone
+        return;
+    }
+
+    if (command_mode == BULK_COMMAND) {             //Only touches the configuration once the whole table arrived
+        get_bulk_command(received_msg);
+        return;
+    }
+
+    if (command_mode == STORE_COMMAND) {            //Flash copy of the configuration
+        get_store_command(received_msg);
         return;
     }
 
-    uint32_t *list_to_use = NULL;
-    uint8_t *count_to_use = NULL;
-    FilterMode_t target_filter_mode = current_filter_state;
+    //Filter commands edit the open transaction, or a fresh shadow copy that is published right after
+    struct bridge_config *config = (config_shadow != NULL) ? config_shadow : config_open_shadow();
+
+    struct filter_list *list_to_use = NULL;
+    FilterMode_t target_filter_mode = config->current_filter_state;
     bool is_list_based_command = false;
 
     switch (command_mode) {
         case WHITELIST_MODE:                                        //Whitelist mode: set mode as FILTER_MODE_WHITELIST and list as whitelist_ids
-            list_to_use = whitelist_ids;
-            count_to_use = &whitelist_count;
+            list_to_use = &config->whitelist_ids;
             target_filter_mode = FILTER_MODE_WHITELIST;
             is_list_based_command = true;
             break;
 
         case BLACKLIST_MODE:                                        //Blacklist mode: set mode as FILTER_MODE_BLACKLIST and list as blacklist_ids
-            list_to_use = blacklist_ids;
-            count_to_use = &blacklist_count;
+            list_to_use = &config->blacklist_ids;
             target_filter_mode = FILTER_MODE_BLACKLIST;
             is_list_based_command = true;
             break;
 
         case OW_1_TO_0_WHITELIST_MODE:                              //One way 1 to 0 whitelist mode: set mode as FILTER_MODE_ONE_WAY_1_TO_0_WHITELIST and list as whitelist_ids
-            list_to_use = whitelist_ids;
-            count_to_use = &whitelist_count;
+            list_to_use = &config->whitelist_ids;
             target_filter_mode = FILTER_MODE_ONE_WAY_1_TO_0_WHITELIST;
             is_list_based_command = true;
             break;
 
         case OW_1_TO_0_BLACKLIST_MODE:                              //One way 1 to 0 blacklist mode: set mode as FILTER_MODE_ONE_WAY_1_TO_0_BLACKLIST and list as blacklist_ids
-            list_to_use = blacklist_ids;
-            count_to_use = &blacklist_count;
+            list_to_use = &config->blacklist_ids;
             target_filter_mode = FILTER_MODE_ONE_WAY_1_TO_0_BLACKLIST;
             is_list_based_command = true;
             break;
 
         case OW_0_TO_1_WHITELIST_MODE:                              //One way 0 to 1 whitelist mode: set mode as FILTER_MODE_ONE_WAY_0_TO_1_WHITELIST and list as whitelist_ids
-            list_to_use = whitelist_ids;
-            count_to_use = &whitelist_count;
+            list_to_use = &config->whitelist_ids;
             target_filter_mode = FILTER_MODE_ONE_WAY_0_TO_1_WHITELIST;
             is_list_based_command = true;
             break;
         
         case OW_0_TO_1_BLACKLIST_MODE:                              //One way 0 to 1 blacklist mode: set mode as FILTER_MODE_ONE_WAY_0_TO_1_BLACKLIST and list as blacklist_ids
-            list_to_use = blacklist_ids;
-            count_to_use = &blacklist_count;
+            list_to_use = &config->blacklist_ids;
             target_filter_mode = FILTER_MODE_ONE_WAY_0_TO_1_BLACKLIST;
             is_list_based_command = true;
             break;
 
         case OW_1_TO_0_EXCEPT_MODE:                                 //One way 1 to 0 except mode: set mode as FILTER_MODE_ONE_WAY_1_TO_0_EXCEPT and list as exception_ids
-            list_to_use = exception_ids;
-            count_to_use = &exception_count;
+            list_to_use = &config->exception_ids;
             target_filter_mode = FILTER_MODE_ONE_WAY_1_TO_0_EXCEPT;
             is_list_based_command = true;
             break;
 
         case OW_0_TO_1_EXCEPT_MODE:                                 //One way 0 to 1 except mode: set mode as FILTER_MODE_ONE_WAY_0_TO_1_EXCEPT and list as exception_ids
-            list_to_use = exception_ids;
-            count_to_use = &exception_count;
+            list_to_use = &config->exception_ids;
             target_filter_mode = FILTER_MODE_ONE_WAY_0_TO_1_EXCEPT;
             is_list_based_command = true;
             break;
 
         case BI_EXCEPT_OW_0_TO_1_MODE:                              //Bidirectional except one way 0 to 1 mode: set mode as FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_0_TO_1 and list as one_way_restricted_ids
-            list_to_use = one_way_restricted_ids;
-            count_to_use = &one_way_restricted_count;
+            list_to_use = &config->one_way_restricted_ids;
             target_filter_mode = FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_0_TO_1;
             is_list_based_command = true;
             break;
 
         case BI_EXCEPT_OW_1_TO_0_MODE:                              //Bidirectional except one way 1 to 0 mode: set mode as FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_1_TO_0 and list as one_way_restricted_ids
-            list_to_use = one_way_restricted_ids;
-            count_to_use = &one_way_restricted_count;
+            list_to_use = &config->one_way_restricted_ids;
             target_filter_mode = FILTER_MODE_BIDIRECTIONAL_EXCEPT_OW_1_TO_0;
             is_list_based_command = true;
             break;
 
+        case J1939_WHITELIST_MODE:                                  //J1939 whitelist mode: set mode as FILTER_MODE_J1939_WHITELIST and list as j1939_ids
+            list_to_use = &config->j1939_ids;
+            target_filter_mode = FILTER_MODE_J1939_WHITELIST;
+            is_list_based_command = true;
+            break;
+
+        case J1939_BLACKLIST_MODE:                                  //J1939 blacklist mode: set mode as FILTER_MODE_J1939_BLACKLIST and list as j1939_ids
+            list_to_use = &config->j1939_ids;
+            target_filter_mode = FILTER_MODE_J1939_BLACKLIST;
+            is_list_based_command = true;
+            break;
+
         case ONE_WAY_ZERO_TO_ONE_MODE:                              //One way 0 to 1 mode: set mode as FILTER_MODE_ZERO_TO_ONE
-            current_filter_state = FILTER_MODE_ZERO_TO_ONE;
+            config->current_filter_state = FILTER_MODE_ZERO_TO_ONE;
             break;
             
         case ONE_WAY_ONE_TO_ZERO_MODE:                              //One way 1 to 0 mode: set mode as FILTER_MODE_ONE_TO_ZERO
-            current_filter_state = FILTER_MODE_ONE_TO_ZERO;
+            config->current_filter_state = FILTER_MODE_ONE_TO_ZERO;
             break;
 
-        case TURNOFF:                                               //Turn off the bridge if action is CONFIRM
-            if (action == CONFIRM) {
-                bridge_enabled = false;
-            }
+        case RULE_COMMAND:                                          //Mask/range rules on the list selected by data[2]
+            get_rule_command(config, received_msg);
             break;
-        
-        case TURNON:                                                //Turn on the bridge if action is CONFIRM
-            if (action == CONFIRM) {
-                bridge_enabled = true;
-            }
+
+        case REWRITE_COMMAND:                                       //Rewrite rules of the direction selected by data[2]
+            get_rewrite_command(config, received_msg);
+            break;
+
+        case RATE_COMMAND:                                          //Rate limits and forward policies, see get_policy_command()
+        case FORWARD_COMMAND:
+            get_policy_command(config, received_msg);
+            break;
+
+        case SCHED_COMMAND:                                         //Per-ID deadlines and outage TTLs
+        case HEALTH_COMMAND:
+            get_deadline_command(config, received_msg);
             break;
+
         default:
             return;
 
         case PASSIVE_MODE:                                          //Passive mode: set mode as FILTER_MODE_PASSIVE bridge everything
-            current_filter_state = FILTER_MODE_PASSIVE;
+            config->current_filter_state = FILTER_MODE_PASSIVE;
             break;
 
      }
 
-     if (is_list_based_command && list_to_use != NULL && count_to_use != NULL) {         //If the command is a list based command
+     if (is_list_based_command && list_to_use != NULL) {         //If the command is a list based command
          switch (action) {
              case SET_MODE:                                                              //If the action is SET_MODE then set the mode
-                 current_filter_state = target_filter_mode;
+                 config->current_filter_state = target_filter_mode;
                  break;
              case ADD_ID:                                                                //If the action is ADD_ID then add the ID to the list
-                 id_to_process = get_id_from_data(received_msg->data);
-                 add_id_to_list(id_to_process, list_to_use, count_to_use, MAX_LIST_SIZE);
+                 id_to_process = get_list_key(config, list_to_use, received_msg->data);
+                 id_set_add(&list_to_use->ids, id_to_process);
                  break;
              case REMOVE_ID:                                                             //If the action is REMOVE_ID then remove the ID from the list
-                 id_to_process = get_id_from_data(received_msg->data);
-                 remove_id_from_list(id_to_process, list_to_use, count_to_use);
+                 id_to_process = get_list_key(config, list_to_use, received_msg->data);
+                 id_set_remove(&list_to_use->ids, id_to_process);
                  break;
              case CLEAR_LIST:                                                            //If the action is CLEAR_LIST then clear the list
-                 *count_to_use = 0;
+                 filter_list_clear(list_to_use);
                  break;
              case SET_MODE_AND_CLEAR:                                                    //If the action is SET_MODE_AND_CLEAR then set the mode and clear the list
-                 current_filter_state = target_filter_mode;
-                 *count_to_use = 0;
+                 config->current_filter_state = target_filter_mode;
+                 filter_list_clear(list_to_use);
                  break;
              case SET_MODE_ADD_ID:                                                       //If the action is SET_MODE_ADD_ID then set the mode and add the ID to the list
-                 current_filter_state = target_filter_mode;
-                 id_to_process = get_id_from_data(received_msg->data);
-                 add_id_to_list(id_to_process, list_to_use, count_to_use, MAX_LIST_SIZE);
+                 config->current_filter_state = target_filter_mode;
+                 id_to_process = get_list_key(config, list_to_use, received_msg->data);
+                 id_set_add(&list_to_use->ids, id_to_process);
                  break;
              default:
                  break;
          }
      }
+
+     if (config_shadow == NULL) {
+         config_publish(config);                                                         //Recompile the routes and swap them in
+     }
  }
+
+/**
+* @brief Handles the commands that do not touch the filter configuration. Returns false for the others.
+* They run with this core's interrupts masked, so its receive interrupts never see half written state.
+* The state the owner of a bus keeps (scheduler, load monitor, echo table, cap and counters of the frames
+* it receives) is changed by that core only, see bridge_owner_post(); the other core is told through
+* atomics (sched_orders, the reset flags) or the published configuration.
+*/
+static bool get_bridge_command(const struct can2040_msg *received_msg) {
+    uint32_t irq_status = save_and_disable_interrupts();
+    bool handled = true;
+    switch (received_msg->data[0]) {
+        case ECHO_COMMAND:                                          //Echo window and counters
+            get_echo_command(received_msg);
+            break;
+        case STATS_COMMAND:                                         //Bridge counters
+            get_stats_command(received_msg);
+            break;
+        case SCHED_COMMAND:                                         //Transmit scheduler settings and counters, the deadlines are configuration
+            handled = get_sched_command(received_msg);
+            break;
+        case RATE_COMMAND:                                          //Bandwidth caps and counters, the limits are configuration
+            handled = get_rate_command(received_msg);
+            break;
+        case FORWARD_COMMAND:                                       //Counters, the forward policies are configuration
+            handled = get_forward_command(received_msg);
+            break;
+        case CONFIG_COMMAND:                                        //Filter configuration transactions
+            get_config_command(received_msg);
+            break;
+        case TRACE_COMMAND:                                         //Frame trace over USB
+            get_trace_command(received_msg);
+            break;
+        case LOAD_COMMAND:                                          //Bus load and load shedding
+            get_load_command(received_msg);
+            break;
+        case HEALTH_COMMAND:                                        //Bus health and counters, the TTLs are configuration
+            handled = get_health_command(received_msg);
+            break;
+        case LATENCY_COMMAND:                                       //Latency probe
+            get_latency_command(received_msg);
+            break;
+        case PERIOD_COMMAND:                                        //Learned periods of the forwarded IDs
+            get_period_command(received_msg);
+            break;
+        case TURNOFF:                                               //Turn off the bridge if action is CONFIRM
+            if (received_msg->data[1] == CONFIRM) {
+                bridge_enabled = false;
+            }
+            break;
+        case TURNON:                                                //Turn on the bridge if action is CONFIRM
+            if (received_msg->data[1] == CONFIRM) {
+                bridge_enabled = true;
+            }
+            break;
+        default:
+            handled = false;
+            break;
+    }
+    restore_interrupts(irq_status);
+    return handled;
+}
+
+/**
+* @brief Handles a CONFIG_COMMAND frame. Between BEGIN and COMMIT the filter commands edit the shadow
+* configuration only, so the receive path never sees a half applied change.
+*/
+static void get_config_command(const struct can2040_msg *received_msg) {
+    switch (received_msg->data[1]) {
+        case CONFIG_BEGIN:                                          //A second BEGIN starts over from the active config
+            config_shadow = config_open_shadow();
+            break;
+        case CONFIG_COMMIT:
+            if (config_shadow != NULL) {
+                config_publish(config_shadow);
+                config_shadow = NULL;
+            }
+            bridge_send_feedback(FEEDBACK_CONFIG_GENERATION, 0, bridge_config_generation());
+            break;
+        case CONFIG_ABORT:
+            config_shadow = NULL;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+* @brief Handles the BULK_COMMAND frames other than the data frames. The table is checked and decoded
+* before it is added, into the open transaction or a shadow copy that is published right after.
+*/
+static void get_bulk_command(const struct can2040_msg *received_msg) {
+    uint32_t value = get_id_from_data(received_msg->data);
+    uint32_t records = 0;
+    switch (received_msg->data[1]) {
+        case BULK_START:
+            bulk_begin(&bulk_upload, value & 0x00FFFFFFu, received_msg->data[2], (uint8_t)(value >> 24));
+            return;
+        case BULK_ABORT:
+            bulk_upload.active = false;
+            return;
+        case BULK_END:
+            break;
+        default:
+            return;
+    }
+
+    BulkStatus_t status = bulk_finish(&bulk_upload, value);
+    if (status == BULK_OK) {
+        status = bulk_apply(bulk_upload.data, bulk_upload.length, NULL, &records);
+    }
+    struct bridge_config *config = NULL;
+    struct filter_list *list = NULL;
+    if (status == BULK_OK) {
+        config = (config_shadow != NULL) ? config_shadow : config_open_shadow();
+        list = config_list(config, bulk_upload.list);
+        if (list == NULL) {
+            status = BULK_ERROR_FORMAT;
+        }
+    }
+    if (status == BULK_OK) {
+        if (bulk_upload.flags & BULK_FLAG_CLEAR) {
+            filter_list_clear(&bulk_list);
+        } else {
+            memcpy(&bulk_list, list, sizeof(bulk_list));
+        }
+        status = bulk_apply(bulk_upload.data, bulk_upload.length, &bulk_list, &records);
+        if (status == BULK_OK) {                    //Otherwise the list and an open transaction stay as they were
+            memcpy(list, &bulk_list, sizeof(*list));
+            if (config_shadow == NULL) {
+                config_publish(config);
+            }
+        }
+    }
+    bridge_send_feedback(FEEDBACK_BULK_ACK, (uint8_t)status, status == BULK_OK ? records : 0);
+}
+
+/**
+* @brief Appends a list to config_store_payload: 16-bit length and its CAN_bulk.h records. False if it does not fit.
+*/
+static bool config_store_list(const struct filter_list *list, uint32_t *length) {
+    if (*length + 2 > sizeof(config_store_payload)) {
+        return false;
+    }
+    struct bulk_encoder encoder;
+    bulk_encoder_init(&encoder, &config_store_payload[*length + 2], sizeof(config_store_payload) - *length - 2);
+    bulk_encode_list(&encoder, list);
+    if (encoder.overflow || encoder.length > 0xFFFF) {
+        return false;
+    }
+    config_store_payload[*length] = (uint8_t)encoder.length;
+    config_store_payload[*length + 1] = (uint8_t)(encoder.length >> 8);
+    *length += 2 + encoder.length;
+    return true;
+}
+
+/**
+* @brief Reads a list written by config_store_list() at *pos. False if the record is damaged.
+*/
+static bool config_load_list(const uint8_t *payload, uint32_t length, uint32_t *pos, struct filter_list *target) {
+    if (*pos + 2 > length) {
+        return false;
+    }
+    uint32_t size = payload[*pos] | ((uint32_t)payload[*pos + 1] << 8);
+    *pos += 2;
+    uint32_t records;
+    filter_list_clear(target);
+    if (size > length - *pos || bulk_apply(&payload[*pos], size, target, &records) != BULK_OK) {
+        return false;
+    }
+    *pos += size;
+    return true;
+}
+
+/**
+* @brief Writes the active configuration and the enable state to flash, see CAN_store.h.
+* An open transaction is not saved. The buses are not served while the flash is busy.
+*/
+StoreStatus_t bridge_config_save(uint32_t *sequence) {
+    const struct bridge_config *config = active_config.load(std::memory_order_acquire);
+    config_store_payload[0] = (uint8_t)config->current_filter_state;
+    config_store_payload[1] = bridge_enabled ? 1 : 0;
+    config_store_payload[2] = 0;
+    config_store_payload[3] = 0;
+    const struct filter_list *lists[] = {       //RULE_LIST_* order
+        &config->whitelist_ids, &config->blacklist_ids, &config->exception_ids, &config->one_way_restricted_ids,
+    };
+    uint32_t length = CONFIG_STORE_HEADER_BYTES;
+    for (const struct filter_list *list : lists) {
+        if (!config_store_list(list, &length)) {
+            return STORE_TOO_LARGE;
+        }
+    }
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        const struct rewrite_table *table = &config->rewrites[i];
+        if (length + 1 + table->count * CONFIG_STORE_REWRITE_BYTES > sizeof(config_store_payload)) {
+            return STORE_TOO_LARGE;
+        }
+        config_store_payload[length++] = table->count;
+        for (uint8_t r = 0; r < table->count; ++r) {
+            const struct rewrite_rule *rule = &table->rules[r];
+            uint8_t *out = &config_store_payload[length];
+            for (uint8_t b = 0; b < 4; ++b) {
+                out[b] = (uint8_t)(rule->id >> (8 * b));
+                out[4 + b] = (uint8_t)(rule->new_id >> (8 * b));
+            }
+            memcpy(&out[8], rule->keep, 8);
+            memcpy(&out[16], rule->set, 8);
+            out[24] = rule->dlc;
+            length += CONFIG_STORE_REWRITE_BYTES;
+        }
+    }
+    if (!config_store_list(&config->j1939_ids, &length)) {
+        return STORE_TOO_LARGE;
+    }
+    return store_write(config_store_payload, length, sequence);
+}
+
+/**
+* @brief Replaces the active configuration and the enable state with the newest saved one.
+* Drops an open transaction. Nothing changes unless the whole record applies.
+*/
+StoreStatus_t bridge_config_load(uint32_t *sequence) {
+    const uint8_t *payload;
+    uint32_t length;
+    StoreStatus_t status = store_read_latest(&payload, &length, sequence);
+    if (status != STORE_OK) {
+        return status;
+    }
+    if (length < CONFIG_STORE_HEADER_BYTES || payload[0] >= sizeof(mode_routes) / sizeof(mode_routes[0])) {
+        return STORE_BAD_PAYLOAD;
+    }
+
+    config_shadow = NULL;
+    struct bridge_config *config = config_open_shadow();
+    config->current_filter_state = (FilterMode_t)payload[0];
+    uint32_t pos = CONFIG_STORE_HEADER_BYTES;
+    for (uint8_t list = RULE_LIST_WHITELIST; list <= RULE_LIST_ONE_WAY; ++list) {
+        if (!config_load_list(payload, length, &pos, config_list(config, list))) {
+            return STORE_BAD_PAYLOAD;
+        }
+    }
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        struct rewrite_table *table = &config->rewrites[i];
+        rewrite_table_clear(table);
+        if (pos == length) {
+            continue;                                   //Saved without rewrite rules
+        }
+        uint8_t count = payload[pos++];
+        if (count > REWRITE_MAX_RULES || count * CONFIG_STORE_REWRITE_BYTES > length - pos) {
+            return STORE_BAD_PAYLOAD;
+        }
+        for (uint8_t r = 0; r < count; ++r) {
+            const uint8_t *in = &payload[pos];
+            struct rewrite_rule rule;
+            rewrite_rule_init(&rule, in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24));
+            rule.new_id = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+            memcpy(rule.keep, &in[8], 8);
+            memcpy(rule.set, &in[16], 8);
+            rule.dlc = in[24];
+            rewrite_table_set(table, &rule);
+            pos += CONFIG_STORE_REWRITE_BYTES;
+        }
+    }
+    filter_list_clear(&config->j1939_ids);
+    if (pos < length && !config_load_list(payload, length, &pos, &config->j1939_ids)) {
+        return STORE_BAD_PAYLOAD;
+    }
+    config_publish(config);
+    bridge_enabled = payload[1] != 0;
+    return STORE_OK;
+}
+
+/**
+* @brief Handles a STORE_COMMAND frame.
+*/
+static void get_store_command(const struct can2040_msg *received_msg) {
+    uint32_t sequence = 0;
+    StoreStatus_t status;
+    switch (received_msg->data[1]) {
+        case STORE_SAVE:
+            status = bridge_config_save(&sequence);
+            break;
+        case STORE_LOAD:
+            status = bridge_config_load(&sequence);
+            break;
+        case STORE_ERASE:
+            store_erase_all();
+            status = STORE_EMPTY;
+            break;
+        default:
+            return;
+    }
+    bridge_send_feedback(FEEDBACK_STORE, (uint8_t)status, sequence);
+}
+
+/**
+* @brief Handles a TRACE_COMMAND frame.
+*/
+static void get_trace_command(const struct can2040_msg *received_msg) {
+    switch (received_msg->data[1]) {
+        case TRACE_START:
+            bridge_trace_set(true);
+            break;
+        case TRACE_STOP:
+            bridge_trace_set(false);
+            break;
+        case TRACE_QUERY:
+            bridge_send_feedback(FEEDBACK_TRACE_DROPS, CAN_IFACE0, trace_rings[CAN_IFACE0].drops.load(std::memory_order_relaxed));
+            bridge_send_feedback(FEEDBACK_TRACE_DROPS, CAN_IFACE1, trace_rings[CAN_IFACE1].drops.load(std::memory_order_relaxed));
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+* @brief Runs the control frames the receive interrupts queued. Call it on CAN_COMMAND_CORE only.
+* Returns the number of commands run.
+*/
+uint32_t bridge_run_commands(void) {
+    struct can2040_msg msg;
+    uint32_t count = 0;
+    for (uint8_t i = CAN_IFACE0; i <= CAN_IFACE1; ++i) {
+        while (frame_queue_pop(&command_queues[i], &msg)) {
+            get_command(&msg);
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+* @brief Generation of the active filter configuration, incremented by every publish.
+*/
+uint32_t bridge_config_generation(void) {
+    return active_config.load(std::memory_order_acquire)->generation;
+}
+
+/**
+* @brief Connects an interface to another controller, see CAN_port.h. Call it before bridge_init().
+*/
+void bridge_attach_port(uint8_t interface_id, const struct bus_port *port) {
+    if (interface_id <= CAN_IFACE1 && port != NULL) {
+        bus_ports[interface_id] = port;
+    }
+}
+
+/**
+* @brief Starts or stops recording frames in the trace rings. Records already in the rings stay there.
+*/
+void bridge_trace_set(bool enabled) {
+    trace_enabled = enabled;
+}
+
+bool bridge_trace_enabled(void) {
+    return trace_enabled;
+}
+
+/**
+* @brief Moves trace records into out as the CAN_trace.h stream. Call it on CAN_COMMAND_CORE only, with
+* capacity the room the output has (at least 4 * TRACE_MAX_ENCODED). Returns the bytes written.
+*/
+uint32_t bridge_trace_drain(uint8_t *out, uint32_t capacity) {
+    return trace_drain(trace_rings, &trace_output, out, capacity, time_us_32());
+}
+
+/**
+* @brief Starts or stops stamping received frames for the latency probe. The sketches keep what they measured.
+*/
+void bridge_latency_set(bool enabled) {
+    latency_enabled = enabled;
+}
+
+/**
+* @brief Clears the latency sketches of the frames received on an interface, done by the core that records
+* them at its next bridge_service().
+*/
+void bridge_latency_reset(uint8_t rx_interface_id) {
+    if (rx_interface_id <= CAN_IFACE1) {
+        latency_reset_pending[rx_interface_id].store(true, std::memory_order_relaxed);
+    }
+}
+
+/**
+* @brief Learned periods of the IDs received on an interface.
+*/
+const struct period_table *bridge_period_table(uint8_t rx_interface_id) {
+    return &period_tables[rx_interface_id & 1];
+}
+
+/**
+* @brief Latency sketches of the frames received on an interface.
+*/
+const struct latency_direction *bridge_latency(uint8_t rx_interface_id) {
+    return &latency_dirs[rx_interface_id & 1];
+}
@@ -0,0 +1,360 @@
+/**
+* DESCRIPTION: Segmented ID/rule table upload: transfer state, CRC and the record format.
+**/
+
+#include "CAN_bulk.h"
+#include <string.h>
+
+#define BULK_BITMAP_BLOCK_IDS       64          // Bitmap grows by this many IDs at a time
+#define BULK_BITMAP_MIN_IDS         10          // IDs a block needs to be cheaper than ID records
+#define BULK_BITMAP_MAX_BYTES       248
+#define BULK_MIN_RUN                3
+
+// CRC-32 (IEEE 802.3, reflected), four bits per step
+static const uint32_t crc32_nibble[16] = {
+    0x00000000u, 0x1DB71064u, 0x3B6E20C8u, 0x26D930ACu, 0x76DC4190u, 0x6B6B51F4u, 0x4DB26158u, 0x5005713Cu,
+    0xEDB88320u, 0xF00F9344u, 0xD6D6A3E8u, 0xCB61B38Cu, 0x9B64C2B0u, 0x86D3D2D4u, 0xA00AE278u, 0xBDBDF21Cu,
+};
+
+/**
+* @brief Feeds bytes to a running CRC-32. Start from 0xFFFFFFFF and invert the result, see bulk_crc32().
+*/
+uint32_t bulk_crc32_update(uint32_t crc, const uint8_t *data, uint32_t length) {
+    for (uint32_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+    }
+    return crc;
+}
+
+/**
+* @brief Starts a transfer of length payload bytes, dropping any transfer in progress.
+*/
+void bulk_begin(struct bulk_transfer *transfer, uint32_t length, uint8_t list, uint8_t flags) {
+    transfer->length = length;
+    transfer->received = 0;
+    transfer->crc = 0xFFFFFFFFu;
+    transfer->next_seq = 0;
+    transfer->list = list;
+    transfer->flags = flags;
+    transfer->active = true;
+    transfer->status = (length > BULK_MAX_BYTES) ? BULK_ERROR_LENGTH : BULK_OK;
+}
+
+/**
+* @brief Stores the payload of a data frame. After the first error the rest of the transfer is ignored.
+*/
+void bulk_receive(struct bulk_transfer *transfer, uint8_t seq, const uint8_t *payload) {
+    if (!transfer->active || transfer->status != BULK_OK) {
+        return;
+    }
+    if (seq != transfer->next_seq) {
+        transfer->status = BULK_ERROR_SEQUENCE;
+        return;
+    }
+    transfer->next_seq = (uint8_t)((transfer->next_seq + 1) & BULK_SEQ_MASK);
+
+    uint32_t count = transfer->length - transfer->received;
+    if (count == 0) {
+        transfer->status = BULK_ERROR_LENGTH;       //More frames than announced
+        return;
+    }
+    if (count > BULK_FRAME_BYTES) {
+        count = BULK_FRAME_BYTES;
+    }
+    memcpy(&transfer->data[transfer->received], payload, count);
+    transfer->crc = bulk_crc32_update(transfer->crc, payload, count);
+    transfer->received += count;
+}
+
+/**
+* @brief Ends a transfer and checks it is complete and matches crc. The payload stays in data until
+* the next bulk_begin().
+*/
+BulkStatus_t bulk_finish(struct bulk_transfer *transfer, uint32_t crc) {
+    if (!transfer->active) {
+        return BULK_ERROR_NO_TRANSFER;
+    }
+    transfer->active = false;
+    if (transfer->status != BULK_OK) {
+        return transfer->status;
+    }
+    if (transfer->received != transfer->length) {
+        return BULK_ERROR_LENGTH;
+    }
+    if ((transfer->crc ^ 0xFFFFFFFFu) != crc) {
+        return BULK_ERROR_CRC;
+    }
+    return BULK_OK;
+}
+
+static bool bulk_read_varint(const uint8_t *data, uint32_t length, uint32_t *pos, uint64_t *value) {
+    uint64_t result = 0;
+    for (uint8_t shift = 0; shift < 64; shift += 7) {
+        if (*pos >= length) {
+            return false;
+        }
+        uint8_t byte = data[(*pos)++];
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* @brief Adds an ID to a list. Only an ID that is not there and does not fit is an error.
+*/
+static bool bulk_add_id(struct filter_list *list, uint32_t id) {
+    return id_set_add(&list->ids, id) || id_set_contains(&list->ids, id);
+}
+
+/**
+* @brief Decodes a payload and adds its records to list. With list NULL it only checks the format.
+* records receives the number of records decoded.
+*/
+BulkStatus_t bulk_apply(const uint8_t *data, uint32_t length, struct filter_list *list, uint32_t *records) {
+    uint32_t pos = 0;
+    uint64_t prev_id = 0, prev_rule = 0;
+    *records = 0;
+
+    while (pos < length) {
+        uint64_t tag, arg;
+        if (!bulk_read_varint(data, length, &pos, &tag)) {
+            return BULK_ERROR_FORMAT;
+        }
+        uint8_t kind = (uint8_t)(tag & 3);
+        uint64_t value = ((kind == BULK_RECORD_RULE) ? prev_rule : prev_id) + (tag >> 2);
+        if (value > 0xFFFFFFFFu) {
+            return BULK_ERROR_FORMAT;
+        }
+        if (kind != BULK_RECORD_ID && !bulk_read_varint(data, length, &pos, &arg)) {
+            return BULK_ERROR_FORMAT;
+        }
+
+        switch (kind) {
+            case BULK_RECORD_ID:
+                if (list != NULL && !bulk_add_id(list, (uint32_t)value)) {
+                    return BULK_ERROR_FULL;
+                }
+                prev_id = value;
+                break;
+            case BULK_RECORD_RUN:
+                if (arg >= BULK_MAX_RUN || value + arg > 0xFFFFFFFFu) {
+                    return BULK_ERROR_FORMAT;
+                }
+                for (uint64_t id = value; list != NULL && id <= value + arg; ++id) {
+                    if (!bulk_add_id(list, (uint32_t)id)) {
+                        return BULK_ERROR_FULL;
+                    }
+                }
+                prev_id = value + arg;
+                break;
+            case BULK_RECORD_BITMAP:
+                if (arg > length - pos || value + arg * 8 > 0x100000000ull) {
+                    return BULK_ERROR_FORMAT;
+                }
+                prev_id = value;
+                for (uint32_t byte = 0; byte < arg; ++byte) {
+                    uint8_t bits = data[pos + byte];
+                    for (uint8_t bit = 0; bits != 0; ++bit, bits >>= 1) {
+                        if (!(bits & 1)) {
+                            continue;
+                        }
+                        prev_id = value + byte * 8u + bit;
+                        if (list != NULL && !bulk_add_id(list, (uint32_t)prev_id)) {
+                            return BULK_ERROR_FULL;
+                        }
+                    }
+                }
+                pos += (uint32_t)arg;
+                break;
+            default:                                //BULK_RECORD_RULE
+                if ((arg >> 1) > 0xFFFFFFFFu || ((arg & 1) && value + (arg >> 1) > 0xFFFFFFFFu)) {
+                    return BULK_ERROR_FORMAT;
+                }
+                if (list != NULL) {
+                    bool added = (arg & 1) ? id_rules_add_range(&list->rules, (uint32_t)value, (uint32_t)(value + (arg >> 1)))
+                                           : id_rules_add_mask(&list->rules, (uint32_t)value, (uint32_t)(arg >> 1));
+                    if (!added) {
+                        return BULK_ERROR_FULL;     //No room, or the rule was already there
+                    }
+                }
+                prev_rule = value;
+                break;
+        }
+        (*records)++;
+    }
+    return BULK_OK;
+}
+
+void bulk_encoder_init(struct bulk_encoder *encoder, uint8_t *out, uint32_t capacity) {
+    encoder->out = out;
+    encoder->capacity = capacity;
+    encoder->length = 0;
+    encoder->prev_id = 0;
+    encoder->prev_rule = 0;
+    encoder->overflow = false;
+}
+
+static void bulk_put_varint(struct bulk_encoder *encoder, uint64_t value) {
+    do {
+        if (encoder->length >= encoder->capacity) {
+            encoder->overflow = true;
+            return;
+        }
+        uint8_t byte = (uint8_t)(value & 0x7F);
+        value >>= 7;
+        encoder->out[encoder->length++] = (uint8_t)(byte | (value ? 0x80 : 0));
+    } while (value);
+}
+
+static void bulk_put_tag(struct bulk_encoder *encoder, uint32_t value, uint32_t prev, uint8_t kind) {
+    if (value < prev) {
+        encoder->overflow = true;               //Not ascending, the delta would be negative
+        return;
+    }
+    bulk_put_varint(encoder, ((uint64_t)(value - prev) << 2) | kind);
+}
+
+/**
+* @brief Adds IDs, sorted ascending without duplicates. Consecutive IDs become runs, dense stretches bitmaps.
+*/
+void bulk_encode_ids(struct bulk_encoder *encoder, const uint32_t *ids, uint32_t count) {
+    uint32_t i = 0;
+    while (i < count && !encoder->overflow) {
+        uint32_t start = ids[i];
+
+        uint32_t run = 1;
+        while (i + run < count && run < BULK_MAX_RUN && ids[i + run] == start + run) {
+            run++;
+        }
+        if (run >= BULK_MIN_RUN) {
+            bulk_put_tag(encoder, start, encoder->prev_id, BULK_RECORD_RUN);
+            bulk_put_varint(encoder, run - 1);
+            encoder->prev_id = start + run - 1;
+            i += run;
+            continue;
+        }
+
+        uint32_t end = i, blocks = 0;           //Bitmap while each 64-ID block holds enough IDs
+        while (blocks * 8 < BULK_BITMAP_MAX_BYTES) {
+            uint64_t block_end = (uint64_t)start + (uint64_t)(blocks + 1) * BULK_BITMAP_BLOCK_IDS;
+            uint32_t j = end;
+            while (j < count && ids[j] < block_end) {
+                j++;
+            }
+            if (j - end < BULK_BITMAP_MIN_IDS) {
+                break;
+            }
+            end = j;
+            blocks++;
+        }
+        if (blocks > 0) {
+            uint32_t bytes = (ids[end - 1] - start) / 8 + 1;
+            bulk_put_tag(encoder, start, encoder->prev_id, BULK_RECORD_BITMAP);
+            bulk_put_varint(encoder, bytes);
+            if (encoder->length + bytes > encoder->capacity) {
+                encoder->overflow = true;
+                return;
+            }
+            uint8_t *bitmap = &encoder->out[encoder->length];
+            memset(bitmap, 0, bytes);
+            for (uint32_t j = i; j < end; ++j) {
+                bitmap[(ids[j] - start) >> 3] |= (uint8_t)(1u << ((ids[j] - start) & 7));
+            }
+            encoder->length += bytes;
+            encoder->prev_id = ids[end - 1];
+            i = end;
+            continue;
+        }
+
+        bulk_put_tag(encoder, start, encoder->prev_id, BULK_RECORD_ID);
+        encoder->prev_id = start;
+        i++;
+    }
+}
+
+/**
+* @brief Adds an id/mask rule. Rule values (masks and range starts together) must be added ascending.
+*/
+void bulk_encode_mask(struct bulk_encoder *encoder, uint32_t value, uint32_t mask) {
+    bulk_put_tag(encoder, value, encoder->prev_rule, BULK_RECORD_RULE);
+    bulk_put_varint(encoder, (uint64_t)mask << 1);
+    encoder->prev_rule = value;
+}
+
+void bulk_encode_range(struct bulk_encoder *encoder, uint32_t lo, uint32_t hi) {
+    bulk_put_tag(encoder, lo, encoder->prev_rule, BULK_RECORD_RULE);
+    bulk_put_varint(encoder, ((uint64_t)(hi - lo) << 1) | 1u);
+    encoder->prev_rule = lo;
+}
+
+/**
+* @brief Adds everything a filter list holds: its IDs, then its rules as configured.
+* Works in small batches so it needs no room for the whole table.
+*/
+void bulk_encode_list(struct bulk_encoder *encoder, const struct filter_list *list) {
+    uint32_t batch[BULK_BITMAP_BLOCK_IDS];
+    uint32_t count = 0;
+    for (uint32_t id = 0; id < ID_SET_STD_IDS; ++id) {
+        if ((list->ids.std_bitmap[id >> 5] >> (id & 31)) & 1u) {
+            batch[count++] = id;
+            if (count == BULK_BITMAP_BLOCK_IDS) {
+                bulk_encode_ids(encoder, batch, count);
+                count = 0;
+            }
+        }
+    }
+
+    uint32_t last = 0;                          //The other IDs sit in hash order, take them smallest first
+    for (uint16_t n = 0; n < list->ids.ext_count; ++n) {
+        uint32_t next = 0xFFFFFFFFu;
+        bool found = false;
+        for (uint32_t slot = 0; slot < ID_SET_EXT_SLOTS; ++slot) {
+            uint32_t id = list->ids.ext_slots[slot];
+            if (id != ID_SET_EMPTY_SLOT && (n == 0 || id > last) && id <= next) {
+                next = id;
+                found = true;
+            }
+        }
+        if (!found) {
+            break;
+        }
+        last = next;
+        batch[count++] = next;
+        if (count == BULK_BITMAP_BLOCK_IDS) {
+            bulk_encode_ids(encoder, batch, count);
+            count = 0;
+        }
+    }
+    bulk_encode_ids(encoder, batch, count);
+
+    const struct id_rules *rules = &list->rules;    //Masks and ranges share one ascending order
+    uint8_t total = (uint8_t)(rules->mask_rule_count + rules->range_rule_count);
+    uint64_t used[2] = {0, 0};
+    for (uint8_t n = 0; n < total; ++n) {
+        int16_t best = -1;
+        uint32_t best_value = 0;
+        for (uint8_t r = 0; r < total; ++r) {
+            if ((used[r >> 6] >> (r & 63)) & 1u) {
+                continue;
+            }
+            uint32_t value = r < rules->mask_rule_count ? rules->mask_rules[r].value
+                                                       : rules->range_rules[r - rules->mask_rule_count].lo;
+            if (best < 0 || value < best_value) {
+                best = r;
+                best_value = value;
+            }
+        }
+        used[best >> 6] |= 1ull << (best & 63);
+        if (best < rules->mask_rule_count) {
+            bulk_encode_mask(encoder, best_value, rules->mask_rules[best].mask);
+        } else {
+            bulk_encode_range(encoder, best_value, rules->range_rules[best - rules->mask_rule_count].hi);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/**
+* DESCRIPTION: Fingerprint based echo suppression used by the bridge.
+**/
+
+#include "CAN_echo.h"
+#include <string.h>
+#include "pico/platform.h"
+
+static inline bool echo_live(const struct echo_entry *entry, uint32_t now_us, uint32_t window_us) {
+    return entry->fingerprint != ECHO_EMPTY && (uint32_t)(now_us - entry->timestamp_us) <= window_us;
+}
+
+static inline struct echo_entry *echo_bucket(struct echo_table *table, uint32_t fingerprint) {
+    return &table->slots[(fingerprint << 1) & (ECHO_TABLE_SLOTS - 1)];
+}
+
+/**
+* @brief Empties a table and sets its window.
+*/
+void echo_table_init(struct echo_table *table, uint32_t window_us) {
+    memset(table, 0, sizeof(*table));
+    table->window_us = window_us;
+}
+
+/**
+* @brief Records a transmitted frame. If both slots of the bucket are live the older one is replaced.
+*/
+void __not_in_flash_func(echo_table_record)(struct echo_table *table, uint32_t fingerprint, uint32_t now_us) {
+    struct echo_entry *bucket = echo_bucket(table, fingerprint);
+    struct echo_entry *slot;
+    bool live0 = echo_live(&bucket[0], now_us, table->window_us);
+    bool live1 = echo_live(&bucket[1], now_us, table->window_us);
+    if (!live0) {
+        slot = &bucket[0];
+    } else if (!live1) {
+        slot = &bucket[1];
+    } else {
+        slot = ((int32_t)(bucket[0].timestamp_us - bucket[1].timestamp_us) <= 0) ? &bucket[0] : &bucket[1];
+        table->evictions++;
+    }
+    slot->fingerprint = fingerprint;
+    slot->timestamp_us = now_us;
+}
+
+/**
+* @brief Restarts the window of a recorded frame when the controller reports it was sent.
+* Returns false if the fingerprint is not in the table anymore.
+*/
+bool __not_in_flash_func(echo_table_confirm)(struct echo_table *table, uint32_t fingerprint, uint32_t now_us) {
+    struct echo_entry *bucket = echo_bucket(table, fingerprint);
+    for (uint8_t i = 0; i < 2; ++i) {
+        if (bucket[i].fingerprint == fingerprint && echo_live(&bucket[i], now_us, table->window_us)) {
+            bucket[i].timestamp_us = now_us;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* @brief Checks a received frame. An echo removes its entry, so every transmission hides at most one frame.
+*/
+bool __not_in_flash_func(echo_table_consume)(struct echo_table *table, uint32_t fingerprint, uint32_t now_us) {
+    struct echo_entry *bucket = echo_bucket(table, fingerprint);
+    for (uint8_t i = 0; i < 2; ++i) {
+        if (bucket[i].fingerprint == fingerprint && echo_live(&bucket[i], now_us, table->window_us)) {
+            bucket[i].fingerprint = ECHO_EMPTY;
+            table->hits++;
+            return true;
+        }
+    }
+    table->misses++;
+    return false;
+}
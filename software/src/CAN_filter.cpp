@@ -0,0 +1,343 @@
+/**
+* DESCRIPTION: ID sets used by the bridge filter lists.
+* Adding and removing is only done when a command arrives, lookups are done for every frame.
+**/
+
+#include "CAN_filter.h"
+#include <string.h>
+
+/**
+* @brief Empties a set.
+*/
+void id_set_clear(struct id_set *set) {
+    memset(set->std_bitmap, 0, sizeof(set->std_bitmap));
+    memset(set->ext_slots, 0, sizeof(set->ext_slots));      //Every slot becomes ID_SET_EMPTY_SLOT
+    set->std_count = 0;
+    set->ext_count = 0;
+}
+
+/**
+* @brief Adds an ID to a set.
+* Returns false if the ID is already there or there is no room for it.
+*/
+bool id_set_add(struct id_set *set, uint32_t id) {
+    if (id < ID_SET_STD_IDS) {
+        uint32_t mask = 1u << (id & 31);
+        if (set->std_bitmap[id >> 5] & mask) {
+            return false;                   //Already in the set
+        }
+        set->std_bitmap[id >> 5] |= mask;
+        set->std_count++;
+        return true;
+    }
+
+    if (set->ext_count >= ID_SET_MAX_EXT_IDS) {
+        return false;
+    }
+    if (id_set_contains(set, id)) {
+        return false;
+    }
+    uint32_t slot = id_set_hash(id);
+    for (uint8_t probe = 0; probe < ID_SET_MAX_PROBE; ++probe) {
+        if (set->ext_slots[slot] == ID_SET_EMPTY_SLOT) {
+            set->ext_slots[slot] = id;
+            set->ext_count++;
+            return true;
+        }
+        slot = (slot + 1) & (ID_SET_EXT_SLOTS - 1);
+    }
+    return false;                           //Probe window full, lookups must stay bounded
+}
+
+/**
+* @brief Removes an ID from a set. Returns false if it was not in the set.
+*/
+bool id_set_remove(struct id_set *set, uint32_t id) {
+    if (id < ID_SET_STD_IDS) {
+        uint32_t mask = 1u << (id & 31);
+        if (!(set->std_bitmap[id >> 5] & mask)) {
+            return false;
+        }
+        set->std_bitmap[id >> 5] &= ~mask;
+        set->std_count--;
+        return true;
+    }
+
+    uint32_t slot = id_set_hash(id);
+    uint8_t probe = 0;
+    while (set->ext_slots[slot] != id) {
+        if (set->ext_slots[slot] == ID_SET_EMPTY_SLOT || ++probe >= ID_SET_MAX_PROBE) {
+            return false;
+        }
+        slot = (slot + 1) & (ID_SET_EXT_SLOTS - 1);
+    }
+
+    //Backward shift deletion: pull later entries of the same cluster into the hole so no
+    //entry ends up further than ID_SET_MAX_PROBE from its home slot
+    uint32_t hole = slot;
+    uint32_t next = (hole + 1) & (ID_SET_EXT_SLOTS - 1);
+    while (set->ext_slots[next] != ID_SET_EMPTY_SLOT) {
+        uint32_t home = id_set_hash(set->ext_slots[next]);
+        if (((next - home) & (ID_SET_EXT_SLOTS - 1)) >= ((next - hole) & (ID_SET_EXT_SLOTS - 1))) {
+            set->ext_slots[hole] = set->ext_slots[next];
+            hole = next;
+        }
+        next = (next + 1) & (ID_SET_EXT_SLOTS - 1);
+    }
+    set->ext_slots[hole] = ID_SET_EMPTY_SLOT;
+    set->ext_count--;
+    return true;
+}
+
+/**
+* @brief Removes every rule.
+*/
+void id_rules_clear(struct id_rules *rules) {
+    memset(rules, 0, sizeof(*rules));
+}
+
+/**
+* @brief Adds an id/mask rule: an ID matches when (id & mask) == (value & mask).
+* Returns false if the rule exists, the table is full, or it would need one mask too many.
+*/
+bool id_rules_add_mask(struct id_rules *rules, uint32_t value, uint32_t mask) {
+    value &= mask;
+    bool known_mask = false;
+    for (uint8_t i = 0; i < rules->mask_rule_count; ++i) {
+        if (rules->mask_rules[i].mask == mask) {
+            if (rules->mask_rules[i].value == value) {
+                return false;               //Already there
+            }
+            known_mask = true;
+        }
+    }
+    if (rules->mask_rule_count >= ID_RULES_MAX_MASK_RULES || (!known_mask && rules->group_count >= ID_RULES_MAX_MASKS)) {
+        return false;
+    }
+    rules->mask_rules[rules->mask_rule_count].value = value;
+    rules->mask_rules[rules->mask_rule_count].mask = mask;
+    rules->mask_rule_count++;
+    id_rules_compile(rules);
+    return true;
+}
+
+/**
+* @brief Removes an id/mask rule. Returns false if it was not configured.
+*/
+bool id_rules_remove_mask(struct id_rules *rules, uint32_t value, uint32_t mask) {
+    value &= mask;
+    for (uint8_t i = 0; i < rules->mask_rule_count; ++i) {
+        if (rules->mask_rules[i].value == value && rules->mask_rules[i].mask == mask) {
+            rules->mask_rules[i] = rules->mask_rules[rules->mask_rule_count - 1];
+            rules->mask_rule_count--;
+            id_rules_compile(rules);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* @brief Adds an [lo,hi] range rule (inclusive). Returns false if lo > hi, the rule exists or the table is full.
+*/
+bool id_rules_add_range(struct id_rules *rules, uint32_t lo, uint32_t hi) {
+    if (lo > hi || rules->range_rule_count >= ID_RULES_MAX_RANGES) {
+        return false;
+    }
+    for (uint8_t i = 0; i < rules->range_rule_count; ++i) {
+        if (rules->range_rules[i].lo == lo && rules->range_rules[i].hi == hi) {
+            return false;
+        }
+    }
+    rules->range_rules[rules->range_rule_count].lo = lo;
+    rules->range_rules[rules->range_rule_count].hi = hi;
+    rules->range_rule_count++;
+    id_rules_compile(rules);
+    return true;
+}
+
+/**
+* @brief Removes an [lo,hi] range rule. Returns false if it was not configured.
+*/
+bool id_rules_remove_range(struct id_rules *rules, uint32_t lo, uint32_t hi) {
+    for (uint8_t i = 0; i < rules->range_rule_count; ++i) {
+        if (rules->range_rules[i].lo == lo && rules->range_rules[i].hi == hi) {
+            rules->range_rules[i] = rules->range_rules[rules->range_rule_count - 1];
+            rules->range_rule_count--;
+            id_rules_compile(rules);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void sort_values(uint32_t *values, uint8_t count) {     //Insertion sort, tables are small
+    for (uint8_t i = 1; i < count; ++i) {
+        uint32_t v = values[i];
+        uint8_t j = i;
+        while (j > 0 && values[j - 1] > v) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = v;
+    }
+}
+
+/**
+* @brief Rebuilds the lookup tables from the configured rules.
+*/
+void id_rules_compile(struct id_rules *rules) {
+    //Mask rules: one group per distinct mask, values sorted inside the group
+    rules->group_count = 0;
+    uint8_t next = 0;
+    for (uint8_t i = 0; i < rules->mask_rule_count; ++i) {
+        uint32_t mask = rules->mask_rules[i].mask;
+        bool seen = false;
+        for (uint8_t g = 0; g < rules->group_count; ++g) {
+            seen = seen || (rules->groups[g].mask == mask);
+        }
+        if (seen || rules->group_count >= ID_RULES_MAX_MASKS) {
+            continue;
+        }
+        struct id_mask_group *group = &rules->groups[rules->group_count++];
+        group->mask = mask;
+        group->first = next;
+        group->count = 0;
+        for (uint8_t j = i; j < rules->mask_rule_count; ++j) {
+            if (rules->mask_rules[j].mask == mask) {
+                rules->group_values[next++] = rules->mask_rules[j].value;
+                group->count++;
+            }
+        }
+        sort_values(&rules->group_values[group->first], group->count);
+    }
+
+    //Range rules: sort by lo and merge overlapping or touching intervals
+    struct id_range_rule sorted[ID_RULES_MAX_RANGES];
+    memcpy(sorted, rules->range_rules, sizeof(sorted[0]) * rules->range_rule_count);
+    for (uint8_t i = 1; i < rules->range_rule_count; ++i) {
+        struct id_range_rule r = sorted[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1].lo > r.lo) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = r;
+    }
+    rules->merged_count = 0;
+    for (uint8_t i = 0; i < rules->range_rule_count; ++i) {
+        struct id_range_rule *last = rules->merged_count ? &rules->merged[rules->merged_count - 1] : NULL;
+        if (last != NULL && (sorted[i].lo <= last->hi || sorted[i].lo - last->hi == 1)) {
+            if (sorted[i].hi > last->hi) {
+                last->hi = sorted[i].hi;
+            }
+        } else {
+            rules->merged[rules->merged_count++] = sorted[i];
+        }
+    }
+
+    //11-bit IDs are resolved here once, the receive path only reads the bitmap
+    memset(rules->std_match, 0, sizeof(rules->std_match));
+    for (uint32_t id = 0; id < ID_SET_STD_IDS; ++id) {
+        if (id_rules_match(rules, id)) {
+            rules->std_match[id >> 5] |= 1u << (id & 31);
+        }
+    }
+}
+
+/**
+* @brief Empties a filter list: exact IDs and rules.
+*/
+void filter_list_clear(struct filter_list *list) {
+    id_set_clear(&list->ids);
+    id_rules_clear(&list->rules);
+}
+
+/**
+* @brief Decision of a J1939 list for an ID above 0x7FF. Never inlined, so route_list_forward() reaches it
+* by a jump before saving the registers its own lookup needs. Runs in the receive interrupt, from SRAM.
+*/
+bool __no_inline_not_in_flash_func(route_j1939_forward)(const struct route_direction *route, uint32_t id) {
+    return j1939_listed(route->list, id) == route->listed_forward;
+}
+
+/**
+* @brief Decision of a list for an ID above bitmap_max_id, out of line for ROUTE_DISPATCH_BOUNDED so
+* route_forward() keeps no registers to save on its bitmap paths. Runs in the receive interrupt, from SRAM.
+*/
+bool __not_in_flash_func(route_list_forward)(const struct route_direction *route, uint32_t id) {
+    if (route->j1939) {
+        return route_j1939_forward(route, id);
+    }
+    return route_list_decision(route, id);
+}
+
+static const char *const route_kind_names[ROUTE_KINDS] = {
+    "never", "always", "listed", "not listed", "j1939 listed", "j1939 not listed",
+};
+
+/**
+* @brief Name of a route kind, for the reports.
+*/
+const char *route_kind_name(uint8_t kind) {
+    return kind < ROUTE_KINDS ? route_kind_names[kind] : "?";
+}
+
+/**
+* @brief Builds the routing decision of one direction from a policy and the list it refers to.
+* A J1939 list holds keys (see j1939_listed()), none of the 11-bit IDs is listed.
+*/
+void route_compile(struct route_direction *route, RoutePolicy_t policy, const struct filter_list *list, bool j1939) {
+    if ((policy == ROUTE_IF_LISTED || policy == ROUTE_IF_NOT_LISTED) && list == NULL) {
+        policy = ROUTE_NEVER;               //A list policy without a list cannot match anything safely
+    }
+    route->j1939 = j1939 && list != NULL;
+    route->kind = (uint8_t)policy;
+    if (route->j1939 && (policy == ROUTE_IF_LISTED || policy == ROUTE_IF_NOT_LISTED)) {
+        route->kind = (uint8_t)(policy + 2);
+    }
+    route->listed_forward = policy == ROUTE_IF_LISTED;
+    route->dispatch = ROUTE_DISPATCH_BOUNDED;     //Right for any policy, route_dispatch_pair() may pick a shorter one
+    route->bitmap_max_id = (policy == ROUTE_IF_LISTED || policy == ROUTE_IF_NOT_LISTED) ? ID_SET_STD_IDS - 1 : UINT32_MAX;
+
+    switch (policy) {
+        case ROUTE_ALWAYS:
+            memset(route->std_forward, 0xFF, sizeof(route->std_forward));
+            route->list = NULL;
+            break;
+        case ROUTE_IF_LISTED:
+            for (uint32_t i = 0; i < ID_SET_STD_IDS / 32; ++i) {
+                route->std_forward[i] = j1939 ? 0 : list->ids.std_bitmap[i] | list->rules.std_match[i];
+            }
+            route->list = list;
+            break;
+        case ROUTE_IF_NOT_LISTED:
+            for (uint32_t i = 0; i < ID_SET_STD_IDS / 32; ++i) {
+                route->std_forward[i] = j1939 ? 0xFFFFFFFFu : ~(list->ids.std_bitmap[i] | list->rules.std_match[i]);
+            }
+            route->list = list;
+            break;
+        case ROUTE_NEVER:
+        default:
+            memset(route->std_forward, 0, sizeof(route->std_forward));
+            route->list = NULL;
+            break;
+    }
+}
+
+/**
+* @brief Picks the dispatch of both directions of a mode, once both are compiled. The choice is made for
+* the pair so route_forward() takes the same branches whichever bus a frame comes from. J1939 lists are
+* looked up out of line, so the plain list lookup is the only one inlined into the receive path.
+*/
+void route_dispatch_pair(struct route_direction routes[2]) {
+    for (uint8_t i = 0; i < 2; ++i) {
+        if (routes[0].list == NULL && routes[1].list == NULL) {
+            routes[i].dispatch = routes[i].kind == ROUTE_ALWAYS ? ROUTE_DISPATCH_FORWARD : ROUTE_DISPATCH_DROP;
+        } else if (routes[0].list != NULL && routes[1].list != NULL) {
+            routes[i].dispatch = routes[i].j1939 ? ROUTE_DISPATCH_BOUNDED : ROUTE_DISPATCH_SPLIT;
+        } else {
+            routes[i].dispatch = ROUTE_DISPATCH_BOUNDED;
+        }
+    }
+}
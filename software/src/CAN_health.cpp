@@ -0,0 +1,149 @@
+/**
+* DESCRIPTION: Bus health tracking and store-and-forward of the frames for a bus that is down.
+**/
+
+#include "CAN_health.h"
+#include <string.h>
+
+/**
+* @brief A bus that is up, seen now.
+*/
+void bus_health_init(struct bus_health *health, uint32_t now_us) {
+    memset(health, 0, sizeof(*health));
+    health->last_seen_us = now_us;
+}
+
+static void bus_health_go_down(struct bus_health *health, uint32_t now_us) {
+    health->down = true;
+    health->down_since_us = now_us;
+    health->last_probe_us = now_us;
+    health->outages++;
+}
+
+/**
+* @brief The controller reported an error, bus_off if it stopped transmitting. Returns true if the bus just went down.
+*/
+bool bus_health_error(struct bus_health *health, bool bus_off, uint32_t now_us) {
+    health->error_total++;
+    if (health->errors < 0xFF) {
+        health->errors++;
+    }
+    if (health->down || (!bus_off && health->errors < HEALTH_ERROR_LIMIT)) {
+        return false;
+    }
+    bus_health_go_down(health, now_us);
+    return true;
+}
+
+/**
+* @brief Polled by the owner core: tx_pending if frames wait on the controller. Returns true if the bus just went down.
+*/
+bool bus_health_check(struct bus_health *health, bool tx_pending, uint32_t now_us) {
+    if (health->down || !tx_pending || now_us - health->last_seen_us < HEALTH_TX_TIMEOUT_US) {
+        return false;
+    }
+    bus_health_go_down(health, now_us);
+    return true;
+}
+
+/**
+* @brief The bus is back (see bus_health_seen()).
+*/
+void bus_health_recover(struct bus_health *health, uint32_t now_us) {
+    health->down = false;
+    if (now_us - health->down_since_us > health->longest_outage_us) {
+        health->longest_outage_us = now_us - health->down_since_us;
+    }
+}
+
+/**
+* @brief Empties a buffer and its counters. Only call while it holds no frame.
+*/
+void outage_init(struct outage_buffer *buffer) {
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+static void outage_remove_at(struct outage_buffer *buffer, uint8_t index) {
+    buffer->entries[index] = buffer->entries[--buffer->count];
+}
+
+/**
+* @brief Drops the held frames whose TTL ran out.
+*/
+void outage_expire(struct outage_buffer *buffer, uint32_t now_us) {
+    for (uint8_t i = 0; i < buffer->count;) {
+        if ((int32_t)(now_us - buffer->entries[i].expires_us) > 0) {
+            frame_release(buffer->entries[i].frame);
+            outage_remove_at(buffer, i);
+            buffer->expired++;
+        } else {
+            ++i;
+        }
+    }
+}
+
+/**
+* @brief Holds a frame for ttl_us, taking over the caller's reference. It replaces the held frame of its ID.
+* A full buffer gives the slot of its lowest priority ID to a higher priority one, otherwise the frame is lost.
+*/
+void outage_put(struct outage_buffer *buffer, frame_handle_t frame, uint32_t ttl_us, uint32_t now_us) {
+    uint32_t id = frame_get(frame)->id;
+    if (ttl_us == 0) {
+        frame_release(frame);
+        buffer->lost++;
+        return;
+    }
+    buffer->stored++;
+    uint8_t index = 0;
+    while (index < buffer->count && buffer->entries[index].id != id) {
+        index++;
+    }
+    if (index < buffer->count) {
+        frame_release(buffer->entries[index].frame);
+        buffer->replaced++;
+    } else {
+        if (buffer->count == OUTAGE_BUFFER_SIZE) {
+            outage_expire(buffer, now_us);
+        }
+        if (buffer->count == OUTAGE_BUFFER_SIZE) {
+            uint8_t victim = 0;
+            for (uint8_t i = 1; i < buffer->count; ++i) {
+                if (can_arbitration_key(buffer->entries[i].id) > can_arbitration_key(buffer->entries[victim].id)) {
+                    victim = i;
+                }
+            }
+            buffer->lost++;
+            if (can_arbitration_key(id) >= can_arbitration_key(buffer->entries[victim].id)) {
+                frame_release(frame);
+                return;
+            }
+            frame_release(buffer->entries[victim].frame);
+            outage_remove_at(buffer, victim);
+        }
+        index = buffer->count++;
+        buffer->entries[index].id = id;
+    }
+    buffer->entries[index].frame = frame;
+    buffer->entries[index].expires_us = now_us + ttl_us;
+}
+
+/**
+* @brief Takes the held frame that wins arbitration, with its reference, dropping the expired ones.
+* Returns false if nothing is held.
+*/
+bool outage_take(struct outage_buffer *buffer, frame_handle_t *frame, uint32_t now_us) {
+    outage_expire(buffer, now_us);
+    if (buffer->count == 0) {
+        return false;
+    }
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < buffer->count; ++i) {
+        if (can_arbitration_key(buffer->entries[i].id) < can_arbitration_key(buffer->entries[best].id)) {
+            best = i;
+        }
+    }
+    *frame = buffer->entries[best].frame;
+    outage_remove_at(buffer, best);
+    buffer->drained++;
+    return true;
+}
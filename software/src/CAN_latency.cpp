@@ -0,0 +1,104 @@
+/**
+* DESCRIPTION: Forwarding latency sketches of the latency probe.
+**/
+
+#include "CAN_latency.h"
+#include <stdio.h>
+#include <string.h>
+#include "pico/platform.h"
+
+/**
+* @brief Empties the sketches of a direction and forgets its IDs.
+*/
+void latency_direction_reset(struct latency_direction *direction) {
+    memset(direction, 0, sizeof(*direction));
+}
+
+static inline void latency_sketch_add(struct latency_sketch *sketch, uint32_t latency_us) {
+    sketch->buckets[latency_bucket(latency_us)]++;
+    sketch->count++;
+    if (latency_us > sketch->max_us) {
+        sketch->max_us = latency_us;
+    }
+}
+
+/**
+* @brief Adds the latency of a frame sent on to its direction, and to its ID while one is tracked or a sketch is free.
+*/
+void __not_in_flash_func(latency_record)(struct latency_direction *direction, uint32_t id, uint32_t latency_us) {
+    latency_sketch_add(&direction->all, latency_us);
+    for (uint8_t i = 0; i < direction->id_count; ++i) {
+        if (direction->ids[i] == id) {
+            latency_sketch_add(&direction->per_id[i], latency_us);
+            return;
+        }
+    }
+    if (direction->id_count == LATENCY_MAX_IDS) {
+        direction->untracked++;
+        return;
+    }
+    direction->ids[direction->id_count] = id;
+    latency_sketch_add(&direction->per_id[direction->id_count++], latency_us);
+}
+
+/**
+* @brief Sketch of an ID, NULL if it has none.
+*/
+const struct latency_sketch *latency_find(const struct latency_direction *direction, uint32_t id) {
+    for (uint8_t i = 0; i < direction->id_count; ++i) {
+        if (direction->ids[i] == id) {
+            return &direction->per_id[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+* @brief Latency below which permille / 1000 of the frames were sent: middle of its bucket, at most the maximum.
+* 0 for an empty sketch.
+*/
+uint32_t latency_percentile(const struct latency_sketch *sketch, uint32_t permille) {
+    if (sketch->count == 0) {
+        return 0;
+    }
+    uint64_t rank = ((uint64_t)sketch->count * permille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint32_t seen = 0;
+    uint32_t bucket = 0;
+    for (; bucket < LATENCY_BUCKETS - 1; ++bucket) {
+        seen += sketch->buckets[bucket];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    uint32_t value = bucket;
+    if (bucket >= 2 * LATENCY_SUB_BUCKETS) {
+        uint32_t shift = (bucket >> LATENCY_SUB_BITS) - 1;
+        uint32_t low = (LATENCY_SUB_BUCKETS | (bucket & (LATENCY_SUB_BUCKETS - 1))) << shift;
+        value = low + ((1u << shift) >> 1);
+    }
+    return value < sketch->max_us ? value : sketch->max_us;
+}
+
+static void latency_sketch_print(const struct latency_sketch *sketch) {
+    printf(" %lu frames, p50 %lu us, p90 %lu us, p99 %lu us, max %lu us\n", (unsigned long)sketch->count,
+           (unsigned long)latency_percentile(sketch, 500), (unsigned long)latency_percentile(sketch, 900),
+           (unsigned long)latency_percentile(sketch, 990), (unsigned long)sketch->max_us);
+}
+
+/**
+* @brief Prints the latency of a direction and of its tracked IDs on stdio (USB on the board).
+*/
+void latency_direction_print(const struct latency_direction *direction, uint8_t interface_id) {
+    printf("CAN%u -> CAN%u latency:", interface_id, interface_id ^ 1);
+    latency_sketch_print(&direction->all);
+    for (uint8_t i = 0; i < direction->id_count; ++i) {
+        printf("  id 0x%08lX:", (unsigned long)direction->ids[i]);
+        latency_sketch_print(&direction->per_id[i]);
+    }
+    if (direction->untracked != 0) {
+        printf("  %lu frames of untracked IDs\n", (unsigned long)direction->untracked);
+    }
+}
@@ -0,0 +1,57 @@
+/**
+* DESCRIPTION: Bus load monitor and load shedding of the bridge.
+**/
+
+#include "CAN_load.h"
+#include "pico/platform.h"
+
+/**
+* @brief Idle bus, no shedding, counters cleared.
+*/
+void bus_load_init(struct bus_load *load, uint32_t bitrate, uint32_t now_us) {
+    load->bitrate = bitrate ? bitrate : LOAD_DEFAULT_BITRATE;
+    load->window_start_us = now_us;
+    load->window_bits = 0;
+    load->load_permille = 0;
+    load->peak_permille = 0;
+    load->shed_permille = 0;
+    load->restore_permille = 0;
+    bus_load_set_class(load, LOAD_NO_CLASS);
+    load->shedding.store(false, std::memory_order_relaxed);
+}
+
+/**
+* @brief Frames that lose arbitration to shed_id (and shed_id itself) are shed, LOAD_NO_CLASS for none.
+*/
+void bus_load_set_class(struct bus_load *load, uint32_t shed_id) {
+    load->shed_id = shed_id;
+    load->shed_key = shed_id == LOAD_NO_CLASS ? UINT32_MAX : can_arbitration_key(shed_id);
+}
+
+/**
+* @brief Closes the window once LOAD_WINDOW_US passed: computes its load and starts or stops shedding.
+* The load is spread over the real length of the window, so an idle bus reads 0 at the next tick.
+*/
+void __not_in_flash_func(bus_load_tick)(struct bus_load *load, uint32_t now_us) {
+    uint32_t elapsed_us = now_us - load->window_start_us;
+    if (elapsed_us < LOAD_WINDOW_US) {
+        return;
+    }
+    uint32_t permille = (uint32_t)((uint64_t)load->window_bits * 1000000000ull / ((uint64_t)load->bitrate * elapsed_us));
+    load->load_permille = permille;
+    if (permille > load->peak_permille) {
+        load->peak_permille = permille;
+    }
+    load->window_start_us = now_us;
+    load->window_bits = 0;
+
+    bool shedding = load->shedding.load(std::memory_order_relaxed);
+    if (load->shed_permille == 0) {
+        shedding = false;
+    } else if (permille >= load->shed_permille) {
+        shedding = true;
+    } else if (permille < load->restore_permille) {
+        shedding = false;
+    }
+    load->shedding.store(shedding, std::memory_order_relaxed);
+}
@@ -0,0 +1,156 @@
+/**
+* DESCRIPTION: Learned period and jitter of the forwarded IDs.
+**/
+
+#include "CAN_period.h"
+#include <stdio.h>
+#include <string.h>
+#include "pico/platform.h"
+
+static const char *const period_state_names[] = {"learning", "steady", "drifting", "silent"};
+
+/**
+* @brief Forgets every ID and the counters.
+*/
+void period_table_init(struct period_table *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+static inline uint32_t period_slot(uint32_t id, uint32_t probe) {
+    return (((id * 2654435761u) >> (32 - PERIOD_TABLE_BITS)) + probe) & (PERIOD_TABLE_SIZE - 1);
+}
+
+/**
+* @brief True if an entry may give its slot to a new ID: silent once learned, or not seen for PERIOD_STALE_US.
+*/
+static inline bool period_stale(const struct period_entry *entry, uint32_t now_us) {
+    uint32_t age_us = now_us - entry->last_us;
+    if (period_learned(entry)) {
+        return age_us / PERIOD_SILENT_FACTOR > period_us(entry);
+    }
+    return age_us > PERIOD_STALE_US;
+}
+
+/**
+* @brief Adds the interval since the last frame of the entry's ID. Once learned, PERIOD_LEARN_SAMPLES gaps in a
+* row mean the node changed its period: it is learned again.
+*/
+static inline void __not_in_flash_func(period_sample)(struct period_entry *entry, uint32_t now_us) {
+    uint32_t interval_us = now_us - entry->last_us;
+    uint32_t interval_q = interval_us > (INT32_MAX >> PERIOD_FRAC_BITS) ? INT32_MAX : interval_us << PERIOD_FRAC_BITS;
+    entry->last_us = now_us;
+    if (period_learned(entry) && interval_q / PERIOD_GAP_FACTOR > entry->period_q) {
+        entry->gaps++;                          //Silent for a while, not a sample of the period
+        if (++entry->gaps_in_row < PERIOD_LEARN_SAMPLES) {
+            return;
+        }
+        entry->samples = 0;
+    }
+    entry->gaps_in_row = 0;
+    if (entry->samples == 0) {
+        entry->period_q = interval_q;
+        entry->jitter_q = 0;
+        entry->reference_us = 0;
+        entry->samples = 1;
+        return;
+    }
+    int32_t error_q = (int32_t)(interval_q - entry->period_q);
+    uint32_t deviation_q = (uint32_t)(error_q < 0 ? -error_q : error_q);
+    entry->period_q += error_q / (1 << PERIOD_GAIN_SHIFT);
+    entry->jitter_q += ((int32_t)deviation_q - (int32_t)entry->jitter_q) / (1 << PERIOD_JITTER_SHIFT);
+    if (entry->samples < UINT16_MAX) {
+        entry->samples++;
+    }
+    if (entry->samples == PERIOD_LEARN_SAMPLES) {
+        entry->reference_us = period_us(entry);
+    }
+}
+
+/**
+* @brief Counts a frame of an ID received now. Returns its learned period in us, 0 while it is not learned.
+*/
+uint32_t __not_in_flash_func(period_update)(struct period_table *table, uint32_t id, uint32_t now_us) {
+    struct period_entry *free_entry = NULL;
+    struct period_entry *stale_entry = NULL;
+    for (uint32_t probe = 0; probe < PERIOD_PROBES; ++probe) {
+        struct period_entry *entry = &table->entries[period_slot(id, probe)];
+        if (!entry->used) {
+            if (free_entry == NULL) {
+                free_entry = entry;
+            }
+        } else if (entry->id == id) {
+            period_sample(entry, now_us);
+            return period_learned(entry) ? period_us(entry) : 0;
+        } else if (stale_entry == NULL && period_stale(entry, now_us)) {
+            stale_entry = entry;
+        }
+    }
+    struct period_entry *entry = free_entry != NULL ? free_entry : stale_entry;
+    if (entry == NULL) {
+        table->untracked++;
+        return 0;
+    }
+    if (entry == free_entry) {
+        table->count++;
+    }
+    memset(entry, 0, sizeof(*entry));
+    entry->used = true;
+    entry->id = id;
+    entry->last_us = now_us;
+    return 0;
+}
+
+/**
+* @brief Entry of an ID, NULL if it is not tracked.
+*/
+const struct period_entry *period_find(const struct period_table *table, uint32_t id) {
+    for (uint32_t probe = 0; probe < PERIOD_PROBES; ++probe) {
+        const struct period_entry *entry = &table->entries[period_slot(id, probe)];
+        if (entry->used && entry->id == id) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+* @brief Signed distance of the period from its reference, in permille. 0 while learning.
+*/
+int32_t period_drift_permille(const struct period_entry *entry) {
+    if (entry->reference_us == 0) {
+        return 0;
+    }
+    return (int32_t)(((int64_t)period_us(entry) - (int64_t)entry->reference_us) * 1000 / entry->reference_us);
+}
+
+PeriodState_t period_state(const struct period_entry *entry, uint32_t now_us) {
+    if (!period_learned(entry)) {
+        return PERIOD_LEARNING;
+    }
+    if (period_stale(entry, now_us)) {
+        return PERIOD_SILENT;
+    }
+    int32_t drift = period_drift_permille(entry);
+    if (drift > PERIOD_DRIFT_PERMILLE || drift < -PERIOD_DRIFT_PERMILLE) {
+        return PERIOD_DRIFTING;
+    }
+    return PERIOD_STEADY;
+}
+
+/**
+* @brief Prints the learned schedule of a direction on stdio (USB on the board).
+*/
+void period_table_print(const struct period_table *table, uint8_t interface_id, uint32_t now_us) {
+    printf("CAN%u learned periods: %u IDs, %lu frames untracked\n", interface_id, table->count,
+           (unsigned long)table->untracked);
+    for (uint32_t i = 0; i < PERIOD_TABLE_SIZE; ++i) {
+        const struct period_entry *entry = &table->entries[i];
+        if (!entry->used) {
+            continue;
+        }
+        printf("  id 0x%08lX: period %lu us, jitter %lu us, drift %ld permille, last %lu us ago, %u gaps, %s\n",
+               (unsigned long)entry->id, (unsigned long)period_us(entry), (unsigned long)period_jitter_us(entry),
+               (long)period_drift_permille(entry), (unsigned long)(now_us - entry->last_us), entry->gaps,
+               period_state_names[period_state(entry, now_us)]);
+    }
+}
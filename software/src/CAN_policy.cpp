@@ -0,0 +1,150 @@
+/**
+* DESCRIPTION: Per-ID forwarding policies of the bridge: the ID/rule table and the token buckets.
+**/
+
+#include "CAN_policy.h"
+#include <string.h>
+
+/**
+* @brief Sets the rate and size of a bucket and fills it. tokens_per_s = 0 removes the limit.
+*/
+void token_bucket_config(struct token_bucket *bucket, uint32_t tokens_per_s, uint32_t burst_tokens, uint32_t now_us) {
+    memset(bucket, 0, sizeof(*bucket));
+    if (tokens_per_s == 0) {
+        return;
+    }
+    uint64_t token_q = ((uint64_t)1000000u << TOKEN_Q) / tokens_per_s;
+    if (token_q == 0) {
+        token_q = 1;
+    }
+    uint64_t burst_q = token_q * (burst_tokens ? burst_tokens : 1u);
+    bucket->token_q = token_q > TOKEN_MAX_CREDIT ? TOKEN_MAX_CREDIT : (uint32_t)token_q;
+    bucket->burst_q = burst_q > TOKEN_MAX_CREDIT ? TOKEN_MAX_CREDIT : (uint32_t)burst_q;
+    bucket->credit_q = bucket->burst_q;
+    bucket->last_us = now_us;
+}
+
+/**
+* @brief Removes every policy.
+*/
+void policy_table_clear(struct policy_table *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+/**
+* @brief Entry of an ID (mask 0xFFFFFFFF) or of an id/mask rule, NULL if there is none.
+*/
+const struct id_policy *policy_table_find(const struct policy_table *table, uint32_t id, uint32_t mask) {
+    id &= mask;
+    for (uint8_t i = 0; i < POLICY_MAX_ENTRIES; ++i) {
+        if (table->entries[i].used && table->entries[i].id == id && table->entries[i].mask == mask) {
+            return &table->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+* @brief Marks an entry as edited, the cores set its state up again.
+*/
+void policy_table_edited(struct policy_table *table, struct id_policy *entry) {
+    entry->revision = ++table->revision;
+}
+
+/**
+* @brief Entry of an ID or rule to edit, added with no limits in a free slot if missing. NULL if the table
+* (or the rules) are full. Call policy_table_compile() once the entry is set up.
+*/
+struct id_policy *policy_table_get(struct policy_table *table, uint32_t id, uint32_t mask) {
+    const struct id_policy *found = policy_table_find(table, id, mask);
+    if (found != NULL) {
+        struct id_policy *entry = &table->entries[found - table->entries];
+        policy_table_edited(table, entry);
+        return entry;
+    }
+    bool is_rule = mask != POLICY_EXACT_MASK;
+    if (table->count >= POLICY_MAX_ENTRIES || (is_rule && table->rule_count >= POLICY_MAX_RULES)) {
+        return NULL;
+    }
+    uint8_t index = 0;
+    while (table->entries[index].used) {                                //count < POLICY_MAX_ENTRIES, one is free
+        index++;
+    }
+    struct id_policy *entry = &table->entries[index];
+    memset(entry, 0, sizeof(*entry));
+    entry->id = id & mask;
+    entry->mask = mask;
+    entry->used = true;
+    policy_table_edited(table, entry);
+    entry->serial = entry->revision;
+    table->count++;
+    if (is_rule) {
+        table->rule_count++;
+    }
+    return entry;
+}
+
+/**
+* @brief Removes the entry of an ID or rule. The others keep their slot (rules match in the order they were added).
+*/
+void policy_table_remove(struct policy_table *table, uint32_t id, uint32_t mask) {
+    const struct id_policy *found = policy_table_find(table, id, mask);
+    if (found == NULL) {
+        return;
+    }
+    struct id_policy *entry = &table->entries[found - table->entries];
+    if (entry->mask != POLICY_EXACT_MASK) {
+        table->rule_count--;
+    }
+    memset(entry, 0, sizeof(*entry));
+    table->count--;
+    table->revision++;
+}
+
+/**
+* @brief Rebuilds the lookup tables from the entries.
+*/
+void policy_table_compile(struct policy_table *table) {
+    memset(table->std_entry, 0, sizeof(table->std_entry));
+    memset(table->ext_entry, 0, sizeof(table->ext_entry));
+
+    uint8_t rules = 0;
+    for (uint8_t i = 0; i < POLICY_MAX_ENTRIES; ++i) {                  //Rules sorted by serial
+        const struct id_policy *entry = &table->entries[i];
+        if (!entry->used || entry->mask == POLICY_EXACT_MASK) {
+            continue;
+        }
+        uint8_t r = rules++;
+        while (r > 0 && table->entries[table->rule_entry[r - 1] - 1].serial > entry->serial) {
+            table->rule_entry[r] = table->rule_entry[r - 1];
+            r--;
+        }
+        table->rule_entry[r] = (uint8_t)(i + 1);
+    }
+    table->rule_count = rules;
+    for (uint8_t r = 0; r < rules; ++r) {
+        const struct id_policy *entry = &table->entries[table->rule_entry[r] - 1];
+        for (uint32_t id = 0; id < ID_SET_STD_IDS; ++id) {              //First rule wins
+            if (table->std_entry[id] == 0 && (id & entry->mask) == entry->id) {
+                table->std_entry[id] = table->rule_entry[r];
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < POLICY_MAX_ENTRIES; ++i) {                  //An ID's own entry beats the rules
+        const struct id_policy *entry = &table->entries[i];
+        if (!entry->used || entry->mask != POLICY_EXACT_MASK) {
+            continue;
+        }
+        if (entry->id < ID_SET_STD_IDS) {
+            table->std_entry[entry->id] = (uint8_t)(i + 1);
+            continue;
+        }
+        uint32_t slot = policy_hash(entry->id);
+        while (table->ext_entry[slot] != 0) {
+            slot = (slot + 1) & (POLICY_EXT_SLOTS - 1);
+        }
+        table->ext_ids[slot] = entry->id;
+        table->ext_entry[slot] = (uint8_t)(i + 1);
+    }
+}
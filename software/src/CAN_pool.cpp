@@ -0,0 +1,93 @@
+/**
+* DESCRIPTION: Reference counted frame pools of the bridge.
+**/
+
+#include "CAN_pool.h"
+#include "pico/platform.h"
+
+struct frame_pool frame_pools[2];
+
+/**
+* @brief Drops one reference of a frame of the calling core's pool, the last one frees the slot.
+*/
+static inline void frame_pool_put(struct frame_pool *pool, uint8_t slot) {
+    if (pool->refs[slot] == 0) {
+        return;                                 //Released twice: keep the free list consistent
+    }
+    if (--pool->refs[slot] == 0) {
+        pool->free_slots[pool->free_count++] = slot;
+    }
+}
+
+/**
+* @brief Empties both pools and their counters. Only call while no frame is in use.
+*/
+void frame_pool_init(void) {
+    for (uint8_t core = 0; core < 2; ++core) {
+        struct frame_pool *pool = &frame_pools[core];
+        for (uint8_t i = 0; i < FRAME_POOL_SIZE; ++i) {
+            pool->refs[i] = 0;
+            pool->free_slots[i] = (uint8_t)(FRAME_POOL_SIZE - 1 - i);
+        }
+        pool->free_count = FRAME_POOL_SIZE;
+        handle_queue_init(&pool->returned);
+        pool->high_water = 0;
+        pool->exhausted = 0;
+    }
+}
+
+/**
+* @brief Takes back the references the other core released to the calling core's pool.
+* From the core's CAN interrupt or with interrupts masked.
+*/
+void __not_in_flash_func(frame_pool_collect)(void) {
+    struct frame_pool *pool = &frame_pools[get_core_num()];
+    uint8_t returned;
+    while (handle_queue_pop(&pool->returned, &returned)) {
+        frame_pool_put(pool, (uint8_t)(returned & ((1u << FRAME_POOL_CORE_SHIFT) - 1)));
+    }
+}
+
+/**
+* @brief Takes a frame of the calling core's pool with one reference. FRAME_NONE if every frame is in use.
+* From the core's CAN interrupt or with interrupts masked.
+*/
+frame_handle_t __not_in_flash_func(frame_alloc)(void) {
+    unsigned int core = get_core_num();
+    struct frame_pool *pool = &frame_pools[core];
+    frame_pool_collect();
+    if (pool->free_count == 0) {
+        pool->exhausted++;
+        return FRAME_NONE;
+    }
+    uint8_t slot = pool->free_slots[--pool->free_count];
+    pool->refs[slot] = 1;
+    if (frame_pool_in_use(pool) > pool->high_water) {
+        pool->high_water = frame_pool_in_use(pool);
+    }
+    return (frame_handle_t)((core << FRAME_POOL_CORE_SHIFT) | slot);
+}
+
+/**
+* @brief Adds a reference to a frame. Only the core that allocated it, like frame_alloc().
+*/
+void __not_in_flash_func(frame_ref)(frame_handle_t frame) {
+    frame_pools[frame >> FRAME_POOL_CORE_SHIFT].refs[frame & ((1u << FRAME_POOL_CORE_SHIFT) - 1)]++;
+}
+
+/**
+* @brief Releases a reference, from either core (from the CAN interrupt or with interrupts masked).
+* A frame of the other core's pool goes back through its return queue.
+*/
+void __not_in_flash_func(frame_release)(frame_handle_t frame) {
+    if (frame == FRAME_NONE) {
+        return;
+    }
+    unsigned int core = frame >> FRAME_POOL_CORE_SHIFT;
+    struct frame_pool *pool = &frame_pools[core];
+    if (core == get_core_num()) {
+        frame_pool_put(pool, (uint8_t)(frame & ((1u << FRAME_POOL_CORE_SHIFT) - 1)));
+    } else {
+        handle_queue_push(&pool->returned, frame);
+    }
+}
@@ -0,0 +1,58 @@
+/**
+* DESCRIPTION: can2040 bus ports and the can2040 entry points of the bridge.
+**/
+
+#include "CAN_bridge.h"
+#include "CAN_port.h"
+
+static int can2040_port_send(void *ctx, struct can2040_msg *msg) {
+    return can_send((struct can2040 *)ctx, msg);
+}
+
+static bool can2040_port_ready(void *ctx) {
+    return can2040_check_transmit((struct can2040 *)ctx) != 0;
+}
+
+static uint32_t can2040_port_tx_total(void *ctx) {
+    struct can2040_stats stats;
+    can2040_get_statistics((struct can2040 *)ctx, &stats);
+    return stats.tx_total;
+}
+
+const struct bus_port can2040_ports[2] = {
+    {can2040_port_send, can2040_port_ready, can2040_port_tx_total, &cbus0, TX_SCHED_HW_DEPTH},
+    {can2040_port_send, can2040_port_ready, can2040_port_tx_total, &cbus1, TX_SCHED_HW_DEPTH},
+};
+
+/**
+* @brief Processes a CAN message received on a specific bus.
+*/
+void __not_in_flash_func(can_rx_callback)(struct can2040 *can_instance_ptr, uint32_t id, uint8_t dlc, uint8_t *data_payload){
+    if (can_instance_ptr == &cbus0) {           //If the message was received on the CAN bus 0
+        bridge_receive(CAN_IFACE0, id, dlc, data_payload);
+    } else if (can_instance_ptr == &cbus1) {    //If the message was received on the CAN bus 1
+        bridge_receive(CAN_IFACE1, id, dlc, data_payload);
+    }
+}
+
+/**
+* @brief Called on CAN2040_NOTIFY_ERROR.
+*/
+void bridge_error_notify(struct can2040 *can_instance_ptr) {
+    if (can_instance_ptr == &cbus0) {
+        bridge_bus_error(CAN_IFACE0, false);
+    } else if (can_instance_ptr == &cbus1) {
+        bridge_bus_error(CAN_IFACE1, false);
+    }
+}
+
+/**
+* @brief Called on CAN2040_NOTIFY_TX.
+*/
+void __not_in_flash_func(bridge_tx_complete)(struct can2040 *can_instance_ptr, const struct can2040_msg *msg) {
+    if (can_instance_ptr == &cbus0) {
+        bridge_tx_done(CAN_IFACE0, msg);
+    } else if (can_instance_ptr == &cbus1) {
+        bridge_tx_done(CAN_IFACE1, msg);
+    }
+}
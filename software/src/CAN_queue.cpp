@@ -0,0 +1,25 @@
+/**
+* DESCRIPTION: Cross-core frame queues of the bridge.
+**/
+
+#include "CAN_queue.h"
+
+/**
+* @brief Empties a queue and its counters. Only call while neither side is using it.
+*/
+void frame_queue_init(struct frame_queue *queue) {
+    queue->head.store(0, std::memory_order_relaxed);
+    queue->tail.store(0, std::memory_order_relaxed);
+    queue->high_water = 0;
+    queue->drops = 0;
+}
+
+/**
+* @brief Empties a handle queue and its counters. Only call while neither side is using it.
+*/
+void handle_queue_init(struct handle_queue *queue) {
+    queue->head.store(0, std::memory_order_relaxed);
+    queue->tail.store(0, std::memory_order_relaxed);
+    queue->high_water = 0;
+    queue->drops = 0;
+}
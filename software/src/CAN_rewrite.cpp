@@ -0,0 +1,86 @@
+/**
+* DESCRIPTION: ID translation and payload rewrite rules of the bridge.
+**/
+
+#include "CAN_rewrite.h"
+
+/**
+* @brief A rule for an ID that changes nothing yet: same ID, payload and DLC.
+*/
+void rewrite_rule_init(struct rewrite_rule *rule, uint32_t id) {
+    memset(rule, 0, sizeof(*rule));
+    rule->id = id;
+    rule->new_id = id;
+    memset(rule->keep, 0xFF, sizeof(rule->keep));
+    rule->dlc = REWRITE_KEEP_DLC;
+}
+
+/**
+* @brief Removes every rule.
+*/
+void rewrite_table_clear(struct rewrite_table *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+/**
+* @brief Adds a rule, or replaces the rule of the same ID. False if the table is full.
+* Call rewrite_table_compile() afterwards.
+*/
+bool rewrite_table_set(struct rewrite_table *table, const struct rewrite_rule *rule) {
+    uint8_t index = 0;
+    while (index < table->count && table->rules[index].id != rule->id) {
+        index++;
+    }
+    if (index == table->count) {
+        if (table->count >= REWRITE_MAX_RULES) {
+            return false;
+        }
+        table->count++;
+    }
+    table->rules[index] = *rule;
+    struct rewrite_rule *stored = &table->rules[index];
+    stored->payload = false;
+    for (uint8_t i = 0; i < 8; ++i) {
+        stored->set[i] &= (uint8_t)~stored->keep[i];        //A set bit is never also kept
+        if (stored->keep[i] != 0xFF || stored->set[i] != 0) {
+            stored->payload = true;
+        }
+    }
+    if (stored->dlc > 8) {
+        stored->dlc = REWRITE_KEEP_DLC;
+    }
+    return true;
+}
+
+/**
+* @brief Removes the rule of an ID. False if there was none.
+*/
+bool rewrite_table_remove(struct rewrite_table *table, uint32_t id) {
+    for (uint8_t i = 0; i < table->count; ++i) {
+        if (table->rules[i].id == id) {
+            table->rules[i] = table->rules[--table->count];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* @brief Rebuilds the lookup tables from the rules.
+*/
+void rewrite_table_compile(struct rewrite_table *table) {
+    memset(table->std_present, 0, sizeof(table->std_present));
+    memset(table->slot_rule, 0, sizeof(table->slot_rule));
+    for (uint8_t i = 0; i < table->count; ++i) {
+        uint32_t id = table->rules[i].id;
+        if (id < ID_SET_STD_IDS) {
+            table->std_present[id >> 5] |= 1u << (id & 31);
+        }
+        uint32_t slot = rewrite_hash(id);
+        while (table->slot_rule[slot] != 0) {
+            slot = (slot + 1) & (REWRITE_SLOTS - 1);
+        }
+        table->slot_ids[slot] = id;
+        table->slot_rule[slot] = (uint8_t)(i + 1);
+    }
+}
@@ -0,0 +1,283 @@
+/**
+* DESCRIPTION: Arbitration ordered transmit scheduler of the bridge.
+**/
+
+#include "CAN_sched.h"
+#include <string.h>
+#include "pico/platform.h"
+
+/**
+* @brief True if entry ea is released before entry eb.
+*/
+static inline bool tx_sched_entry_before(const struct tx_scheduler *sched, const struct tx_sched_entry *ea,
+                                         const struct tx_sched_entry *eb) {
+    if (sched->order == TX_ORDER_EDF && ea->due_us != eb->due_us) {
+        return (int32_t)(ea->due_us - eb->due_us) < 0;
+    }
+    if (ea->key != eb->key) {
+        return ea->key < eb->key;
+    }
+    return (int32_t)(ea->seq - eb->seq) < 0;       //Same ID: arrival order
+}
+
+/**
+* @brief True if pool entry a is released before pool entry b.
+*/
+static inline bool tx_sched_before(const struct tx_scheduler *sched, uint8_t a, uint8_t b) {
+    return tx_sched_entry_before(sched, &sched->pool[a], &sched->pool[b]);
+}
+
+static inline bool tx_sched_is_expired(const struct tx_sched_entry *entry, uint32_t now_us) {
+    return entry->has_deadline && (int32_t)(now_us - entry->deadline_us) > 0;
+}
+
+static void __not_in_flash_func(tx_sched_sift_up)(struct tx_scheduler *sched, uint8_t pos) {
+    uint8_t slot = sched->heap[pos];
+    while (pos > 0) {
+        uint8_t parent = (uint8_t)((pos - 1) >> 1);
+        if (!tx_sched_before(sched, slot, sched->heap[parent])) {
+            break;
+        }
+        sched->heap[pos] = sched->heap[parent];
+        pos = parent;
+    }
+    sched->heap[pos] = slot;
+}
+
+static void __not_in_flash_func(tx_sched_sift_down)(struct tx_scheduler *sched, uint8_t pos) {
+    uint8_t slot = sched->heap[pos];
+    while (true) {
+        uint16_t child = (uint16_t)(2 * pos + 1);
+        if (child >= sched->count) {
+            break;
+        }
+        if (child + 1 < sched->count && tx_sched_before(sched, sched->heap[child + 1], sched->heap[child])) {
+            child++;
+        }
+        if (!tx_sched_before(sched, sched->heap[child], slot)) {
+            break;
+        }
+        sched->heap[pos] = sched->heap[child];
+        pos = (uint8_t)child;
+    }
+    sched->heap[pos] = slot;
+}
+
+/**
+* @brief Removes the entry at a heap position and gives its pool slot back. The frame is the caller's.
+*/
+static void __not_in_flash_func(tx_sched_remove_at)(struct tx_scheduler *sched, uint8_t pos) {
+    uint8_t slot = sched->heap[pos];
+    sched->free_slots[sched->free_count++] = slot;
+    sched->count--;
+    if (pos == sched->count) {
+        return;
+    }
+    sched->heap[pos] = sched->heap[sched->count];
+    if (pos > 0 && tx_sched_before(sched, sched->heap[pos], sched->heap[(pos - 1) >> 1])) {
+        tx_sched_sift_up(sched, pos);
+    } else {
+        tx_sched_sift_down(sched, pos);
+    }
+}
+
+/**
+* @brief Makes room in a full scheduler for the incoming entry.
+* Expired frames go first, then the overflow policy decides. Returns false if the new frame is the one to drop.
+* Only runs when the scheduler is full, the linear scans are bounded by TX_SCHED_POOL_SIZE.
+*/
+static bool __not_in_flash_func(tx_sched_make_room)(struct tx_scheduler *sched, const struct tx_sched_entry *incoming,
+                                                    uint32_t now_us) {
+    for (uint8_t pos = 0; pos < sched->count; ++pos) {
+        if (tx_sched_is_expired(&sched->pool[sched->heap[pos]], now_us)) {
+            frame_release(sched->pool[sched->heap[pos]].frame);
+            tx_sched_remove_at(sched, pos);
+            sched->expired++;
+            return true;
+        }
+    }
+
+    sched->overflow_drops++;
+    uint8_t victim = 0;
+    if (sched->policy == TX_SCHED_DROP_OLDEST) {
+        for (uint8_t pos = 1; pos < sched->count; ++pos) {
+            if ((int32_t)(sched->pool[sched->heap[pos]].seq - sched->pool[sched->heap[victim]].seq) < 0) {
+                victim = pos;
+            }
+        }
+    } else {
+        for (uint8_t pos = (uint8_t)(sched->count >> 1); pos < sched->count; ++pos) {   //The last frame is a leaf
+            if (victim == 0 || tx_sched_before(sched, sched->heap[victim], sched->heap[pos])) {
+                victim = pos;
+            }
+        }
+        if (!tx_sched_entry_before(sched, incoming, &sched->pool[sched->heap[victim]])) {
+            return false;                               //The new frame has the lowest priority of all
+        }
+    }
+    frame_release(sched->pool[sched->heap[victim]].frame);
+    tx_sched_remove_at(sched, victim);
+    return true;
+}
+
+/**
+* @brief Empties a scheduler and its counters.
+*/
+void tx_sched_init(struct tx_scheduler *sched, TxOverflowPolicy_t policy) {
+    memset(sched, 0, sizeof(*sched));
+    sched->policy = policy;
+    for (uint8_t i = 0; i < TX_SCHED_POOL_SIZE; ++i) {
+        sched->free_slots[i] = (uint8_t)(TX_SCHED_POOL_SIZE - 1 - i);
+    }
+    sched->free_count = TX_SCHED_POOL_SIZE;
+    sched->capacity = TX_SCHED_DEFAULT_CAPACITY;
+}
+
+/**
+* @brief Limits the frames waiting, between 1 and TX_SCHED_POOL_SIZE. Frames already waiting stay
+* until they are sent, a smaller capacity applies to the next ones.
+*/
+void tx_sched_set_capacity(struct tx_scheduler *sched, uint32_t capacity) {
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    sched->capacity = (uint8_t)(capacity > TX_SCHED_POOL_SIZE ? TX_SCHED_POOL_SIZE : capacity);
+}
+
+/**
+* @brief Releases the waiting frames in the given order from now on. Owner core, like push and pop.
+*/
+void tx_sched_set_order(struct tx_scheduler *sched, TxOrder_t order) {
+    if (sched->order == order) {
+        return;
+    }
+    sched->order = order;
+    for (int32_t pos = (int32_t)(sched->count >> 1) - 1; pos >= 0; --pos) {    //Heap again under the new order
+        tx_sched_sift_down(sched, (uint8_t)pos);
+    }
+}
+
+/**
+* @brief Capacity of a bus at bitrate fed by a bus at source_bitrate: TX_SCHED_DEFAULT_CAPACITY, plus on a
+* slower bus the backlog a burst of TX_BURST_WINDOW_US builds up, the frames of the source bus minus the
+* ones the slow bus sends meanwhile.
+*/
+uint32_t tx_sched_burst_capacity(uint32_t source_bitrate, uint32_t bitrate) {
+    uint32_t capacity = TX_SCHED_DEFAULT_CAPACITY;
+    if (source_bitrate > bitrate) {
+        capacity += (uint32_t)((uint64_t)(source_bitrate - bitrate) * TX_BURST_WINDOW_US / (1000000ull * TX_BURST_FRAME_BITS));
+    }
+    return capacity > TX_SCHED_POOL_SIZE ? TX_SCHED_POOL_SIZE : capacity;
+}
+
+/**
+* @brief Queues a frame, taking over the caller's reference. deadline_us is relative to now_us,
+* TX_SCHED_NO_DEADLINE for none, due_us the absolute time it should be sent by (an earlier deadline wins).
+* Returns false if the frame was dropped (and released) by the overflow policy.
+*/
+bool __not_in_flash_func(tx_sched_push)(struct tx_scheduler *sched, frame_handle_t frame, uint32_t now_us,
+                                        uint32_t deadline_us, uint32_t due_us) {
+    struct tx_sched_entry incoming;
+    incoming.frame = frame;
+    incoming.key = can_arbitration_key(frame_get(frame)->id);
+    incoming.seq = sched->next_seq;
+    incoming.has_deadline = deadline_us != TX_SCHED_NO_DEADLINE;
+    incoming.deadline_us = now_us + deadline_us;
+    incoming.due_us = incoming.has_deadline && (int32_t)(incoming.deadline_us - due_us) < 0 ? incoming.deadline_us : due_us;
+    while (sched->count >= sched->capacity) {
+        if (!tx_sched_make_room(sched, &incoming, now_us)) {
+            frame_release(frame);
+            return false;
+        }
+    }
+    uint8_t slot = sched->free_slots[--sched->free_count];
+    sched->pool[slot] = incoming;
+    sched->next_seq++;
+
+    sched->heap[sched->count] = slot;
+    sched->count++;
+    tx_sched_sift_up(sched, (uint8_t)(sched->count - 1));
+    if (sched->count > sched->high_water) {
+        sched->high_water = sched->count;
+    }
+    return true;
+}
+
+/**
+* @brief Takes the frame that wins arbitration, dropping the expired frames in front of it.
+* The caller gets the scheduler's reference. Returns false if nothing is left to send.
+*/
+bool __not_in_flash_func(tx_sched_pop)(struct tx_scheduler *sched, frame_handle_t *frame, uint32_t now_us) {
+    while (sched->count > 0) {
+        const struct tx_sched_entry *entry = &sched->pool[sched->heap[0]];
+        bool expired = tx_sched_is_expired(entry, now_us);
+        frame_handle_t head = entry->frame;
+        tx_sched_remove_at(sched, 0);
+        if (!expired) {
+            *frame = head;
+            return true;
+        }
+        frame_release(head);
+        sched->expired++;
+    }
+    return false;
+}
+
+/**
+* @brief Index of the first ID not below id.
+*/
+static uint8_t __not_in_flash_func(tx_deadline_lower_bound)(const struct tx_deadline_table *table, uint32_t id) {
+    uint8_t lo = 0, hi = table->count;
+    while (lo < hi) {
+        uint8_t mid = (uint8_t)((lo + hi) >> 1);
+        if (table->ids[mid] < id) {
+            lo = (uint8_t)(mid + 1);
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void tx_deadline_clear(struct tx_deadline_table *table) {
+    table->count = 0;
+}
+
+/**
+* @brief Sets the deadline of an ID, TX_SCHED_NO_DEADLINE removes it. Returns false if the table is full.
+*/
+bool tx_deadline_set(struct tx_deadline_table *table, uint32_t id, uint32_t deadline_us) {
+    uint8_t pos = tx_deadline_lower_bound(table, id);
+    bool present = pos < table->count && table->ids[pos] == id;
+
+    if (deadline_us == TX_SCHED_NO_DEADLINE) {
+        if (present) {
+            memmove(&table->ids[pos], &table->ids[pos + 1], (table->count - pos - 1) * sizeof(uint32_t));
+            memmove(&table->deadline_us[pos], &table->deadline_us[pos + 1], (table->count - pos - 1) * sizeof(uint32_t));
+            table->count--;
+        }
+        return true;
+    }
+    if (!present) {
+        if (table->count >= TX_SCHED_MAX_DEADLINES) {
+            return false;
+        }
+        memmove(&table->ids[pos + 1], &table->ids[pos], (table->count - pos) * sizeof(uint32_t));
+        memmove(&table->deadline_us[pos + 1], &table->deadline_us[pos], (table->count - pos) * sizeof(uint32_t));
+        table->ids[pos] = id;
+        table->count++;
+    }
+    table->deadline_us[pos] = deadline_us;
+    return true;
+}
+
+/**
+* @brief Deadline of an ID, TX_SCHED_NO_DEADLINE if it has none.
+*/
+uint32_t __not_in_flash_func(tx_deadline_lookup)(const struct tx_deadline_table *table, uint32_t id) {
+    if (table->count == 0) {
+        return TX_SCHED_NO_DEADLINE;
+    }
+    uint8_t pos = tx_deadline_lower_bound(table, id);
+    return (pos < table->count && table->ids[pos] == id) ? table->deadline_us[pos] : TX_SCHED_NO_DEADLINE;
+}
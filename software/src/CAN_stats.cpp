@@ -0,0 +1,115 @@
+/**
+* DESCRIPTION: Counters, top talkers and RX timing histogram of the bridge.
+**/
+
+#include "CAN_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include "pico/platform.h"
+
+/**
+* @brief Starts the SysTick of the calling core as a free running 24-bit cycle counter.
+* Each core has its own, so call it on both.
+*/
+void stats_cycle_counter_init(void) {
+#if CAN_BRIDGE_STATS || CAN_BRIDGE_ISR_BUDGET
+    systick_hw->rvr = STATS_SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_ENABLE_BITS | M0PLUS_SYST_CSR_CLKSOURCE_BITS;    //Processor clock, no interrupt
+#endif
+}
+
+void direction_stats_reset(struct direction_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+/**
+* @brief Counts a frame of an ID above 0x7FF (space-saving: a new ID takes over the least counted slot,
+* so the IDs that really are frequent stay, with a count that is never too low).
+*/
+void __not_in_flash_func(direction_stats_count_ext)(struct direction_stats *stats, uint32_t id) {
+    uint8_t min_slot = 0;
+    for (uint8_t i = 0; i < STATS_EXT_TALKERS; ++i) {
+        if (stats->ext_ids[i] == id && stats->ext_hits[i] != 0) {
+            stats->ext_hits[i]++;
+            return;
+        }
+        if (stats->ext_hits[i] < stats->ext_hits[min_slot]) {
+            min_slot = i;
+        }
+    }
+    stats->ext_ids[min_slot] = id;
+    stats->ext_hits[min_slot]++;
+}
+
+/**
+* @brief Inserts a candidate in the top list, kept sorted by hits (most first).
+*/
+static void stats_top_insert(struct stats_talker *top, uint8_t *used, uint8_t count, uint32_t id, uint32_t hits) {
+    if (hits == 0 || (*used == count && hits <= top[count - 1].hits)) {
+        return;
+    }
+    uint8_t pos = (*used < count) ? (*used)++ : (uint8_t)(count - 1);
+    while (pos > 0 && top[pos - 1].hits < hits) {
+        top[pos] = top[pos - 1];
+        pos--;
+    }
+    top[pos].id = id;
+    top[pos].hits = hits;
+}
+
+/**
+* @brief Fills top with the count most frequent IDs. Returns how many were found.
+*/
+uint8_t direction_stats_top(const struct direction_stats *stats, struct stats_talker *top, uint8_t count) {
+    uint8_t used = 0;
+    if (count == 0) {
+        return 0;
+    }
+    for (uint32_t id = 0; id < ID_SET_STD_IDS; ++id) {
+        stats_top_insert(top, &used, count, id, stats->std_hits[id]);
+    }
+    for (uint8_t i = 0; i < STATS_EXT_TALKERS; ++i) {
+        stats_top_insert(top, &used, count, stats->ext_ids[i], stats->ext_hits[i]);
+    }
+    return used;
+}
+
+/**
+* @brief Prints the counters, top talkers and histogram of one direction on stdio (USB on the board).
+*/
+void direction_stats_print(const struct direction_stats *stats, uint8_t interface_id) {
+    printf("CAN%u rx %lu: forwarded %lu (rewritten %lu), filtered %lu, echo %lu, shaped %lu, control %lu\n", interface_id,
+           (unsigned long)stats->rx, (unsigned long)stats->forwarded, (unsigned long)stats->rewritten,
+           (unsigned long)stats->filtered, (unsigned long)stats->echo_dropped, (unsigned long)stats->shaped,
+           (unsigned long)stats->control);
+
+    struct stats_talker top[STATS_TOP_MAX];
+    uint8_t found = direction_stats_top(stats, top, STATS_TOP_MAX);
+    for (uint8_t i = 0; i < found; ++i) {
+        printf("  top %u: id 0x%08lX hits %lu\n", i, (unsigned long)top[i].id, (unsigned long)top[i].hits);
+    }
+
+    printf("  rx cycles (%u per bucket, max %lu):", 1u << STATS_HIST_SHIFT, (unsigned long)stats->hist_max);
+    for (uint8_t i = 0; i < STATS_HIST_BUCKETS; ++i) {
+        printf(" %lu", (unsigned long)stats->hist[i]);
+    }
+    printf("\n");
+}
+
+void isr_budget_reset(struct isr_budget *budget) {
+    memset(budget, 0, sizeof(*budget));
+}
+
+/**
+* @brief Prints the worst bridge_receive() cycles of each route kind that ran.
+*/
+void isr_budget_print(const struct isr_budget *budget, uint8_t interface_id) {
+    printf("CAN%u receive budget:\n", interface_id);
+    for (uint8_t kind = 0; kind < ROUTE_KINDS; ++kind) {
+        if (budget->frames[kind] != 0) {
+            printf("  route %-16s worst %lu cycles over %lu frames\n", route_kind_name(kind),
+                   (unsigned long)budget->worst[kind], (unsigned long)budget->frames[kind]);
+        }
+    }
+}
@@ -0,0 +1,172 @@
+/**
+* DESCRIPTION: Wear-levelled, CRC protected records in a reserved flash region.
+**/
+
+#include "CAN_store.h"
+#include "CAN_bulk.h"
+#include <stddef.h>
+#include <string.h>
+#include "hardware/flash.h"
+#include "hardware/regs/addressmap.h"
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+
+#define STORE_PAGES_PER_SECTOR      (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define STORE_PAGES                 (STORE_SECTORS * STORE_PAGES_PER_SECTOR)
+#define STORE_HEADER_BYTES          ((uint32_t)sizeof(struct store_record_header))
+
+static_assert(STORE_MAX_PAYLOAD + sizeof(struct store_record_header) <= FLASH_SECTOR_SIZE, "A record must fit a sector");
+
+static uint8_t store_buffer[FLASH_SECTOR_SIZE];     //Record being written, whole pages
+
+struct store_scan {
+    bool found;                                     //Newest record of any version
+    uint32_t page;
+    struct store_record_header header;
+    bool found_current;                             //Newest record of STORE_VERSION
+    uint32_t current_page;
+    struct store_record_header current;
+};
+
+/**
+* @brief Flash offset of the region, the last STORE_SECTORS sectors.
+*/
+uint32_t store_region_offset(void) {
+    return PICO_FLASH_SIZE_BYTES - STORE_SECTORS * FLASH_SECTOR_SIZE;
+}
+
+static inline const uint8_t *store_page(uint32_t page) {
+    return (const uint8_t *)(XIP_BASE + store_region_offset() + page * FLASH_PAGE_SIZE);
+}
+
+static inline uint32_t store_next_sector(uint32_t page) {
+    return ((page / STORE_PAGES_PER_SECTOR + 1) * STORE_PAGES_PER_SECTOR) % STORE_PAGES;
+}
+
+static uint32_t store_record_crc(const struct store_record_header *header, const uint8_t *payload) {
+    uint32_t crc = bulk_crc32_update(0xFFFFFFFFu, (const uint8_t *)header, offsetof(struct store_record_header, crc));
+    return bulk_crc32_update(crc, payload, header->length) ^ 0xFFFFFFFFu;
+}
+
+/**
+* @brief Reads the header at a page and checks the record, whatever its version.
+*/
+static bool store_record_valid(uint32_t page, struct store_record_header *header) {
+    memcpy(header, store_page(page), sizeof(*header));
+    if (header->magic != STORE_MAGIC || header->pages == 0
+        || page % STORE_PAGES_PER_SECTOR + header->pages > STORE_PAGES_PER_SECTOR
+        || header->length > header->pages * FLASH_PAGE_SIZE - STORE_HEADER_BYTES) {
+        return false;
+    }
+    return store_record_crc(header, store_page(page) + STORE_HEADER_BYTES) == header->crc;
+}
+
+static void store_scan_region(struct store_scan *scan) {
+    memset(scan, 0, sizeof(*scan));
+    uint32_t page = 0;
+    while (page < STORE_PAGES) {
+        struct store_record_header header;
+        if (!store_record_valid(page, &header)) {
+            page++;
+            continue;
+        }
+        if (!scan->found || (int32_t)(header.sequence - scan->header.sequence) > 0) {
+            scan->found = true;
+            scan->page = page;
+            scan->header = header;
+        }
+        if (header.version == STORE_VERSION && (!scan->found_current || (int32_t)(header.sequence - scan->current.sequence) > 0)) {
+            scan->found_current = true;
+            scan->current_page = page;
+            scan->current = header;
+        }
+        page += header.pages;
+    }
+}
+
+static bool store_pages_blank(uint32_t page, uint32_t count) {
+    const uint8_t *data = store_page(page);
+    for (uint32_t i = 0; i < count * FLASH_PAGE_SIZE; ++i) {
+        if (data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* @brief Finds the newest valid record of STORE_VERSION. The payload points into flash.
+*/
+StoreStatus_t store_read_latest(const uint8_t **payload, uint32_t *length, uint32_t *sequence) {
+    struct store_scan scan;
+    store_scan_region(&scan);
+    if (!scan.found_current) {
+        return STORE_EMPTY;
+    }
+    *payload = store_page(scan.current_page) + STORE_HEADER_BYTES;
+    *length = scan.current.length;
+    *sequence = scan.current.sequence;
+    return STORE_OK;
+}
+
+/**
+* @brief Appends a record after the newest one. The other core is locked out and interrupts are off
+* while the flash is busy (a few ms to program, tens of ms when a sector has to be erased).
+* Call it with the other core running multicore_lockout_victim_init().
+*/
+StoreStatus_t store_write(const uint8_t *payload, uint32_t length, uint32_t *sequence) {
+    if (length > STORE_MAX_PAYLOAD) {
+        return STORE_TOO_LARGE;
+    }
+    struct store_scan scan;
+    store_scan_region(&scan);
+
+    uint32_t pages = (STORE_HEADER_BYTES + length + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    uint32_t page = scan.found ? (scan.page + scan.header.pages) % STORE_PAGES : 0;
+    if (page % STORE_PAGES_PER_SECTOR + pages > STORE_PAGES_PER_SECTOR) {
+        page = store_next_sector(page);             //Records never cross a sector
+    }
+    if (page % STORE_PAGES_PER_SECTOR != 0 && !store_pages_blank(page, pages)) {
+        page = store_next_sector(page);             //Left over from an interrupted write
+    }
+    //Only a sector that writing enters from its start is erased: it holds the oldest records
+    bool erase = page % STORE_PAGES_PER_SECTOR == 0 && !store_pages_blank(page, STORE_PAGES_PER_SECTOR);
+
+    struct store_record_header header;
+    header.magic = STORE_MAGIC;
+    header.version = STORE_VERSION;
+    header.pages = (uint16_t)pages;
+    header.sequence = scan.found ? scan.header.sequence + 1 : 1;
+    header.length = length;
+    header.crc = store_record_crc(&header, payload);
+    memset(store_buffer, 0xFF, pages * FLASH_PAGE_SIZE);
+    memcpy(store_buffer, &header, sizeof(header));
+    memcpy(store_buffer + STORE_HEADER_BYTES, payload, length);
+
+    uint32_t offset = store_region_offset() + page * FLASH_PAGE_SIZE;
+    multicore_lockout_start_blocking();
+    uint32_t irq_status = save_and_disable_interrupts();
+    if (erase) {
+        flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    }
+    flash_range_program(offset, store_buffer, pages * FLASH_PAGE_SIZE);
+    restore_interrupts(irq_status);
+    multicore_lockout_end_blocking();
+
+    if (memcmp(store_page(page), store_buffer, pages * FLASH_PAGE_SIZE) != 0) {
+        return STORE_VERIFY_FAILED;
+    }
+    *sequence = header.sequence;
+    return STORE_OK;
+}
+
+/**
+* @brief Erases the whole region, same locking as store_write().
+*/
+void store_erase_all(void) {
+    multicore_lockout_start_blocking();
+    uint32_t irq_status = save_and_disable_interrupts();
+    flash_range_erase(store_region_offset(), STORE_SECTORS * FLASH_SECTOR_SIZE);
+    restore_interrupts(irq_status);
+    multicore_lockout_end_blocking();
+}
@@ -0,0 +1,207 @@
+/**
+* DESCRIPTION: Frame trace rings and their byte stream encoding.
+**/
+
+#include "CAN_trace.h"
+
+#define TRACE_FLAG_BUS              0x01
+#define TRACE_FLAG_VERDICT_SHIFT    1
+#define TRACE_FLAG_VERDICT_MASK     0x0E
+#define TRACE_FLAG_EXTENDED         0x10
+#define TRACE_FLAG_REMOTE           0x20
+#define TRACE_FLAG_TRANSMITTED      0x40
+#define TRACE_FLAG_REWRITTEN        0x80
+
+/**
+* @brief Empties a ring and its drop counter. Only call while neither side is using it.
+*/
+void trace_ring_init(struct trace_ring *ring) {
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+    ring->drops.store(0, std::memory_order_relaxed);
+}
+
+void trace_stream_init(struct trace_stream *stream) {
+    memset(stream, 0, sizeof(*stream));
+}
+
+static uint32_t trace_put_varint(uint8_t *out, uint32_t value) {
+    uint32_t length = 0;
+    do {
+        uint8_t byte = (uint8_t)(value & 0x7F);
+        value >>= 7;
+        out[length++] = (uint8_t)(byte | (value ? 0x80 : 0));
+    } while (value);
+    return length;
+}
+
+/**
+* @brief Encodes one stream record, at most TRACE_MAX_ENCODED bytes.
+*/
+static uint32_t trace_encode(uint8_t *out, uint8_t bus, uint8_t verdict, uint32_t id, uint8_t dlc,
+                             const uint8_t *data, uint32_t time) {
+    bool extended = (id & CAN2040_ID_EFF) || verdict == TRACE_LOST;
+    uint32_t length = 0;
+    out[length++] = TRACE_SYNC;
+    bool rewritten = verdict == TRACE_REWRITTEN;
+    uint8_t coded = rewritten ? (uint8_t)TRACE_FORWARDED : verdict;    //TRACE_REWRITTEN does not fit in 3 bits
+    out[length++] = (uint8_t)((bus & TRACE_FLAG_BUS) | (coded << TRACE_FLAG_VERDICT_SHIFT)
+                              | (extended ? TRACE_FLAG_EXTENDED : 0) | ((id & CAN2040_ID_RTR) ? TRACE_FLAG_REMOTE : 0)
+                              | (verdict == TRACE_SENT ? TRACE_FLAG_TRANSMITTED : 0) | (rewritten ? TRACE_FLAG_REWRITTEN : 0));
+    out[length++] = dlc;
+    length += trace_put_varint(&out[length], time);
+    uint32_t raw = extended ? (verdict == TRACE_LOST ? id : (id & 0x1FFFFFFFu)) : (id & 0x7FFu);
+    if (extended) {
+        out[length++] = (uint8_t)(raw >> 24);
+        out[length++] = (uint8_t)(raw >> 16);
+    }
+    out[length++] = (uint8_t)(raw >> 8);
+    out[length++] = (uint8_t)raw;
+    memcpy(&out[length], data, dlc);
+    return length + dlc;
+}
+
+/**
+* @brief Consumer side: moves records of both rings, oldest first, into out as a stream.
+* Returns the bytes written, 0 if there was nothing to send or out is too small.
+*/
+uint32_t trace_drain(struct trace_ring *rings, struct trace_stream *stream, uint8_t *out, uint32_t capacity, uint32_t now_us) {
+    static const uint8_t no_data[8] = {0};
+    if (capacity < 4 * TRACE_MAX_ENCODED) {
+        return 0;
+    }
+    uint32_t tails[2], heads[2], drops[2];
+    for (uint8_t bus = 0; bus < 2; ++bus) {
+        tails[bus] = rings[bus].tail.load(std::memory_order_relaxed);
+        heads[bus] = rings[bus].head.load(std::memory_order_acquire);
+        drops[bus] = rings[bus].drops.load(std::memory_order_relaxed);
+    }
+    bool lost = drops[0] != stream->reported_drops[0] || drops[1] != stream->reported_drops[1];
+    if (tails[0] == heads[0] && tails[1] == heads[1] && !lost) {
+        return 0;
+    }
+
+    //Time base: the oldest record waiting, or now when there are only drops to report
+    uint32_t base = now_us;
+    for (uint8_t bus = 0; bus < 2; ++bus) {
+        if (tails[bus] != heads[bus]) {
+            uint32_t time = rings[bus].slots[tails[bus] & (TRACE_RING_RECORDS - 1)].time_us;
+            if (base == now_us || (int32_t)(time - base) < 0) {
+                base = time;
+            }
+        }
+    }
+    uint32_t length = trace_encode(out, 0, TRACE_TIME, 0, 0, no_data, base);
+    stream->last_us = base;
+    for (uint8_t bus = 0; bus < 2; ++bus) {
+        if (drops[bus] != stream->reported_drops[bus]) {
+            length += trace_encode(&out[length], bus, TRACE_LOST, drops[bus] - stream->reported_drops[bus], 0, no_data, 0);
+            stream->reported_drops[bus] = drops[bus];
+        }
+    }
+
+    while (length + TRACE_MAX_ENCODED <= capacity) {
+        int8_t bus = -1;
+        for (uint8_t b = 0; b < 2; ++b) {
+            if (tails[b] == heads[b]) {
+                continue;
+            }
+            if (bus < 0 || (int32_t)(rings[b].slots[tails[b] & (TRACE_RING_RECORDS - 1)].time_us
+                                     - rings[bus].slots[tails[bus] & (TRACE_RING_RECORDS - 1)].time_us) < 0) {
+                bus = (int8_t)b;
+            }
+        }
+        if (bus < 0) {
+            break;
+        }
+        const struct trace_record *record = &rings[bus].slots[tails[bus] & (TRACE_RING_RECORDS - 1)];
+        int32_t delta = (int32_t)(record->time_us - stream->last_us);
+        if (delta < 0) {
+            delta = 0;                                  //Stamped on the other core just before an emitted record
+        } else {
+            stream->last_us = record->time_us;
+        }
+        length += trace_encode(&out[length], (uint8_t)bus, record->verdict, record->id, record->dlc, record->data, (uint32_t)delta);
+        tails[bus]++;
+    }
+    rings[0].tail.store(tails[0], std::memory_order_release);
+    rings[1].tail.store(tails[1], std::memory_order_release);
+    return length;
+}
+
+/**
+* @brief Reads the next frame or TRACE_LOST record from a stream, skipping bytes until a valid record.
+* time_us carries the stream time between calls (start it at 0). Returns false when the rest of data
+* does not hold a whole record, pos is then where the next call should resume.
+*/
+bool trace_decode(const uint8_t *data, uint32_t length, uint32_t *pos, uint64_t *time_us, struct trace_event *event) {
+    while (*pos + 5 <= length) {
+        uint32_t p = *pos;
+        uint8_t flags = data[p + 1];
+        uint8_t dlc = data[p + 2];
+        if (data[p] != TRACE_SYNC || dlc > 8
+            || ((flags & TRACE_FLAG_REWRITTEN) && (flags & TRACE_FLAG_VERDICT_MASK) != (TRACE_FORWARDED << TRACE_FLAG_VERDICT_SHIFT))) {
+            (*pos)++;
+            continue;
+        }
+        p += 3;
+        uint32_t time = 0;
+        uint8_t shift = 0;
+        while (p < length && shift < 35 && (data[p] & 0x80)) {
+            time |= (uint32_t)(data[p++] & 0x7F) << shift;
+            shift += 7;
+        }
+        if (p >= length) {
+            return false;
+        }
+        if (shift >= 35) {
+            (*pos)++;
+            continue;
+        }
+        time |= (uint32_t)data[p++] << shift;
+        uint32_t id_bytes = (flags & TRACE_FLAG_EXTENDED) ? 4 : 2;
+        if (p + id_bytes + dlc > length) {
+            return false;
+        }
+        uint32_t id = 0;
+        for (uint32_t i = 0; i < id_bytes; ++i) {
+            id = (id << 8) | data[p++];
+        }
+
+        uint8_t verdict = (flags & TRACE_FLAG_REWRITTEN) ? (uint8_t)TRACE_REWRITTEN
+                                                         : (uint8_t)((flags & TRACE_FLAG_VERDICT_MASK) >> TRACE_FLAG_VERDICT_SHIFT);
+        if (verdict == TRACE_TIME) {
+            uint64_t absolute = (*time_us & ~0xFFFFFFFFull) | time;
+            if (absolute + 0x80000000ull < *time_us) {
+                absolute += 0x100000000ull;             //The 32-bit microsecond counter wrapped
+            }
+            *time_us = absolute;
+        } else {
+            *time_us += time;
+        }
+        *pos = p + dlc;
+        if (verdict == TRACE_TIME) {
+            continue;
+        }
+
+        memset(event, 0, sizeof(*event));
+        event->time_us = *time_us;
+        event->bus = flags & TRACE_FLAG_BUS;
+        event->verdict = verdict;
+        if (verdict == TRACE_LOST) {
+            event->msg.id = id;
+        } else {
+            event->msg.id = id;
+            if (flags & TRACE_FLAG_EXTENDED) {
+                event->msg.id |= CAN2040_ID_EFF;
+            }
+            if (flags & TRACE_FLAG_REMOTE) {
+                event->msg.id |= CAN2040_ID_RTR;
+            }
+        }
+        event->msg.dlc = dlc;
+        memcpy(event->msg.data, &data[p], dlc);
+        return true;
+    }
+    return false;
+}
@@ -2,6 +2,9 @@
 #include <string.h>
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
+#include "pico/stdio_usb.h"
+#include "tusb.h"
+#include "hardware/sync.h"
 #include "CAN_bridge.h"
 
 
@@ -21,9 +24,15 @@ extern "C" {
 #define CAN1_TX 7           //CAN1 TX PIN
 
 
-#define BITRATE_CAN 125000  //CAN bitrate
+#define BITRATE_CAN0 125000 //CAN0 bitrate
+#define BITRATE_CAN1 125000 //CAN1 bitrate, may differ from CAN0: the slower bus buffers the bursts of the faster one
 #define MAX_DLC_CAN_MSG 8   //Maximum number of bytes in the CAN message
 
+#define STATS_DUMP_KEY 's'  //Typed on the USB console, prints the bridge statistics
+#define TRACE_TOGGLE_KEY 't'    //Typed on the USB console, starts or stops the binary frame trace
+
+#define TRACE_CHUNK 512     //Most trace bytes written to USB per loop
+
 
 // Global CAN bus objects
 // from rp_agrolib_can.h
@@ -33,39 +42,93 @@ extern struct can2040 cbus1;
 
 void can2040_cb0(struct can2040 *cd, uint32_t notify, struct can2040_msg *msg){ //The callback function for CAN bus 0
 
-  can_rx_callback(cd, msg->id, msg->dlc, msg->data);
+  if (notify == CAN2040_NOTIFY_RX) {
+    can_rx_callback(cd, msg->id, msg->dlc, msg->data);
+  } else if (notify == CAN2040_NOTIFY_TX) {   //Our own transmission completed, not a received frame
+    bridge_tx_complete(cd, msg);
+  } else if (notify == CAN2040_NOTIFY_ERROR) {  //Counts towards marking the bus down, see CAN_health.h
+    bridge_error_notify(cd);
+  }
 }
 
 void can2040_cb1(struct can2040 *cd, uint32_t notify, struct can2040_msg *msg){ //The callback function for CAN bus 1
 
-  can_rx_callback(cd, msg->id, msg->dlc, msg->data);
+  if (notify == CAN2040_NOTIFY_RX) {
+    can_rx_callback(cd, msg->id, msg->dlc, msg->data);
+  } else if (notify == CAN2040_NOTIFY_TX) {   //Our own transmission completed, not a received frame
+    bridge_tx_complete(cd, msg);
+  } else if (notify == CAN2040_NOTIFY_ERROR) {  //Counts towards marking the bus down, see CAN_health.h
+    bridge_error_notify(cd);
+  }
 }
 
 // ---
 //Core 1 Entry Point
-//This function will run on **CPU 1**. It initializes CAN bus 1 and then enters an infinite loop to keep the core alive.
+//This function will run on **CPU 1**. It initializes CAN bus 1 and then sends the frames core 0 queued for it.
 
 void core1_entry() {    //Core 1 handles CAN bus 1
 
-    canbus_setup1(CAN1_RX, CAN1_TX, BITRATE_CAN, can2040_cb1);
+    stats_cycle_counter_init();     //SysTick of this core times its can_rx_callback
+    multicore_lockout_victim_init();    //Core 0 pauses this core while it writes the saved configuration
+    canbus_setup1(CAN1_RX, CAN1_TX, BITRATE_CAN1, can2040_cb1);
     while (1) {
-        tight_loop_contents();  //keep core 1 alive
+        if (bridge_service(CAN_IFACE1) == 0 && !bridge_has_held(CAN_IFACE1) && !bridge_health_pending(CAN_IFACE1)) {
+            __wfe();            //Sleep until core 0 queues a frame (it signals with __sev) or an interrupt
+        }
     }
 }
 
 
+static uint8_t trace_chunk[TRACE_CHUNK];
+
+/**
+* @brief Sends pending trace records over USB, only as many as the CDC buffer takes right now so the
+* loop never waits for the computer. Returns the bytes sent.
+*/
+static uint32_t trace_service(void) {
+  if (!tud_cdc_connected()) {
+    return 0;
+  }
+  uint32_t room = tud_cdc_write_available();
+  uint32_t length = bridge_trace_drain(trace_chunk, room < TRACE_CHUNK ? room : TRACE_CHUNK);
+  if (length > 0) {
+    stdio_usb.out_chars((const char *)trace_chunk, (int)length);  //Raw bytes, no CR/LF translation
+  }
+  return length;
+}
+
+
 int main() {
   stdio_init_all();
 
+  bridge_init();    //Filter state and compiled routes must be ready before the first CAN callback
+  bridge_set_bitrate(CAN_IFACE0, BITRATE_CAN0);
+  bridge_set_bitrate(CAN_IFACE1, BITRATE_CAN1);
+  uint32_t saved_sequence;
+  bridge_config_load(&saved_sequence);  //Saved mode, lists and enable state, if any, so the first frame is filtered right
+  stats_cycle_counter_init();
+
   // Launch core1_entry on CPU 1
   multicore_launch_core1(core1_entry);
 
   /*************************CAN INIT***************************/
-  canbus_setup0(CAN0_RX, CAN0_TX, BITRATE_CAN, can2040_cb0);    //Core 0 handles CAN bus 0
+  canbus_setup0(CAN0_RX, CAN0_TX, BITRATE_CAN0, can2040_cb0);    //Core 0 handles CAN bus 0
 
   while(1){
-    
-    sleep_ms(1000);
+
+    int key = getchar_timeout_us(0);
+    if (key == STATS_DUMP_KEY) {                    //Statistics on request over USB
+      bridge_stats_dump();
+    } else if (key == TRACE_TOGGLE_KEY) {
+      bridge_trace_set(!bridge_trace_enabled());
+    }
+
+    uint32_t commands = bridge_run_commands();                              //Control frames received on either bus
+    uint32_t traced = trace_service();                                      //Lowest priority: whatever USB takes
+    if (bridge_service(CAN_IFACE0) == 0 && commands == 0 && traced == 0 && !bridge_has_held(CAN_IFACE0)
+        && !bridge_health_pending(CAN_IFACE0)) {                            //Send the frames core 1 queued for bus 0
+      __wfe();                                                              //Held latest values and a stalled bus need polling
+    }
 
   }
 }
\ No newline at end of file